@@ -5,6 +5,7 @@
 #pragma once
 
 #include <cstddef>
+#include <vector>
 #include "configure.hpp"
 #include "memory.hpp"
 #include "stream.hpp"
@@ -68,4 +69,52 @@ namespace mango
         void write(const void* source, size_t bytes);
     };
 
+    /*
+        SegmentedStream is a growing memory stream which chains fixed size segments
+        instead of reallocating and copying one contiguous buffer. The segments can be
+        written out with a single gather write without flattening them first.
+
+        Usage example:
+
+        SegmentedStream output;
+        encoder.encode(output, surface, options);
+
+        FileStream file("image.png", Stream::WRITE);
+        output.writeTo(file);
+
+    */
+
+    class SegmentedStream : public Stream
+    {
+    private:
+        struct Segment
+        {
+            u8* address;
+            size_t offset; // offset of the segment in the stream
+            size_t capacity;
+        };
+
+        std::vector<Segment> m_segments;
+        size_t m_size;
+        size_t m_offset;
+        size_t m_segment_size;
+
+        size_t find(size_t offset) const;
+        void grow(size_t bytes);
+
+    public:
+        SegmentedStream(size_t segment_size = 64 * 1024);
+        ~SegmentedStream();
+
+        std::vector<ConstMemory> segments() const;
+        void writeTo(Stream& stream) const;
+        void reset();
+
+        u64 size() const;
+        u64 offset() const;
+        void seek(u64 distance, SeekMode mode);
+        void read(void* dest, size_t bytes);
+        void write(const void* source, size_t bytes);
+    };
+
 } // namespace mango
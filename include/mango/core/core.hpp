@@ -11,6 +11,7 @@
 #include "endian.hpp"
 #include "pointer.hpp"
 #include "compress.hpp"
+#include "inflate.hpp"
 #include "crc32.hpp"
 #include "hash.hpp"
 #include "aes.hpp"
@@ -4,6 +4,8 @@
 */
 #pragma once
 
+#include <string>
+#include <vector>
 #include "configure.hpp"
 
 namespace mango
@@ -62,4 +64,56 @@ namespace mango
 
 	u64 getCPUFlags();
 
+    // ----------------------------------------------------------------------------
+    // runtime dispatch
+    // ----------------------------------------------------------------------------
+
+    // Kernels compiled for more than one instruction set list their variants
+    // ordered from the baseline to the most capable one. The last variant whose
+    // features are all supported by the CPU is selected and recorded in a
+    // process-wide table, which can be inspected with getDispatchTable().
+    // setDispatchOverride() forces a named variant, if the CPU supports it, for
+    // the kernels selected after the call; an empty name restores the default.
+
+    template <typename Function>
+    struct DispatchVariant
+    {
+        u64 features; // required CPU features; 0 for the baseline
+        const char* name;
+        Function function;
+    };
+
+    struct DispatchEntry
+    {
+        std::string kernel;
+        std::string variant;
+    };
+
+    void setDispatchVariant(const std::string& kernel, const std::string& variant);
+    std::vector<DispatchEntry> getDispatchTable();
+
+    void setDispatchOverride(const std::string& kernel, const std::string& variant);
+    std::string getDispatchOverride(const std::string& kernel);
+
+    template <typename Function, size_t N>
+    const DispatchVariant<Function>& selectDispatchVariant(const char* kernel, const DispatchVariant<Function> (&variants)[N])
+    {
+        const u64 flags = getCPUFlags();
+        const std::string forced = getDispatchOverride(kernel);
+        size_t index = 0;
+
+        for (size_t i = 0; i < N; ++i)
+        {
+            if ((variants[i].features & flags) == variants[i].features)
+            {
+                index = i;
+                if (forced == variants[i].name)
+                    break;
+            }
+        }
+
+        setDispatchVariant(kernel, variants[index].name);
+        return variants[index];
+    }
+
 } // namespace mango
@@ -12,5 +12,6 @@ namespace mango
 
     u32 crc32(u32 crc, ConstMemory memory);
     u32 crc32c(u32 crc, ConstMemory memory);
+    u32 adler32(u32 adler, ConstMemory memory);
 
 } // namespace mango
@@ -85,6 +85,20 @@ namespace mango
         ustore64(p, byteswap(value));
     }
 
+    // --------------------------------------------------------------
+    // bulk byteswap
+    // --------------------------------------------------------------
+
+    // Swap the byte order of count elements from source to dest. The arrays
+    // do not have to be aligned. The swap can be done in-place (dest == source)
+    // but the arrays must not otherwise overlap.
+
+    void byteswap(u16* dest, const u16* source, size_t count);
+    void byteswap(u32* dest, const u32* source, size_t count);
+    void byteswap(u64* dest, const u64* source, size_t count);
+    void byteswap(float* dest, const float* source, size_t count);
+    void byteswap(double* dest, const double* source, size_t count);
+
     // --------------------------------------------------------------
 	// endian load/store
     // --------------------------------------------------------------
@@ -65,6 +65,14 @@ namespace mango
     SHA1 sha1(ConstMemory memory);
     SHA2 sha2(ConstMemory memory);
 
+    // Batched hashing of independent messages; the hashes are computed in
+    // parallel SIMD lanes or with the SHA instruction set extensions when
+    // the CPU supports them. hashes[i] is the hash of messages[i].
+
+    void md5(MD5* hashes, const ConstMemory* messages, size_t count);
+    void sha1(SHA1* hashes, const ConstMemory* messages, size_t count);
+    void sha2(SHA2* hashes, const ConstMemory* messages, size_t count);
+
     u32 xxhash32(u32 seed, ConstMemory memory);
     u64 xxhash64(u64 seed, ConstMemory memory);
 
@@ -0,0 +1,53 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <memory>
+#include "configure.hpp"
+#include "memory.hpp"
+#include "object.hpp"
+
+namespace mango
+{
+
+    // Table driven DEFLATE (RFC 1951) decoder with optional zlib (RFC 1950) framing.
+    //
+    // The compressed stream can be split into segments (PNG IDAT chunks, for example)
+    // which are decoded where they are in memory; the segments must remain valid
+    // while the inflater is used. All segments are appended before reading.
+    //
+    // The streaming interface does not verify the zlib Adler-32 checksum; the one-shot
+    // decompress() decodes straight into the destination and verifies it.
+
+    class Inflater : protected NonCopyable
+    {
+    protected:
+        struct State;
+        std::unique_ptr<State> m_state;
+
+    public:
+        enum Format
+        {
+            DEFLATE,
+            ZLIB
+        };
+
+        Inflater(Format format);
+        ~Inflater();
+
+        void append(ConstMemory segment);
+
+        // returns number of bytes decoded into dest; less than dest.size when
+        // the stream ends or is corrupted (see isEnd() and getError())
+        size_t read(Memory dest);
+
+        bool isEnd() const;
+        const char* getError() const;
+
+        // returns the decompressed size; throws on corrupted or truncated data
+        static size_t decompress(Memory dest, ConstMemory source, Format format);
+    };
+
+} // namespace mango
@@ -129,6 +129,29 @@ namespace detail {
     void* aligned_malloc(size_t bytes, Alignment alignment = Alignment());
     void aligned_free(void* aligned);
 
+    // -----------------------------------------------------------------------
+    // large malloc / realloc / free
+    // -----------------------------------------------------------------------
+
+    // Allocations of LARGE_ALLOCATION_THRESHOLD bytes or more are mapped directly
+    // from the operating system instead of the heap. The policy flags control
+    // how the pages are backed and when they are faulted in. Smaller requests
+    // are served from aligned_malloc() and ignore the policy.
+
+    enum : u32
+    {
+        ALLOCATE_DEFAULT     = 0x0000,
+        ALLOCATE_HUGE_PAGES  = 0x0001, // transparent huge pages (MADV_HUGEPAGE)
+        ALLOCATE_PREFAULT    = 0x0002, // fault all pages in at allocation time
+        ALLOCATE_FIRST_TOUCH = 0x0004, // fault pages in parallel from the ThreadPool
+    };
+
+    static constexpr size_t LARGE_ALLOCATION_THRESHOLD = 1024 * 1024;
+
+    void* large_malloc(size_t bytes, u32 policy = ALLOCATE_DEFAULT, Alignment alignment = Alignment());
+    void* large_realloc(void* ptr, size_t bytes);
+    void large_free(void* ptr);
+
     // -----------------------------------------------------------------------
     // AlignedPointer
     // -----------------------------------------------------------------------
@@ -166,6 +166,24 @@ namespace detail {
             p += 8;
             return value;
         }
+
+        void read16(u16* dest, size_t count)
+        {
+            std::memcpy(dest, p, count * 2);
+            p += count * 2;
+        }
+
+        void read32(u32* dest, size_t count)
+        {
+            std::memcpy(dest, p, count * 4);
+            p += count * 4;
+        }
+
+        void read64(u64* dest, size_t count)
+        {
+            std::memcpy(dest, p, count * 8);
+            p += count * 8;
+        }
     };
 
     // --------------------------------------------------------------
@@ -247,6 +265,24 @@ namespace detail {
             ustore64(p, value.u);
             p += 8;
         }
+
+        void write16(const u16* source, size_t count)
+        {
+            std::memcpy(p, source, count * 2);
+            p += count * 2;
+        }
+
+        void write32(const u32* source, size_t count)
+        {
+            std::memcpy(p, source, count * 4);
+            p += count * 4;
+        }
+
+        void write64(const u64* source, size_t count)
+        {
+            std::memcpy(p, source, count * 8);
+            p += count * 8;
+        }
     };
 
     // --------------------------------------------------------------
@@ -331,6 +367,24 @@ namespace detail {
             p += 8;
             return value;
         }
+
+        void read16(u16* dest, size_t count)
+        {
+            byteswap(dest, reinterpret_cast<const u16*>(p), count);
+            p += count * 2;
+        }
+
+        void read32(u32* dest, size_t count)
+        {
+            byteswap(dest, reinterpret_cast<const u32*>(p), count);
+            p += count * 4;
+        }
+
+        void read64(u64* dest, size_t count)
+        {
+            byteswap(dest, reinterpret_cast<const u64*>(p), count);
+            p += count * 8;
+        }
     };
 
     // --------------------------------------------------------------
@@ -412,6 +466,24 @@ namespace detail {
             ustore64swap(p, value.u);
             p += 8;
         }
+
+        void write16(const u16* source, size_t count)
+        {
+            byteswap(reinterpret_cast<u16*>(p), source, count);
+            p += count * 2;
+        }
+
+        void write32(const u32* source, size_t count)
+        {
+            byteswap(reinterpret_cast<u32*>(p), source, count);
+            p += count * 4;
+        }
+
+        void write64(const u64* source, size_t count)
+        {
+            byteswap(reinterpret_cast<u64*>(p), source, count);
+            p += count * 8;
+        }
     };
 
 } // namespace detail
@@ -4,8 +4,10 @@
 */
 #pragma once
 
+#include <memory>
 #include "configure.hpp"
 #include "endian.hpp"
+#include "exception.hpp"
 #include "memory.hpp"
 #include "object.hpp"
 #include "half.hpp"
@@ -38,6 +40,15 @@ namespace mango
         virtual void read(void* dest, size_t size) = 0;
         virtual void write(const void* data, size_t size) = 0;
 
+        // gather write; streams which can do better than one write() per buffer override this
+        virtual void writev(const ConstMemory* buffers, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                write(buffers[i].address, buffers[i].size);
+            }
+        }
+
         void write(Memory memory)
         {
             write(memory.address, memory.size);
@@ -335,4 +346,432 @@ namespace mango
 
 #endif
 
+namespace detail {
+
+    // --------------------------------------------------------------
+    // StreamReader
+    // --------------------------------------------------------------
+
+    // The endian streams above call the virtual Stream::read() for every field,
+    // which is a fread() per field with FileStream. The reader pulls the Stream in
+    // large blocks and decodes the fields inline from the block. The Stream offset
+    // is left at the logical read position when the reader is destroyed.
+
+    template <bool SWAP>
+    class StreamReader : private NonCopyable
+    {
+    protected:
+        Stream& s;
+        std::unique_ptr<u8[]> m_buffer;
+        size_t m_capacity;
+        const u8* m_ptr;
+        const u8* m_end;
+        u64 m_position; // stream offset of m_end
+        u64 m_size;
+
+        template <typename T>
+        T load()
+        {
+            if (size_t(m_end - m_ptr) < sizeof(T))
+            {
+                refill(sizeof(T));
+            }
+
+            T value;
+            std::memcpy(&value, m_ptr, sizeof(T));
+            m_ptr += sizeof(T);
+            return SWAP ? byteswap(value) : value;
+        }
+
+        void refill(size_t bytes)
+        {
+            // move the unread bytes to the front of the buffer
+            const size_t left = size_t(m_end - m_ptr);
+            std::memmove(m_buffer.get(), m_ptr, left);
+
+            const size_t count = size_t(std::min(u64(m_capacity - left), m_size - m_position));
+            s.read(m_buffer.get() + left, count);
+            m_position += count;
+
+            m_ptr = m_buffer.get();
+            m_end = m_ptr + left + count;
+
+            if (left + count < bytes)
+            {
+                MANGO_EXCEPTION("[StreamReader] Reading past end of stream.");
+            }
+        }
+
+    public:
+        StreamReader(Stream& stream, size_t capacity = 64 * 1024)
+            : s(stream)
+            , m_buffer(new u8[capacity])
+            , m_capacity(capacity)
+            , m_ptr(m_buffer.get())
+            , m_end(m_buffer.get())
+            , m_position(stream.offset())
+            , m_size(stream.size())
+        {
+        }
+
+        ~StreamReader()
+        {
+            s.seek(offset(), Stream::BEGIN);
+        }
+
+        u64 size() const
+        {
+            return m_size;
+        }
+
+        u64 offset() const
+        {
+            return m_position - u64(m_end - m_ptr);
+        }
+
+        void seek(u64 distance, Stream::SeekMode mode)
+        {
+            u64 target = 0;
+            switch (mode)
+            {
+                case Stream::BEGIN:
+                    target = distance;
+                    break;
+                case Stream::CURRENT:
+                    target = offset() + distance;
+                    break;
+                case Stream::END:
+                    target = distance > m_size ? 0 : m_size - distance;
+                    break;
+            }
+
+            target = std::min(target, m_size);
+
+            const u64 start = m_position - u64(m_end - m_buffer.get());
+            if (target >= start && target <= m_position)
+            {
+                // seek inside the buffer
+                m_ptr = m_buffer.get() + size_t(target - start);
+            }
+            else
+            {
+                s.seek(target, Stream::BEGIN);
+                m_position = target;
+                m_ptr = m_buffer.get();
+                m_end = m_buffer.get();
+            }
+        }
+
+        // read functions
+
+        void read(void* dest, size_t size)
+        {
+            u8* d = reinterpret_cast<u8*>(dest);
+
+            const size_t left = std::min(size, size_t(m_end - m_ptr));
+            std::memcpy(d, m_ptr, left);
+            m_ptr += left;
+            d += left;
+            size -= left;
+
+            if (size >= m_capacity)
+            {
+                // large reads bypass the buffer
+                if (m_size - m_position < size)
+                {
+                    MANGO_EXCEPTION("[StreamReader] Reading past end of stream.");
+                }
+
+                s.read(d, size);
+                m_position += size;
+
+                // the buffer no longer holds the bytes before the position
+                m_ptr = m_buffer.get();
+                m_end = m_buffer.get();
+            }
+            else if (size > 0)
+            {
+                refill(size);
+                std::memcpy(d, m_ptr, size);
+                m_ptr += size;
+            }
+        }
+
+        u8 read8()
+        {
+            if (m_ptr == m_end)
+            {
+                refill(1);
+            }
+            return *m_ptr++;
+        }
+
+        u16 read16()
+        {
+            return load<u16>();
+        }
+
+        u32 read32()
+        {
+            return load<u32>();
+        }
+
+        u64 read64()
+        {
+            return load<u64>();
+        }
+
+        float16 read16f()
+        {
+            Half value;
+            value.u = read16();
+            return value;
+        }
+
+        float read32f()
+        {
+            Float value;
+            value.u = read32();
+            return value;
+        }
+
+        double read64f()
+        {
+            Double value;
+            value.u = read64();
+            return value;
+        }
+
+        // bulk read functions
+
+        void read16(u16* dest, size_t count)
+        {
+            read(dest, count * sizeof(u16));
+            if (SWAP)
+            {
+                byteswap(dest, dest, count);
+            }
+        }
+
+        void read32(u32* dest, size_t count)
+        {
+            read(dest, count * sizeof(u32));
+            if (SWAP)
+            {
+                byteswap(dest, dest, count);
+            }
+        }
+
+        void read64(u64* dest, size_t count)
+        {
+            read(dest, count * sizeof(u64));
+            if (SWAP)
+            {
+                byteswap(dest, dest, count);
+            }
+        }
+    };
+
+    // --------------------------------------------------------------
+    // StreamWriter
+    // --------------------------------------------------------------
+
+    // Collects the written fields into a block and writes it into the Stream
+    // when the block is full, on flush() and when the writer is destroyed.
+
+    template <bool SWAP>
+    class StreamWriter : private NonCopyable
+    {
+    protected:
+        Stream& s;
+        std::unique_ptr<u8[]> m_buffer;
+        size_t m_capacity;
+        u8* m_ptr;
+        u8* m_end;
+
+        template <typename T>
+        void store(T value)
+        {
+            if (size_t(m_end - m_ptr) < sizeof(T))
+            {
+                flush();
+            }
+
+            value = SWAP ? byteswap(value) : value;
+            std::memcpy(m_ptr, &value, sizeof(T));
+            m_ptr += sizeof(T);
+        }
+
+        template <typename T>
+        void store(const T* source, size_t count)
+        {
+            if (!SWAP)
+            {
+                write(source, count * sizeof(T));
+                return;
+            }
+
+            while (count > 0)
+            {
+                size_t n = size_t(m_end - m_ptr) / sizeof(T);
+                if (!n)
+                {
+                    flush();
+                    continue;
+                }
+
+                // swap directly into the buffer
+                n = std::min(n, count);
+                byteswap(reinterpret_cast<T*>(m_ptr), source, n);
+                m_ptr += n * sizeof(T);
+                source += n;
+                count -= n;
+            }
+        }
+
+    public:
+        StreamWriter(Stream& stream, size_t capacity = 64 * 1024)
+            : s(stream)
+            , m_buffer(new u8[capacity])
+            , m_capacity(capacity)
+            , m_ptr(m_buffer.get())
+            , m_end(m_buffer.get() + capacity)
+        {
+        }
+
+        ~StreamWriter()
+        {
+            flush();
+        }
+
+        void flush()
+        {
+            const size_t bytes = size_t(m_ptr - m_buffer.get());
+            if (bytes > 0)
+            {
+                s.write(m_buffer.get(), bytes);
+                m_ptr = m_buffer.get();
+            }
+        }
+
+        u64 size() const
+        {
+            return std::max(s.size(), offset());
+        }
+
+        u64 offset() const
+        {
+            return s.offset() + u64(m_ptr - m_buffer.get());
+        }
+
+        void seek(u64 distance, Stream::SeekMode mode)
+        {
+            flush();
+            s.seek(distance, mode);
+        }
+
+        // write functions
+
+        void write(const void* data, size_t size)
+        {
+            if (size > size_t(m_end - m_ptr))
+            {
+                flush();
+
+                if (size >= m_capacity)
+                {
+                    // large writes bypass the buffer
+                    s.write(data, size);
+                    return;
+                }
+            }
+
+            std::memcpy(m_ptr, data, size);
+            m_ptr += size;
+        }
+
+        void write(mango::Memory memory)
+        {
+            write(memory.address, memory.size);
+        }
+
+        void write8(u8 value)
+        {
+            if (m_ptr == m_end)
+            {
+                flush();
+            }
+            *m_ptr++ = value;
+        }
+
+        void write16(u16 value)
+        {
+            store<u16>(value);
+        }
+
+        void write32(u32 value)
+        {
+            store<u32>(value);
+        }
+
+        void write64(u64 value)
+        {
+            store<u64>(value);
+        }
+
+        void write16f(Half value)
+        {
+            write16(value.u);
+        }
+
+        void write32f(Float value)
+        {
+            write32(value.u);
+        }
+
+        void write64f(Double value)
+        {
+            write64(value.u);
+        }
+
+        // bulk write functions
+
+        void write16(const u16* source, size_t count)
+        {
+            store<u16>(source, count);
+        }
+
+        void write32(const u32* source, size_t count)
+        {
+            store<u32>(source, count);
+        }
+
+        void write64(const u64* source, size_t count)
+        {
+            store<u64>(source, count);
+        }
+    };
+
+} // namespace detail
+
+    // --------------------------------------------------------------
+    // Little/BigEndianStreamReader/Writer
+    // --------------------------------------------------------------
+
+#ifdef MANGO_LITTLE_ENDIAN
+
+    using LittleEndianStreamReader = detail::StreamReader<false>;
+    using BigEndianStreamReader = detail::StreamReader<true>;
+    using LittleEndianStreamWriter = detail::StreamWriter<false>;
+    using BigEndianStreamWriter = detail::StreamWriter<true>;
+
+#else
+
+    using LittleEndianStreamReader = detail::StreamReader<true>;
+    using BigEndianStreamReader = detail::StreamReader<false>;
+    using LittleEndianStreamWriter = detail::StreamWriter<true>;
+    using BigEndianStreamWriter = detail::StreamWriter<false>;
+
+#endif
+
 } // namespace mango
@@ -56,6 +56,7 @@ namespace filesystem {
         void seek(u64 distance, SeekMode mode);
         void read(void* dest, size_t size);
         void write(const void* data, size_t size);
+        void writev(const ConstMemory* buffers, size_t count);
     };
 
 } // namespace filesystem
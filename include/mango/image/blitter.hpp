@@ -4,6 +4,7 @@
 */
 #pragma once
 
+#include <vector>
 #include "../core/object.hpp"
 #include "../simd/simd.hpp"
 #include "surface.hpp"
@@ -25,49 +26,35 @@ namespace mango
         int height;
     };
 
+    struct BlitPlan;
+
     class Blitter : protected NonCopyable
     {
     public:
         Format srcFormat;
         Format destFormat;
 
-        struct Component
-        {
-            // integer components
-            u32 srcMask;
-            u32 destMask;
-            float scale;
-            float bias;
-
-            // float components
-            float constant;
-            int offset;
-
-            u32 computePack(u32 s) const
-            {
-                return u32((s & srcMask) * scale + bias) & destMask;
-            }
-        } component[4];
-
-        int components;
-        int sampleSize;
-        u32 initMask;
-        u32 copyMask;
-
-#ifdef MANGO_ENABLE_SSE2
-        __m128 sseScale;
-        __m128i sseSrcMask;
-        __m128i sseDestMask;
-        __m128i sseShiftMask;
-#endif
-
         typedef void (*FastFunc)(u8 *, const u8 *, int);
         typedef void (*ConvertFunc)(const Blitter& blitter, const BlitRect& rect);
 
         FastFunc custom;
         ConvertFunc convertFunc;
 
+        // staged conversion of the format pairs without a custom function; the
+        // plans are built once per format pair and shared by all blitters
+        const BlitPlan* plan;
+
+        // indexed source: the destination pixels of every source byte
+        std::vector<u8> indexTable;
+        int indexPixels; // pixels in a source byte
+
         Blitter(const Format& dest, const Format& source);
+
+        // Converts 1, 2, 4 or 8 bit indices to any destination format through the palette;
+        // the sub-byte indices are packed starting from the most significant bits. An
+        // 8 bit indexed destination receives the unpacked indices.
+        Blitter(const Format& dest, const Format& source, const Palette& palette);
+
         ~Blitter();
 
         void convert(const BlitRect& rect) const
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <string>
+#include <functional>
 #include "../core/object.hpp"
 #include "format.hpp"
 #include "compression.hpp"
@@ -24,6 +25,7 @@ namespace mango
         bool    palette = false; // palette is available
         Format  format; // preferred format (fastest available "direct" decoding is possible)
         TextureCompression compression = TextureCompression::NONE;
+        int     scale = 1;   // width and height are 1/scale of the full image size
     };
 
     struct ImageDecodeStatus : image::Status
@@ -48,6 +50,58 @@ namespace mango
         // - palette is resolved into the provided palette object
         // - decode() destination surface must be indexed
         Palette* palette = nullptr; // enable indexed decoding by pointing to a palette
+
+        // request reduced size decoding
+        // - the image is decoded at 1/scale resolution; 1, 2, 4 and 8 are supported
+        // - header(options) reports the dimensions and the scale which the decoder will use;
+        //   decoders without reduced size support ignore the request and report scale 1
+        int scale = 1;
+
+        // request region of interest decoding
+        // - only the rectangle is decoded; decode() destination surface is the size of the rectangle
+        // - the rectangle is in the coordinates of the (reduced size) image and is clipped to it
+        // - zero width or height selects the whole image
+        struct Region
+        {
+            int x = 0;
+            int y = 0;
+            int width = 0;
+            int height = 0;
+        } region;
+
+        // request band decoding
+        // - the decoded scanlines are delivered to the callback in horizontal bands from top to bottom
+        //   instead of being stored into the destination surface; y is the first scanline of the band
+        // - the band surface is valid only during the callback
+        // - decode() destination surface selects the pixel format, its image is not accessed
+        std::function<void(const Surface& band, int y)> callback;
+    };
+
+    // Helper for the decoders which implement region and band decoding:
+    // the decoded scanlines are handed to write() which stores the part inside of the
+    // region into the destination surface or passes it to the band callback.
+    class ImageDecodeRegion : protected NonCopyable
+    {
+    protected:
+        Surface& m_dest;
+        const ImageDecodeOptions& m_options;
+        bool m_whole;
+
+    public:
+        // region in image coordinates, clipped to the image
+        int x;
+        int y;
+        int width;
+        int height;
+
+        ImageDecodeRegion(Surface& dest, const ImageDecodeOptions& options, int image_width, int image_height);
+        ~ImageDecodeRegion();
+
+        bool isWhole() const; // whole image is stored into the destination surface
+        bool isBand() const;  // scanlines go to the band callback
+
+        // source contains the image scanlines starting from (x0, y0)
+        void write(const Surface& source, int x0, int y0);
     };
 
     class ImageDecoderInterface : protected NonCopyable
@@ -60,6 +114,8 @@ namespace mango
         virtual ImageDecodeStatus decode(Surface& dest, Palette* palette, int level, int depth, int face) = 0;
 
         // optional
+        virtual ImageHeader header(const ImageDecodeOptions& options);
+        virtual ImageDecodeStatus decode(Surface& dest, const ImageDecodeOptions& options, int level, int depth, int face);
         virtual ConstMemory memory(int level, int depth, int face); // get compressed data
         virtual ConstMemory icc(); // get ICC data
         virtual ConstMemory exif(); // get exif data
@@ -73,6 +129,7 @@ namespace mango
 
         bool isDecoder() const;
         ImageHeader header();
+        ImageHeader header(const ImageDecodeOptions& options);
         ImageDecodeStatus decode(Surface& dest, const ImageDecodeOptions& options = ImageDecodeOptions(), int level = 0, int depth = 0, int face = 0);
 
         ConstMemory memory(int level, int depth, int face);
@@ -23,9 +23,17 @@ namespace mango
     struct ImageEncodeOptions
     {
         Palette palette;
+
+        // png: quality selects the compression level; 0.0 is the fastest and 1.0 the smallest
         float quality = 0.90f;
         bool dithering = true;
         bool lossless = false;
+
+        // jpeg: chroma subsampling (444, 422 or 420), two-pass optimized huffman tables
+        // and progressive encoding (always uses optimized tables)
+        int subsampling = 444;
+        bool optimize = false;
+        bool progressive = false;
     };
 
     class ImageEncoder : protected NonCopyable
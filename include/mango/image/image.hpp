@@ -14,3 +14,7 @@
 #include "blitter.hpp"
 #include "surface.hpp"
 #include "quantize.hpp"
+#include "transform.hpp"
+#include "resample.hpp"
+#include "mipmap.hpp"
+#include "pixelops.hpp"
@@ -0,0 +1,101 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <vector>
+#include "../core/configure.hpp"
+#include "../core/buffer.hpp"
+#include "format.hpp"
+#include "compression.hpp"
+#include "surface.hpp"
+#include "resample.hpp"
+
+namespace mango
+{
+
+    // Storage for a mipmap chain. The levels are stored contiguously from the
+    // largest to the smallest without padding between the scanlines or the levels;
+    // this is the layout of a DDS surface and of the level data in a KTX file.
+    // Compressed levels are stored as rows of blocks, as written by
+    // TextureCompressionInfo::compress().
+
+    class Mipmap : private NonCopyable
+    {
+    protected:
+        struct Level
+        {
+            int width;
+            int height;
+            size_t offset;
+            size_t bytes;
+        };
+
+        std::vector<Level> m_levels;
+        Buffer m_buffer;
+
+        void allocate(int width, int height, int levels, int xblock, int yblock, int bytes);
+
+    public:
+        Format format; // pixel format; the encoding format of a compressed chain
+        TextureCompressionInfo info; // compression is NONE for a pixel chain
+
+        // levels == 0 allocates the full chain down to 1x1
+        Mipmap(int width, int height, const Format& format, int levels = 0);
+        Mipmap(int width, int height, TextureCompression compression, int levels = 0);
+        ~Mipmap();
+
+        int getLevelCount() const;
+        int getWidth(int level) const;
+        int getHeight(int level) const;
+
+        Memory memory() const; // the whole chain
+        Memory memory(int level) const;
+
+        // pixel chain only
+        Surface surface(int level) const;
+
+        static int getMaxLevelCount(int width, int height);
+    };
+
+    struct MipmapOptions
+    {
+        ResampleFilter filter = ResampleFilter::BOX;
+
+        // the color components of UNORM surfaces are stored as sRGB
+        bool srgb = false;
+
+        // filter the colors weighted by alpha (see ResampleOptions)
+        bool premultiply = true;
+
+        // Alpha tested textures lose coverage in the smaller levels as the alpha
+        // is averaged. When the reference is non-zero, the alpha of every level is
+        // scaled so that the fraction of texels passing the alpha test
+        // (alpha >= reference) is the same as in the largest level.
+        float alphaCoverage = 0.0f;
+    };
+
+    // Builds a mipmap chain from a surface. The largest level is a copy of the source
+    // when the sizes match (resampled otherwise) and the second level is resampled
+    // from the source; every other level is filtered from the previous level, which
+    // is kept in linear float RGBA, so the chain does not accumulate rounding errors.
+    // The largest level is never stored in float: at most two consecutive float
+    // levels are alive, about 5 bytes per texel of the largest level at the peak
+    // (1.3 GB for 16384 x 16384), plus one level in the encoding format for
+    // compressed chains. The levels are filtered in bands on the thread pool and
+    // compressed chains are encoded level by level.
+
+    class MipmapGenerator
+    {
+    protected:
+        MipmapOptions m_options;
+
+    public:
+        MipmapGenerator(const MipmapOptions& options = MipmapOptions());
+        ~MipmapGenerator();
+
+        void generate(const Mipmap& mipmap, const Surface& source) const;
+    };
+
+} // namespace mango
@@ -0,0 +1,72 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include "../core/configure.hpp"
+#include "surface.hpp"
+
+namespace mango
+{
+
+    // Pixel operations on surfaces. The operations work in place on the surface
+    // (or on the destination surface) and a sub-surface limits them to a rectangle.
+    // The operations with two surfaces process the area covered by both, starting
+    // from the top-left corner.
+    //
+    // Formats with 8 bit components and RGBA32F are processed directly, the other
+    // UNORM and float formats are converted through the Blitter. Missing color
+    // components read as zero and missing alpha reads as one. Luminance formats
+    // read the luminance into all color components and store the luminance of the
+    // color. The rows are processed in bands on the thread pool.
+
+    // Porter-Duff compositing operators; S is the source and D the destination
+    // (premultiplied), Sa and Da are the alpha of the source and the destination.
+    enum class CompositeMode
+    {
+        CLEAR,      // 0
+        SOURCE,     // S
+        DEST,       // D
+        OVER,       // S + D * (1 - Sa)
+        DEST_OVER,  // S * (1 - Da) + D
+        IN,         // S * Da
+        DEST_IN,    // D * Sa
+        OUT,        // S * (1 - Da)
+        DEST_OUT,   // D * (1 - Sa)
+        ATOP,       // S * Da + D * (1 - Sa)
+        DEST_ATOP,  // S * (1 - Da) + D * Sa
+        XOR,        // S * (1 - Da) + D * (1 - Sa)
+    };
+
+    // multiply the color components with alpha
+    void premultiply(const Surface& surface);
+
+    // divide the color components by alpha; transparent pixels become black
+    void unpremultiply(const Surface& surface);
+
+    // Composites the source over the destination. Surfaces which are not premultiplied
+    // are premultiplied for the operator and the result is divided by its alpha.
+    void composite(const Surface& dest, const Surface& source, CompositeMode mode, bool premultiplied = false);
+
+    // D = D + (S - D) * alpha for all components
+    void blend(const Surface& dest, const Surface& source, float alpha);
+
+    // writes a component (Format::RED .. Format::ALPHA) of the source into all
+    // components of the destination, which usually has a single component (L8, A8, ..)
+    void extractChannel(const Surface& dest, const Surface& source, int component);
+
+    // writes the only component of the source (the luminance of a luminance format)
+    // into a component (Format::RED .. Format::ALPHA) of the destination
+    void insertChannel(const Surface& dest, const Surface& source, int component);
+
+    // reorders the components; the arguments select the source component of each
+    // component (Format::RED .. Format::ALPHA)
+    void swizzle(const Surface& surface, int red, int green, int blue, int alpha);
+
+    // Replaces the components with table[value]; the tables have 256 entries and a
+    // null table leaves the component unchanged. The formats must have 8 bit
+    // components; the red table is used for the luminance.
+    void applyLUT(const Surface& surface, const u8* red, const u8* green, const u8* blue, const u8* alpha);
+
+} // namespace mango
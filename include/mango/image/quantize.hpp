@@ -12,7 +12,18 @@ namespace image {
 
     struct ColorQuantizeOptions
     {
-        float quality = 0.90f;
+        enum Method
+        {
+            // Kohonen neural network trained with a sample of the pixels (one thread)
+            NEUQUANT,
+
+            // Wu's variance minimizing cuts of a color histogram refined with k-means;
+            // the histogram, the pixel mapping and the dithering run on the thread pool
+            WU,
+        };
+
+        Method method = NEUQUANT;
+        float quality = 0.90f; // NEUQUANT: sample factor, WU: k-means iterations
         bool dithering = true;
     };
 
@@ -0,0 +1,42 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include "../core/configure.hpp"
+#include "surface.hpp"
+
+namespace mango
+{
+
+    enum class ResampleFilter
+    {
+        BOX,        // area average; nearest neighbour when magnifying
+        BILINEAR,   // triangle filter
+        MITCHELL,   // Mitchell-Netravali cubic (B = C = 1/3)
+        LANCZOS,    // three lobe Lanczos windowed sinc
+    };
+
+    struct ResampleOptions
+    {
+        ResampleFilter filter = ResampleFilter::LANCZOS;
+
+        // the color components of UNORM surfaces are stored as sRGB and are filtered in
+        // linear space (alpha and float surfaces are always linear)
+        bool srgb = false;
+
+        // the color components are weighted by alpha while filtering, so that fully
+        // transparent pixels do not bleed their color; the surfaces are not premultiplied
+        bool premultiply = true;
+    };
+
+    // Scales the source surface to the size of the destination surface with a
+    // separable filter. The formats of the surfaces can be different: UNORM formats
+    // up to 64 bits per pixel and FLOAT16 / FLOAT32 formats are supported. The
+    // scanlines are filtered in bands on the thread pool; every band keeps only
+    // the horizontally filtered source scanlines covered by the vertical filter,
+    // so the memory use does not depend on the source height.
+    void resample(const Surface& dest, const Surface& source, const ResampleOptions& options = ResampleOptions());
+
+} // namespace mango
@@ -48,6 +48,7 @@ namespace mango
         void save(const std::string& filename, const ImageEncodeOptions& options = ImageEncodeOptions()) const;
         void clear(float red, float green, float blue, float alpha) const;
         void blit(int x, int y, const Surface& source) const;
+        void blit(int x, int y, const Surface& source, const Palette& palette) const;
         void xflip() const;
         void yflip() const;
     };
@@ -55,7 +56,7 @@ namespace mango
     class Bitmap : private NonCopyable, public Surface
     {
     public:
-        Bitmap(int width, int height, const Format& format, int stride = 0);
+        Bitmap(int width, int height, const Format& format, int stride = 0, u32 policy = ALLOCATE_HUGE_PAGES);
         Bitmap(ConstMemory memory, const std::string& extension);
         Bitmap(ConstMemory memory, const std::string& extension, const Format& format);
         Bitmap(const std::string& filename);
@@ -0,0 +1,51 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include "../core/memory.hpp"
+#include "../core/stream.hpp"
+#include "encoder.hpp"
+
+namespace mango
+{
+
+    enum class ImageTransform
+    {
+        NONE,
+        FLIP_HORIZONTAL,
+        FLIP_VERTICAL,
+        TRANSPOSE,      // mirror over the top-left to bottom-right diagonal
+        TRANSVERSE,     // mirror over the top-right to bottom-left diagonal
+        ROTATE_90,      // clockwise
+        ROTATE_180,
+        ROTATE_270,
+    };
+
+    struct ImageTransformOptions
+    {
+        ImageTransform transform = ImageTransform::NONE;
+
+        // crop rectangle in the source image, applied before the transform
+        // - the top-left corner is aligned down to the MCU grid
+        // - zero width or height selects the whole image
+        struct Region
+        {
+            int x = 0;
+            int y = 0;
+            int width = 0;
+            int height = 0;
+        } crop;
+    };
+
+    // transform which displays an image stored with the EXIF orientation (1..8) upright
+    ImageTransform getImageTransform(int orientation);
+
+    // Lossless JPEG transform: the quantized DCT coefficients are rearranged and
+    // entropy coded again without decompression. The right and bottom edges which
+    // are mirrored by the transform are trimmed to whole MCUs. The metadata segments
+    // are copied and the EXIF orientation is updated to match the transformed image.
+    ImageEncodeStatus transformJPEG(Stream& output, ConstMemory input, const ImageTransformOptions& options);
+
+} // namespace mango
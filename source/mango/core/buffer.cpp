@@ -2,6 +2,7 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <algorithm>
 #include <mango/core/buffer.hpp>
 #include <mango/core/exception.hpp>
 
@@ -93,11 +94,20 @@ namespace mango {
     {
         if (bytes > m_capacity)
         {
-            u8* storage = allocate(bytes, m_alignment);
+            u8* storage;
             if (m_memory.address)
             {
-                std::memcpy(storage, m_memory.address, m_memory.size);
-                free(m_memory.address);
+                // large buffers are grown by remapping the pages (no copy)
+                void* ptr = large_realloc(m_memory.address, bytes);
+                if (!ptr)
+                {
+                    MANGO_EXCEPTION("[Buffer] Out of memory.");
+                }
+                storage = reinterpret_cast<u8*>(ptr);
+            }
+            else
+            {
+                storage = allocate(bytes, m_alignment);
             }
             m_memory.address = storage;
             m_capacity = bytes;
@@ -119,13 +129,17 @@ namespace mango {
 
     u8* Buffer::allocate(size_t bytes, Alignment alignment) const
     {
-        void* ptr = aligned_malloc(bytes, alignment);
+        void* ptr = large_malloc(bytes, ALLOCATE_DEFAULT, alignment);
+        if (!ptr)
+        {
+            MANGO_EXCEPTION("[Buffer] Out of memory.");
+        }
         return reinterpret_cast<u8*>(ptr);
     }
 
     void Buffer::free(u8* ptr) const
     {
-        aligned_free(ptr);
+        large_free(ptr);
     }
 
     // ----------------------------------------------------------------------------
@@ -228,4 +242,167 @@ namespace mango {
         m_offset += bytes;
     }
 
+    // ----------------------------------------------------------------------------
+    // SegmentedStream
+    // ----------------------------------------------------------------------------
+
+    SegmentedStream::SegmentedStream(size_t segment_size)
+        : m_size(0)
+        , m_offset(0)
+        , m_segment_size(std::max(segment_size, size_t(256)))
+    {
+    }
+
+    SegmentedStream::~SegmentedStream()
+    {
+        reset();
+    }
+
+    std::vector<ConstMemory> SegmentedStream::segments() const
+    {
+        std::vector<ConstMemory> result;
+
+        for (const Segment& segment : m_segments)
+        {
+            // only the last segment can be partially filled
+            const size_t bytes = std::min(segment.capacity, m_size - segment.offset);
+            if (bytes > 0)
+            {
+                result.emplace_back(segment.address, bytes);
+            }
+        }
+
+        return result;
+    }
+
+    void SegmentedStream::writeTo(Stream& stream) const
+    {
+        std::vector<ConstMemory> buffers = segments();
+        stream.writev(buffers.data(), buffers.size());
+    }
+
+    void SegmentedStream::reset()
+    {
+        for (Segment& segment : m_segments)
+        {
+            large_free(segment.address);
+        }
+
+        m_segments.clear();
+        m_size = 0;
+        m_offset = 0;
+    }
+
+    size_t SegmentedStream::find(size_t offset) const
+    {
+        // index of the segment containing the offset
+        auto it = std::upper_bound(m_segments.begin(), m_segments.end(), offset,
+            [] (size_t offset, const Segment& segment) { return offset < segment.offset; });
+        return size_t(it - m_segments.begin()) - 1;
+    }
+
+    void SegmentedStream::grow(size_t bytes)
+    {
+        size_t capacity = 0;
+        if (!m_segments.empty())
+        {
+            const Segment& last = m_segments.back();
+            capacity = last.offset + last.capacity;
+        }
+
+        while (capacity < bytes)
+        {
+            // segment size doubles up to 16 MB to keep the segment count low
+            const size_t size = m_segment_size;
+            m_segment_size = std::min(m_segment_size * 2, size_t(16 * 1024 * 1024));
+
+            void* ptr = large_malloc(size);
+            if (!ptr)
+            {
+                MANGO_EXCEPTION("[SegmentedStream] Out of memory.");
+            }
+
+            m_segments.push_back({ reinterpret_cast<u8*>(ptr), capacity, size });
+            capacity += size;
+        }
+    }
+
+    u64 SegmentedStream::size() const
+    {
+        return u64(m_size);
+    }
+
+    u64 SegmentedStream::offset() const
+    {
+        return u64(m_offset);
+    }
+
+    void SegmentedStream::seek(u64 distance, SeekMode mode)
+    {
+        const u64 size = u64(m_size);
+        switch (mode)
+        {
+            case BEGIN:
+                m_offset = size_t(std::min(size, distance));
+                break;
+
+            case CURRENT:
+                m_offset = size_t(std::min(size, m_offset + distance));
+                break;
+
+            case END:
+                m_offset = size_t(distance > size ? 0 : size - distance);
+                break;
+        }
+    }
+
+    void SegmentedStream::read(void* dest, size_t bytes)
+    {
+        const size_t left = m_size - m_offset;
+        if (left < bytes)
+        {
+            MANGO_EXCEPTION("[SegmentedStream] Reading past end of buffer.");
+        }
+
+        u8* d = reinterpret_cast<u8*>(dest);
+        size_t index = find(m_offset);
+
+        while (bytes > 0)
+        {
+            const Segment& segment = m_segments[index++];
+            const size_t offset = m_offset - segment.offset;
+            const size_t count = std::min(bytes, segment.capacity - offset);
+            std::memcpy(d, segment.address + offset, count);
+            d += count;
+            bytes -= count;
+            m_offset += count;
+        }
+    }
+
+    void SegmentedStream::write(const void* source, size_t bytes)
+    {
+        if (!bytes)
+        {
+            return;
+        }
+
+        grow(m_offset + bytes);
+
+        const u8* s = reinterpret_cast<const u8*>(source);
+        size_t index = find(m_offset);
+
+        while (bytes > 0)
+        {
+            const Segment& segment = m_segments[index++];
+            const size_t offset = m_offset - segment.offset;
+            const size_t count = std::min(bytes, segment.capacity - offset);
+            std::memcpy(segment.address + offset, s, count);
+            s += count;
+            bytes -= count;
+            m_offset += count;
+        }
+
+        m_size = std::max(m_size, m_offset);
+    }
+
 } // namespace mango
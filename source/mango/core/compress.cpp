@@ -6,6 +6,7 @@
 #include <vector>
 
 #include <mango/core/compress.hpp>
+#include <mango/core/inflate.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/core/buffer.hpp>
 #include <mango/core/bits.hpp>
@@ -92,34 +93,7 @@ namespace miniz {
 
     void decompress(Memory dest, ConstMemory source)
     {
-        mz_ulong dest_size = mz_ulong(dest.size);
-        mz_ulong source_size = mz_ulong(source.size);
-
-        int status = mz_uncompress(dest, &dest_size, source, source_size);
-        if (status != MZ_OK)
-        {
-            const char* msg = nullptr;
-            switch (status)
-            {
-                case MZ_MEM_ERROR:
-                    msg = "[miniz] not enough memory.";
-                    break;
-                case MZ_BUF_ERROR:
-                    msg = "[miniz] not enough room in the output buffer.";
-                    break;
-                case MZ_DATA_ERROR:
-                    msg = "[miniz] corrupted input data.";
-                    break;
-                default:
-                    msg = "[miniz] undefined error.";
-                    break;
-            }
-
-            if (msg)
-            {
-                MANGO_EXCEPTION(msg);
-            }
-        }
+        Inflater::decompress(dest, source, Inflater::ZLIB);
     }
 
 } // namespace miniz
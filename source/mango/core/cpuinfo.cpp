@@ -3,6 +3,8 @@
     Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <algorithm>
+#include <map>
+#include <mutex>
 #include <mango/core/cpuinfo.hpp>
 
 namespace
@@ -24,6 +26,11 @@ namespace
         __cpuid(info, id);
     }
 
+    u64 xgetbv()
+    {
+        return _xgetbv(0);
+    }
+
 #elif defined(MANGO_PLATFORM_UNIX)
 
 #include "cpuid.h"
@@ -39,6 +46,14 @@ namespace
         info[3] = regs[3];
     }
 
+    u64 xgetbv()
+    {
+        // inline assembly: the _xgetbv() intrinsic requires -mxsave
+        u32 eax, edx;
+        __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (u64(edx) << 32) | eax;
+    }
+
 #else
 
     #error "cpuid() not implemented."
@@ -52,6 +67,7 @@ namespace
     u64 getCPUFlagsInternal()
     {
         u64 flags = 0;
+        bool osxsave = false;
 
         int cpuInfo[4] = { 0, 0, 0, 0 };
 
@@ -85,6 +101,7 @@ namespace
                     if ((cpuInfo[2] & 0x20000000) != 0) flags |= CPU_F16C;
                     if ((cpuInfo[2] & 0x40000000) != 0) flags |= CPU_RDRAND;
                     if ((cpuInfo[2] & 0x00002000) != 0) flags |= CPU_CMPXCHG16B;
+                    osxsave = (cpuInfo[2] & 0x08000000) != 0;
                     break;
                 case 7:
                     // ebx
@@ -127,6 +144,26 @@ namespace
             }
         }
 
+        // The AVX and AVX-512 registers are usable only when the OS saves their
+        // state on context switch, which it reports in XCR0 (SSE and AVX state for
+        // YMM, opmask and upper ZMM state for AVX-512).
+        const u64 xcr0 = osxsave ? xgetbv() : 0;
+
+        const u64 avx = CPU_AVX | CPU_AVX2 | CPU_FMA3 | CPU_F16C | CPU_FMA4 | CPU_XOP;
+        const u64 avx512 = CPU_AVX512F | CPU_AVX512PFI | CPU_AVX512ERI | CPU_AVX512CDI |
+                           CPU_AVX512BW | CPU_AVX512VL | CPU_AVX512DQ | CPU_AVX512IFMA |
+                           CPU_AVX512VBMI;
+
+        if ((xcr0 & 0x06) != 0x06)
+        {
+            flags &= ~(avx | avx512);
+        }
+
+        if ((xcr0 & 0xe6) != 0xe6)
+        {
+            flags &= ~avx512;
+        }
+
         return flags;
     }
 
@@ -206,6 +243,18 @@ namespace
     {
         u64 flags = 0;
 
+#if defined(__aarch64__)
+
+        long hwcaps = getauxval(AT_HWCAP);
+
+        if (hwcaps & HWCAP_ASIMD) flags |= CPU_ARM_NEON;
+        if (hwcaps & HWCAP_AES)   flags |= CPU_ARM_AES;
+        if (hwcaps & HWCAP_SHA1)  flags |= CPU_ARM_SHA1;
+        if (hwcaps & HWCAP_SHA2)  flags |= CPU_ARM_SHA2;
+        if (hwcaps & HWCAP_CRC32) flags |= CPU_ARM_CRC32;
+
+#else
+
         long hwcaps = getauxval(AT_HWCAP);
 
         if (hwcaps & HWCAP_NEON)
@@ -213,12 +262,14 @@ namespace
             flags |= CPU_ARM_NEON;
         }
 
-#if 0   // TODO: more hwcaps - need __aarch64__ ARM / Linux for testing
-        // defined(__aarch64__) || defined(MANGO_CPU_64BIT)
-        if (hwcaps & HWCAP_AES)
-        if (hwcaps & HWCAP_CRC32)
-        if (hwcaps & HWCAP_SHA1)
-        if (hwcaps & HWCAP_SHA2)
+        // ARMv8 crypto extensions in AArch32 state
+        long hwcaps2 = getauxval(AT_HWCAP2);
+
+        if (hwcaps2 & HWCAP2_AES)   flags |= CPU_ARM_AES;
+        if (hwcaps2 & HWCAP2_SHA1)  flags |= CPU_ARM_SHA1;
+        if (hwcaps2 & HWCAP2_SHA2)  flags |= CPU_ARM_SHA2;
+        if (hwcaps2 & HWCAP2_CRC32) flags |= CPU_ARM_CRC32;
+
 #endif
 
         return flags;
@@ -244,4 +295,70 @@ namespace mango
         return flags;
     }
 
+    // ----------------------------------------------------------------------------
+    // runtime dispatch
+    // ----------------------------------------------------------------------------
+
+    namespace
+    {
+        struct DispatchTable
+        {
+            std::mutex mutex;
+            std::map<std::string, std::string> variants;
+            std::map<std::string, std::string> overrides;
+        };
+
+        // constructed on first use so that static initializers can register kernels
+        DispatchTable& getDispatchTableInstance()
+        {
+            static DispatchTable table;
+            return table;
+        }
+    }
+
+    void setDispatchVariant(const std::string& kernel, const std::string& variant)
+    {
+        DispatchTable& table = getDispatchTableInstance();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        table.variants[kernel] = variant;
+    }
+
+    std::vector<DispatchEntry> getDispatchTable()
+    {
+        DispatchTable& table = getDispatchTableInstance();
+        std::lock_guard<std::mutex> lock(table.mutex);
+
+        std::vector<DispatchEntry> result;
+        for (auto& node : table.variants)
+        {
+            result.push_back({ node.first, node.second });
+        }
+
+        return result;
+    }
+
+    void setDispatchOverride(const std::string& kernel, const std::string& variant)
+    {
+        DispatchTable& table = getDispatchTableInstance();
+        std::lock_guard<std::mutex> lock(table.mutex);
+
+        if (variant.empty())
+        {
+            table.overrides.erase(kernel);
+        }
+        else
+        {
+            table.overrides[kernel] = variant;
+        }
+    }
+
+    std::string getDispatchOverride(const std::string& kernel)
+    {
+        DispatchTable& table = getDispatchTableInstance();
+        std::lock_guard<std::mutex> lock(table.mutex);
+
+        auto it = table.overrides.find(kernel);
+        return it != table.overrides.end() ? it->second : std::string();
+    }
+
 } // namespace mango
@@ -2,28 +2,18 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <algorithm>
 #include <mango/core/crc32.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/core/bits.hpp>
 #include <mango/core/endian.hpp>
-
-#if defined(MANGO_ENABLE_SSE4_2)
-
-    #define MANGO_HARDWARE_CRC32C
-
-#elif defined(__ARM_FEATURE_CRC32)
-
-    #define MANGO_HARDWARE_CRC32
-    #define MANGO_HARDWARE_CRC32C
-
-#endif
+#include <mango/core/cpuinfo.hpp>
+#include "target.hpp"
 
 namespace
 {
     using namespace mango;
 
-#if !defined(MANGO_HARDWARE_CRC32)
-
     // //////////////////////////////////////////////////////////
     // Copyright (c) 2014 Stephan Brumme. All rights reserved.
     // see http://create.stephan-brumme.com/disclaimer.html
@@ -349,9 +339,7 @@ namespace
     }
 
 #endif // MANGO_CPU_64BIT
-#endif // MANGO_HARDWARE_CRC32
 
-#if !defined(MANGO_HARDWARE_CRC32C)
     
     constexpr u32 g_crc32c_table[] =
     {
@@ -675,11 +663,11 @@ namespace
     }
 
 #endif // MANGO_CPU_64BIT
-#endif // MANGO_HARDWARE_CRC32C
 
-#if defined(MANGO_ENABLE_SSE4_2)
+#if defined(MANGO_ENABLE_TARGET_SSE4_2)
 
-    inline u32 u8_crc32c(u32 crc, u8 data)
+    MANGO_TARGET_SSE4_2
+    inline u32 sse42_u8_crc32c(u32 crc, u8 data)
     {
         return _mm_crc32_u8(crc, data);
     }
@@ -688,7 +676,8 @@ namespace
 
     // 64 bit crc32c (SSE4.2)
 
-    inline u32 u64_crc32c(u32 crc, const u8* data)
+    MANGO_TARGET_SSE4_2
+    inline u32 sse42_u64_crc32c(u32 crc, const u8* data)
     {
         return u32(_mm_crc32_u64(crc, *reinterpret_cast<const u64 *>(data)));
     }
@@ -698,7 +687,8 @@ namespace
     // 32 bit crc32c (SSE4.2)
     // (_mm_crc32_u64 is not available in 32 bit x86)
 
-    inline u32 u64_crc32c(u32 crc, const u8* data)
+    MANGO_TARGET_SSE4_2
+    inline u32 sse42_u64_crc32c(u32 crc, const u8* data)
     {
         crc = _mm_crc32_u32(crc, *reinterpret_cast<const u32 *>(data + 0));
         crc = _mm_crc32_u32(crc, *reinterpret_cast<const u32 *>(data + 4));
@@ -707,58 +697,262 @@ namespace
 
 #endif // MANGO_CPU_64BIT
 
-#elif defined(__ARM_FEATURE_CRC32)
+#endif // MANGO_ENABLE_TARGET_SSE4_2
 
-    inline u32 u8_crc32(u32 crc, u8 data)
+#if defined(MANGO_ENABLE_TARGET_ARM_CRC32)
+
+    MANGO_TARGET_ARM_CRC32
+    inline u32 arm_u8_crc32(u32 crc, u8 data)
     {
         return __crc32b(crc, data);
     }
 
-    inline u32 u64_crc32(u32 crc, const u8* data)
+    MANGO_TARGET_ARM_CRC32
+    inline u32 arm_u64_crc32(u32 crc, const u8* data)
     {
         return __crc32d(crc, *reinterpret_cast<const u64 *>(data));
     }
 
-    inline u32 u8_crc32c(u32 crc, u8 data)
+    MANGO_TARGET_ARM_CRC32
+    inline u32 arm_u8_crc32c(u32 crc, u8 data)
     {
         return __crc32cb(crc, data);
     }
 
-    inline u32 u64_crc32c(u32 crc, const u8* data)
+    MANGO_TARGET_ARM_CRC32
+    inline u32 arm_u64_crc32c(u32 crc, const u8* data)
     {
         return __crc32cd(crc, *reinterpret_cast<const u64 *>(data));
     }
 
+#endif // MANGO_ENABLE_TARGET_ARM_CRC32
+
+    // The loop is a macro so that each variant is compiled with the target
+    // options of the function it is expanded in and the primitives are inlined.
+
+#define CRC_LOOP(crc, memory, u8_func, u64_func) \
+    crc = ~crc; \
+    uintptr_t alignment = (0 - reinterpret_cast<uintptr_t>(memory.address)) & 7; \
+    if (alignment <= memory.size) \
+    { \
+        memory.size -= alignment; \
+        while (alignment--) \
+        { \
+            crc = u8_func(crc, *memory.address++); \
+        } \
+        while (memory.size >= 8) \
+        { \
+            crc = u64_func(crc, memory.address); \
+            memory.address += 8; \
+            memory.size -= 8; \
+        } \
+    } \
+    while (memory.size--) \
+    { \
+        crc = u8_func(crc, *memory.address++); \
+    } \
+    return ~crc
+
+    using CRCFunc = u32 (*)(u32 crc, ConstMemory memory);
+
+    u32 generic_crc32(u32 crc, ConstMemory memory)
+    {
+        CRC_LOOP(crc, memory, u8_crc32, u64_crc32);
+    }
+
+    u32 generic_crc32c(u32 crc, ConstMemory memory)
+    {
+        CRC_LOOP(crc, memory, u8_crc32c, u64_crc32c);
+    }
+
+#if defined(MANGO_ENABLE_TARGET_SSE4_2)
+
+    MANGO_TARGET_SSE4_2
+    u32 sse42_crc32c(u32 crc, ConstMemory memory)
+    {
+        CRC_LOOP(crc, memory, sse42_u8_crc32c, sse42_u64_crc32c);
+    }
+
 #endif
 
-    template <typename F8, typename F64>
-    inline u32 crc_template(u32 crc, ConstMemory memory, F8 u8_func, F64 u64_func)
+#if defined(MANGO_ENABLE_TARGET_ARM_CRC32)
+
+    MANGO_TARGET_ARM_CRC32
+    u32 arm_crc32(u32 crc, ConstMemory memory)
+    {
+        CRC_LOOP(crc, memory, arm_u8_crc32, arm_u64_crc32);
+    }
+
+    MANGO_TARGET_ARM_CRC32
+    u32 arm_crc32c(u32 crc, ConstMemory memory)
     {
-        crc = ~crc;
+        CRC_LOOP(crc, memory, arm_u8_crc32c, arm_u64_crc32c);
+    }
 
-        uintptr_t alignment = (0 - reinterpret_cast<uintptr_t>(memory.address)) & 7;
-        if (alignment <= memory.size)
+#endif
+
+#undef CRC_LOOP
+
+    // The ARM flag is required when the compiler does not enable the extension
+    // by default; otherwise the instructions are always available.
+
+#if defined(__ARM_FEATURE_CRC32)
+    constexpr u64 ARM_CRC32_FEATURES = 0;
+#else
+    constexpr u64 ARM_CRC32_FEATURES = CPU_ARM_CRC32;
+#endif
+
+    CRCFunc select_crc32()
+    {
+        static const DispatchVariant<CRCFunc> variants[] =
+        {
+            { 0, "generic", generic_crc32 },
+#if defined(MANGO_ENABLE_TARGET_ARM_CRC32)
+            { ARM_CRC32_FEATURES, "ARM CRC32", arm_crc32 },
+#endif
+        };
+
+        return selectDispatchVariant("crc32", variants).function;
+    }
+
+    CRCFunc select_crc32c()
+    {
+        static const DispatchVariant<CRCFunc> variants[] =
         {
-            memory.size -= alignment;
-            while (alignment--)
+            { 0, "generic", generic_crc32c },
+#if defined(MANGO_ENABLE_TARGET_SSE4_2)
+            { CPU_SSE4_2, "SSE4.2", sse42_crc32c },
+#endif
+#if defined(MANGO_ENABLE_TARGET_ARM_CRC32)
+            { ARM_CRC32_FEATURES, "ARM CRC32", arm_crc32c },
+#endif
+        };
+
+        return selectDispatchVariant("crc32c", variants).function;
+    }
+
+    // ------------------------------------------------------------
+    // adler32
+    // ------------------------------------------------------------
+
+    constexpr u32 ADLER_BASE = 65521;
+    constexpr size_t ADLER_NMAX = 5552; // largest n such that 255n(n+1)/2 + (n+1)(BASE-1) fits in 32 bits
+
+    using AdlerFunc = u32 (*)(u32 adler, ConstMemory memory);
+
+    u32 generic_adler32(u32 adler, ConstMemory memory)
+    {
+        const u8* data = memory.address;
+        size_t size = memory.size;
+
+        u32 a = adler & 0xffff;
+        u32 b = adler >> 16;
+
+        while (size > 0)
+        {
+            size_t n = std::min(size, ADLER_NMAX);
+            size -= n;
+
+            for ( ; n >= 8; n -= 8)
             {
-                crc = u8_func(crc, *memory.address++);
+                a += data[0]; b += a;
+                a += data[1]; b += a;
+                a += data[2]; b += a;
+                a += data[3]; b += a;
+                a += data[4]; b += a;
+                a += data[5]; b += a;
+                a += data[6]; b += a;
+                a += data[7]; b += a;
+                data += 8;
             }
 
-            while (memory.size >= 8)
+            for ( ; n > 0; --n)
             {
-                crc = u64_func(crc, memory.address);
-                memory.address += 8;
-                memory.size -= 8;
+                a += *data++;
+                b += a;
             }
+
+            a %= ADLER_BASE;
+            b %= ADLER_BASE;
         }
 
-        while (memory.size--)
+        return (b << 16) | a;
+    }
+
+#if defined(MANGO_ENABLE_TARGET_SSSE3)
+
+    MANGO_TARGET_SSSE3
+    inline u32 ssse3_hsum32(__m128i v)
+    {
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return u32(_mm_cvtsi128_si32(v));
+    }
+
+    // 32 bytes per iteration: the byte sums come from psadbw and the position
+    // weighted sums from pmaddubsw; the running a is folded into b once per block.
+    MANGO_TARGET_SSSE3
+    u32 ssse3_adler32(u32 adler, ConstMemory memory)
+    {
+        const u8* data = memory.address;
+
+        u32 a = adler & 0xffff;
+        u32 b = adler >> 16;
+
+        const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+        const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+
+        size_t blocks = memory.size / 32;
+
+        while (blocks)
         {
-            crc = u8_func(crc, *memory.address++);
+            size_t n = std::min(blocks, ADLER_NMAX / 32);
+            blocks -= n;
+
+            __m128i sum_prev = _mm_cvtsi32_si128(int(a * n));
+            __m128i sum_a = zero;
+            __m128i sum_b = _mm_cvtsi32_si128(int(b));
+
+            do
+            {
+                const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0));
+                const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+
+                sum_prev = _mm_add_epi32(sum_prev, sum_a);
+
+                sum_a = _mm_add_epi32(sum_a, _mm_sad_epu8(v0, zero));
+                sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(_mm_maddubs_epi16(v0, tap1), ones));
+                sum_a = _mm_add_epi32(sum_a, _mm_sad_epu8(v1, zero));
+                sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(_mm_maddubs_epi16(v1, tap2), ones));
+
+                data += 32;
+            } while (--n);
+
+            sum_b = _mm_add_epi32(sum_b, _mm_slli_epi32(sum_prev, 5));
+
+            a = (a + ssse3_hsum32(sum_a)) % ADLER_BASE;
+            b = ssse3_hsum32(sum_b) % ADLER_BASE;
         }
 
-        return ~crc;
+        const size_t tail = memory.size & 31;
+        return generic_adler32((b << 16) | a, ConstMemory(data, tail));
+    }
+
+#endif // MANGO_ENABLE_TARGET_SSSE3
+
+    AdlerFunc select_adler32()
+    {
+        static const DispatchVariant<AdlerFunc> variants[] =
+        {
+            { 0, "generic", generic_adler32 },
+#if defined(MANGO_ENABLE_TARGET_SSSE3)
+            { CPU_SSSE3, "SSSE3", ssse3_adler32 },
+#endif
+        };
+
+        return selectDispatchVariant("adler32", variants).function;
     }
 
 } // namespace
@@ -768,12 +962,20 @@ namespace mango
 
     u32 crc32(u32 crc, ConstMemory memory)
     {
-        return crc_template(crc, memory, u8_crc32, u64_crc32);
+        static const CRCFunc func = select_crc32();
+        return func(crc, memory);
     }
 
     u32 crc32c(u32 crc, ConstMemory memory)
     {
-        return crc_template(crc, memory, u8_crc32c, u64_crc32c);
+        static const CRCFunc func = select_crc32c();
+        return func(crc, memory);
+    }
+
+    u32 adler32(u32 adler, ConstMemory memory)
+    {
+        static const AdlerFunc func = select_adler32();
+        return func(adler, memory);
     }
 
 } // namespace mango
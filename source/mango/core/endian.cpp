@@ -0,0 +1,255 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/core/endian.hpp>
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // scalar
+    // ----------------------------------------------------------------------------
+
+    template <typename T>
+    void byteswap_scalar(T* dest, const T* source, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            T value;
+            std::memcpy(&value, source + i, sizeof(T));
+            value = byteswap(value);
+            std::memcpy(dest + i, &value, sizeof(T));
+        }
+    }
+
+#if defined(MANGO_ENABLE_SSE2)
+
+    // ----------------------------------------------------------------------------
+    // SSE2 / SSSE3
+    // ----------------------------------------------------------------------------
+
+    static inline __m128i swap16(__m128i v)
+    {
+#if defined(MANGO_ENABLE_SSSE3)
+        const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        return _mm_shuffle_epi8(v, mask);
+#else
+        return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+#endif
+    }
+
+    static inline __m128i swap32(__m128i v)
+    {
+#if defined(MANGO_ENABLE_SSSE3)
+        const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return _mm_shuffle_epi8(v, mask);
+#else
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        return v;
+#endif
+    }
+
+    static inline __m128i swap64(__m128i v)
+    {
+#if defined(MANGO_ENABLE_SSSE3)
+        const __m128i mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        return _mm_shuffle_epi8(v, mask);
+#else
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        return v;
+#endif
+    }
+
+#if defined(MANGO_ENABLE_AVX2)
+
+    // ----------------------------------------------------------------------------
+    // AVX2
+    // ----------------------------------------------------------------------------
+
+    static inline __m256i swap16(__m256i v)
+    {
+        const __m256i mask = _mm256_setr_epi8(
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        return _mm256_shuffle_epi8(v, mask);
+    }
+
+    static inline __m256i swap32(__m256i v)
+    {
+        const __m256i mask = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return _mm256_shuffle_epi8(v, mask);
+    }
+
+    static inline __m256i swap64(__m256i v)
+    {
+        const __m256i mask = _mm256_setr_epi8(
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        return _mm256_shuffle_epi8(v, mask);
+    }
+
+    template <typename T, __m256i (*swap256)(__m256i), __m128i (*swap128)(__m128i)>
+    void byteswap_simd(T* dest, const T* source, size_t count)
+    {
+        constexpr size_t N = 32 / sizeof(T);
+
+        while (count >= N * 2)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + 0));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + N));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 0), swap256(a));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + N), swap256(b));
+            source += N * 2;
+            dest += N * 2;
+            count -= N * 2;
+        }
+
+        if (count >= N / 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), swap128(a));
+            source += N / 2;
+            dest += N / 2;
+            count -= N / 2;
+        }
+
+        byteswap_scalar(dest, source, count);
+    }
+
+    constexpr auto byteswap16 = byteswap_simd<u16, swap16, swap16>;
+    constexpr auto byteswap32 = byteswap_simd<u32, swap32, swap32>;
+    constexpr auto byteswap64 = byteswap_simd<u64, swap64, swap64>;
+
+#else
+
+    template <typename T, __m128i (*swap)(__m128i)>
+    void byteswap_simd(T* dest, const T* source, size_t count)
+    {
+        constexpr size_t N = 16 / sizeof(T);
+
+        while (count >= N * 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 0));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + N));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 0), swap(a));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + N), swap(b));
+            source += N * 2;
+            dest += N * 2;
+            count -= N * 2;
+        }
+
+        if (count >= N)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), swap(a));
+            source += N;
+            dest += N;
+            count -= N;
+        }
+
+        byteswap_scalar(dest, source, count);
+    }
+
+    constexpr auto byteswap16 = byteswap_simd<u16, swap16>;
+    constexpr auto byteswap32 = byteswap_simd<u32, swap32>;
+    constexpr auto byteswap64 = byteswap_simd<u64, swap64>;
+
+#endif // MANGO_ENABLE_AVX2
+
+#elif defined(MANGO_ENABLE_NEON)
+
+    // ----------------------------------------------------------------------------
+    // NEON
+    // ----------------------------------------------------------------------------
+
+    template <typename T, uint8x16_t (*swap)(uint8x16_t)>
+    void byteswap_simd(T* dest, const T* source, size_t count)
+    {
+        constexpr size_t N = 16 / sizeof(T);
+
+        while (count >= N * 2)
+        {
+            const u8* s = reinterpret_cast<const u8*>(source);
+            u8* d = reinterpret_cast<u8*>(dest);
+            uint8x16_t a = vld1q_u8(s + 0);
+            uint8x16_t b = vld1q_u8(s + 16);
+            vst1q_u8(d + 0, swap(a));
+            vst1q_u8(d + 16, swap(b));
+            source += N * 2;
+            dest += N * 2;
+            count -= N * 2;
+        }
+
+        byteswap_scalar(dest, source, count);
+    }
+
+    static inline uint8x16_t swap16(uint8x16_t v)
+    {
+        return vrev16q_u8(v);
+    }
+
+    static inline uint8x16_t swap32(uint8x16_t v)
+    {
+        return vrev32q_u8(v);
+    }
+
+    static inline uint8x16_t swap64(uint8x16_t v)
+    {
+        return vrev64q_u8(v);
+    }
+
+    constexpr auto byteswap16 = byteswap_simd<u16, swap16>;
+    constexpr auto byteswap32 = byteswap_simd<u32, swap32>;
+    constexpr auto byteswap64 = byteswap_simd<u64, swap64>;
+
+#else
+
+    constexpr auto byteswap16 = byteswap_scalar<u16>;
+    constexpr auto byteswap32 = byteswap_scalar<u32>;
+    constexpr auto byteswap64 = byteswap_scalar<u64>;
+
+#endif
+
+} // namespace
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // bulk byteswap
+    // ----------------------------------------------------------------------------
+
+    void byteswap(u16* dest, const u16* source, size_t count)
+    {
+        byteswap16(dest, source, count);
+    }
+
+    void byteswap(u32* dest, const u32* source, size_t count)
+    {
+        byteswap32(dest, source, count);
+    }
+
+    void byteswap(u64* dest, const u64* source, size_t count)
+    {
+        byteswap64(dest, source, count);
+    }
+
+    void byteswap(float* dest, const float* source, size_t count)
+    {
+        byteswap32(reinterpret_cast<u32*>(dest), reinterpret_cast<const u32*>(source), count);
+    }
+
+    void byteswap(double* dest, const double* source, size_t count)
+    {
+        byteswap64(reinterpret_cast<u64*>(dest), reinterpret_cast<const u64*>(source), count);
+    }
+
+} // namespace mango
@@ -2,13 +2,514 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <vector>
+#include <numeric>
+#include <algorithm>
 #include <mango/core/hash.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/core/cpuinfo.hpp>
+#include <mango/simd/simd.hpp>
+#include "sha.hpp"
 
 #define XXH_STATIC_LINKING_ONLY
 #include "../../external/zstd/common/xxhash.h"
 
+namespace
+{
+    using namespace mango;
+    using namespace mango::simd;
+
+    // ----------------------------------------------------------------------------
+    // multi-buffer hashing
+    // ----------------------------------------------------------------------------
+
+    // Independent messages are hashed in parallel, one message per 32 bit lane.
+    // Each lane feeds its message one 64 byte block at a time, including the
+    // padding blocks, and picks up the next message when it is done.
+
+    constexpr int LANES = 8;
+
+    template <int N>
+    inline u32x8 rotl(u32x8 a)
+    {
+        return bitwise_or(slli<N>(a), srli<32 - N>(a));
+    }
+
+    template <int N>
+    inline u32x8 rotr(u32x8 a)
+    {
+        return bitwise_or(srli<N>(a), slli<32 - N>(a));
+    }
+
+    inline u32x8 add(u32x8 a, u32x8 b, u32x8 c)
+    {
+        return add(add(a, b), c);
+    }
+
+    inline u32x8 add(u32x8 a, u32x8 b, u32x8 c, u32x8 d)
+    {
+        return add(add(a, b), add(c, d));
+    }
+
+    inline u32x8 bitwise_xor(u32x8 a, u32x8 b, u32x8 c)
+    {
+        return bitwise_xor(bitwise_xor(a, b), c);
+    }
+
+    struct MessageLane
+    {
+        const u8* data;
+        size_t index;   // message index
+        size_t blocks;  // number of complete message blocks
+        size_t total;   // number of blocks including padding
+        size_t current;
+        u8 tail[128];
+
+        void init(size_t index, ConstMemory memory, bool bigendian)
+        {
+            this->data = memory.address;
+            this->index = index;
+            this->blocks = memory.size / 64;
+            this->current = 0;
+
+            const size_t bytes = memory.size - blocks * 64;
+            const size_t padded = bytes < 56 ? 64 : 128;
+
+            std::memcpy(tail, data + blocks * 64, bytes);
+            std::memset(tail + bytes, 0, padded - bytes);
+            tail[bytes] = 0x80;
+
+            const u64 bits = u64(memory.size) * 8;
+            if (bigendian)
+                ustore64be(tail + padded - 8, bits);
+            else
+                ustore64le(tail + padded - 8, bits);
+
+            total = blocks + padded / 64;
+        }
+
+        const u8* next()
+        {
+            const u8* block = current < blocks ? data + current * 64
+                                               : tail + (current - blocks) * 64;
+            ++current;
+            return block;
+        }
+
+        bool done() const
+        {
+            return current == total;
+        }
+    };
+
+    template <typename Kernel, typename HashType>
+    void hash_lanes(HashType* hashes, const ConstMemory* messages, size_t count)
+    {
+        constexpr int WORDS = Kernel::WORDS;
+
+        // schedule the longest messages first to keep the lanes busy
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [=] (size_t a, size_t b)
+        {
+            return messages[a].size > messages[b].size;
+        });
+
+        static const u8 zero[64] = { 0 };
+
+        MessageLane lane[LANES];
+        bool active[LANES];
+        u32 state[WORDS][LANES];
+        size_t next = 0;
+        int running = 0;
+
+        auto assign = [&] (int i)
+        {
+            active[i] = next < count;
+            if (active[i])
+            {
+                size_t index = order[next++];
+                lane[i].init(index, messages[index], Kernel::bigendian);
+                for (int j = 0; j < WORDS; ++j)
+                {
+                    state[j][i] = Kernel::iv[j];
+                }
+                ++running;
+            }
+        };
+
+        for (int i = 0; i < LANES; ++i)
+        {
+            assign(i);
+        }
+
+        while (running > 0)
+        {
+            const u8* blocks[LANES];
+            for (int i = 0; i < LANES; ++i)
+            {
+                blocks[i] = active[i] ? lane[i].next() : zero;
+            }
+
+            Kernel::transform(state, blocks);
+
+            for (int i = 0; i < LANES; ++i)
+            {
+                if (active[i] && lane[i].done())
+                {
+                    HashType& hash = hashes[lane[i].index];
+                    for (int j = 0; j < WORDS; ++j)
+                    {
+                        hash.data[j] = Kernel::bigendian ? byteswap(state[j][i]) : state[j][i];
+                    }
+                    --running;
+                    assign(i);
+                }
+            }
+        }
+    }
+
+    template <bool BIGENDIAN>
+    void load_message(u32x8* w, const u8* const* blocks)
+    {
+        u32 temp[16][LANES];
+
+        for (int i = 0; i < LANES; ++i)
+        {
+            for (int j = 0; j < 16; ++j)
+            {
+                temp[j][i] = BIGENDIAN ? uload32be(blocks[i] + j * 4)
+                                       : uload32le(blocks[i] + j * 4);
+            }
+        }
+
+        for (int j = 0; j < 16; ++j)
+        {
+            w[j] = u32x8_uload(temp[j]);
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // MD5
+    // ----------------------------------------------------------------------------
+
+    struct KernelMD5
+    {
+        static constexpr int WORDS = 4;
+        static constexpr bool bigendian = false;
+        static const u32 iv[WORDS];
+
+        template <int S>
+        static inline void step(u32x8& a, u32x8 b, u32x8 f, u32x8 w, u32 k)
+        {
+            a = add(b, rotl<S>(add(a, f, w, u32x8_set(k))));
+        }
+
+        static void transform(u32 state[WORDS][LANES], const u8* const* blocks)
+        {
+            static const u32 K[64] =
+            {
+                0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+                0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+                0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+                0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+                0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+                0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+                0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+                0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+            };
+
+            u32x8 w[16];
+            load_message<false>(w, blocks);
+
+            u32x8 a = u32x8_uload(state[0]);
+            u32x8 b = u32x8_uload(state[1]);
+            u32x8 c = u32x8_uload(state[2]);
+            u32x8 d = u32x8_uload(state[3]);
+
+            const u32x8 a0 = a;
+            const u32x8 b0 = b;
+            const u32x8 c0 = c;
+            const u32x8 d0 = d;
+
+            #define F(x, y, z) bitwise_xor(z, bitwise_and(x, bitwise_xor(y, z)))
+            #define G(x, y, z) bitwise_xor(y, bitwise_and(z, bitwise_xor(x, y)))
+            #define H(x, y, z) bitwise_xor(x, y, z)
+            #define I(x, y, z) bitwise_xor(y, bitwise_or(x, bitwise_not(z)))
+
+            for (int i = 0; i < 16; i += 4)
+            {
+                step< 7>(a, b, F(b, c, d), w[i + 0], K[i + 0]);
+                step<12>(d, a, F(a, b, c), w[i + 1], K[i + 1]);
+                step<17>(c, d, F(d, a, b), w[i + 2], K[i + 2]);
+                step<22>(b, c, F(c, d, a), w[i + 3], K[i + 3]);
+            }
+
+            for (int i = 16; i < 32; i += 4)
+            {
+                step< 5>(a, b, G(b, c, d), w[(5 * i + 1) & 15], K[i + 0]);
+                step< 9>(d, a, G(a, b, c), w[(5 * i + 6) & 15], K[i + 1]);
+                step<14>(c, d, G(d, a, b), w[(5 * i + 11) & 15], K[i + 2]);
+                step<20>(b, c, G(c, d, a), w[(5 * i + 16) & 15], K[i + 3]);
+            }
+
+            for (int i = 32; i < 48; i += 4)
+            {
+                step< 4>(a, b, H(b, c, d), w[(3 * i + 5) & 15], K[i + 0]);
+                step<11>(d, a, H(a, b, c), w[(3 * i + 8) & 15], K[i + 1]);
+                step<16>(c, d, H(d, a, b), w[(3 * i + 11) & 15], K[i + 2]);
+                step<23>(b, c, H(c, d, a), w[(3 * i + 14) & 15], K[i + 3]);
+            }
+
+            for (int i = 48; i < 64; i += 4)
+            {
+                step< 6>(a, b, I(b, c, d), w[(7 * i + 0) & 15], K[i + 0]);
+                step<10>(d, a, I(a, b, c), w[(7 * i + 7) & 15], K[i + 1]);
+                step<15>(c, d, I(d, a, b), w[(7 * i + 14) & 15], K[i + 2]);
+                step<21>(b, c, I(c, d, a), w[(7 * i + 21) & 15], K[i + 3]);
+            }
+
+            #undef F
+            #undef G
+            #undef H
+            #undef I
+
+            u32x8_ustore(state[0], add(a, a0));
+            u32x8_ustore(state[1], add(b, b0));
+            u32x8_ustore(state[2], add(c, c0));
+            u32x8_ustore(state[3], add(d, d0));
+        }
+    };
+
+    const u32 KernelMD5::iv[] =
+    {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+    };
+
+    // ----------------------------------------------------------------------------
+    // SHA1
+    // ----------------------------------------------------------------------------
+
+    struct KernelSHA1
+    {
+        static constexpr int WORDS = 5;
+        static constexpr bool bigendian = true;
+        static const u32 iv[WORDS];
+
+        static inline u32x8 schedule(u32x8* w, int t)
+        {
+            if (t >= 16)
+            {
+                w[t & 15] = rotl<1>(bitwise_xor(bitwise_xor(w[(t + 13) & 15], w[(t + 8) & 15]),
+                                                bitwise_xor(w[(t + 2) & 15], w[t & 15])));
+            }
+            return w[t & 15];
+        }
+
+        static inline void round(u32x8& a, u32x8& b, u32x8& c, u32x8& d, u32x8& e, u32x8 f, u32x8 k, u32x8 w)
+        {
+            u32x8 temp = add(add(rotl<5>(a), f), add(e, k, w));
+            e = d;
+            d = c;
+            c = rotl<30>(b);
+            b = a;
+            a = temp;
+        }
+
+        static void transform(u32 state[WORDS][LANES], const u8* const* blocks)
+        {
+            u32x8 w[16];
+            load_message<true>(w, blocks);
+
+            u32x8 a = u32x8_uload(state[0]);
+            u32x8 b = u32x8_uload(state[1]);
+            u32x8 c = u32x8_uload(state[2]);
+            u32x8 d = u32x8_uload(state[3]);
+            u32x8 e = u32x8_uload(state[4]);
+
+            const u32x8 a0 = a;
+            const u32x8 b0 = b;
+            const u32x8 c0 = c;
+            const u32x8 d0 = d;
+            const u32x8 e0 = e;
+
+            u32x8 k = u32x8_set(0x5a827999);
+            for (int t = 0; t < 20; ++t)
+            {
+                u32x8 f = bitwise_xor(d, bitwise_and(b, bitwise_xor(c, d)));
+                round(a, b, c, d, e, f, k, schedule(w, t));
+            }
+
+            k = u32x8_set(0x6ed9eba1);
+            for (int t = 20; t < 40; ++t)
+            {
+                u32x8 f = bitwise_xor(b, c, d);
+                round(a, b, c, d, e, f, k, schedule(w, t));
+            }
+
+            k = u32x8_set(0x8f1bbcdc);
+            for (int t = 40; t < 60; ++t)
+            {
+                u32x8 f = bitwise_or(bitwise_and(b, c), bitwise_and(d, bitwise_or(b, c)));
+                round(a, b, c, d, e, f, k, schedule(w, t));
+            }
+
+            k = u32x8_set(0xca62c1d6);
+            for (int t = 60; t < 80; ++t)
+            {
+                u32x8 f = bitwise_xor(b, c, d);
+                round(a, b, c, d, e, f, k, schedule(w, t));
+            }
+
+            u32x8_ustore(state[0], add(a, a0));
+            u32x8_ustore(state[1], add(b, b0));
+            u32x8_ustore(state[2], add(c, c0));
+            u32x8_ustore(state[3], add(d, d0));
+            u32x8_ustore(state[4], add(e, e0));
+        }
+    };
+
+    const u32 KernelSHA1::iv[] =
+    {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+
+    // ----------------------------------------------------------------------------
+    // SHA2
+    // ----------------------------------------------------------------------------
+
+    struct KernelSHA2
+    {
+        static constexpr int WORDS = 8;
+        static constexpr bool bigendian = true;
+        static const u32 iv[WORDS];
+
+        static void transform(u32 state[WORDS][LANES], const u8* const* blocks)
+        {
+            static const u32 K[64] =
+            {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+            };
+
+            u32x8 w[16];
+            load_message<true>(w, blocks);
+
+            u32x8 s[8];
+            for (int i = 0; i < 8; ++i)
+            {
+                s[i] = u32x8_uload(state[i]);
+            }
+
+            u32x8 a = s[0];
+            u32x8 b = s[1];
+            u32x8 c = s[2];
+            u32x8 d = s[3];
+            u32x8 e = s[4];
+            u32x8 f = s[5];
+            u32x8 g = s[6];
+            u32x8 h = s[7];
+
+            for (int t = 0; t < 64; ++t)
+            {
+                if (t >= 16)
+                {
+                    u32x8 w2 = w[(t - 2) & 15];
+                    u32x8 w15 = w[(t - 15) & 15];
+                    u32x8 s0 = bitwise_xor(rotr<7>(w15), rotr<18>(w15), srli<3>(w15));
+                    u32x8 s1 = bitwise_xor(rotr<17>(w2), rotr<19>(w2), srli<10>(w2));
+                    w[t & 15] = add(w[t & 15], s0, w[(t - 7) & 15], s1);
+                }
+
+                u32x8 S1 = bitwise_xor(rotr<6>(e), rotr<11>(e), rotr<25>(e));
+                u32x8 ch = bitwise_xor(g, bitwise_and(e, bitwise_xor(f, g)));
+                u32x8 temp1 = add(add(h, S1), add(ch, u32x8_set(K[t]), w[t & 15]));
+                u32x8 S0 = bitwise_xor(rotr<2>(a), rotr<13>(a), rotr<22>(a));
+                u32x8 maj = bitwise_or(bitwise_and(a, b), bitwise_and(c, bitwise_or(a, b)));
+                u32x8 temp2 = add(S0, maj);
+
+                h = g;
+                g = f;
+                f = e;
+                e = add(d, temp1);
+                d = c;
+                c = b;
+                b = a;
+                a = add(temp1, temp2);
+            }
+
+            u32x8_ustore(state[0], add(s[0], a));
+            u32x8_ustore(state[1], add(s[1], b));
+            u32x8_ustore(state[2], add(s[2], c));
+            u32x8_ustore(state[3], add(s[3], d));
+            u32x8_ustore(state[4], add(s[4], e));
+            u32x8_ustore(state[5], add(s[5], f));
+            u32x8_ustore(state[6], add(s[6], g));
+            u32x8_ustore(state[7], add(s[7], h));
+        }
+    };
+
+    const u32 KernelSHA2::iv[] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+} // namespace
+
 namespace mango {
 
+    // ----------------------------------------------------------------------------
+    // batched hashing
+    // ----------------------------------------------------------------------------
+
+    void md5(MD5* hashes, const ConstMemory* messages, size_t count)
+    {
+        hash_lanes<KernelMD5>(hashes, messages, count);
+    }
+
+    // The SHA instruction set extensions hash a single message faster than the
+    // multi-buffer kernels hash eight messages in parallel.
+
+    void sha1(SHA1* hashes, const ConstMemory* messages, size_t count)
+    {
+        if (isHardwareSHA1())
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                hashes[i] = sha1(messages[i]);
+            }
+        }
+        else
+        {
+            hash_lanes<KernelSHA1>(hashes, messages, count);
+        }
+    }
+
+    void sha2(SHA2* hashes, const ConstMemory* messages, size_t count)
+    {
+        if (isHardwareSHA2())
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                hashes[i] = sha2(messages[i]);
+            }
+        }
+        else
+        {
+            hash_lanes<KernelSHA2>(hashes, messages, count);
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // xxhash
+    // ----------------------------------------------------------------------------
+
     u32 xxhash32(u32 seed, ConstMemory memory)
     {
         return XXH32(memory.address, memory.size, seed);
@@ -0,0 +1,1173 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <mango/core/inflate.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/bits.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/core/crc32.hpp>
+
+namespace
+{
+    using namespace mango;
+
+    // ------------------------------------------------------------
+    // decoding tables
+    // ------------------------------------------------------------
+
+    // Table entry layout:
+    //   bits  0..3  - code length; the primary table bits for a subtable link
+    //   bits  4..7  - extra bits, the length of the first literal of a pair or subtable bits
+    //   bits  8..13 - entry type
+    //   bits 16..31 - literal (or two literals), base value or subtable offset
+
+    enum : u32
+    {
+        ENTRY_LITERAL  = 0x0100,
+        ENTRY_PAIR     = 0x0200, // two literals decoded with one lookup
+        ENTRY_LENGTH   = 0x0400,
+        ENTRY_EOB      = 0x0800,
+        ENTRY_SUBTABLE = 0x1000,
+        ENTRY_INVALID  = 0x2000,
+    };
+
+    constexpr int LITLEN_BITS = 11;
+    constexpr int DIST_BITS = 8;
+    constexpr int CODELEN_BITS = 7;
+
+    // the primary table followed by subtables of up to 2^(15 - bits) entries for each long code
+    constexpr int LITLEN_TABLE_SIZE = (1 << LITLEN_BITS) + 288 * (1 << (15 - LITLEN_BITS));
+    constexpr int DIST_TABLE_SIZE = (1 << DIST_BITS) + 32 * (1 << (15 - DIST_BITS));
+    constexpr int CODELEN_TABLE_SIZE = 1 << CODELEN_BITS;
+
+    constexpr u32 LITLEN_MASK = (1 << LITLEN_BITS) - 1;
+    constexpr u32 DIST_MASK = (1 << DIST_BITS) - 1;
+
+    constexpr u32 WINDOW_SIZE = 32 * 1024;
+    constexpr u32 STREAM_BUFFER_SIZE = 128 * 1024;
+
+    // the fast loop writes whole 16 byte blocks; it stops this far from the end of the output
+    constexpr size_t FAST_OUTPUT_MARGIN = 258 + 32;
+    constexpr size_t FAST_INPUT_MARGIN = 16;
+
+    struct SymbolTables
+    {
+        u32 litlen[288];
+        u32 dist[32];
+        u32 codelen[19];
+
+        SymbolTables()
+        {
+            static const u16 length_base[] =
+            {
+                3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+            };
+
+            static const u8 length_extra[] =
+            {
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+            };
+
+            static const u16 dist_base[] =
+            {
+                1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+            };
+
+            static const u8 dist_extra[] =
+            {
+                0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+            };
+
+            for (u32 i = 0; i < 256; ++i)
+            {
+                litlen[i] = (i << 16) | ENTRY_LITERAL;
+            }
+
+            litlen[256] = ENTRY_EOB;
+
+            for (u32 i = 0; i < 29; ++i)
+            {
+                litlen[257 + i] = (length_base[i] << 16) | (length_extra[i] << 4) | ENTRY_LENGTH;
+            }
+
+            litlen[286] = ENTRY_INVALID;
+            litlen[287] = ENTRY_INVALID;
+
+            for (u32 i = 0; i < 30; ++i)
+            {
+                dist[i] = (dist_base[i] << 16) | (dist_extra[i] << 4);
+            }
+
+            dist[30] = ENTRY_INVALID;
+            dist[31] = ENTRY_INVALID;
+
+            for (u32 i = 0; i < 19; ++i)
+            {
+                codelen[i] = i << 16;
+            }
+        }
+    };
+
+    const SymbolTables g_symbols;
+
+    // Build a canonical huffman decoding table from the code lengths. Codes longer
+    // than the primary table bits are resolved with a second lookup into a subtable.
+    // Incomplete codes are accepted; the unused codes decode as ENTRY_INVALID.
+    bool buildTable(u32* table, int bits, int capacity, const u8* lengths, int count, const u32* values)
+    {
+        int histogram[16] = { 0 };
+
+        for (int i = 0; i < count; ++i)
+        {
+            ++histogram[lengths[i]];
+        }
+
+        histogram[0] = 0;
+
+        int left = 1;
+        for (int len = 1; len < 16; ++len)
+        {
+            left = (left << 1) - histogram[len];
+            if (left < 0)
+            {
+                // over-subscribed
+                return false;
+            }
+        }
+
+        int offsets[16];
+        offsets[1] = 0;
+        for (int len = 1; len < 15; ++len)
+        {
+            offsets[len + 1] = offsets[len] + histogram[len];
+        }
+
+        u16 sorted[288];
+        for (int i = 0; i < count; ++i)
+        {
+            if (lengths[i])
+            {
+                sorted[offsets[lengths[i]]++] = u16(i);
+            }
+        }
+
+        const int symbols = offsets[15];
+
+        // assign the canonical codes in bit-reversed order (deflate streams are LSB first)
+        u16 codes[288];
+        u32 code = 0;
+        int prevlen = 0;
+
+        for (int i = 0; i < symbols; ++i)
+        {
+            const int len = lengths[sorted[i]];
+            code <<= (len - prevlen);
+            prevlen = len;
+            codes[i] = u16(u32_reverse_bits(code) >> (32 - len));
+            ++code;
+        }
+
+        const u32 size = 1u << bits;
+        const u32 mask = size - 1;
+        std::fill(table, table + size, ENTRY_INVALID);
+
+        // allocate the subtables; the largest code sharing a prefix determines the subtable size
+        u8 subbits[1 << LITLEN_BITS] = { 0 };
+        bool subtables = false;
+
+        for (int i = 0; i < symbols; ++i)
+        {
+            const int len = lengths[sorted[i]];
+            if (len > bits)
+            {
+                u8& sb = subbits[codes[i] & mask];
+                sb = std::max(sb, u8(len - bits));
+                subtables = true;
+            }
+        }
+
+        if (subtables)
+        {
+            u32 offset = size;
+
+            for (u32 prefix = 0; prefix < size; ++prefix)
+            {
+                const u32 sb = subbits[prefix];
+                if (sb)
+                {
+                    if (offset + (1u << sb) > u32(capacity))
+                    {
+                        return false;
+                    }
+
+                    table[prefix] = (offset << 16) | (sb << 4) | bits | ENTRY_SUBTABLE;
+                    std::fill(table + offset, table + offset + (1u << sb), ENTRY_INVALID);
+                    offset += 1u << sb;
+                }
+            }
+        }
+
+        for (int i = 0; i < symbols; ++i)
+        {
+            const int symbol = sorted[i];
+            const u32 len = lengths[symbol];
+            const u32 reversed = codes[i];
+
+            if (len <= u32(bits))
+            {
+                const u32 entry = values[symbol] | len;
+                for (u32 j = reversed; j < size; j += (1u << len))
+                {
+                    table[j] = entry;
+                }
+            }
+            else
+            {
+                const u32 link = table[reversed & mask];
+                const u32 offset = link >> 16;
+                const u32 sb = (link >> 4) & 15;
+                const u32 sublen = len - bits;
+                const u32 entry = values[symbol] | sublen;
+                for (u32 j = reversed >> bits; j < (1u << sb); j += (1u << sublen))
+                {
+                    table[offset + j] = entry;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Combine two literals into one primary table entry when both codes fit in the
+    // primary table bits. The entries are visited downwards so that the second
+    // lookup always sees the original single literal entry.
+    void buildLiteralPairs(u32* table, int bits)
+    {
+        for (int i = (1 << bits) - 1; i >= 0; --i)
+        {
+            const u32 first = table[i];
+            if ((first & (ENTRY_LITERAL | ENTRY_PAIR)) != ENTRY_LITERAL)
+                continue;
+
+            const u32 len1 = first & 15;
+            const u32 second = table[i >> len1];
+            if ((second & (ENTRY_LITERAL | ENTRY_PAIR)) != ENTRY_LITERAL)
+                continue;
+
+            const u32 len2 = second & 15;
+            if (len1 + len2 <= u32(bits))
+            {
+                table[i] = (first & 0x00ff0000) | ((second & 0x00ff0000) << 8) |
+                           ENTRY_LITERAL | ENTRY_PAIR | (len1 << 4) | (len1 + len2);
+            }
+        }
+    }
+
+    // ------------------------------------------------------------
+    // match copy
+    // ------------------------------------------------------------
+
+    // The copy is allowed to write up to 15 bytes past the end of the match.
+    static inline
+    void copyMatch(u8* dest, u32 distance, u32 length)
+    {
+        const u8* src = dest - distance;
+        u8* end = dest + length;
+
+        if (distance >= 16)
+        {
+            do
+            {
+                std::memcpy(dest, src, 16);
+                dest += 16;
+                src += 16;
+            } while (dest < end);
+        }
+        else if (distance >= 8)
+        {
+            do
+            {
+                std::memcpy(dest, src, 8);
+                dest += 8;
+                src += 8;
+            } while (dest < end);
+        }
+        else if (distance == 1)
+        {
+            const u64 value = src[0] * 0x0101010101010101ull;
+            do
+            {
+                std::memcpy(dest, &value, 8);
+                dest += 8;
+            } while (dest < end);
+        }
+        else
+        {
+            // repeat the pattern bytewise until it spans a period of at least 8 bytes,
+            // after which the remaining output can be copied in 8 byte blocks
+            static const u8 periods[] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+            const u32 period = periods[distance];
+
+            for (u32 i = 0; i < period; ++i)
+            {
+                dest[i] = src[i];
+            }
+
+            dest += period;
+
+            while (dest < end)
+            {
+                std::memcpy(dest, dest - period, 8);
+                dest += 8;
+            }
+        }
+    }
+
+} // namespace
+
+namespace mango
+{
+
+    // ------------------------------------------------------------
+    // Inflater::State
+    // ------------------------------------------------------------
+
+    struct Inflater::State
+    {
+        enum Mode
+        {
+            HEADER,
+            BLOCK,
+            STORED,
+            HUFFMAN,
+            TRAILER,
+            DONE,
+            FAILED
+        };
+
+        Format format;
+        Mode mode;
+        bool final = false;
+        bool fixed = false; // the tables contain the fixed huffman codes
+
+        // input
+        std::vector<ConstMemory> segments;
+        size_t segment_index = 0;
+        const u8* in = nullptr;
+        const u8* in_end = nullptr;
+
+        u64 bitbuf = 0;
+        int bitcount = 0;
+        int overrun = 0; // zero bytes fed past the end of the input
+
+        // block state
+        u32 stored_remain = 0;
+        u32 match_length = 0;
+        u32 match_distance = 0;
+        u32 adler = 0;
+
+        const char* error = nullptr;
+
+        // output history starts here
+        u8* base = nullptr;
+
+        // streaming window: 32 KB of history followed by decoded data
+        std::unique_ptr<u8[]> window;
+        u8* window_read = nullptr;
+        u8* window_write = nullptr;
+
+        u32 litlen_table[LITLEN_TABLE_SIZE];
+        u32 dist_table[DIST_TABLE_SIZE];
+
+        State(Format format)
+            : format(format)
+            , mode(format == ZLIB ? HEADER : BLOCK)
+        {
+        }
+
+        void fail(const char* message)
+        {
+            error = message;
+            mode = FAILED;
+        }
+
+        bool nextSegment()
+        {
+            while (segment_index < segments.size())
+            {
+                const ConstMemory& segment = segments[segment_index++];
+                if (segment.size)
+                {
+                    in = segment.address;
+                    in_end = segment.address + segment.size;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void refill()
+        {
+            if (in_end - in >= 8)
+            {
+                bitbuf |= uload64le(in) << bitcount;
+                in += (63 - bitcount) >> 3;
+                bitcount |= 56;
+                return;
+            }
+
+            while (bitcount <= 56)
+            {
+                if (in == in_end && !nextSegment())
+                {
+                    // feed zeros; consuming them is detected with truncated()
+                    ++overrun;
+                    bitcount += 8;
+                    continue;
+                }
+
+                bitbuf |= u64(*in++) << bitcount;
+                bitcount += 8;
+            }
+        }
+
+        bool truncated() const
+        {
+            return bitcount < overrun * 8;
+        }
+
+        u32 getBits(int count)
+        {
+            if (bitcount < count)
+            {
+                refill();
+            }
+
+            const u32 value = u32(bitbuf) & ((1u << count) - 1);
+            bitbuf >>= count;
+            bitcount -= count;
+            return value;
+        }
+
+        void consume(int count)
+        {
+            bitbuf >>= count;
+            bitcount -= count;
+        }
+
+        void alignToByte()
+        {
+            consume(bitcount & 7);
+        }
+
+        // ------------------------------------------------------------
+        // headers
+        // ------------------------------------------------------------
+
+        void decodeHeader()
+        {
+            const u32 cmf = getBits(8);
+            const u32 flg = getBits(8);
+
+            if (truncated())
+            {
+                fail("Not enough compressed data.");
+            }
+            else if (((cmf << 8) | flg) % 31 || (cmf & 15) != 8 || (cmf >> 4) > 7)
+            {
+                fail("Incorrect zlib header.");
+            }
+            else if (flg & 0x20)
+            {
+                fail("Preset dictionary is not supported.");
+            }
+            else
+            {
+                mode = BLOCK;
+            }
+        }
+
+        void decodeBlockHeader()
+        {
+            final = getBits(1) != 0;
+            const u32 type = getBits(2);
+
+            switch (type)
+            {
+                case 0:
+                {
+                    alignToByte();
+                    const u32 length = getBits(16);
+                    const u32 nlength = getBits(16);
+                    if (length != (~nlength & 0xffff))
+                    {
+                        fail("Incorrect stored block length.");
+                        return;
+                    }
+
+                    stored_remain = length;
+                    mode = STORED;
+                    break;
+                }
+
+                case 1:
+                    if (!fixed)
+                    {
+                        buildFixedTables();
+                        fixed = true;
+                    }
+                    mode = HUFFMAN;
+                    break;
+
+                case 2:
+                    fixed = false;
+                    if (!buildDynamicTables())
+                    {
+                        return;
+                    }
+                    mode = HUFFMAN;
+                    break;
+
+                default:
+                    fail("Incorrect block type.");
+                    return;
+            }
+
+            if (truncated())
+            {
+                fail("Not enough compressed data.");
+            }
+        }
+
+        void buildFixedTables()
+        {
+            u8 lengths[288 + 32];
+
+            std::memset(lengths +   0, 8, 144);
+            std::memset(lengths + 144, 9, 112);
+            std::memset(lengths + 256, 7, 24);
+            std::memset(lengths + 280, 8, 8);
+            std::memset(lengths + 288, 5, 32);
+
+            buildTable(litlen_table, LITLEN_BITS, LITLEN_TABLE_SIZE, lengths, 288, g_symbols.litlen);
+            buildLiteralPairs(litlen_table, LITLEN_BITS);
+            buildTable(dist_table, DIST_BITS, DIST_TABLE_SIZE, lengths + 288, 32, g_symbols.dist);
+        }
+
+        bool buildDynamicTables()
+        {
+            static const u8 order[] =
+            {
+                16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+            };
+
+            const int hlit = getBits(5) + 257;
+            const int hdist = getBits(5) + 1;
+            const int hclen = getBits(4) + 4;
+
+            if (hlit > 286 || hdist > 30)
+            {
+                fail("Incorrect number of huffman codes.");
+                return false;
+            }
+
+            u8 codelen_lengths[19] = { 0 };
+            for (int i = 0; i < hclen; ++i)
+            {
+                codelen_lengths[order[i]] = u8(getBits(3));
+            }
+
+            u32 codelen_table[CODELEN_TABLE_SIZE];
+            if (!buildTable(codelen_table, CODELEN_BITS, CODELEN_TABLE_SIZE, codelen_lengths, 19, g_symbols.codelen))
+            {
+                fail("Incorrect code length codes.");
+                return false;
+            }
+
+            u8 lengths[286 + 30];
+            const int count = hlit + hdist;
+
+            for (int n = 0; n < count; )
+            {
+                if (bitcount < 16)
+                {
+                    refill();
+                }
+
+                const u32 entry = codelen_table[bitbuf & (CODELEN_TABLE_SIZE - 1)];
+                if (entry & ENTRY_INVALID)
+                {
+                    fail("Incorrect code lengths.");
+                    return false;
+                }
+
+                consume(entry & 15);
+                const u32 symbol = entry >> 16;
+
+                if (symbol < 16)
+                {
+                    lengths[n++] = u8(symbol);
+                    continue;
+                }
+
+                u8 value = 0;
+                int repeat;
+
+                if (symbol == 16)
+                {
+                    if (!n)
+                    {
+                        fail("Incorrect code lengths.");
+                        return false;
+                    }
+
+                    value = lengths[n - 1];
+                    repeat = 3 + getBits(2);
+                }
+                else if (symbol == 17)
+                {
+                    repeat = 3 + getBits(3);
+                }
+                else
+                {
+                    repeat = 11 + getBits(7);
+                }
+
+                if (n + repeat > count)
+                {
+                    fail("Incorrect code lengths.");
+                    return false;
+                }
+
+                std::memset(lengths + n, value, repeat);
+                n += repeat;
+            }
+
+            if (truncated())
+            {
+                fail("Not enough compressed data.");
+                return false;
+            }
+
+            if (!lengths[256])
+            {
+                fail("Missing end-of-block code.");
+                return false;
+            }
+
+            if (!buildTable(litlen_table, LITLEN_BITS, LITLEN_TABLE_SIZE, lengths, hlit, g_symbols.litlen) ||
+                !buildTable(dist_table, DIST_BITS, DIST_TABLE_SIZE, lengths + hlit, hdist, g_symbols.dist))
+            {
+                fail("Incorrect huffman codes.");
+                return false;
+            }
+
+            buildLiteralPairs(litlen_table, LITLEN_BITS);
+            return true;
+        }
+
+        void decodeTrailer()
+        {
+            alignToByte();
+
+            if (format == ZLIB)
+            {
+                u32 value = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    value = (value << 8) | getBits(8);
+                }
+
+                if (truncated())
+                {
+                    fail("Not enough compressed data.");
+                    return;
+                }
+
+                adler = value;
+            }
+
+            mode = DONE;
+        }
+
+        // ------------------------------------------------------------
+        // stored block
+        // ------------------------------------------------------------
+
+        u8* decodeStored(u8* out, u8* end)
+        {
+            // whole bytes which are already in the bit buffer come first
+            while (stored_remain && bitcount >= 8)
+            {
+                if (out == end)
+                {
+                    return out;
+                }
+
+                if (bitcount <= overrun * 8)
+                {
+                    fail("Not enough compressed data.");
+                    return out;
+                }
+
+                *out++ = u8(bitbuf);
+                consume(8);
+                --stored_remain;
+            }
+
+            if (!bitcount)
+            {
+                // the fast refill leaves input bytes above the valid bits
+                bitbuf = 0;
+            }
+
+            while (stored_remain)
+            {
+                if (out == end)
+                {
+                    return out;
+                }
+
+                if (in == in_end && !nextSegment())
+                {
+                    fail("Not enough compressed data.");
+                    return out;
+                }
+
+                size_t n = std::min(size_t(stored_remain), size_t(in_end - in));
+                n = std::min(n, size_t(end - out));
+                std::memcpy(out, in, n);
+                in += n;
+                out += n;
+                stored_remain -= u32(n);
+            }
+
+            mode = BLOCK;
+            return out;
+        }
+
+        // ------------------------------------------------------------
+        // huffman block
+        // ------------------------------------------------------------
+
+        // Decode while there is plenty of input in the current segment and room in
+        // the output: one refill per symbol, no bounds checks and wide match copies.
+        u8* decodeFast(u8* out, u8* end)
+        {
+            const u32* litlen = litlen_table;
+            const u32* dist = dist_table;
+
+            u64 bitbuf = this->bitbuf;
+            int bitcount = this->bitcount;
+            const u8* in = this->in;
+
+            const u8* in_limit = in_end - FAST_INPUT_MARGIN;
+            const u8* out_limit = end - FAST_OUTPUT_MARGIN;
+
+            while (in <= in_limit && out <= out_limit)
+            {
+                bitbuf |= uload64le(in) << bitcount;
+                in += (63 - bitcount) >> 3;
+                bitcount |= 56;
+
+                u32 entry = litlen[bitbuf & LITLEN_MASK];
+
+                if (entry & ENTRY_LITERAL)
+                {
+                    // up to three primary entries of one or two literals each fit in the
+                    // refilled bits; the length and distance need a refill afterwards
+                    bitbuf >>= entry & 15;
+                    bitcount -= entry & 15;
+                    out[0] = u8(entry >> 16);
+                    out[1] = u8(entry >> 24);
+                    out += 1 + ((entry & ENTRY_PAIR) >> 9);
+
+                    entry = litlen[bitbuf & LITLEN_MASK];
+                    if (entry & ENTRY_LITERAL)
+                    {
+                        bitbuf >>= entry & 15;
+                        bitcount -= entry & 15;
+                        out[0] = u8(entry >> 16);
+                        out[1] = u8(entry >> 24);
+                        out += 1 + ((entry & ENTRY_PAIR) >> 9);
+
+                        entry = litlen[bitbuf & LITLEN_MASK];
+                        if (entry & ENTRY_LITERAL)
+                        {
+                            bitbuf >>= entry & 15;
+                            bitcount -= entry & 15;
+                            out[0] = u8(entry >> 16);
+                            out[1] = u8(entry >> 24);
+                            out += 1 + ((entry & ENTRY_PAIR) >> 9);
+                            continue;
+                        }
+                    }
+
+                    bitbuf |= uload64le(in) << bitcount;
+                    in += (63 - bitcount) >> 3;
+                    bitcount |= 56;
+                }
+
+                if (entry & ENTRY_SUBTABLE)
+                {
+                    bitbuf >>= LITLEN_BITS;
+                    bitcount -= LITLEN_BITS;
+                    entry = litlen[(entry >> 16) + (u32(bitbuf) & ((1u << ((entry >> 4) & 15)) - 1))];
+
+                    if (entry & ENTRY_LITERAL)
+                    {
+                        bitbuf >>= entry & 15;
+                        bitcount -= entry & 15;
+                        *out++ = u8(entry >> 16);
+                        continue;
+                    }
+                }
+
+                if (entry & ENTRY_LENGTH)
+                {
+                    u32 bits = entry & 15;
+                    u32 extra = (entry >> 4) & 15;
+                    const u32 length = (entry >> 16) + (u32(bitbuf >> bits) & ((1u << extra) - 1));
+                    bitbuf >>= bits + extra;
+                    bitcount -= bits + extra;
+
+                    entry = dist[bitbuf & DIST_MASK];
+                    if (entry & ENTRY_SUBTABLE)
+                    {
+                        bitbuf >>= DIST_BITS;
+                        bitcount -= DIST_BITS;
+                        entry = dist[(entry >> 16) + (u32(bitbuf) & ((1u << ((entry >> 4) & 15)) - 1))];
+                    }
+
+                    if (entry & ENTRY_INVALID)
+                    {
+                        fail("Incorrect distance code.");
+                        break;
+                    }
+
+                    bits = entry & 15;
+                    extra = (entry >> 4) & 15;
+                    const u32 distance = (entry >> 16) + (u32(bitbuf >> bits) & ((1u << extra) - 1));
+                    bitbuf >>= bits + extra;
+                    bitcount -= bits + extra;
+
+                    if (distance > size_t(out - base))
+                    {
+                        fail("Distance is too far back.");
+                        break;
+                    }
+
+                    copyMatch(out, distance, length);
+                    out += length;
+                    continue;
+                }
+
+                if (entry & ENTRY_EOB)
+                {
+                    bitbuf >>= entry & 15;
+                    bitcount -= entry & 15;
+                    mode = BLOCK;
+                    break;
+                }
+
+                fail("Incorrect literal/length code.");
+                break;
+            }
+
+            this->bitbuf = bitbuf;
+            this->bitcount = bitcount;
+            this->in = in;
+
+            return out;
+        }
+
+        u8* decodeHuffman(u8* out, u8* end)
+        {
+            for (;;)
+            {
+                if (match_length)
+                {
+                    // finish a match which did not fit into the output
+                    const u32 n = std::min(match_length, u32(end - out));
+                    const u8* src = out - match_distance;
+                    for (u32 i = 0; i < n; ++i)
+                    {
+                        out[i] = src[i];
+                    }
+
+                    out += n;
+                    match_length -= n;
+
+                    if (match_length)
+                    {
+                        return out;
+                    }
+                }
+
+                if (size_t(in_end - in) >= FAST_INPUT_MARGIN && size_t(end - out) >= FAST_OUTPUT_MARGIN)
+                {
+                    out = decodeFast(out, end);
+                    if (mode != HUFFMAN)
+                    {
+                        return out;
+                    }
+                }
+
+                // decode one symbol with exact bounds checking
+                refill();
+
+                u32 entry = litlen_table[bitbuf & LITLEN_MASK];
+                int skip = 0;
+
+                if (entry & ENTRY_SUBTABLE)
+                {
+                    skip = LITLEN_BITS;
+                    entry = litlen_table[(entry >> 16) + (u32(bitbuf >> skip) & ((1u << ((entry >> 4) & 15)) - 1))];
+                }
+
+                if (entry & ENTRY_LITERAL)
+                {
+                    if (out == end)
+                    {
+                        return out;
+                    }
+
+                    if ((entry & ENTRY_PAIR) && end - out >= 2)
+                    {
+                        out[0] = u8(entry >> 16);
+                        out[1] = u8(entry >> 24);
+                        out += 2;
+                        consume(entry & 15);
+                    }
+                    else
+                    {
+                        *out++ = u8(entry >> 16);
+                        consume(skip + ((entry & ENTRY_PAIR) ? (entry >> 4) & 15 : entry & 15));
+                    }
+                }
+                else if (entry & ENTRY_LENGTH)
+                {
+                    u32 bits = skip + (entry & 15);
+                    u32 extra = (entry >> 4) & 15;
+                    const u32 length = (entry >> 16) + (u32(bitbuf >> bits) & ((1u << extra) - 1));
+                    consume(bits + extra);
+
+                    entry = dist_table[bitbuf & DIST_MASK];
+                    if (entry & ENTRY_SUBTABLE)
+                    {
+                        consume(DIST_BITS);
+                        entry = dist_table[(entry >> 16) + (u32(bitbuf) & ((1u << ((entry >> 4) & 15)) - 1))];
+                    }
+
+                    if (entry & ENTRY_INVALID)
+                    {
+                        fail("Incorrect distance code.");
+                        return out;
+                    }
+
+                    bits = entry & 15;
+                    extra = (entry >> 4) & 15;
+                    const u32 distance = (entry >> 16) + (u32(bitbuf >> bits) & ((1u << extra) - 1));
+                    consume(bits + extra);
+
+                    if (distance > size_t(out - base))
+                    {
+                        fail("Distance is too far back.");
+                        return out;
+                    }
+
+                    match_length = length;
+                    match_distance = distance;
+                }
+                else if (entry & ENTRY_EOB)
+                {
+                    consume(skip + (entry & 15));
+                    mode = BLOCK;
+                }
+                else
+                {
+                    fail("Incorrect literal/length code.");
+                    return out;
+                }
+
+                if (truncated())
+                {
+                    fail("Not enough compressed data.");
+                    return out;
+                }
+
+                if (mode != HUFFMAN)
+                {
+                    return out;
+                }
+            }
+        }
+
+        // Decode into [out, end); the output must be preceded by the history which
+        // starts at base. Returns when the output is full or the stream ends or fails.
+        u8* decode(u8* out, u8* end)
+        {
+            for (;;)
+            {
+                switch (mode)
+                {
+                    case HEADER:
+                        decodeHeader();
+                        break;
+
+                    case BLOCK:
+                        if (final)
+                        {
+                            mode = TRAILER;
+                        }
+                        else
+                        {
+                            decodeBlockHeader();
+                        }
+                        break;
+
+                    case STORED:
+                        out = decodeStored(out, end);
+                        if (mode == STORED)
+                        {
+                            return out;
+                        }
+                        break;
+
+                    case HUFFMAN:
+                        out = decodeHuffman(out, end);
+                        if (mode == HUFFMAN)
+                        {
+                            return out;
+                        }
+                        break;
+
+                    case TRAILER:
+                        decodeTrailer();
+                        break;
+
+                    case DONE:
+                    case FAILED:
+                        return out;
+                }
+            }
+        }
+    };
+
+    // ------------------------------------------------------------
+    // Inflater
+    // ------------------------------------------------------------
+
+    Inflater::Inflater(Format format)
+        : m_state(new State(format))
+    {
+    }
+
+    Inflater::~Inflater()
+    {
+    }
+
+    void Inflater::append(ConstMemory segment)
+    {
+        m_state->segments.push_back(segment);
+    }
+
+    size_t Inflater::read(Memory dest)
+    {
+        State& s = *m_state;
+
+        if (!s.window)
+        {
+            s.window.reset(new u8[WINDOW_SIZE + STREAM_BUFFER_SIZE]);
+            s.base = s.window.get();
+            s.window_read = s.base;
+            s.window_write = s.base;
+        }
+
+        u8* const window_end = s.base + WINDOW_SIZE + STREAM_BUFFER_SIZE;
+
+        u8* ptr = dest.address;
+        size_t remain = dest.size;
+
+        while (remain)
+        {
+            const size_t available = s.window_write - s.window_read;
+            if (available)
+            {
+                const size_t n = std::min(available, remain);
+                std::memcpy(ptr, s.window_read, n);
+                s.window_read += n;
+                ptr += n;
+                remain -= n;
+                continue;
+            }
+
+            if (s.mode == State::DONE || s.mode == State::FAILED)
+            {
+                break;
+            }
+
+            if (s.window_write == window_end)
+            {
+                // keep the last 32 KB as history for the matches
+                std::memmove(s.base, window_end - WINDOW_SIZE, WINDOW_SIZE);
+                s.window_read = s.base + WINDOW_SIZE;
+                s.window_write = s.window_read;
+            }
+
+            s.window_write = s.decode(s.window_write, window_end);
+        }
+
+        return dest.size - remain;
+    }
+
+    bool Inflater::isEnd() const
+    {
+        return m_state->mode == State::DONE;
+    }
+
+    const char* Inflater::getError() const
+    {
+        return m_state->error;
+    }
+
+    size_t Inflater::decompress(Memory dest, ConstMemory source, Format format)
+    {
+        std::unique_ptr<State> state(new State(format));
+        State& s = *state;
+
+        s.segments.push_back(source);
+        s.base = dest.address;
+
+        u8* out = s.decode(dest.address, dest.address + dest.size);
+
+        if (s.mode == State::FAILED)
+        {
+            MANGO_EXCEPTION("[Inflater] %s", s.error);
+        }
+
+        if (s.mode != State::DONE)
+        {
+            MANGO_EXCEPTION("[Inflater] Not enough room in the output buffer.");
+        }
+
+        const size_t size = out - dest.address;
+
+        if (format == ZLIB && adler32(1, ConstMemory(dest.address, size)) != s.adler)
+        {
+            MANGO_EXCEPTION("[Inflater] Checksum mismatch.");
+        }
+
+        return size;
+    }
+
+} // namespace mango
@@ -5,6 +5,223 @@
 #include <cassert>
 #include <mango/core/bits.hpp>
 #include <mango/core/memory.hpp>
+#include <mango/core/thread.hpp>
+
+#if defined(MANGO_PLATFORM_UNIX)
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+namespace
+{
+    using namespace mango;
+
+    // -----------------------------------------------------------------------
+    // page mapping
+    // -----------------------------------------------------------------------
+
+#if defined(MANGO_PLATFORM_WINDOWS)
+
+    size_t get_pagesize()
+    {
+        static size_t x = 0;
+        if (!x)
+        {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            x = size_t(info.dwPageSize);
+        }
+        return x;
+    }
+
+    u8* map_pages(size_t bytes, u32 policy)
+    {
+        // NOTE: MEM_LARGE_PAGES requires SeLockMemoryPrivilege so we don't even try
+        MANGO_UNREFERENCED(policy);
+        void* address = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        return reinterpret_cast<u8*>(address);
+    }
+
+    void unmap_pages(u8* address, size_t bytes)
+    {
+        MANGO_UNREFERENCED(bytes);
+        VirtualFree(address, 0, MEM_RELEASE);
+    }
+
+    u8* remap_pages(u8* address, size_t old_bytes, size_t new_bytes)
+    {
+        // not supported; the caller will copy
+        MANGO_UNREFERENCED(address);
+        MANGO_UNREFERENCED(old_bytes);
+        MANGO_UNREFERENCED(new_bytes);
+        return nullptr;
+    }
+
+    constexpr bool is_populate_supported = false;
+
+#elif defined(MANGO_PLATFORM_UNIX)
+
+    size_t get_pagesize()
+    {
+        static size_t x = size_t(::sysconf(_SC_PAGESIZE));
+        return x;
+    }
+
+    u8* map_pages(size_t bytes, u32 policy)
+    {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#if defined(MAP_POPULATE)
+        if ((policy & (ALLOCATE_PREFAULT | ALLOCATE_FIRST_TOUCH)) == ALLOCATE_PREFAULT)
+        {
+            flags |= MAP_POPULATE;
+        }
+#endif
+
+        void* address = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (address == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+#if defined(MADV_HUGEPAGE)
+        if (policy & ALLOCATE_HUGE_PAGES)
+        {
+            // advisory only; failure is not an error
+            ::madvise(address, bytes, MADV_HUGEPAGE);
+        }
+#endif
+
+        return reinterpret_cast<u8*>(address);
+    }
+
+    void unmap_pages(u8* address, size_t bytes)
+    {
+        ::munmap(address, bytes);
+    }
+
+    u8* remap_pages(u8* address, size_t old_bytes, size_t new_bytes)
+    {
+#if defined(MANGO_PLATFORM_LINUX) || defined(MANGO_PLATFORM_ANDROID)
+        // the kernel moves the page tables instead of copying the pages
+        void* result = ::mremap(address, old_bytes, new_bytes, MREMAP_MAYMOVE);
+        return result == MAP_FAILED ? nullptr : reinterpret_cast<u8*>(result);
+#else
+        MANGO_UNREFERENCED(address);
+        MANGO_UNREFERENCED(old_bytes);
+        MANGO_UNREFERENCED(new_bytes);
+        return nullptr;
+#endif
+    }
+
+#if defined(MAP_POPULATE)
+    constexpr bool is_populate_supported = true;
+#else
+    constexpr bool is_populate_supported = false;
+#endif
+
+#else
+
+    size_t get_pagesize()
+    {
+        return 4096;
+    }
+
+    u8* map_pages(size_t bytes, u32 policy)
+    {
+        // not supported; the caller will fall back to the heap
+        MANGO_UNREFERENCED(bytes);
+        MANGO_UNREFERENCED(policy);
+        return nullptr;
+    }
+
+    void unmap_pages(u8* address, size_t bytes)
+    {
+        MANGO_UNREFERENCED(address);
+        MANGO_UNREFERENCED(bytes);
+    }
+
+    u8* remap_pages(u8* address, size_t old_bytes, size_t new_bytes)
+    {
+        MANGO_UNREFERENCED(address);
+        MANGO_UNREFERENCED(old_bytes);
+        MANGO_UNREFERENCED(new_bytes);
+        return nullptr;
+    }
+
+    constexpr bool is_populate_supported = false;
+
+#endif
+
+    void touch_pages(u8* address, size_t bytes)
+    {
+        const size_t pagesize = get_pagesize();
+        for (size_t offset = 0; offset < bytes; offset += pagesize)
+        {
+            // freshly mapped anonymous pages are zero; writing zero faults them in
+            reinterpret_cast<volatile u8*>(address)[offset] = 0;
+        }
+    }
+
+    void touch_pages_parallel(u8* address, size_t bytes)
+    {
+        // The decoders split the image into horizontal bands and hand them to the
+        // ThreadPool in order; touching the pages in the same band layout has good
+        // odds of placing them on the NUMA node of the thread that writes them.
+        const size_t pagesize = get_pagesize();
+        const size_t pages = (bytes + pagesize - 1) / pagesize;
+        const size_t N = std::min(size_t(ThreadPool::getInstanceSize()), pages);
+        const size_t section = (pages / N) * pagesize;
+
+        ConcurrentQueue queue("memory.touch", Priority::HIGH);
+
+        for (size_t i = 0; i < N; ++i)
+        {
+            const size_t offset = i * section;
+            const size_t size = (i == N - 1) ? bytes - offset : section;
+
+            queue.enqueue([=]
+            {
+                touch_pages(address + offset, size);
+            });
+        }
+
+        queue.wait();
+    }
+
+    // -----------------------------------------------------------------------
+    // LargeHeader
+    // -----------------------------------------------------------------------
+
+    // The header is stored immediately before the address returned to the caller.
+
+    struct LargeHeader
+    {
+        u8* base;       // start of the allocation
+        size_t mapped;  // bytes mapped from the OS or zero for heap allocation
+        size_t bytes;   // bytes requested by the caller
+        u32 policy;
+        u32 alignment;
+    };
+
+    inline LargeHeader* get_header(void* ptr)
+    {
+        return reinterpret_cast<LargeHeader*>(ptr) - 1;
+    }
+
+    inline size_t get_header_offset(u32 alignment)
+    {
+        const size_t mask = alignment - 1;
+        return (sizeof(LargeHeader) + mask) & ~mask;
+    }
+
+    inline size_t get_mapping_size(size_t bytes)
+    {
+        const size_t mask = get_pagesize() - 1;
+        return (bytes + mask) & ~mask;
+    }
+
+} // namespace
 
 namespace mango
 {
@@ -109,4 +326,116 @@ namespace mango
 
 #endif
 
+    // -----------------------------------------------------------------------
+    // large malloc/realloc/free
+    // -----------------------------------------------------------------------
+
+    void* large_malloc(size_t bytes, u32 policy, Alignment alignment)
+    {
+        const size_t offset = get_header_offset(alignment);
+
+        u8* base = nullptr;
+        size_t mapped = 0;
+
+        if (bytes >= LARGE_ALLOCATION_THRESHOLD && u32(alignment) <= get_pagesize())
+        {
+            mapped = get_mapping_size(offset + bytes);
+            base = map_pages(mapped, policy);
+            if (base)
+            {
+                if (policy & ALLOCATE_FIRST_TOUCH)
+                {
+                    touch_pages_parallel(base, mapped);
+                }
+                else if ((policy & ALLOCATE_PREFAULT) && !is_populate_supported)
+                {
+                    touch_pages(base, mapped);
+                }
+            }
+            else
+            {
+                mapped = 0;
+            }
+        }
+
+        if (!base)
+        {
+            base = reinterpret_cast<u8*>(aligned_malloc(offset + bytes, alignment));
+            if (!base)
+            {
+                return nullptr;
+            }
+        }
+
+        u8* ptr = base + offset;
+
+        LargeHeader* header = get_header(ptr);
+        header->base = base;
+        header->mapped = mapped;
+        header->bytes = bytes;
+        header->policy = policy;
+        header->alignment = alignment;
+
+        return ptr;
+    }
+
+    void* large_realloc(void* ptr, size_t bytes)
+    {
+        if (!ptr)
+        {
+            return large_malloc(bytes);
+        }
+
+        LargeHeader* header = get_header(ptr);
+        const size_t offset = reinterpret_cast<u8*>(ptr) - header->base;
+
+        if (header->mapped)
+        {
+            const size_t mapped = get_mapping_size(offset + bytes);
+            if (mapped <= header->mapped)
+            {
+                // the mapping is already large enough
+                header->bytes = bytes;
+                return ptr;
+            }
+
+            u8* base = remap_pages(header->base, header->mapped, mapped);
+            if (base)
+            {
+                u8* result = base + offset;
+                header = get_header(result);
+                header->base = base;
+                header->mapped = mapped;
+                header->bytes = bytes;
+                return result;
+            }
+        }
+
+        // fallback: allocate, copy and free
+        void* result = large_malloc(bytes, header->policy, header->alignment);
+        if (result)
+        {
+            std::memcpy(result, ptr, std::min(bytes, header->bytes));
+            large_free(ptr);
+        }
+
+        return result;
+    }
+
+    void large_free(void* ptr)
+    {
+        if (ptr)
+        {
+            LargeHeader* header = get_header(ptr);
+            if (header->mapped)
+            {
+                unmap_pages(header->base, header->mapped);
+            }
+            else
+            {
+                aligned_free(header->base);
+            }
+        }
+    }
+
 } // namespace mango
@@ -0,0 +1,15 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+namespace mango
+{
+
+    // true when sha1() / sha2() run on the SHA instruction set extensions; the
+    // answer comes from the dispatch selection, including setDispatchOverride()
+    bool isHardwareSHA1();
+    bool isHardwareSHA2();
+
+} // namespace mango
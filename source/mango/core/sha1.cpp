@@ -7,12 +7,14 @@
 #include <mango/core/bits.hpp>
 #include <mango/core/endian.hpp>
 #include <mango/core/cpuinfo.hpp>
+#include "target.hpp"
+#include "sha.hpp"
 
 namespace
 {
     using namespace mango;
 
-#if defined(__ARM_FEATURE_CRYPTO)
+#if defined(MANGO_ENABLE_TARGET_ARM_CRYPTO)
 
     // ----------------------------------------------------------------------------------------
     // ARM Crypto SHA1
@@ -34,6 +36,7 @@ namespace
     A = vsha1su1q_u32(A, D);           \
     B = vsha1su0q_u32(B, C, D);
 
+    MANGO_TARGET_ARM_CRYPTO
     void arm_sha1_update(u32 state[5], const u8* block, int count)
     {
         // set K0..K3 constants
@@ -120,7 +123,7 @@ namespace
 #undef ROUND0
 #undef ROUND1
 
-#elif defined(MANGO_ENABLE_SHA)
+#elif defined(MANGO_ENABLE_TARGET_SHA)
 
     /*******************************************************************************
     * Copyright (c) 2013, Intel Corporation 
@@ -174,6 +177,7 @@ namespace
     *
     *******************************************************************************/
 
+    MANGO_TARGET_SHA
     void intel_sha1_update(u32 *digest, const u8 *data, int num_blks)
     {
         __m128i abcd, e0, e1;
@@ -506,14 +510,46 @@ namespace
             state[2] += c;
             state[3] += d;
             state[4] += e;
+
+            block += 64;
         }
     }
 
+    // ----------------------------------------------------------------------------------------
+    // dispatch
+    // ----------------------------------------------------------------------------------------
+
+    using TransformFunc = void (*)(u32* state, const u8* data, int count);
+
+    // selected once; the batched sha1() hashes with the same transform
+    const DispatchVariant<TransformFunc>& select_sha1_transform()
+    {
+        static const DispatchVariant<TransformFunc> variants[] =
+        {
+            { 0, "generic", generic_sha1_update },
+#if defined(__ARM_FEATURE_CRYPTO)
+            { 0, "ARM Crypto", arm_sha1_update },
+#elif defined(MANGO_ENABLE_TARGET_ARM_CRYPTO)
+            { CPU_ARM_SHA1, "ARM Crypto", arm_sha1_update },
+#elif defined(MANGO_ENABLE_TARGET_SHA)
+            { CPU_SHA | CPU_SSE4_1, "SHA", intel_sha1_update },
+#endif
+        };
+
+        static const DispatchVariant<TransformFunc>& variant = selectDispatchVariant("sha1", variants);
+        return variant;
+    }
+
 } // namespace
 
 namespace mango
 {
 
+    bool isHardwareSHA1()
+    {
+        return select_sha1_transform().function != generic_sha1_update;
+    }
+
     SHA1 sha1(ConstMemory memory)
     {
         SHA1 hash;
@@ -523,18 +559,7 @@ namespace mango
         hash.data[3] = 0x10325476;
         hash.data[4] = 0xC3D2E1F0;
 
-        auto transform = generic_sha1_update;
-#if defined(__ARM_FEATURE_CRYPTO)
-        if ((getCPUFlags() & CPU_ARM_SHA1) != 0)
-        {
-            transform = arm_sha1_update;
-        }
-#elif defined(MANGO_ENABLE_SHA)
-        if ((getCPUFlags() & CPU_SHA) != 0)
-        {
-            transform = intel_sha1_update;
-        }
-#endif
+        const TransformFunc transform = select_sha1_transform().function;
 
         const u32 len = u32(memory.size);
         const u8* message = memory.address;
@@ -546,7 +571,7 @@ namespace mango
 
         u8 block[64];
         u32 rem = len - i;
-        memcpy(block, message + i, rem);
+        memcpy(block, message, rem);
 
         block[rem++] = 0x80;
         if (64 - rem >= 8)
@@ -7,12 +7,14 @@
 #include <mango/core/bits.hpp>
 #include <mango/core/endian.hpp>
 #include <mango/core/cpuinfo.hpp>
+#include "target.hpp"
+#include "sha.hpp"
 
 namespace
 {
     using namespace mango;
 
-#if defined(__ARM_FEATURE_CRYPTO)
+#if defined(MANGO_ENABLE_TARGET_ARM_CRYPTO)
 
     // ----------------------------------------------------------------------------------------
     // ARMv8 Crypto SHA2
@@ -23,6 +25,7 @@ namespace
     /*   Based on code from ARM, and by Johannes Schneiders, Skip */
     /*   Hovsmith and Barry O'Rourke for the mbedTLS project.     */
 
+    MANGO_TARGET_ARM_CRYPTO
     void arm_sha2_update(u32* state, const u8* data, int count)
     {
         static const uint32_t K[] =
@@ -204,7 +207,7 @@ namespace
 
 #endif
 
-#if defined(MANGO_ENABLE_SHA)
+#if defined(MANGO_ENABLE_TARGET_SHA)
 
     /*******************************************************************************
     * Copyright (c) 2013, Intel Corporation 
@@ -258,6 +261,7 @@ namespace
     *
     *******************************************************************************/
 
+    MANGO_TARGET_SHA
     void intel_sha2_transform(u32 digest[8], const u8* data, int block_count)
     {
         __m128i state0, state1;
@@ -568,11 +572,41 @@ namespace
         }
     }
 
+    // ----------------------------------------------------------------------------------------
+    // dispatch
+    // ----------------------------------------------------------------------------------------
+
+    using TransformFunc = void (*)(u32* state, const u8* data, int count);
+
+    // selected once; the batched sha2() hashes with the same transform
+    const DispatchVariant<TransformFunc>& select_sha2_transform()
+    {
+        static const DispatchVariant<TransformFunc> variants[] =
+        {
+            { 0, "generic", generic_sha2_transform },
+#if defined(__ARM_FEATURE_CRYPTO)
+            { 0, "ARM Crypto", arm_sha2_update },
+#elif defined(MANGO_ENABLE_TARGET_ARM_CRYPTO)
+            { CPU_ARM_SHA2, "ARM Crypto", arm_sha2_update },
+#elif defined(MANGO_ENABLE_TARGET_SHA)
+            { CPU_SHA | CPU_SSE4_1, "SHA", intel_sha2_transform },
+#endif
+        };
+
+        static const DispatchVariant<TransformFunc>& variant = selectDispatchVariant("sha2", variants);
+        return variant;
+    }
+
 } // namespace
 
 namespace mango
 {
 
+    bool isHardwareSHA2()
+    {
+        return select_sha2_transform().function != generic_sha2_transform;
+    }
+
     SHA2 sha2(ConstMemory memory)
     {
         SHA2 hash;
@@ -585,18 +619,7 @@ namespace mango
         hash.data[6] = 0x1f83d9ab;
         hash.data[7] = 0x5be0cd19;
 
-        auto transform = generic_sha2_transform;
-#if defined(__ARM_FEATURE_CRYPTO)
-        if ((getCPUFlags() & CPU_ARM_SHA2) != 0)
-        {
-            transform = arm_sha2_update;
-        }
-#elif defined(MANGO_ENABLE_SHA)
-        if ((getCPUFlags() & CPU_SHA) != 0)
-        {
-            transform = intel_sha2_transform;
-        }
-#endif
+        const TransformFunc transform = select_sha2_transform().function;
 
         u32 size = u32(memory.size);
         const u8* data = memory.address;
@@ -0,0 +1,99 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <mango/core/configure.hpp>
+
+// MANGO_TARGET(features) compiles one function for an instruction set extension
+// which is not enabled for the whole build. The caller selects the function at
+// runtime with selectDispatchVariant() or getCPUFlags(). MANGO_TARGET_<ISA> expands
+// to nothing when the whole build already targets the extension.
+
+#if defined(MANGO_COMPILER_GCC) || defined(MANGO_COMPILER_CLANG)
+    #define MANGO_ENABLE_TARGET
+    #define MANGO_TARGET(features) __attribute__((target(features)))
+#elif defined(MANGO_COMPILER_MICROSOFT)
+    // intrinsics are available without compiler options
+    #define MANGO_ENABLE_TARGET
+    #define MANGO_TARGET(features)
+#else
+    #define MANGO_TARGET(features)
+#endif
+
+#if defined(MANGO_CPU_INTEL)
+
+    #if defined(MANGO_ENABLE_SHA)
+        #define MANGO_ENABLE_TARGET_SHA
+        #define MANGO_TARGET_SHA
+    #elif defined(MANGO_ENABLE_TARGET)
+        #define MANGO_ENABLE_TARGET_SHA
+        #define MANGO_TARGET_SHA MANGO_TARGET("sha,sse4.1")
+    #endif
+
+    #if defined(MANGO_ENABLE_SSSE3)
+        #define MANGO_ENABLE_TARGET_SSSE3
+        #define MANGO_TARGET_SSSE3
+    #elif defined(MANGO_ENABLE_TARGET)
+        #define MANGO_ENABLE_TARGET_SSSE3
+        #define MANGO_TARGET_SSSE3 MANGO_TARGET("ssse3")
+    #endif
+
+    #if defined(MANGO_ENABLE_SSE4_1)
+        #define MANGO_ENABLE_TARGET_SSE4_1
+        #define MANGO_TARGET_SSE4_1
+    #elif defined(MANGO_ENABLE_TARGET)
+        #define MANGO_ENABLE_TARGET_SSE4_1
+        #define MANGO_TARGET_SSE4_1 MANGO_TARGET("sse4.1")
+    #endif
+
+    #if defined(MANGO_ENABLE_SSE4_2)
+        #define MANGO_ENABLE_TARGET_SSE4_2
+        #define MANGO_TARGET_SSE4_2
+    #elif defined(MANGO_ENABLE_TARGET)
+        #define MANGO_ENABLE_TARGET_SSE4_2
+        #define MANGO_TARGET_SSE4_2 MANGO_TARGET("sse4.2")
+    #endif
+
+    #if defined(MANGO_ENABLE_AVX2)
+        #define MANGO_ENABLE_TARGET_AVX2
+        #define MANGO_TARGET_AVX2
+    #elif defined(MANGO_ENABLE_TARGET)
+        #define MANGO_ENABLE_TARGET_AVX2
+        #define MANGO_TARGET_AVX2 MANGO_TARGET("avx2")
+    #endif
+
+    #if defined(__AVX512BW__)
+        #define MANGO_ENABLE_TARGET_AVX512BW
+        #define MANGO_TARGET_AVX512BW
+    #elif defined(MANGO_ENABLE_TARGET)
+        #define MANGO_ENABLE_TARGET_AVX512BW
+        #define MANGO_TARGET_AVX512BW MANGO_TARGET("avx512f,avx512bw")
+    #endif
+
+    #if defined(MANGO_ENABLE_TARGET)
+        #include <immintrin.h>
+    #endif
+
+#elif defined(MANGO_CPU_ARM)
+
+    #if defined(__ARM_FEATURE_CRYPTO)
+        #define MANGO_ENABLE_TARGET_ARM_CRYPTO
+        #define MANGO_TARGET_ARM_CRYPTO
+    #elif defined(MANGO_CPU_64BIT) && defined(MANGO_COMPILER_GCC)
+        #define MANGO_ENABLE_TARGET_ARM_CRYPTO
+        #define MANGO_TARGET_ARM_CRYPTO MANGO_TARGET("+crypto")
+        #include <arm_neon.h>
+    #endif
+
+    #if defined(__ARM_FEATURE_CRC32)
+        #define MANGO_ENABLE_TARGET_ARM_CRC32
+        #define MANGO_TARGET_ARM_CRC32
+    #elif defined(MANGO_CPU_64BIT) && defined(MANGO_COMPILER_GCC)
+        #define MANGO_ENABLE_TARGET_ARM_CRC32
+        #define MANGO_TARGET_ARM_CRC32 MANGO_TARGET("+crc")
+        #include <arm_acle.h>
+    #endif
+
+#endif
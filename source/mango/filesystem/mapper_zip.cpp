@@ -6,14 +6,13 @@
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/core/compress.hpp>
+#include <mango/core/inflate.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
 #include "indexer.hpp"
 
 #ifdef MANGO_ENABLE_ARCHIVE_ZIP
 
-#include "../../external/miniz/miniz.h"
-
 /*
 https://courses.cs.ut.ee/MTAT.07.022/2015_fall/uploads/Main/dmitri-report-f15-16.pdf
 
@@ -490,48 +489,9 @@ namespace
 
 	u64 zip_decompress(const u8* compressed, u8* uncompressed, u64 compressedLen, u64 uncompressedLen)
 	{
-		z_stream zstream;
-		std::memset(&zstream, 0, sizeof(zstream));
-
-		zstream.next_in  = compressed;
-		zstream.avail_in = uInt(compressedLen); // TODO: upgrade to support 64 bit files
-
-        if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
-		{
-            MANGO_EXCEPTION("[mapper.zip] InflateInit failed.");
-		}
-
-    	// decompression
-		zstream.next_out  = uncompressed;
-	    zstream.avail_out = uInt(uncompressedLen); // TODO: upgrade to support 64 bit files
-
-    	int zcode = inflate(&zstream, Z_FINISH);
-		if (zcode != Z_STREAM_END)
-        {
-            const char* msg = "[mapper.zip] Internal error.";
-            switch (zcode)
-            {
-                case Z_MEM_ERROR:
-                    msg = "[mapper.zip] Memory error.";
-                    break;
-
-                case Z_BUF_ERROR:
-                    msg = "[mapper.zip] Buffer error.";
-                    break;
-
-                case Z_DATA_ERROR:
-                    msg = "[mapper.zip] Data error.";
-                    break;
-            }
-            MANGO_EXCEPTION(msg);
-        }
-
-		if (inflateEnd(&zstream) != Z_OK)
-	    {
-            MANGO_EXCEPTION("[mapper.zip] Inflate failed.");
-		}
-
-		return zstream.total_out;
+        Memory dest(uncompressed, size_t(uncompressedLen));
+        ConstMemory source(compressed, size_t(compressedLen));
+        return Inflater::decompress(dest, source, Inflater::DEFLATE);
     }
 
 } // namespace
@@ -6,8 +6,11 @@
 #define _FILE_OFFSET_BITS 64 /* LFS: 64 bit off_t */
 #endif
 #include <cstdio>
+#include <cerrno>
+#include <algorithm>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
@@ -71,6 +74,71 @@ namespace filesystem {
 	        size_t status = std::fwrite(data, 1, size, m_file);
 	        MANGO_UNREFERENCED(status);
 	    }
+
+	    void writev(const ConstMemory* buffers, size_t count)
+	    {
+	        // drain the stdio buffer and write directly into the file descriptor
+	        std::fflush(m_file);
+	        const int fd = ::fileno(m_file);
+	        off_t position = ftello(m_file);
+
+	        constexpr size_t batch_size = 64;
+	        struct iovec iov[batch_size];
+
+	        size_t index = 0;
+	        ConstMemory current = count ? buffers[0] : ConstMemory();
+
+	        while (index < count)
+	        {
+	            iov[0].iov_base = const_cast<u8*>(current.address);
+	            iov[0].iov_len = current.size;
+
+	            size_t n = 1;
+	            for ( ; n < batch_size && index + n < count; ++n)
+	            {
+	                iov[n].iov_base = const_cast<u8*>(buffers[index + n].address);
+	                iov[n].iov_len = buffers[index + n].size;
+	            }
+
+#if defined(MANGO_PLATFORM_LINUX)
+	            ssize_t written = ::pwritev(fd, iov, int(n), position);
+#else
+	            ::lseek(fd, position, SEEK_SET);
+	            ssize_t written = ::writev(fd, iov, int(n));
+#endif
+	            if (written < 0)
+	            {
+	                if (errno == EINTR)
+	                    continue;
+	                break;
+	            }
+
+	            position += written;
+
+	            // skip the buffers which were completely written
+	            size_t left = size_t(written);
+	            while (index < count && left >= current.size)
+	            {
+	                left -= current.size;
+	                if (++index < count)
+	                {
+	                    current = buffers[index];
+	                }
+	            }
+
+	            if (index < count)
+	            {
+	                if (!written)
+	                    break;
+
+	                current.address += left;
+	                current.size -= left;
+	            }
+	        }
+
+	        // keep the stdio file position in sync
+	        fseeko(m_file, position, SEEK_SET);
+	    }
 	};
 
     // -----------------------------------------------------------------
@@ -155,5 +223,10 @@ namespace filesystem {
 		m_handle->write(data, size);
     }
 
+    void FileStream::writev(const ConstMemory* buffers, size_t count)
+    {
+		m_handle->writev(buffers, count);
+    }
+
 } // namespace filesystem
 } // namespace mango
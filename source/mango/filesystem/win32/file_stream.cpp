@@ -167,5 +167,14 @@ namespace filesystem {
 		m_handle->write(data, size);
     }
 
+    void FileStream::writev(const ConstMemory* buffers, size_t count)
+    {
+        // NOTE: WriteFileGather() requires page sized and aligned buffers
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_handle->write(buffers[i].address, buffers[i].size);
+        }
+    }
+
 } // namespace filesystem
 } // namespace mango
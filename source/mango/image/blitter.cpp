@@ -3,12 +3,17 @@
     Copyright (C) 2012-2017 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <map>
+#include <mutex>
+#include <memory>
+#include <algorithm>
 #include <mango/core/system.hpp>
+#include <mango/core/exception.hpp>
 #include <mango/core/cpuinfo.hpp>
 #include <mango/core/half.hpp>
 #include <mango/image/blitter.hpp>
 #include <mango/math/vector.hpp>
 #include <mango/math/srgb.hpp>
+#include "../core/target.hpp"
 
 namespace
 {
@@ -170,450 +175,766 @@ namespace
     loss. Such conversions are supported for symmetry only, application which knows the mapping
     of HDR to LDR should do the tone mapping using more advanced algorithm.
 
-    The design is a trade-off between code size and performance. The Optimum solution would be to
-    generate the conversion code using JIT techniques. LLVM offers a great infrastructure for this.
-    The generated conversion functions can also have more state to affect the conversion so it
-    is practical to support wider range of formats than these basic facilities we offer here.
+    The design is a trade-off between code size and performance. The common conversions have
+    custom functions; every other conversion is composed from a small set of stages at runtime
+    (see Blitter Engine v2) instead of generating the code with JIT techniques.
 
     TODO:
-    - blitter can handle all UNORM conversions
-    - other types will be handled by generic/slow path
-    - generic/slow path will have optional LLVM JIT optimizer
-    - palette to rgba conversions
     - ui16 and ui32 component formats
     - 1, 2 and 4 bit packed luminance formats (alignment to at least 8 bits)
 
     */
 
     // ----------------------------------------------------------------------------
-    // macros
+    // Blitter Engine v2
     // ----------------------------------------------------------------------------
 
     /*
 
-    The MODEMASK system below requires little explanation. The pixelformat conversion
-    code uses a hash value to classify the different conversion routines. The MAKE_MODEMASK
-    macro computes the hash using # of bits for color components. The UNORM formats use bits
-    from 1 to 32. Thus, the FP16 and FP32 are assigned synthetic bit values of 40 and 48.
-
-    The hash is computed using multiplies of 8 bits and begins from zero, resulting in hash codes
-    to be computed according to the following table:
-
-    ------------------------------------
-    Hash     Format
-    ------------------------------------
-     0       8 bit unorm colors
-     1       16 bit unorm colors
-     2       24 bit unorm colors
-     3       32 bit unorm colors
-     4       16 bit half components
-     5       32 bit float components
-     6       16 bit unorm components
-     7       32 bit unorm components
-
-    Colors store all components in the specified number of bits, for example, 16 bit unorm color will pack
-    the red, green, blue and alpha into 16 bit unsigned integer. The component formats use exactly specified
-    number of bits per color component. This arrangement allows efficient memory access patterns for reading
-    and writing data in the conversion loops.
-
-    The hash allows efficient conversion function lookup. All possible  conversions are not yet supported. :_(
+    The conversions without a custom function are decomposed into stages:
+
+    load     source pixels -> 32 bit words (two words for 5 to 8 byte pixels)
+    unpack   words -> normalized float components (UNORM)
+             pixels -> float components (FLOAT16, FLOAT32)
+    convert  missing components, luminance
+    pack     float components -> words (UNORM)
+             float components -> pixels (FLOAT16, FLOAT32)
+    store    words -> destination pixels
+
+    The stages run on blocks of pixels and keep every component in a plane of floats,
+    so the unpack and pack stages process four pixels per instruction. The swizzle is
+    resolved when the plan is built: the pack stage reads the plane of the matching
+    source component, a missing component reads a constant plane and the identical
+    color components of a luminance source share one plane.
+
+    The plans are built once per format pair and cached (see BlitPlan).
 
     */
 
-	// TODO: support FP64 in the blitter
+    constexpr int BLIT_BLOCK = 64;
+
+    enum
+    {
+        // planes 0..3 are the source components
+        PLANE_LUMA = 4,
+        PLANE_ZERO = 5,
+        PLANE_ONE = 6,
+        PLANE_COUNT = 7
+    };
+
+    struct BlitBlock
+    {
+        alignas(16) u32 word[2][BLIT_BLOCK];
+        alignas(16) float plane[PLANE_COUNT][BLIT_BLOCK];
 
-#define BITS_FP16 40  /* (32 + 8), half is at index 4    */
-#define BITS_FP32 48  /* (32 + 16), float is at index 5  */
-#define BITS_UI16  56 /* (32 + 24), u16 is at index 6 */
-#define BITS_UI32  64 /* (32 + 32), u32 is at index 7 */
-#define MAKE_MODEMASK(destBits, sourceBits) \
-    ((((destBits - 8) / 8) * 8) + ((sourceBits - 8) / 8))
+        BlitBlock()
+        {
+            std::fill_n(plane[PLANE_ZERO], BLIT_BLOCK, 0.0f);
+            std::fill_n(plane[PLANE_ONE], BLIT_BLOCK, 1.0f);
+        }
+    };
 
-    int modeBits(const Format& format)
+    struct BlitChannel
     {
-        int bits = 0;
+        // UNORM: the component is (word[index] >> offset) & mask; a component which
+        // straddles the words or is 24 bits or wider has index -1 and is processed
+        // from the 64 bit pixel (offset is then the offset in the pixel).
+        // FLOAT16, FLOAT32: the component is element "index" of the pixel.
+        int index;
+        int offset;
+        u64 mask;
+    };
 
-        switch (format.type)
+    struct BlitLayout
+    {
+        Format::Type type;
+        int bytes;
+        int words;
+        bool luminance;
+        bool present[4];
+        BlitChannel channel[4];
+
+        bool init(const Format& format)
         {
-			case Format::UNORM:
-				bits = format.bits;
-				break;
-		
-			case Format::FLOAT16:
-				bits = BITS_FP16;
-				break;
+            type = format.type;
+            bytes = format.bytes();
+            words = bytes > 4 ? 2 : 1;
+            luminance = format.isLuminance();
+
+            if (format.isIndexed() || !format.bits || format.bits & 7)
+                return false;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                const int size = format.size[i];
+                const int offset = format.offset[i];
+
+                present[i] = size != 0;
+                channel[i].index = 0;
+                channel[i].offset = 0;
+                channel[i].mask = 0;
+
+                if (!size)
+                    continue;
+
+                switch (type)
+                {
+                    case Format::UNORM:
+                        if (bytes > 8 || size > 32 || offset + size > bytes * 8)
+                            return false;
+
+                        channel[i].mask = (u64(1) << size) - 1;
+
+                        if (size > 23 || (offset < 32 && offset + size > 32))
+                        {
+                            channel[i].index = -1;
+                            channel[i].offset = offset;
+                        }
+                        else
+                        {
+                            channel[i].index = offset / 32;
+                            channel[i].offset = offset % 32;
+                        }
+                        break;
 
-			case Format::FLOAT32:
-				bits = BITS_FP32;
-				break;
+                    case Format::FLOAT16:
+                    case Format::FLOAT32:
+                    {
+                        const int bits = type == Format::FLOAT16 ? 16 : 32;
+                        if (size != bits || offset % bits)
+                            return false;
+
+                        channel[i].index = offset / bits;
+                        break;
+                    }
 
-			case Format::FLOAT64:
-				// TODO: support FP64
-				break;
+                    default:
+                        return false;
+                }
+            }
 
-            default:
-                break;
+            return true;
         }
+    };
 
-        return bits;
+    // 4 pixels of up to 4 bytes <-> 32 bit words
+
+    template <int BYTES>
+    inline uint32x4 load_pixels(const u8* src)
+    {
+        u32 v[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            const u8* p = src + i * BYTES;
+            switch (BYTES)
+            {
+                case 1: v[i] = p[0]; break;
+                case 2: v[i] = uload16(p); break;
+                case 3: v[i] = uload16(p) | (u32(p[2]) << 16); break;
+                case 4: v[i] = uload32(p); break;
+            }
+        }
+        return simd::u32x4_uload(v);
     }
 
-    /*
-    template <typename FloatType>
-    inline u32 floatToByte(FloatType sample)
+    template <int BYTES>
+    inline void store_pixels(u8* dest, uint32x4 v)
     {
-        float v = float(sample);
-        v = clamp(v, 0.0f, 1.0f);
-        return u32(v * 255.0f + 0.5f);
+        u32 s[4];
+        simd::u32x4_ustore(s, v);
+        for (int i = 0; i < 4; ++i)
+        {
+            u8* p = dest + i * BYTES;
+            switch (BYTES)
+            {
+                case 1: p[0] = u8(s[i]); break;
+                case 2: ustore16(p, u16(s[i])); break;
+                case 3: ustore16(p, u16(s[i])); p[2] = u8(s[i] >> 16); break;
+                case 4: ustore32(p, s[i]); break;
+            }
+        }
     }
-    */
 
-    inline u32 packFloat(u32 mask, float v)
+#if defined(MANGO_ENABLE_SSE2)
+
+    template <>
+    inline uint32x4 load_pixels<1>(const u8* src)
     {
-        v = clamp(v, 0.0f, 1.0f);
-        const u32 lsb = mask ^ (mask - 1);
-        const float bias = lsb * 0.5f; // The rounding bias should be precomputed
-        return u32(v * mask + bias) & mask;
+        const __m128i zero = _mm_setzero_si128();
+        __m128i v = _mm_cvtsi32_si128(uload32(src));
+        v = _mm_unpacklo_epi8(v, zero);
+        v = _mm_unpacklo_epi16(v, zero);
+        return simd::u32x4(v);
     }
 
-    // ----------------------------------------------------------------------------
-    // debug print
-    // ----------------------------------------------------------------------------
-#if 0
-    void print(const Blitter& blitter)
+    template <>
+    inline uint32x4 load_pixels<2>(const u8* src)
     {
-        printf("Blitter \n");
-        printf("  components: %d\n", blitter.components);
-        for (int i = 0; i < blitter.components; ++i)
-        {
-            printf("    srcMask: 0x%x\n", blitter.component[i].srcMask);
-            printf("    destMask: 0x%x\n", blitter.component[i].destMask);
-            printf("    scale: %f\n", blitter.component[i].scale);
-            printf("    constant: %f\n", blitter.component[i].constant);
-            printf("    offset: %d\n", blitter.component[i].offset);
-        }
-        printf("  sampleSize: %d\n", blitter.sampleSize);
-        printf("  initMask: 0x%x\n", blitter.initMask);
-        printf("  copyMask: 0x%x\n", blitter.copyMask);
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+        v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+        return simd::u32x4(v);
     }
-#endif
 
-    // ----------------------------------------------------------------------------
-    // conversion templates
-    // ----------------------------------------------------------------------------
+    template <>
+    inline uint32x4 load_pixels<4>(const u8* src)
+    {
+        return simd::u32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    }
 
-    // unorm <- unorm
+    template <>
+    inline void store_pixels<1>(u8* dest, uint32x4 v)
+    {
+        // the words are at most 8 bits
+        __m128i s = _mm_packs_epi32(v.m, v.m);
+        s = _mm_packus_epi16(s, s);
+        ustore32(dest, _mm_cvtsi128_si32(s));
+    }
 
-    template <typename DestType, typename SourceType>
-    void convert_template_unorm_unorm_fpu(const Blitter& blitter, const BlitRect& rect)
+    template <>
+    inline void store_pixels<2>(u8* dest, uint32x4 v)
     {
-        u8* source = rect.src.address;
-        u8* dest = rect.dest.address;
+        __m128i s = v.m;
+        s = _mm_shufflelo_epi16(s, 0x08);
+        s = _mm_shufflehi_epi16(s, 0x08);
+        s = _mm_shuffle_epi32(s, 0x08);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dest), s);
+    }
 
-        for (int y = 0; y < rect.height; ++y)
-        {
-            const SourceType* src = reinterpret_cast<const SourceType*>(source);
-            DestType* dst = reinterpret_cast<DestType*>(dest);
+    template <>
+    inline void store_pixels<4>(u8* dest, uint32x4 v)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), v.m);
+    }
+
+#endif // MANGO_ENABLE_SSE2
 
-            for (int x = 0; x < rect.width; ++x)
+    // load
+
+    template <int BYTES>
+    void load_words(BlitBlock& block, const u8* src, int count)
+    {
+        u32* lo = block.word[0];
+        u32* hi = block.word[1];
+
+        if (BYTES <= 4)
+        {
+            for ( ; count >= 4; count -= 4)
             {
-                u32 s = src[x];
-                u32 v = blitter.initMask | (s & blitter.copyMask);
-                switch (blitter.components)
-                {
-                    case 4: v |= blitter.component[3].computePack(s);
-                    case 3: v |= blitter.component[2].computePack(s);
-                    case 2: v |= blitter.component[1].computePack(s);
-                    case 1: v |= blitter.component[0].computePack(s);
-                }
-                dst[x] = DestType(v);
+                simd::u32x4_ustore(lo, load_pixels<BYTES <= 4 ? BYTES : 4>(src));
+                src += BYTES * 4;
+                lo += 4;
+                hi += 4;
             }
+        }
 
-            source += rect.src.stride;
-            dest += rect.dest.stride;
+        for (int x = 0; x < count; ++x)
+        {
+            switch (BYTES)
+            {
+                case 1: lo[x] = src[0]; break;
+                case 2: lo[x] = uload16(src); break;
+                case 3: lo[x] = uload16(src) | (u32(src[2]) << 16); break;
+                case 4: lo[x] = uload32(src); break;
+                case 5: lo[x] = uload32(src); hi[x] = src[4]; break;
+                case 6: lo[x] = uload32(src); hi[x] = uload16(src + 4); break;
+                case 7: lo[x] = uload32(src); hi[x] = uload16(src + 4) | (u32(src[6]) << 16); break;
+                case 8: lo[x] = uload32(src); hi[x] = uload32(src + 4); break;
+            }
+            src += BYTES;
         }
     }
 
-    // unorm <- fp
+    // store
 
-    template <typename DestType, typename SourceType>
-    void convert_template_unorm_fp_fpu(const Blitter& blitter, const BlitRect& rect)
+    template <int BYTES>
+    void store_words(u8* dest, const BlitBlock& block, int count)
     {
-        u8* source = rect.src.address;
-        u8* dest = rect.dest.address;
-
-        const Format& sf = blitter.srcFormat;
-        const Format& df = blitter.destFormat;
+        const u32* lo = block.word[0];
+        const u32* hi = block.word[1];
 
-        u32 mask[4];
-        int offset[4];
-        int components = 0;
+        if (BYTES <= 4)
+        {
+            for ( ; count >= 4; count -= 4)
+            {
+                store_pixels<BYTES <= 4 ? BYTES : 4>(dest, simd::u32x4_uload(lo));
+                dest += BYTES * 4;
+                lo += 4;
+                hi += 4;
+            }
+        }
 
-        for (int i = 0; i < 4; ++i)
+        for (int x = 0; x < count; ++x)
         {
-            if (df.size[i] && sf.size[i])
+            switch (BYTES)
             {
-                mask[components] = df.mask(i);
-                offset[components] = sf.offset[i] / (sizeof(SourceType) * 8);
-                ++components;
+                case 1: dest[0] = u8(lo[x]); break;
+                case 2: ustore16(dest, u16(lo[x])); break;
+                case 3: ustore16(dest, u16(lo[x])); dest[2] = u8(lo[x] >> 16); break;
+                case 4: ustore32(dest, lo[x]); break;
+                case 5: ustore32(dest, lo[x]); dest[4] = u8(hi[x]); break;
+                case 6: ustore32(dest, lo[x]); ustore16(dest + 4, u16(hi[x])); break;
+                case 7: ustore32(dest, lo[x]); ustore16(dest + 4, u16(hi[x])); dest[6] = u8(hi[x] >> 16); break;
+                case 8: ustore32(dest, lo[x]); ustore32(dest + 4, hi[x]); break;
             }
+            dest += BYTES;
         }
+    }
 
-        // default alpha is 1.0 (if destination does not have alpha the mask is 0)
-        u32 alphaMask = df.mask(3);
+    typedef void (*BlitLoadFunc)(BlitBlock& block, const u8* src, int count);
+    typedef void (*BlitStoreFunc)(u8* dest, const BlitBlock& block, int count);
 
-        // if source format has alpha channel use computed alpha instead of the default
-        if (sf.isAlpha())
-            alphaMask = 0;
+    BlitLoadFunc select_load(int bytes)
+    {
+        switch (bytes)
+        {
+            case 1: return load_words<1>;
+            case 2: return load_words<2>;
+            case 3: return load_words<3>;
+            case 4: return load_words<4>;
+            case 5: return load_words<5>;
+            case 6: return load_words<6>;
+            case 7: return load_words<7>;
+            case 8: return load_words<8>;
+        }
+        return nullptr;
+    }
 
-        for (int y = 0; y < rect.height; ++y)
+    BlitStoreFunc select_store(int bytes)
+    {
+        switch (bytes)
         {
-            const SourceType* src = reinterpret_cast<const SourceType*>(source);
-            DestType* dst = reinterpret_cast<DestType*>(dest);
+            case 1: return store_words<1>;
+            case 2: return store_words<2>;
+            case 3: return store_words<3>;
+            case 4: return store_words<4>;
+            case 5: return store_words<5>;
+            case 6: return store_words<6>;
+            case 7: return store_words<7>;
+            case 8: return store_words<8>;
+        }
+        return nullptr;
+    }
 
-            for (int x = 0; x < rect.width; ++x)
-            {
-                u32 v = alphaMask;
+    // unpack / pack (UNORM)
 
-                switch (components)
-                {
-                    case 4: v |= packFloat(mask[3], src[offset[3]]);
-                    case 3: v |= packFloat(mask[2], src[offset[2]]);
-                    case 2: v |= packFloat(mask[1], src[offset[1]]);
-                    case 1: v |= packFloat(mask[0], src[offset[0]]);
-                }
+    // The blocks are processed in groups of four pixels; the planes and words have
+    // room for the rounded up count. The components are at most 23 bits, so the
+    // signed conversions are exact and a scaled full scale value cannot round
+    // past the mask.
 
-                src += components;
-                dst[x] = DestType(v);
-            }
+    void unpack_unorm(float* dest, const u32* src, int count, int offset, u32 mask)
+    {
+        const uint32x4 m(mask);
+        const float32x4 scale(float(1.0 / mask));
 
-            source += rect.src.stride;
-            dest += rect.dest.stride;
+        for (int x = 0; x < count; x += 4)
+        {
+            uint32x4 v = simd::u32x4_uload(src + x);
+            v = (v >> offset) & m;
+            float32x4 f = convert<float32x4>(reinterpret<int32x4>(v)) * scale;
+            simd::f32x4_ustore(dest + x, f);
         }
     }
 
-    // fp <- unorm
+    void pack_unorm(u32* dest, const float* src, int count, int offset, u32 mask)
+    {
+        const float32x4 scale = float(mask);
+
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 f = simd::f32x4_uload(src + x);
+            f = clamp(f, 0.0f, 1.0f) * scale;
+            uint32x4 v = reinterpret<uint32x4>(convert<int32x4>(f)) << offset;
+            v = v | uint32x4(simd::u32x4_uload(dest + x));
+            simd::u32x4_ustore(dest + x, v);
+        }
+    }
+
+    // components of 24 bits or wider lose precision in single precision floats
 
-    template <typename DestType, typename SourceType>
-    void convert_template_fp_unorm_fpu(const Blitter& blitter, const BlitRect& rect)
+    void unpack_unorm_wide(float* dest, const BlitBlock& block, int count, int offset, u64 mask)
     {
-        MANGO_UNREFERENCED(blitter);
+        const double scale = 1.0 / double(mask);
 
-        u8* source = rect.src.address;
-        u8* dest = rect.dest.address;
+        for (int x = 0; x < count; ++x)
+        {
+            const u64 v = block.word[0][x] | (u64(block.word[1][x]) << 32);
+            dest[x] = float(double((v >> offset) & mask) * scale);
+        }
+    }
 
-        for (int y = 0; y < rect.height; ++y)
+    void pack_unorm_wide(BlitBlock& block, const float* src, int count, int offset, u64 mask)
+    {
+        for (int x = 0; x < count; ++x)
         {
-            const SourceType* src = reinterpret_cast<const SourceType*>(source);
-            DestType* dst = reinterpret_cast<DestType*>(dest);
+            const double c = clamp(double(src[x]), 0.0, 1.0);
+            const u64 v = u64(c * double(mask) + 0.5) << offset;
+            block.word[0][x] |= u32(v);
+            block.word[1][x] |= u32(v >> 32);
+        }
+    }
 
-            for (int x = 0; x < rect.width; ++x)
-            {
-                // TODO
-                MANGO_UNREFERENCED(src);
-                MANGO_UNREFERENCED(dst);
-            }
+    // unpack / pack (FLOAT16, FLOAT32)
 
-            source += rect.src.stride;
-            dest += rect.dest.stride;
+    void unpack_float32(float* dest, const u8* src, int count, int stride, int index)
+    {
+        const float* s = reinterpret_cast<const float*>(src) + index;
+
+        for (int x = 0; x < count; ++x)
+        {
+            dest[x] = s[x * stride];
         }
     }
 
-    // fp <- fp
+    void pack_float32(u8* dest, const float* src, int count, int stride, int index)
+    {
+        float* d = reinterpret_cast<float*>(dest) + index;
+
+        for (int x = 0; x < count; ++x)
+        {
+            d[x * stride] = src[x];
+        }
+    }
 
-    template <typename DestType, typename SourceType>
-    void convert_template_fp_fp_fpu(const Blitter& blitter, const BlitRect& rect)
+    void unpack_float16(float* dest, const u8* src, int count, int stride, int index)
     {
-        u8* source = rect.src.address;
-        u8* dest = rect.dest.address;
+        const float16* s = reinterpret_cast<const float16*>(src) + index;
 
-        SourceType constant[4];
-        const SourceType* input[4];
-        int stride[4];
+        for (int x = 0; x < count; x += 4)
+        {
+            float16x4 h;
+            for (int i = 0; i < 4; ++i)
+            {
+                // the pixels past the count repeat the last pixel
+                h[i] = s[std::min(x + i, count - 1) * stride];
+            }
+            simd::f32x4_ustore(dest + x, convert<float32x4>(h));
+        }
+    }
 
-        const int components = std::min(4, blitter.components);
+    void pack_float16(u8* dest, const float* src, int count, int stride, int index)
+    {
+        float16* d = reinterpret_cast<float16*>(dest) + index;
 
-        for (int i = 0; i < components; ++i)
+        for (int x = 0; x < count; x += 4)
         {
-            int offset = blitter.component[i].offset;
-            if (offset < 0)
+            const float16x4 h = convert<float16x4>(float32x4(simd::f32x4_uload(src + x)));
+            const int n = std::min(4, count - x);
+            for (int i = 0; i < n; ++i)
             {
-                constant[i] = SourceType(blitter.component[i].constant);
-                input[i] = &constant[i];
-                stride[i] = 0;
+                d[(x + i) * stride] = h[i];
             }
-            else
+        }
+    }
+
+    // convert
+
+    void compute_luma(float* dest, const float* r, const float* g, const float* b, int count)
+    {
+        const float32x4 wr(0.299f);
+        const float32x4 wg(0.587f);
+        const float32x4 wb(0.114f);
+
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 s = float32x4(simd::f32x4_uload(r + x)) * wr;
+            s = madd(s, float32x4(simd::f32x4_uload(g + x)), wg);
+            s = madd(s, float32x4(simd::f32x4_uload(b + x)), wb);
+            simd::f32x4_ustore(dest + x, s);
+        }
+    }
+
+    // shuffle
+
+    // The conversions which only move bytes (the components have the same type and size
+    // in both formats) are a byte shuffle. A group is the number of pixels which fit in
+    // 16 bytes in both formats; the index has the source byte of every destination byte
+    // of a group (0x80 selects the constant).
+
+    struct BlitShuffle
+    {
+        int sourceBytes;
+        int destBytes;
+        int group;
+        u8 index[16];
+        u8 constant[16];
+    };
+
+    void shuffle_bytes(u8* dest, const u8* src, int count, const BlitShuffle& shuffle)
+    {
+        for (int x = 0; x < count; ++x)
+        {
+            for (int i = 0; i < shuffle.destBytes; ++i)
             {
-                stride[i] = blitter.sampleSize;
+                const u8 s = shuffle.index[i];
+                dest[i] = s & 0x80 ? shuffle.constant[i] : src[s];
             }
+
+            src += shuffle.sourceBytes;
+            dest += shuffle.destBytes;
         }
+    }
 
-#if 0
-        printf("components: %d\n", components);
-        for (int i = 0; i < components; ++i)
+#if defined(MANGO_ENABLE_TARGET_SSSE3)
+
+    MANGO_TARGET_SSSE3
+    void shuffle_bytes_ssse3(u8* dest, const u8* src, int count, const BlitShuffle& shuffle)
+    {
+        const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle.index));
+        const __m128i constant = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle.constant));
+
+        const int group = shuffle.group;
+        const int sourceStep = group * shuffle.sourceBytes;
+        const int destStep = group * shuffle.destBytes;
+
+        // the loads and stores are 16 bytes
+        for ( ; count * shuffle.sourceBytes >= 16 && count * shuffle.destBytes >= 16; count -= group)
         {
-            printf("  component[%d]:  .offset: %d,  .stride: %d \n",
-                i,
-                blitter.component[i].offset,
-                stride[i]);
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            v = _mm_or_si128(_mm_shuffle_epi8(v, index), constant);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), v);
+            src += sourceStep;
+            dest += destStep;
         }
-#endif
 
-        for (int y = 0; y < rect.height; ++y)
+        shuffle_bytes(dest, src, count, shuffle);
+    }
+
+#endif // MANGO_ENABLE_TARGET_SSSE3
+
+    typedef void (*BlitShuffleFunc)(u8* dest, const u8* src, int count, const BlitShuffle& shuffle);
+
+    // packed
+
+    // UNORM conversion between pixels of up to 32 bits. Four pixels are loaded into
+    // words, converted and stored in registers; only the components with a different
+    // size are scaled.
+
+    struct BlitPacked
+    {
+        struct Component
         {
-            const SourceType* src = reinterpret_cast<const SourceType*>(source);
-            DestType* dst = reinterpret_cast<DestType*>(dest);
+            int sourceOffset;
+            u32 sourceMask;
+            int destOffset;
+            float scale; // 0: same size
+        };
+
+        int components;
+        Component component[4];
+        u32 constant;
+    };
+
+    // The components are unrolled so that the constants stay in registers.
+
+    template <int N>
+    struct PackedComponents
+    {
+        enum { SIZE = N ? N : 1 };
 
-            for (int i = 0; i < components; ++i)
+        uint32x4 mask[SIZE];
+        float32x4 scale[SIZE];
+        int sourceOffset[SIZE];
+        int destOffset[SIZE];
+        bool exact[SIZE];
+        uint32x4 constant;
+
+        PackedComponents(const BlitPacked& packed)
+            : constant(packed.constant)
+        {
+            for (int i = 0; i < N; ++i)
             {
-                int offset = blitter.component[i].offset;
-                if (offset >= 0)
-                {
-                    input[i] = src + offset;
-                }
+                const BlitPacked::Component& c = packed.component[i];
+                mask[i] = uint32x4(c.sourceMask);
+                scale[i] = float32x4(c.scale);
+                sourceOffset[i] = c.sourceOffset;
+                destOffset[i] = c.destOffset;
+                exact[i] = !c.scale;
             }
+        }
+
+        uint32x4 apply(uint32x4 v) const
+        {
+            uint32x4 result = constant;
 
-            for (int x = 0; x < rect.width; ++x)
+            for (int i = 0; i < N; ++i)
             {
-                switch (components)
+                uint32x4 s = (v >> sourceOffset[i]) & mask[i];
+                if (!exact[i])
                 {
-                    case 4: dst[3] = *input[3]; input[3] += stride[3];
-                    case 3: dst[2] = *input[2]; input[2] += stride[2];
-                    case 2: dst[1] = *input[1]; input[1] += stride[1];
-                    case 1: dst[0] = *input[0]; input[0] += stride[0];
+                    float32x4 f = convert<float32x4>(reinterpret<int32x4>(s)) * scale[i];
+                    s = reinterpret<uint32x4>(convert<int32x4>(f));
                 }
-                dst += components;
+                result = result | (s << destOffset[i]);
             }
 
-            source += rect.src.stride;
-            dest += rect.dest.stride;
+            return result;
         }
-    }
+    };
+
+    template <int SOURCE, int DEST, int N>
+    void convert_packed(u8* dest, const u8* src, int count, const BlitPacked& packed)
+    {
+        const PackedComponents<N> components(packed);
 
-    Blitter::ConvertFunc convert_fpu(int modeMask)
-    {
-        Blitter::ConvertFunc func = nullptr;
-
-        switch (modeMask)
-        {
-            case MAKE_MODEMASK( 8,  8): func = convert_template_unorm_unorm_fpu<u8, u8>; break;
-            case MAKE_MODEMASK( 8, 16): func = convert_template_unorm_unorm_fpu<u8, u16>; break;
-            case MAKE_MODEMASK( 8, 24): func = convert_template_unorm_unorm_fpu<u8, u24>; break;
-            case MAKE_MODEMASK( 8, 32): func = convert_template_unorm_unorm_fpu<u8, u32>; break;
-            case MAKE_MODEMASK(16,  8): func = convert_template_unorm_unorm_fpu<u16, u8>; break;
-            case MAKE_MODEMASK(16, 16): func = convert_template_unorm_unorm_fpu<u16, u16>; break;
-            case MAKE_MODEMASK(16, 24): func = convert_template_unorm_unorm_fpu<u16, u24>; break;
-            case MAKE_MODEMASK(16, 32): func = convert_template_unorm_unorm_fpu<u16, u32>; break;
-            case MAKE_MODEMASK(24,  8): func = convert_template_unorm_unorm_fpu<u24, u8>; break;
-            case MAKE_MODEMASK(24, 16): func = convert_template_unorm_unorm_fpu<u24, u16>; break;
-            case MAKE_MODEMASK(24, 24): func = convert_template_unorm_unorm_fpu<u24, u24>; break;
-            case MAKE_MODEMASK(24, 32): func = convert_template_unorm_unorm_fpu<u24, u32>; break;
-            case MAKE_MODEMASK(32,  8): func = convert_template_unorm_unorm_fpu<u32, u8>; break;
-            case MAKE_MODEMASK(32, 16): func = convert_template_unorm_unorm_fpu<u32, u16>; break;
-            case MAKE_MODEMASK(32, 24): func = convert_template_unorm_unorm_fpu<u32, u24>; break;
-            case MAKE_MODEMASK(32, 32): func = convert_template_unorm_unorm_fpu<u32, u32>; break;
-            case MAKE_MODEMASK( 8, BITS_FP16): func = convert_template_unorm_fp_fpu<u8, float16>; break;
-            case MAKE_MODEMASK(16, BITS_FP16): func = convert_template_unorm_fp_fpu<u16, float16>; break;
-            case MAKE_MODEMASK(24, BITS_FP16): func = convert_template_unorm_fp_fpu<u24, float16>; break;
-            case MAKE_MODEMASK(32, BITS_FP16): func = convert_template_unorm_fp_fpu<u32, float16>; break;
-            case MAKE_MODEMASK( 8, BITS_FP32): func = convert_template_unorm_fp_fpu<u8, float>; break;
-            case MAKE_MODEMASK(16, BITS_FP32): func = convert_template_unorm_fp_fpu<u16, float>; break;
-            case MAKE_MODEMASK(24, BITS_FP32): func = convert_template_unorm_fp_fpu<u24, float>; break;
-            case MAKE_MODEMASK(32, BITS_FP32): func = convert_template_unorm_fp_fpu<u32, float>; break;
-            case MAKE_MODEMASK(BITS_FP16,  8): func = convert_template_fp_unorm_fpu<float16, u8>; break;
-            case MAKE_MODEMASK(BITS_FP16, 16): func = convert_template_fp_unorm_fpu<float16, u16>; break;
-            case MAKE_MODEMASK(BITS_FP16, 24): func = convert_template_fp_unorm_fpu<float16, u24>; break;
-            case MAKE_MODEMASK(BITS_FP16, 32): func = convert_template_fp_unorm_fpu<float16, u32>; break;
-            case MAKE_MODEMASK(BITS_FP32,  8): func = convert_template_fp_unorm_fpu<float, u8>; break;
-            case MAKE_MODEMASK(BITS_FP32, 16): func = convert_template_fp_unorm_fpu<float, u16>; break;
-            case MAKE_MODEMASK(BITS_FP32, 24): func = convert_template_fp_unorm_fpu<float, u24>; break;
-            case MAKE_MODEMASK(BITS_FP32, 32): func = convert_template_fp_unorm_fpu<float, u32>; break;
-            case MAKE_MODEMASK(BITS_FP16, BITS_FP16): func = convert_template_fp_fp_fpu<float16, float16>; break;
-            case MAKE_MODEMASK(BITS_FP16, BITS_FP32): func = convert_template_fp_fp_fpu<float16, float>; break;
-            case MAKE_MODEMASK(BITS_FP32, BITS_FP16): func = convert_template_fp_fp_fpu<float, float16>; break;
-            case MAKE_MODEMASK(BITS_FP32, BITS_FP32): func = convert_template_fp_fp_fpu<float, float>; break;
+        for ( ; count >= 4; count -= 4)
+        {
+            uint32x4 v = load_pixels<SOURCE>(src);
+            store_pixels<DEST>(dest, components.apply(v));
+            src += SOURCE * 4;
+            dest += DEST * 4;
         }
 
-        return func;
+        if (count > 0)
+        {
+            u8 temp[16] = { 0 };
+            std::memcpy(temp, src, count * SOURCE);
+            uint32x4 v = load_pixels<SOURCE>(temp);
+            store_pixels<DEST>(temp, components.apply(v));
+            std::memcpy(dest, temp, count * DEST);
+        }
     }
 
-#ifdef MANGO_ENABLE_SSE2
-    template <typename DestType, typename SourceType>
-    void convert_template_sse2(const Blitter& blitter, const BlitRect& rect)
+    typedef void (*BlitPackedFunc)(u8* dest, const u8* src, int count, const BlitPacked& packed);
+
+    template <int SOURCE, int DEST>
+    BlitPackedFunc select_packed(int components)
     {
-        u8* source = rect.src.address;
-        u8* dest = rect.dest.address;
+        switch (components)
+        {
+            case 0: return convert_packed<SOURCE, DEST, 0>;
+            case 1: return convert_packed<SOURCE, DEST, 1>;
+            case 2: return convert_packed<SOURCE, DEST, 2>;
+            case 3: return convert_packed<SOURCE, DEST, 3>;
+            case 4: return convert_packed<SOURCE, DEST, 4>;
+        }
+        return nullptr;
+    }
 
-        __m128 scale = blitter.sseScale;
-        __m128i src_mask = blitter.sseSrcMask;
-        __m128i dest_mask = blitter.sseDestMask;
-        __m128i shift_mask = blitter.sseShiftMask;
+    template <int SOURCE>
+    BlitPackedFunc select_packed(int destBytes, int components)
+    {
+        switch (destBytes)
+        {
+            case 1: return select_packed<SOURCE, 1>(components);
+            case 2: return select_packed<SOURCE, 2>(components);
+            case 3: return select_packed<SOURCE, 3>(components);
+            case 4: return select_packed<SOURCE, 4>(components);
+        }
+        return nullptr;
+    }
 
-        for (int y = 0; y < rect.height; ++y)
+    BlitPackedFunc select_packed(int destBytes, int sourceBytes, int components)
+    {
+        switch (sourceBytes)
         {
-            SourceType* src = reinterpret_cast<SourceType*>(source);
-            DestType* dst = reinterpret_cast<DestType*>(dest);
+            case 1: return select_packed<1>(destBytes, components);
+            case 2: return select_packed<2>(destBytes, components);
+            case 3: return select_packed<3>(destBytes, components);
+            case 4: return select_packed<4>(destBytes, components);
+        }
+        return nullptr;
+    }
 
-            for (int x = 0; x < rect.width; ++x)
-            {
-                u32 s = src[x];
-                __m128i r = _mm_set1_epi32(s);
-                __m128 m = _mm_cvtepi32_ps(_mm_and_si128(r, src_mask));
-                r = _mm_cvtps_epi32(_mm_mul_ps(m, scale));
-                r = _mm_and_si128(r, dest_mask);
-                r = _mm_add_epi32(r, _mm_and_si128(r, shift_mask));
-                r = _mm_or_si128(_mm_shuffle_epi32(r, 0x44), _mm_shuffle_epi32(r, 0xee));
-                r = _mm_or_si128(_mm_shuffle_epi32(r, 0x00), _mm_shuffle_epi32(r, 0x55));
-                u32 v = blitter.initMask | _mm_cvtsi128_si32(r);
-                dst[x] = DestType(v);
-            }
+    void convert_custom(const Blitter& blitter, const BlitRect& rect)
+    {
+        u8* src = rect.src.address;
+        u8* dest = rect.dest.address;
 
-            source += rect.src.stride;
+        for (int y = 0; y < rect.height; ++y)
+        {
+            blitter.custom(dest, src, rect.width);
+            src += rect.src.stride;
             dest += rect.dest.stride;
         }
     }
 
-    Blitter::ConvertFunc convert_sse2(int modeMask)
+    // ----------------------------------------------------------------------------
+    // indexed conversion
+    // ----------------------------------------------------------------------------
+
+    // The index table has the destination pixels for every value of a source byte,
+    // so each source byte is converted with one copy of N bytes.
+
+    template <int N>
+    void convert_indexed_template(const Blitter& blitter, const BlitRect& rect)
     {
-        Blitter::ConvertFunc func = nullptr;
+        const u8* table = blitter.indexTable.data();
+        const int count = rect.width / blitter.indexPixels;
+        const int tail = (rect.width - count * blitter.indexPixels) * blitter.destFormat.bytes();
+
+        u8* src = rect.src.address;
+        u8* dest = rect.dest.address;
 
-        switch (modeMask)
+        for (int y = 0; y < rect.height; ++y)
         {
-            case MAKE_MODEMASK( 8,  8): func = convert_template_sse2<u8, u8>; break;
-            case MAKE_MODEMASK( 8, 16): func = convert_template_sse2<u8, u16>; break;
-            case MAKE_MODEMASK( 8, 24): func = convert_template_sse2<u8, u24>; break;
-            case MAKE_MODEMASK( 8, 32): func = convert_template_sse2<u8, u32>; break;
-            case MAKE_MODEMASK(16,  8): func = convert_template_sse2<u16, u8>; break;
-            case MAKE_MODEMASK(16, 16): func = convert_template_sse2<u16, u16>; break;
-            case MAKE_MODEMASK(16, 24): func = convert_template_sse2<u16, u24>; break;
-            case MAKE_MODEMASK(16, 32): func = convert_template_sse2<u16, u32>; break;
-            case MAKE_MODEMASK(24,  8): func = convert_template_sse2<u24, u8>; break;
-            case MAKE_MODEMASK(24, 16): func = convert_template_sse2<u24, u16>; break;
-            case MAKE_MODEMASK(24, 24): func = convert_template_sse2<u24, u24>; break;
-            case MAKE_MODEMASK(24, 32): func = convert_template_sse2<u24, u32>; break;
-            case MAKE_MODEMASK(32,  8): func = convert_template_sse2<u32, u8>; break;
-            case MAKE_MODEMASK(32, 16): func = convert_template_sse2<u32, u16>; break;
-            case MAKE_MODEMASK(32, 24): func = convert_template_sse2<u32, u24>; break;
-            case MAKE_MODEMASK(32, 32): func = convert_template_sse2<u32, u32>; break;
-        }
+            u8* d = dest;
 
-        return func;
+            for (int x = 0; x < count; ++x)
+            {
+                std::memcpy(d, table + src[x] * N, N);
+                d += N;
+            }
+
+            if (tail)
+            {
+                std::memcpy(d, table + src[count] * N, tail);
+            }
+
+            src += rect.src.stride;
+            dest += rect.dest.stride;
+        }
     }
-#endif
 
-    void convert_custom(const Blitter& blitter, const BlitRect& rect)
+    void convert_indexed(const Blitter& blitter, const BlitRect& rect)
     {
+        const u8* table = blitter.indexTable.data();
+        const int size = blitter.indexPixels * blitter.destFormat.bytes();
+        const int count = rect.width / blitter.indexPixels;
+        const int tail = (rect.width - count * blitter.indexPixels) * blitter.destFormat.bytes();
+
         u8* src = rect.src.address;
         u8* dest = rect.dest.address;
 
         for (int y = 0; y < rect.height; ++y)
         {
-            blitter.custom(dest, src, rect.width);
+            u8* d = dest;
+
+            for (int x = 0; x < count; ++x)
+            {
+                std::memcpy(d, table + src[x] * size, size);
+                d += size;
+            }
+
+            if (tail)
+            {
+                std::memcpy(d, table + src[count] * size, tail);
+            }
+
             src += rect.src.stride;
             dest += rect.dest.stride;
         }
     }
 
+    Blitter::ConvertFunc select_indexed(int size)
+    {
+        switch (size)
+        {
+            case 1: return convert_indexed_template<1>;
+            case 2: return convert_indexed_template<2>;
+            case 3: return convert_indexed_template<3>;
+            case 4: return convert_indexed_template<4>;
+            case 6: return convert_indexed_template<6>;
+            case 8: return convert_indexed_template<8>;
+            case 12: return convert_indexed_template<12>;
+            case 16: return convert_indexed_template<16>;
+            case 24: return convert_indexed_template<24>;
+            case 32: return convert_indexed_template<32>;
+            case 64: return convert_indexed_template<64>;
+            default: return convert_indexed;
+        }
+    }
+
     // ----------------------------------------------------------------------------
     // custom conversion functions
     // ----------------------------------------------------------------------------
@@ -963,8 +1284,159 @@ namespace
         }
     }
 
+#if defined(MANGO_ENABLE_TARGET_SSSE3)
+
     // ----------------------------------------------------------------------------
-    // custom conversion function lookup
+    // SSSE3 custom conversion functions
+    // ----------------------------------------------------------------------------
+
+    MANGO_TARGET_SSSE3
+    void blit_bgra8888_to_and_from_rgba8888_ssse3(u8* dest, const u8* src, int count)
+    {
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+        for ( ; count >= 4; count -= 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_shuffle_epi8(v, mask));
+            src += 16;
+            dest += 16;
+        }
+
+        blit_bgra8888_to_and_from_rgba8888(dest, src, count);
+    }
+
+    // expand 16 pixels from 24 to 32 bits; the last load is offset by 4 bytes
+    // so that it stays inside the 48 byte source block
+
+    static inline MANGO_TARGET_SSSE3
+    void expand_24to32_ssse3(u8* dest, const u8* src, __m128i mask0, __m128i mask1, __m128i alpha)
+    {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+        __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24));
+        __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+        __m128i* d = reinterpret_cast<__m128i*>(dest);
+        _mm_storeu_si128(d + 0, _mm_or_si128(_mm_shuffle_epi8(v0, mask0), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(v1, mask0), alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(v2, mask0), alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(v3, mask1), alpha));
+    }
+
+    // pack 16 pixels from 32 to 24 bits
+
+    static inline MANGO_TARGET_SSSE3
+    void pack_32to24_ssse3(u8* dest, const u8* src, __m128i mask)
+    {
+        const __m128i* s = reinterpret_cast<const __m128i*>(src);
+        __m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128(s + 0), mask);
+        __m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128(s + 1), mask);
+        __m128i v2 = _mm_shuffle_epi8(_mm_loadu_si128(s + 2), mask);
+        __m128i v3 = _mm_shuffle_epi8(_mm_loadu_si128(s + 3), mask);
+        __m128i* d = reinterpret_cast<__m128i*>(dest);
+        _mm_storeu_si128(d + 0, _mm_or_si128(v0, _mm_slli_si128(v1, 12)));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_srli_si128(v1, 4), _mm_slli_si128(v2, 8)));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_srli_si128(v2, 8), _mm_slli_si128(v3, 4)));
+    }
+
+    MANGO_TARGET_SSSE3
+    void blit_bgra8888_from_bgr888_ssse3(u8* dest, const u8* src, int count)
+    {
+        constexpr u8 n = 0x80;
+        const __m128i mask0 = _mm_setr_epi8(0, 1, 2, n, 3, 4, 5, n, 6, 7, 8, n, 9, 10, 11, n);
+        const __m128i mask1 = _mm_setr_epi8(4, 5, 6, n, 7, 8, 9, n, 10, 11, 12, n, 13, 14, 15, n);
+        const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+        for ( ; count >= 16; count -= 16)
+        {
+            expand_24to32_ssse3(dest, src, mask0, mask1, alpha);
+            src += 48;
+            dest += 64;
+        }
+
+        blit_bgra8888_from_bgr888(dest, src, count);
+    }
+
+    MANGO_TARGET_SSSE3
+    void blit_rgba8888_from_bgr888_ssse3(u8* dest, const u8* src, int count)
+    {
+        constexpr u8 n = 0x80;
+        const __m128i mask0 = _mm_setr_epi8(2, 1, 0, n, 5, 4, 3, n, 8, 7, 6, n, 11, 10, 9, n);
+        const __m128i mask1 = _mm_setr_epi8(6, 5, 4, n, 9, 8, 7, n, 12, 11, 10, n, 15, 14, 13, n);
+        const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+        for ( ; count >= 16; count -= 16)
+        {
+            expand_24to32_ssse3(dest, src, mask0, mask1, alpha);
+            src += 48;
+            dest += 64;
+        }
+
+        blit_rgba8888_from_bgr888(dest, src, count);
+    }
+
+    MANGO_TARGET_SSSE3
+    void blit_bgr888_from_bgra8888_ssse3(u8* dest, const u8* src, int count)
+    {
+        constexpr u8 n = 0x80;
+        const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, n, n, n, n);
+
+        for ( ; count >= 16; count -= 16)
+        {
+            pack_32to24_ssse3(dest, src, mask);
+            src += 64;
+            dest += 48;
+        }
+
+        blit_bgr888_from_bgra8888(dest, src, count);
+    }
+
+    MANGO_TARGET_SSSE3
+    void blit_rgb888_from_bgra8888_ssse3(u8* dest, const u8* src, int count)
+    {
+        constexpr u8 n = 0x80;
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, n, n, n, n);
+
+        for ( ; count >= 16; count -= 16)
+        {
+            pack_32to24_ssse3(dest, src, mask);
+            src += 64;
+            dest += 48;
+        }
+
+        blit_rgb888_from_bgra8888(dest, src, count);
+    }
+
+#endif // MANGO_ENABLE_TARGET_SSSE3
+
+#if defined(MANGO_ENABLE_TARGET_AVX2)
+
+    // ----------------------------------------------------------------------------
+    // AVX2 custom conversion functions
+    // ----------------------------------------------------------------------------
+
+    MANGO_TARGET_AVX2
+    void blit_bgra8888_to_and_from_rgba8888_avx2(u8* dest, const u8* src, int count)
+    {
+        const __m256i mask = _mm256_setr_epi8(
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+        for ( ; count >= 8; count -= 8)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), _mm256_shuffle_epi8(v, mask));
+            src += 32;
+            dest += 32;
+        }
+
+        blit_bgra8888_to_and_from_rgba8888(dest, src, count);
+    }
+
+#endif // MANGO_ENABLE_TARGET_AVX2
+
+    // ----------------------------------------------------------------------------
+    // custom conversion function lookup
     // ----------------------------------------------------------------------------
 
     // list of custom conversion functions
@@ -972,7 +1444,7 @@ namespace
     {
         Format dest;
         Format source;
-        u32 requireCpuFeature;
+        u64 requireCpuFeature;
         Blitter::FastFunc func;
     }
     const g_custom_func_table[] =
@@ -1015,15 +1487,33 @@ namespace
         { FORMAT_B8G8R8A8, FORMAT_RGBA32F,    0, blit_bgra8888_from_rgba32f },
         { FORMAT_RGBA16F,  FORMAT_RGBA32F,    0, blit_rgba16f_from_rgba32f },
         { FORMAT_RGBA32F,  FORMAT_RGBA16F,    0, blit_rgba32f_from_rgba16f },
+#if defined(MANGO_ENABLE_TARGET_SSSE3)
+        { FORMAT_B8G8R8X8, FORMAT_R8G8B8X8,   CPU_SSSE3, blit_bgra8888_to_and_from_rgba8888_ssse3 },
+        { FORMAT_R8G8B8X8, FORMAT_B8G8R8X8,   CPU_SSSE3, blit_bgra8888_to_and_from_rgba8888_ssse3 },
+        { FORMAT_B8G8R8A8, FORMAT_R8G8B8A8,   CPU_SSSE3, blit_bgra8888_to_and_from_rgba8888_ssse3 },
+        { FORMAT_R8G8B8A8, FORMAT_B8G8R8A8,   CPU_SSSE3, blit_bgra8888_to_and_from_rgba8888_ssse3 },
+        { FORMAT_B8G8R8A8, FORMAT_B8G8R8,     CPU_SSSE3, blit_bgra8888_from_bgr888_ssse3 },
+        { FORMAT_B8G8R8A8, FORMAT_R8G8B8,     CPU_SSSE3, blit_rgba8888_from_bgr888_ssse3 },
+        { FORMAT_B8G8R8,   FORMAT_B8G8R8A8,   CPU_SSSE3, blit_bgr888_from_bgra8888_ssse3 },
+        { FORMAT_R8G8B8,   FORMAT_B8G8R8A8,   CPU_SSSE3, blit_rgb888_from_bgra8888_ssse3 },
+#endif
+#if defined(MANGO_ENABLE_TARGET_AVX2)
+        { FORMAT_B8G8R8X8, FORMAT_R8G8B8X8,   CPU_AVX2, blit_bgra8888_to_and_from_rgba8888_avx2 },
+        { FORMAT_R8G8B8X8, FORMAT_B8G8R8X8,   CPU_AVX2, blit_bgra8888_to_and_from_rgba8888_avx2 },
+        { FORMAT_B8G8R8A8, FORMAT_R8G8B8A8,   CPU_AVX2, blit_bgra8888_to_and_from_rgba8888_avx2 },
+        { FORMAT_R8G8B8A8, FORMAT_B8G8R8A8,   CPU_AVX2, blit_bgra8888_to_and_from_rgba8888_avx2 },
+#endif
     };
 
     typedef std::map< std::pair<Format, Format>, Blitter::FastFunc > FastConversionMap;
 
     // initialize map of custom conversion functions
+    // (the table is ordered so that later entries with supported features override earlier ones)
     FastConversionMap g_custom_func_map = [] {
         FastConversionMap map;
 
         u64 cpuFlags = getCPUFlags();
+        u64 selected = 0;
 
         const int table_size = sizeof(g_custom_func_table) / sizeof(g_custom_func_table[0]);
 
@@ -1031,12 +1521,21 @@ namespace
         {
             const auto& node = g_custom_func_table[i];
 
-            if (!node.requireCpuFeature || (cpuFlags & node.requireCpuFeature) != 0)
+            if ((cpuFlags & node.requireCpuFeature) == node.requireCpuFeature)
             {
                 map[std::make_pair(node.dest, node.source)] = node.func;
+                selected |= node.requireCpuFeature;
             }
         }
 
+        const char* variant = "generic";
+        if (selected & CPU_AVX2)
+            variant = "AVX2";
+        else if (selected & CPU_SSSE3)
+            variant = "SSSE3";
+
+        setDispatchVariant("blitter", variant);
+
         return map;
     } ();
 
@@ -1078,185 +1577,487 @@ namespace mango
 {
 
     // ----------------------------------------------------------------------------
-    // Blitter
+    // BlitPlan
     // ----------------------------------------------------------------------------
 
-    Blitter::Blitter(const Format& dest, const Format& source)
-        : srcFormat(source)
-        , destFormat(dest)
-        , custom(nullptr)
-        , convertFunc(nullptr)
+    // A plan selects the cheapest path which can do the conversion:
+    //
+    // SHUFFLE   byte shuffle (the components only move)
+    // PACKED    load -> convert -> store in registers (UNORM, up to 32 bits)
+    // PLANES    load -> unpack -> convert -> pack -> store (everything else)
+
+    struct BlitPlan
     {
-        custom = find_custom_blitter(dest, source);
-        if (custom)
+        enum Path
         {
-            // found custom blitter
-            convertFunc = convert_custom;
-            return;
-        }
+            SHUFFLE,
+            PACKED,
+            PLANES
+        };
+
+        Path path;
+
+        BlitLayout source;
+        BlitLayout dest;
 
-        components = 0;
-        initMask = 0;
-        copyMask = 0;
+        BlitShuffle shuffle;
+        BlitShuffleFunc shuffleFunc;
 
-        sampleSize = 0;
+        BlitPacked packed;
+        BlitPackedFunc packedFunc;
 
-        const int source_float_shift = source.type - Format::FLOAT16 + 4;
+        BlitLoadFunc load;
+        BlitStoreFunc store;
 
-        if (dest.isFloat() && source.isFloat())
+        // source plane of the destination components
+        int plane[4];
+
+        // the source components which are unpacked into their planes
+        bool unpack[4];
+
+        // the planes of the color components when the luma is computed
+        bool luma;
+        int color[3];
+
+        bool init(const Format& destFormat, const Format& sourceFormat)
         {
+            if (!source.init(sourceFormat) || !dest.init(destFormat))
+                return false;
+
+            load = source.type == Format::UNORM ? select_load(source.bytes) : nullptr;
+            store = dest.type == Format::UNORM ? select_store(dest.bytes) : nullptr;
+
             for (int i = 0; i < 4; ++i)
             {
-                if (dest.size[i])
-                {
-                    // not used in float to float blitting
-                    component[components].srcMask = 0;
-                    component[components].destMask = 0;
-                    component[components].scale = 1.0f;
-                    component[components].bias = 0.0f;
+                unpack[i] = false;
 
-                    component[components].constant = i == 3 ? 1.0f : 0.0f;
-                    component[components].offset = source.size[i] ? source.offset[i] >> source_float_shift : -1;
+                if (!source.present[i])
+                {
+                    // missing color is zero and missing alpha is one
+                    plane[i] = i == 3 ? PLANE_ONE : PLANE_ZERO;
+                    continue;
+                }
 
-                    if (source.size[i])
-                        ++sampleSize;
+                plane[i] = i;
+                unpack[i] = true;
 
-                    ++components;
+                for (int j = 0; j < i; ++j)
+                {
+                    // identical components (luminance) are unpacked once
+                    const BlitChannel& a = source.channel[i];
+                    const BlitChannel& b = source.channel[j];
+                    if (source.present[j] && a.index == b.index && a.offset == b.offset && a.mask == b.mask)
+                    {
+                        plane[i] = plane[j];
+                        unpack[i] = false;
+                        break;
+                    }
                 }
             }
 
-            // select innerloop
-            int destBits = modeBits(dest);
-            int sourceBits = modeBits(source);
-            int modeMask = MAKE_MODEMASK(destBits, sourceBits);
+            // a luminance destination stores the luma into the red component
+            luma = dest.luminance && !source.luminance;
+            if (luma)
+            {
+                color[0] = plane[0];
+                color[1] = plane[1];
+                color[2] = plane[2];
+                plane[0] = PLANE_LUMA;
+            }
 
-            convertFunc = convert_fpu(modeMask);
+            if (initShuffle(destFormat, sourceFormat))
+            {
+                path = SHUFFLE;
+            }
+            else if (initPacked())
+            {
+                path = PACKED;
+            }
+            else
+            {
+                path = PLANES;
+            }
 
-            return;
+            return true;
         }
 
-        for (int i = 0; i < 4; ++i)
+        bool initShuffle(const Format& destFormat, const Format& sourceFormat)
         {
-            u32 src_mask = source.mask(i);
-            u32 dest_mask = dest.mask(i);
+            if (luma || source.type != dest.type || source.bytes > 16 || dest.bytes > 16)
+                return false;
+
+            u8 index[16];
+            u8 constant[16];
+
+            std::fill_n(index, 16, 0x80);
+            std::fill_n(constant, 16, 0);
 
-            if (dest_mask)
+            for (int i = 0; i < 4; ++i)
             {
-                if (src_mask != dest_mask)
+                const int size = destFormat.size[i];
+                const int offset = destFormat.offset[i];
+
+                if (!size)
+                    continue;
+
+                if (size & 7 || offset & 7)
+                    return false;
+
+                if (!sourceFormat.size[i])
                 {
-                    if (src_mask)
+                    if (i == 3)
                     {
-                        // isolate least significant bit of mask; this is used for correct rounding
-                        const u32 lsb = dest_mask ^ (dest_mask - 1);
+                        // missing alpha is one
+                        u32 one = 0xffffffff;
+                        if (dest.type == Format::FLOAT16)
+                            one = 0x3c00;
+                        else if (dest.type == Format::FLOAT32)
+                            one = 0x3f800000;
+                        std::memcpy(constant + offset / 8, &one, size / 8);
+                    }
+                    continue;
+                }
 
-                        // source and destination are different: add channel to component array
-                        component[components].srcMask = src_mask;
-                        component[components].destMask = dest_mask;
-                        component[components].scale = float(dest_mask) / float(src_mask);
-                        component[components].bias = lsb * 0.5f;
+                if (sourceFormat.size[i] != size || sourceFormat.offset[i] & 7)
+                    return false;
 
-                        component[components].constant = i == 3 ? 1.0f : 0.0f;
-                        component[components].offset = source.offset[i] >> source_float_shift;
+                for (int j = 0; j < size / 8; ++j)
+                {
+                    index[offset / 8 + j] = u8(sourceFormat.offset[i] / 8 + j);
+                }
+            }
 
-                        if (source.size[i])
-                            ++sampleSize;
+            shuffle.sourceBytes = source.bytes;
+            shuffle.destBytes = dest.bytes;
+            shuffle.group = 16 / std::max(source.bytes, dest.bytes);
 
-                        ++components;
-                    }
-                    else
-                    {
-                        // no source channel
-                        const bool is_alpha_channel = (i == 3);
-                        if (is_alpha_channel)
-                        {
-                            // alpha defaults to 1.0 (all bits of destination are set)
-                            initMask |= dest_mask;
-                        }
-                        else
-                        {
-                            // color defaults to 0.0
-                        }
-                    }
+            std::fill_n(shuffle.index, 16, 0x80);
+            std::fill_n(shuffle.constant, 16, 0);
+
+            for (int x = 0; x < shuffle.group; ++x)
+            {
+                for (int j = 0; j < dest.bytes; ++j)
+                {
+                    const int k = x * dest.bytes + j;
+                    shuffle.index[k] = index[j] & 0x80 ? 0x80 : u8(x * source.bytes + index[j]);
+                    shuffle.constant[k] = constant[j];
                 }
-                else
+            }
+
+            shuffleFunc = shuffle_bytes;
+
+#if defined(MANGO_ENABLE_TARGET_SSSE3)
+            if (getCPUFlags() & CPU_SSSE3)
+            {
+                shuffleFunc = shuffle_bytes_ssse3;
+            }
+#endif
+
+            return true;
+        }
+
+        bool initPacked()
+        {
+            if (luma || source.type != Format::UNORM || dest.type != Format::UNORM ||
+                source.bytes > 4 || dest.bytes > 4)
+                return false;
+
+            packed.components = 0;
+            packed.constant = 0;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!dest.present[i] || (dest.luminance && (i == 1 || i == 2)))
+                    continue;
+
+                const BlitChannel& d = dest.channel[i];
+                const BlitChannel& s = source.channel[i];
+
+                if (d.index < 0)
+                    return false;
+
+                if (!source.present[i])
                 {
-                    // identical masks: pass-through w/o expensive processing
-                    copyMask |= src_mask;
+                    if (i == 3)
+                        packed.constant |= u32(d.mask) << d.offset;
+                    continue;
                 }
+
+                if (s.index < 0)
+                    return false;
+
+                BlitPacked::Component& c = packed.component[packed.components++];
+
+                c.sourceOffset = s.offset;
+                c.sourceMask = u32(s.mask);
+                c.destOffset = d.offset;
+                c.scale = s.mask == d.mask ? 0.0f : float(double(d.mask) / double(s.mask));
             }
+
+            packedFunc = select_packed(dest.bytes, source.bytes, packed.components);
+
+            return true;
         }
 
-        u64 cpuFlags = getCPUFlags();
-        bool sse2 = (cpuFlags & CPU_SSE2) != 0;
+        void convert(u8* dst, const u8* src, int count, BlitBlock& block) const
+        {
+            switch (path)
+            {
+                case SHUFFLE:
+                    shuffleFunc(dst, src, count, shuffle);
+                    break;
+
+                case PACKED:
+                    packedFunc(dst, src, count, packed);
+                    break;
+
+                case PLANES:
+                    read(block, src, count);
+                    write(dst, block, count);
+                    break;
+            }
+        }
 
-        if (components < 2)
+        void read(BlitBlock& block, const u8* src, int count) const
         {
-            // the fpu loop is faster when we process only single channel
-            // the fpu can handle mask 0xffffffff where SSE will corrupt LSB when using 32 bit mask
-            sse2 = false; // force fpu conversion
+            if (load)
+            {
+                load(block, src, count);
+            }
+
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!unpack[i])
+                    continue;
+
+                const BlitChannel& channel = source.channel[i];
+                float* p = block.plane[i];
+
+                switch (source.type)
+                {
+                    case Format::UNORM:
+                        if (channel.index < 0)
+                            unpack_unorm_wide(p, block, count, channel.offset, channel.mask);
+                        else
+                            unpack_unorm(p, block.word[channel.index], count, channel.offset, u32(channel.mask));
+                        break;
+
+                    case Format::FLOAT16:
+                        unpack_float16(p, src, count, source.bytes / 2, channel.index);
+                        break;
+
+                    default:
+                        unpack_float32(p, src, count, source.bytes / 4, channel.index);
+                        break;
+                }
+            }
+
+            if (luma)
+            {
+                compute_luma(block.plane[PLANE_LUMA], block.plane[color[0]], block.plane[color[1]], block.plane[color[2]], count);
+            }
         }
 
-        // select innerloop
-        int destBits = modeBits(dest);
-        int sourceBits = modeBits(source);
-        int modeMask = MAKE_MODEMASK(destBits, sourceBits);
+        void write(u8* dst, BlitBlock& block, int count) const
+        {
+            if (store)
+            {
+                std::memset(block.word[0], 0, sizeof(block.word[0]));
+                if (dest.words > 1)
+                    std::memset(block.word[1], 0, sizeof(block.word[1]));
+            }
 
-        convertFunc = convert_fpu(modeMask);
+            for (int i = 0; i < 4; ++i)
+            {
+                // the color components of a luminance destination share the red component
+                if (!dest.present[i] || (dest.luminance && (i == 1 || i == 2)))
+                    continue;
+
+                const BlitChannel& channel = dest.channel[i];
+                const float* p = block.plane[plane[i]];
+
+                switch (dest.type)
+                {
+                    case Format::UNORM:
+                        if (channel.index < 0)
+                            pack_unorm_wide(block, p, count, channel.offset, channel.mask);
+                        else
+                            pack_unorm(block.word[channel.index], p, count, channel.offset, u32(channel.mask));
+                        break;
 
-#ifdef MANGO_ENABLE_SSE2
-        if (sse2)
+                    case Format::FLOAT16:
+                        pack_float16(dst, p, count, dest.bytes / 2, channel.index);
+                        break;
+
+                    default:
+                        pack_float32(dst, p, count, dest.bytes / 4, channel.index);
+                        break;
+                }
+            }
+
+            if (store)
+            {
+                store(dst, block, count);
+            }
+        }
+    };
+
+    namespace
+    {
+
+        std::mutex g_plan_mutex;
+        std::map< std::pair<Format, Format>, std::unique_ptr<BlitPlan> > g_plan_cache;
+
+        // the unsupported format pairs are cached as null plans
+        const BlitPlan* find_plan(const Format& dest, const Format& source)
         {
-            // select innerloop
-            ConvertFunc func = convert_sse2(modeMask);
+            std::lock_guard<std::mutex> lock(g_plan_mutex);
 
-            if (func)
+            const auto key = std::make_pair(dest, source);
+
+            auto i = g_plan_cache.find(key);
+            if (i != g_plan_cache.end())
             {
-                convertFunc = func;
+                return i->second.get();
+            }
 
-                initMask = 0;
+            std::unique_ptr<BlitPlan> plan(new BlitPlan());
+            if (!plan->init(dest, source))
+            {
+                plan.reset();
+            }
 
-                u32 shift_mask[4] = { 0, 0, 0, 0 };
-                u32 dest_mask[4];
-                u32 src_mask[4];
-                float scale[4];
+            const BlitPlan* result = plan.get();
+            g_plan_cache[key] = std::move(plan);
 
-                for (int i = 0; i < 4; ++i)
-                {
-                    src_mask[i] = source.mask(i);
-                    dest_mask[i] = dest.mask(i);
-                    scale[i] = 0;
+            return result;
+        }
 
-                    if (dest_mask[i])
-                    {
-                        if (src_mask[i])
-                        {
-                            scale[i] = float(dest_mask[i]) / float(src_mask[i]);
-                        }
-                        else if (i == 3)
-                        {
-                            initMask |= dest_mask[i];
-                        }
-                    }
+        void convert_plan(const Blitter& blitter, const BlitRect& rect)
+        {
+            const BlitPlan& plan = *blitter.plan;
 
-                    // SSE floatToInt conversion is signed
-                    if (dest_mask[i] & 0x80000000)
-                    {
-                        dest_mask[i] >>= 1;
-                        shift_mask[i] = dest_mask[i];
-                        scale[i] *= 0.5f;
-                    }
+            const int sourceBytes = plan.source.bytes;
+            const int destBytes = plan.dest.bytes;
+
+            BlitBlock block;
+
+            u8* src = rect.src.address;
+            u8* dest = rect.dest.address;
+
+            // only the planes are processed in blocks
+            const int blockSize = plan.path == BlitPlan::PLANES ? BLIT_BLOCK : rect.width;
+
+            for (int y = 0; y < rect.height; ++y)
+            {
+                for (int x = 0; x < rect.width; x += blockSize)
+                {
+                    const int count = std::min(blockSize, rect.width - x);
+                    plan.convert(dest + x * destBytes, src + x * sourceBytes, count, block);
                 }
 
-                // convert components into SSE registers
-                sseScale = _mm_set_ps(scale[0], scale[1], scale[2], scale[3]);
-                sseSrcMask = _mm_set_epi32(src_mask[0], src_mask[1], src_mask[2], src_mask[3]);
-                sseDestMask = _mm_set_epi32(dest_mask[0], dest_mask[1], dest_mask[2], dest_mask[3]);
-                sseShiftMask = _mm_set_epi32(shift_mask[0], shift_mask[1], shift_mask[2], shift_mask[3]);
+                src += rect.src.stride;
+                dest += rect.dest.stride;
             }
         }
-#else
-        MANGO_UNREFERENCED(sse2);
-#endif
+
+    } // namespace
+
+    // ----------------------------------------------------------------------------
+    // Blitter
+    // ----------------------------------------------------------------------------
+
+    Blitter::Blitter(const Format& dest, const Format& source)
+        : srcFormat(source)
+        , destFormat(dest)
+        , custom(nullptr)
+        , convertFunc(nullptr)
+        , plan(nullptr)
+        , indexPixels(0)
+    {
+        custom = find_custom_blitter(dest, source);
+        if (custom)
+        {
+            // found custom blitter
+            convertFunc = convert_custom;
+            return;
+        }
+
+        // staged conversion
+        plan = find_plan(dest, source);
+        if (plan)
+        {
+            convertFunc = convert_plan;
+        }
+    }
+
+    Blitter::Blitter(const Format& dest, const Format& source, const Palette& palette)
+        : srcFormat(source)
+        , destFormat(dest)
+        , custom(nullptr)
+        , convertFunc(nullptr)
+        , plan(nullptr)
+        , indexPixels(0)
+    {
+        const int bits = source.bits;
+
+        if (!source.isIndexed() || (bits != 1 && bits != 2 && bits != 4 && bits != 8))
+        {
+            MANGO_EXCEPTION("[Blitter] The source must be 1, 2, 4 or 8 bit indexed.");
+        }
+
+        const int bytes = dest.bytes();
+
+        // destination pixels of the palette entries
+        std::vector<u8> colors(256 * bytes);
+
+        if (dest.isIndexed())
+        {
+            if (dest.bits != 8)
+            {
+                MANGO_EXCEPTION("[Blitter] The indexed destination must be 8 bits.");
+            }
+
+            for (int i = 0; i < 256; ++i)
+            {
+                colors[i] = u8(i);
+            }
+        }
+        else
+        {
+            BlitRect rect;
+
+            rect.src.address = const_cast<u8*>(reinterpret_cast<const u8*>(palette.color));
+            rect.src.stride = 256 * 4;
+            rect.dest.address = colors.data();
+            rect.dest.stride = 256 * bytes;
+            rect.width = 256;
+            rect.height = 1;
+
+            Blitter blitter(dest, FORMAT_B8G8R8A8);
+            blitter.convert(rect);
+        }
+
+        // destination pixels of every source byte
+        indexPixels = 8 / bits;
+
+        const int size = indexPixels * bytes;
+        const u32 mask = (1 << bits) - 1;
+
+        indexTable.resize(256 * size);
+
+        for (int value = 0; value < 256; ++value)
+        {
+            u8* d = indexTable.data() + value * size;
+
+            for (int i = 0; i < indexPixels; ++i)
+            {
+                const u32 index = (value >> (8 - bits * (i + 1))) & mask;
+                std::memcpy(d + i * bytes, colors.data() + index * bytes, bytes);
+            }
+        }
+
+        convertFunc = select_indexed(size);
     }
 
     Blitter::~Blitter()
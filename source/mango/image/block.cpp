@@ -1182,6 +1182,26 @@ namespace mango
                     Surface source(surface, x * width, y * height, width, height);
                     temp.blit(0, 0, source);
 
+                    // partial blocks on the right and bottom edges repeat the last column and row
+                    if (source.width < width || source.height < height)
+                    {
+                        const int pixelBytes = format.bytes();
+
+                        for (int i = 0; i < source.height; ++i)
+                        {
+                            u8* scan = temp.address<u8>(0, i);
+                            for (int j = source.width; j < width; ++j)
+                            {
+                                std::memcpy(scan + j * pixelBytes, scan + (source.width - 1) * pixelBytes, pixelBytes);
+                            }
+                        }
+
+                        for (int i = source.height; i < height; ++i)
+                        {
+                            std::memcpy(temp.address<u8>(0, i), temp.address<u8>(0, source.height - 1), width * pixelBytes);
+                        }
+                    }
+
                     u8* image = temp.address<u8>();
                     encode(*this, data, image, temp.stride);
                     data += bytes;
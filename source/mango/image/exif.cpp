@@ -6,6 +6,7 @@
 #include <cmath>
 #include <mango/core/endian.hpp>
 #include <mango/image/exif.hpp>
+#include <mango/image/transform.hpp>
 
 namespace
 {
@@ -726,4 +727,23 @@ namespace image {
     }
 
 } // namespace image
+
+    ImageTransform getImageTransform(int orientation)
+    {
+        static const ImageTransform table [] =
+        {
+            ImageTransform::NONE,
+            ImageTransform::NONE,            // 1: top-left
+            ImageTransform::FLIP_HORIZONTAL, // 2: top-right
+            ImageTransform::ROTATE_180,      // 3: bottom-right
+            ImageTransform::FLIP_VERTICAL,   // 4: bottom-left
+            ImageTransform::TRANSPOSE,       // 5: left-top
+            ImageTransform::ROTATE_90,       // 6: right-top
+            ImageTransform::TRANSVERSE,      // 7: right-bottom
+            ImageTransform::ROTATE_270,      // 8: left-bottom
+        };
+
+        return orientation >= 1 && orientation <= 8 ? table[orientation] : ImageTransform::NONE;
+    }
+
 } // namespace mango
@@ -206,10 +206,116 @@ namespace mango
         return func != nullptr;
     }
 
+    // ----------------------------------------------------------------------------
+    // ImageDecodeRegion
+    // ----------------------------------------------------------------------------
+
+    ImageDecodeRegion::ImageDecodeRegion(Surface& dest, const ImageDecodeOptions& options, int image_width, int image_height)
+        : m_dest(dest)
+        , m_options(options)
+    {
+        const ImageDecodeOptions::Region& region = options.region;
+
+        if (region.width > 0 && region.height > 0)
+        {
+            const int x0 = std::max(region.x, 0);
+            const int y0 = std::max(region.y, 0);
+            const int x1 = std::min(region.x + region.width, image_width);
+            const int y1 = std::min(region.y + region.height, image_height);
+
+            x = x0;
+            y = y0;
+            width = std::max(x1 - x0, 0);
+            height = std::max(y1 - y0, 0);
+        }
+        else
+        {
+            x = 0;
+            y = 0;
+            width = image_width;
+            height = image_height;
+        }
+
+        m_whole = !options.callback && width == image_width && height == image_height;
+    }
+
+    ImageDecodeRegion::~ImageDecodeRegion()
+    {
+    }
+
+    bool ImageDecodeRegion::isWhole() const
+    {
+        return m_whole;
+    }
+
+    bool ImageDecodeRegion::isBand() const
+    {
+        return bool(m_options.callback);
+    }
+
+    void ImageDecodeRegion::write(const Surface& source, int x0, int y0)
+    {
+        // intersect the source with the region
+        const int left = std::max(x, x0);
+        const int top = std::max(y, y0);
+        const int right = std::min(x + width, x0 + source.width);
+        const int bottom = std::min(y + height, y0 + source.height);
+
+        if (left >= right || top >= bottom)
+        {
+            return;
+        }
+
+        Surface s(source, left - x0, top - y0, right - left, bottom - top);
+
+        if (!m_options.callback)
+        {
+            m_dest.blit(left - x, top - y, s);
+        }
+        else if (s.format == m_dest.format)
+        {
+            m_options.callback(s, top - y);
+        }
+        else
+        {
+            Bitmap temp(s.width, s.height, m_dest.format);
+            temp.blit(0, 0, s);
+            m_options.callback(temp, top - y);
+        }
+    }
+
     // ----------------------------------------------------------------------------
     // ImageDecoderInterface
     // ----------------------------------------------------------------------------
 
+    ImageHeader ImageDecoderInterface::header(const ImageDecodeOptions& options)
+    {
+        MANGO_UNREFERENCED(options);
+        return header();
+    }
+
+    ImageDecodeStatus ImageDecoderInterface::decode(Surface& dest, const ImageDecodeOptions& options, int level, int depth, int face)
+    {
+        ImageHeader temp = header();
+        ImageDecodeRegion region(dest, options, temp.width, temp.height);
+
+        if (region.isWhole())
+        {
+            return decode(dest, options.palette, level, depth, face);
+        }
+
+        // decoders without region support decode the whole image and crop it
+        Bitmap bitmap(temp.width, temp.height, dest.format);
+        ImageDecodeStatus status = decode(bitmap, options.palette, level, depth, face);
+        if (status.success)
+        {
+            region.write(bitmap, 0, 0);
+        }
+
+        status.direct = false;
+        return status;
+    }
+
     ConstMemory ImageDecoderInterface::memory(int level, int depth, int face)
     {
         MANGO_UNREFERENCED(level);
@@ -267,6 +373,22 @@ namespace mango
         return header;
     }
 
+    ImageHeader ImageDecoder::header(const ImageDecodeOptions& options)
+    {
+        ImageHeader header;
+
+        if (!m_interface)
+        {
+            header.setError("[WARNING] ImageDecoder::header() is not supported for this extension.");
+        }
+        else
+        {
+            header = m_interface->header(options);
+        }
+
+        return header;
+    }
+
     ImageDecodeStatus ImageDecoder::decode(Surface& dest, const ImageDecodeOptions& options, int level, int depth, int face)
     {
         ImageDecodeStatus status;
@@ -277,7 +399,7 @@ namespace mango
         }
         else
         {
-            status = m_interface->decode(dest, options.palette, level, depth, face);
+            status = m_interface->decode(dest, options, level, depth, face);
         }
 
         return status;
@@ -94,16 +94,8 @@ namespace
 
     void resolve_palette(Surface& s, int width, int height, const u8* image, const Palette& palette)
     {
-        for (int y = 0; y < height; ++y)
-        {
-            ColorBGRA* scan = s.address<ColorBGRA>(0, y);
-            const u8* src = image + y * width;
-
-            for (int x = 0; x < width; ++x)
-            {
-                scan[x] = palette[src[x]];
-            }
-        }
+        Surface indices(width, height, IndexedFormat(8), width, const_cast<u8*>(image));
+        s.blit(0, 0, indices, palette);
     }
 
     // ------------------------------------------------------------
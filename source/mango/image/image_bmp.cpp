@@ -605,31 +605,11 @@ namespace
         }
     }
 
-    void readIndexed(Surface& surface, const BitmapHeader& header, int stride, const u8* data)
+    void readIndexed(const Surface& surface, const BitmapHeader& header, int stride, const u8* data, const Palette& palette)
     {
-        const int bits = header.bitsPerPixel;
-        const u32 mask = (1 << bits) - 1;
-
-        for (int y = 0; y < header.height; ++y)
-        {
-            BigEndianConstPointer p(data + y * stride);
-            u8* dest = surface.address<u8>(0, y);
-
-            u32 value = 0;
-            int left = 0;
-
-            for (int x = 0; x < header.width; ++x)
-            {
-                if (!left)
-                {
-                    value = p.read32();
-                    left = 32;
-                }
-
-                left -= bits;
-                dest[x] = (value >> left) & mask;
-            }
-        }
+        // the blitter resolves the palette or, for indexed surface, unpacks the indices
+        Surface source(header.width, header.height, IndexedFormat(header.bitsPerPixel), stride, data);
+        surface.blit(0, 0, source, palette);
     }
 
     void readRGB(const Surface& surface, const BitmapHeader& header, int stride, const u8* data)
@@ -640,22 +620,8 @@ namespace
 
     void blitPalette(const Surface& dest, const Surface& indices, const Palette& palette)
     {
-        const int width = dest.width;
-        const int height = dest.height;
-
-        Bitmap temp(width, height, FORMAT_B8G8R8A8);
-
-        for (int y = 0; y < height; ++y)
-        {
-            u8* s = indices.address<u8>(0, y);
-            ColorBGRA* d = temp.address<ColorBGRA>(0, y);
-            for (int x = 0; x < width; ++x)
-            {
-                d[x] = palette[s[x]];
-            }
-        }
-
-        dest.blit(0, 0, temp);
+        Surface source(indices.width, indices.height, IndexedFormat(8), indices.stride, indices.image);
+        dest.blit(0, 0, source, palette);
     }
 
     const char* decodeBitmap(Surface& surface, ConstMemory memory, int offset, bool isIcon, Palette* ptr_palette)
@@ -719,14 +685,9 @@ namespace
                         if (ptr_palette)
                         {
                             *ptr_palette = palette;
-                            readIndexed(mirror, header, stride, data);
-                        }
-                        else
-                        {
-                            Bitmap temp(header.width, header.height, FORMAT_L8);
-                            readIndexed(temp, header, stride, data);
-                            blitPalette(mirror, temp, palette);
                         }
+
+                        readIndexed(mirror, header, stride, data, palette);
                         break;
                     }
 
@@ -56,16 +56,8 @@ namespace
 
     void resolve_palette(Surface& s, u8* data, int width, int height, const Palette& palette)
     {
-        for (int y = 0; y < height; ++y)
-        {
-            ColorBGRA* scan = s.address<ColorBGRA>(0, y);
-
-            for (int x = 0; x < width; ++x)
-            {
-                u8 index = *data++;
-                scan[x] = palette[index];
-            }
-        }
+        Surface indices(width, height, IndexedFormat(8), width, data);
+        s.blit(0, 0, indices, palette);
     }
 
     void rle_ecb(u8* buffer, const u8* input, int scansize, const u8* input_end, u8 escape_char)
@@ -291,18 +291,15 @@ namespace
 		}
 	}
 
-	void scanline_copy_indices(u8* dest, const u8* src, int width, const Palette& palette, u8 transparent)
+	void scanline_copy_indices(u8* dest, const u8* src, int width, u8 transparent)
 	{
-		MANGO_UNREFERENCED(palette);
 		MANGO_UNREFERENCED(transparent);
 
 		std::memcpy(dest, src, width);
 	}
 
-	void scanline_blend_indices(u8* dest, const u8* src, int width, const Palette& palette, u8 transparent)
+	void scanline_blend_indices(u8* dest, const u8* src, int width, u8 transparent)
 	{
-		MANGO_UNREFERENCED(palette);
-
 		for (int x = 0; x < width; ++x)
 		{
 			u8 sample = src[x];
@@ -313,35 +310,6 @@ namespace
 		}
 	}
 
-	void scanline_copy_palette(u8* dest8, const u8* src, int width, const Palette& palette, u8 transparent)
-	{
-		MANGO_UNREFERENCED(transparent);
-
-		u32* dest = reinterpret_cast<u32*>(dest8);
-
-		for (int x = 0; x < width; ++x)
-		{
-			u8 sample = src[x];
-			ColorBGRA color = palette[sample];
-			dest[x] = color;
-		}
-	}
-
-	void scanline_blend_palette(u8* dest8, const u8* src, int width, const Palette& palette, u8 transparent)
-	{
-		u32* dest = reinterpret_cast<u32*>(dest8);
-
-		for (int x = 0; x < width; ++x)
-		{
-			u8 sample = src[x];
-			if (sample != transparent)
-			{
-				ColorBGRA color = palette[sample];
-				dest[x] = color;
-			}
-		}
-	}
-
     const u8* read_image(const u8* data, const u8* end, 
 	                     gif_state& state, 
 	                     Surface& surface, Palette* ptr_palette)
@@ -411,27 +379,40 @@ namespace
 			bits.reset(temp);
 		}
 
-		void (*func)(u8*, const u8*, int , const Palette& , u8) = nullptr;
+		// NOTE: clipping happens with some image files; don't be too clever and "optimize" this later :)
+		Surface rect(surface, x, y, width, height);
+		if (!rect.width || !rect.height)
+			return data;
 
 		if (ptr_palette)
 		{
 			*ptr_palette = palette;
-			func = blend ? scanline_blend_indices : scanline_copy_indices;
+
+			void (*func)(u8*, const u8*, int, u8) = blend ? scanline_blend_indices : scanline_copy_indices;
+			const u8* src = bits.get();
+
+			for (int y = 0; y < rect.height; ++y)
+			{
+				u8* dest = rect.address<u8>(0, y);
+				func(dest, src, rect.width, transparent);
+				src += width;
+			}
 		}
 		else
 		{
-			func = blend ? scanline_blend_palette : scanline_copy_palette;
-		}
+			Surface indices(width, height, IndexedFormat(8), width, bits.get());
 
-		// NOTE: clipping happens with some image files; don't be too clever and "optimize" this later :)
-		Surface rect(surface, x, y, width, height);
-		u8* src = bits.get();
-
-		for (int y = 0; y < rect.height; ++y)
-		{
-			u8* dest = rect.address<u8>(0, y);
-			func(dest, src, rect.width, palette, transparent);
-			src += width;
+			if (blend)
+			{
+				// the transparent color has zero alpha and leaves the previous frame visible
+				Bitmap temp(rect.width, rect.height, FORMAT_B8G8R8A8);
+				temp.blit(0, 0, indices, palette);
+				composite(rect, temp, CompositeMode::OVER);
+			}
+			else
+			{
+				rect.blit(0, 0, indices, palette);
+			}
 		}
 
 		return data;
@@ -657,6 +638,7 @@ namespace
 		u8 data = 0;
 		int index = 0;
 
+		// chunk[0] is reserved for the chunk size
 		int chunkIndex = 0;
 		u8 chunk[256];
 
@@ -677,7 +659,7 @@ namespace
 
 				if (index > 7)
 				{
-					chunk[chunkIndex++] = data;
+					chunk[++chunkIndex] = data;
 					if (chunkIndex == 255)
 					{
 						flushChunk(s);
@@ -691,8 +673,8 @@ namespace
 
 		void flushChunk(LittleEndianStream& s)
 		{
-			s.write8(chunkIndex);
-			s.write(chunk, chunkIndex);
+			chunk[0] = u8(chunkIndex);
+			s.write(chunk, chunkIndex + 1);
 			chunkIndex = 0;
 		}
 
@@ -700,7 +682,7 @@ namespace
 		{
 			if (index)
 			{
-				chunk[chunkIndex++] = data;
+				chunk[++chunkIndex] = data;
 			}
 
 			if (chunkIndex > 0)
@@ -809,12 +791,14 @@ namespace
 		s.write8(0); // aspect ratio
 
 		// palette
+		u8 colors[256 * 3];
 		for (int i = 0; i < 256; ++i)
 		{
-			s.write8(palette[i].r);
-			s.write8(palette[i].g);
-			s.write8(palette[i].b);
+			colors[i * 3 + 0] = palette[i].r;
+			colors[i * 3 + 1] = palette[i].g;
+			colors[i * 3 + 2] = palette[i].b;
 		}
+		s.write(colors, 256 * 3);
 
 		// TODO: write graphics_control_extension to disable translucent color
 		// TODO: support the extension in decoder so that we don't have one index being invisible
@@ -862,6 +846,7 @@ namespace
     		Bitmap temp(surface.width, surface.height, IndexedFormat(8));
 
 			image::ColorQuantizeOptions quantize_options;
+			quantize_options.method = image::ColorQuantizeOptions::WU;
 			quantize_options.dithering = options.dithering;
 			quantize_options.quality = options.quality;
 
@@ -170,17 +170,6 @@ namespace
 		}
 	}
 
-    void expand_palette(u8* dest, const u8* src, int xsize, int ysize, const Palette& palette)
-    {
-        ColorBGRA* image = reinterpret_cast<ColorBGRA*>(dest);
-        int count = xsize * ysize;
-
-        for (int i = 0; i < count; ++i)
-        {
-            image[i] = palette[src[i]];
-        }
-    }
-
     enum Signature
     {
         SIGNATURE_IFF = 0,
@@ -486,6 +475,23 @@ namespace
                     std::memcpy(dest.image, raw.image, xsize * ysize);
                 }
             }
+            else if (nplanes <= 8 && !ham)
+            {
+                // the blitter resolves the palette into the destination format
+                if (is_pbm)
+                {
+                    // linear
+                    Surface indices(xsize, ysize, IndexedFormat(8), xsize, buffer);
+                    dest.blit(0, 0, indices, palette);
+                }
+                else
+                {
+                    // interlaced
+                    Bitmap raw(xsize, ysize, IndexedFormat(8));
+                    p2c_raw(raw.image, buffer, xsize, ysize, nplanes, mask);
+                    dest.blit(0, 0, raw, palette);
+                }
+            }
             else
             {
                 // choose pixelformat
@@ -497,34 +503,15 @@ namespace
                 {
                     p2c_ham(temp.image, buffer, xsize, ysize, nplanes, palette);
                 }
+                else if (is_pbm)
+                {
+                    // linear
+                    std::memcpy(temp.image, buffer, temp.stride * ysize);
+                }
                 else
                 {
-                    if (is_pbm)
-                    {
-                        // linear
-                        if (nplanes <= 8)
-                        {
-                            expand_palette(temp.image, buffer, xsize, ysize, palette);
-                        }
-                        else
-                        {
-                            std::memcpy(temp.image, buffer, temp.stride * ysize);
-                        }
-                    }
-                    else
-                    {
-                        // interlaced
-                        if (nplanes <= 8)
-                        {
-                            Bitmap raw(xsize, ysize, FORMAT_L8);
-                            p2c_raw(raw.image, buffer, xsize, ysize, nplanes, mask);
-                            expand_palette(temp.image, raw.image, xsize, ysize, palette);
-                        }
-                        else
-                        {
-                            p2c_raw(temp.image, buffer, xsize, ysize, nplanes, mask);
-                        }
-                    }
+                    // interlaced
+                    p2c_raw(temp.image, buffer, xsize, ysize, nplanes, mask);
                 }
 
 			    // NOTE: we could directly decode into dest if the formats match.
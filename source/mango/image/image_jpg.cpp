@@ -37,6 +37,11 @@ namespace
             return m_parser.header;
         }
 
+        ImageHeader header(const ImageDecodeOptions& options) override
+        {
+            return m_parser.getHeader(options.scale);
+        }
+
         ConstMemory icc() override
         {
             return Memory(m_parser.icc_buffer);
@@ -57,6 +62,16 @@ namespace
             ImageDecodeStatus status = m_parser.decode(dest);
             return status;
         }
+
+        ImageDecodeStatus decode(Surface& dest, const ImageDecodeOptions& options, int level, int depth, int face) override
+        {
+            MANGO_UNREFERENCED(level);
+            MANGO_UNREFERENCED(depth);
+            MANGO_UNREFERENCED(face);
+
+            ImageDecodeStatus status = m_parser.decode(dest, options);
+            return status;
+        }
     };
 
     ImageDecoderInterface* createInterface(ConstMemory memory)
@@ -71,7 +86,7 @@ namespace
 
     ImageEncodeStatus imageEncode(Stream& stream, const Surface& surface, const ImageEncodeOptions& options)
     {
-        ImageEncodeStatus status = jpeg::encodeImage(stream, surface, options.quality);
+        ImageEncodeStatus status = jpeg::encodeImage(stream, surface, options);
         return status;
     }
 
@@ -90,6 +105,12 @@ namespace mango
         registerImageEncoder(imageEncode, ".jpeg");
     }
 
+    ImageEncodeStatus transformJPEG(Stream& output, ConstMemory input, const ImageTransformOptions& options)
+    {
+        ImageEncodeStatus status = jpeg::transformImage(output, input, options);
+        return status;
+    }
+
 } // namespace mango
 
 #endif // MANGO_ENABLE_IMAGE_JPG
@@ -301,19 +301,9 @@ namespace
                             }
                             else
                             {
-                                Bitmap indices(width, height, FORMAT_L8);
+                                Bitmap indices(width, height, IndexedFormat(8));
                                 decode4(indices, buffer, scansize);
-
-                                for (int y = 0; y < height; ++y)
-                                {
-                                    u32* d = temp.address<u32>(0, y);
-                                    u8* s = indices.address<u8>(0, y);
-                                    for (int x = 0; x < width; ++x)
-                                    {
-                                        d[x] = palette[s[x]];
-                                    }
-                                }
-                                dest.blit(0, 0, temp);
+                                dest.blit(0, 0, indices, palette);
                             }
                             break;
                         }
@@ -356,24 +346,11 @@ namespace
                                 if (ptr_palette)
                                 {
                                     *ptr_palette = palette;
-                                    decode8(dest, buffer, scansize);
-                                }
-                                else
-                                {
-                                    Bitmap indices(width, height, FORMAT_L8);
-                                    decode8(indices, buffer, scansize);
-
-                                    for (int y = 0; y < height; ++y)
-                                    {
-                                        u32* d = temp.address<u32>(0, y);
-                                        u8* s = indices.address<u8>(0, y);
-                                        for (int x = 0; x < width; ++x)
-                                        {
-                                            d[x] = palette[s[x]];
-                                        }
-                                    }
-                                    dest.blit(0, 0, temp);
                                 }
+
+                                // the indices are resolved straight from the decoded scanlines
+                                Surface indices(width, height, IndexedFormat(8), scansize, buffer);
+                                dest.blit(0, 0, indices, palette);
                             }
                             else
                             {
@@ -7,6 +7,7 @@
 #include <mango/core/core.hpp>
 #include <mango/image/image.hpp>
 #include <mango/math/math.hpp>
+#include "../core/target.hpp"
 
 #ifdef MANGO_ENABLE_IMAGE_PNG
 
@@ -15,42 +16,25 @@
 
 // TODO: discard modes (requires us to keep a copy of main image)
 // TODO: check that animations starting with "IDAT" and "fdAT" work correctly
-// TODO: SIMD blending (not critical)
 
 static
 constexpr int FILTER_BYTE = 1;
 
+// scanlines decoded at a time in region and band decoding
+static
+constexpr int BAND_HEIGHT = 16;
+
+// the scanlines of the whole image are inflated, filtered and processed in bands of about this size
+static
+constexpr int SCANLINE_BUFFER_SIZE = 64 * 1024;
+
 // ------------------------------------------------------------
 // miniz
 // ------------------------------------------------------------
 
 #include "../../external/miniz/miniz.h"
 #undef crc32 // fix miniz pollution
-
-// ------------------------------------------------------------
-// stb zlib
-// ------------------------------------------------------------
-
-#define STBI_NO_STDIO
-#define STBI_NO_JPEG
-#define STBI_NO_BMP
-#define STBI_NO_PSD
-#define STBI_NO_PIC
-#define STBI_NO_TGA
-#define STBI_NO_GIF
-#define STBI_NO_PNM
-//#define STBI_NO_PNG
-//#define STBI_NO_HDR
-
-#define STBI_SUPPORT_ZLIB
-
-#define STBI_MALLOC(sz)           malloc(sz)
-#define STBI_REALLOC(p,newsz)     realloc(p,newsz)
-#define STBI_FREE(p)              free(p)
-
-#define STB_IMAGE_IMPLEMENTATION
-
-#include "../../external/stb/stb_image.h"
+#undef adler32
 
 namespace
 {
@@ -138,6 +122,17 @@ namespace
         }
     }
 
+    void filter_average_8bit(u8* scan, const u8* prev, int bytes, int bpp)
+    {
+        int a = 0;
+
+        for (int x = 0; x < bytes; ++x)
+        {
+            a = (scan[x] + ((a + prev[x]) >> 1)) & 0xff;
+            scan[x] = u8(a);
+        }
+    }
+
     void filter_paeth_8bit(u8* scan, const u8* prev, int bytes, int bpp)
     {
         int c = prev[0];
@@ -177,29 +172,86 @@ namespace
     // SSE2 Filters
     // -----------------------------------------------------------------------------------
 
-    inline int8x16 load4(const void* p)
+    // load and store one pixel into the low bytes of a register
+
+    template <int size>
+    inline int8x16 load_pixel(const void* p);
+
+    template <int size>
+    inline void store_pixel(void* p, __m128i v);
+
+    template <>
+    inline int8x16 load_pixel<2>(const void* p)
     {
-        u32 temp = uload32(p);
+        u32 temp = uload16(p);
         return int8x16(_mm_cvtsi32_si128(temp));
     }
 
-    inline void store4(void* p, __m128i v)
+    template <>
+    inline void store_pixel<2>(void* p, __m128i v)
     {
         u32 temp = _mm_cvtsi128_si32(v);
-        ustore32(p, temp);
+        ustore16(p, u16(temp));
+    }
+
+    template <>
+    inline int8x16 load_pixel<3>(const void* p)
+    {
+        // a memcpy through memory would stall on store forwarding
+        const u8* s = reinterpret_cast<const u8*>(p);
+        u32 temp = uload16(s) | (s[2] << 16);
+        return int8x16(_mm_cvtsi32_si128(temp));
     }
 
-    inline int8x16 load3(const void* p)
+    template <>
+    inline void store_pixel<3>(void* p, __m128i v)
     {
-        u32 temp = 0;
-        std::memcpy(&temp, p, 3);
+        u8* d = reinterpret_cast<u8*>(p);
+        u32 temp = _mm_cvtsi128_si32(v);
+        ustore16(d, u16(temp));
+        d[2] = u8(temp >> 16);
+    }
+
+    template <>
+    inline int8x16 load_pixel<4>(const void* p)
+    {
+        u32 temp = uload32(p);
         return int8x16(_mm_cvtsi32_si128(temp));
     }
 
-    inline void store3(void* p, __m128i v)
+    template <>
+    inline void store_pixel<4>(void* p, __m128i v)
     {
         u32 temp = _mm_cvtsi128_si32(v);
-        std::memcpy(p, &temp, 3);
+        ustore32(p, temp);
+    }
+
+    template <>
+    inline int8x16 load_pixel<6>(const void* p)
+    {
+        const u8* s = reinterpret_cast<const u8*>(p);
+        __m128i v = _mm_cvtsi32_si128(uload32(s));
+        return int8x16(_mm_insert_epi16(v, uload16(s + 4), 2));
+    }
+
+    template <>
+    inline void store_pixel<6>(void* p, __m128i v)
+    {
+        u8* d = reinterpret_cast<u8*>(p);
+        ustore32(d, _mm_cvtsi128_si32(v));
+        ustore16(d + 4, u16(_mm_extract_epi16(v, 2)));
+    }
+
+    template <>
+    inline int8x16 load_pixel<8>(const void* p)
+    {
+        return int8x16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+    }
+
+    template <>
+    inline void store_pixel<8>(void* p, __m128i v)
+    {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), v);
     }
 
     inline __m128i average_sse2(__m128i a, __m128i b, __m128i d)
@@ -210,7 +262,7 @@ namespace
         return d;
     }
 
-    inline int16x8 nearest_sse2(u8* scan, const u8* prev, __m128i zero, int16x8 a, int16x8 b, int16x8 c, int16x8 d)
+    inline int16x8 nearest_sse2(int16x8 a, int16x8 b, int16x8 c, int16x8 d)
     {
         int16x8 pa = b - c;
         int16x8 pb = a - c;
@@ -225,89 +277,161 @@ namespace
         return d;
     }
 
-    void filter_sub_24bit_sse2(u8* scan, const u8* prev, int bytes, int bpp)
+    // The sub filter of 8 and 16 bit samples is a prefix sum; each 16 byte block
+    // is summed in log2 steps and the last pixel of the previous block is added.
+
+    template <int size>
+    void filter_sub_prefix_sse2(u8* scan, const u8* prev, int bytes, int bpp)
     {
         MANGO_UNREFERENCED(prev);
 
-        __m128i d = _mm_setzero_si128();
+        __m128i last = _mm_setzero_si128();
+        int x = 0;
 
-        for (int x = 0; x < bytes; x += 3)
+        for ( ; x <= bytes - 16; x += 16)
         {
-            d = _mm_add_epi8(load3(scan + x), d);
-            store3(scan + x, d);
-        }
-    }
-
-    void filter_sub_32bit_sse2(u8* scan, const u8* prev, int bytes, int bpp)
-    {
-        MANGO_UNREFERENCED(prev);
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scan + x));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, size));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, size * 2));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, size * 4));
+            if (size == 1)
+            {
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+            }
+            v = _mm_add_epi8(v, last);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(scan + x), v);
 
-        __m128i d = _mm_setzero_si128();
+            // broadcast the last pixel
+            if (size == 1)
+            {
+                v = _mm_unpackhi_epi8(v, v);
+            }
+            last = _mm_shuffle_epi32(_mm_shufflehi_epi16(v, 0xff), 0xff);
+        }
 
-        for (int x = 0; x < bytes; x += 4)
+        for (x = std::max(x, size); x < bytes; ++x)
         {
-            d = _mm_add_epi8(load4(scan + x), d);
-            store4(scan + x, d);
+            scan[x] += scan[x - size];
         }
     }
 
-    void filter_average_24bit_sse2(u8* scan, const u8* prev, int bytes, int bpp)
+    template <int size>
+    void filter_sub_sse2(u8* scan, const u8* prev, int bytes, int bpp)
     {
+        MANGO_UNREFERENCED(prev);
+
         __m128i d = _mm_setzero_si128();
 
-        for (int x = 0; x < bytes; x += 3)
+        for (int x = 0; x < bytes; x += size)
         {
-            d = average_sse2(d, load3(prev + x), load3(scan + x));
-            store3(scan + x, d);
+            d = _mm_add_epi8(load_pixel<size>(scan + x), d);
+            store_pixel<size>(scan + x, d);
         }
     }
 
-    void filter_average_32bit_sse2(u8* scan, const u8* prev, int bytes, int bpp)
+    template <int size>
+    void filter_average_sse2(u8* scan, const u8* prev, int bytes, int bpp)
     {
         __m128i d = _mm_setzero_si128();
 
-        for (int x = 0; x < bytes; x += 4)
+        for (int x = 0; x < bytes; x += size)
         {
-            d = average_sse2(d, load4(prev + x), load4(scan + x));
-            store4(scan + x, d);
+            d = average_sse2(d, load_pixel<size>(prev + x), load_pixel<size>(scan + x));
+            store_pixel<size>(scan + x, d);
         }
     }
 
-    void filter_paeth_24bit_sse2(u8* scan, const u8* prev, int bytes, int bpp)
+    template <int size>
+    void filter_paeth_sse2(u8* scan, const u8* prev, int bytes, int bpp)
     {
         int8x16 zero = 0;
         int16x8 b = 0;
         int16x8 d = 0;
 
-        for (int x = 0; x < bytes; x += 3)
+        for (int x = 0; x < bytes; x += size)
         {
             int16x8 c = b;
             int16x8 a = d;
-            b = _mm_unpacklo_epi8(load3(prev + x), zero);
-            d = _mm_unpacklo_epi8(load3(scan + x), zero);
-            d = nearest_sse2(scan, prev, zero, a, b, c, d);
-            store3(scan + x, _mm_packus_epi16(d, d));
+            b = _mm_unpacklo_epi8(load_pixel<size>(prev + x), zero);
+            d = _mm_unpacklo_epi8(load_pixel<size>(scan + x), zero);
+            d = nearest_sse2(a, b, c, d);
+            store_pixel<size>(scan + x, _mm_packus_epi16(d, d));
         }
     }
 
-    void filter_paeth_32bit_sse2(u8* scan, const u8* prev, int bytes, int bpp)
+#endif // MANGO_ENABLE_SSE2
+
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+
+    // -----------------------------------------------------------------------------------
+    // SSSE3 Filters
+    // -----------------------------------------------------------------------------------
+
+    static inline MANGO_TARGET_SSSE3
+    __m128i nearest_ssse3(__m128i a, __m128i b, __m128i c, __m128i d)
+    {
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_add_epi16(pa, pb);
+        pa = _mm_abs_epi16(pa);
+        pb = _mm_abs_epi16(pb);
+        pc = _mm_abs_epi16(pc);
+        __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+        __m128i mask_a = _mm_cmpeq_epi16(smallest, pa);
+        __m128i mask_b = _mm_cmpeq_epi16(smallest, pb);
+        __m128i nearest = _mm_or_si128(_mm_and_si128(mask_b, b), _mm_andnot_si128(mask_b, c));
+        nearest = _mm_or_si128(_mm_and_si128(mask_a, a), _mm_andnot_si128(mask_a, nearest));
+        return _mm_add_epi8(d, nearest);
+    }
+
+    template <int size>
+    MANGO_TARGET_SSSE3
+    void filter_paeth_ssse3(u8* scan, const u8* prev, int bytes, int bpp)
     {
-        int8x16 zero = 0;
-        int16x8 b = 0;
-        int16x8 d = 0;
+        const __m128i zero = _mm_setzero_si128();
+        __m128i b = zero;
+        __m128i d = zero;
 
-        for (int x = 0; x < bytes; x += 4)
+        for (int x = 0; x < bytes; x += size)
         {
-            int16x8 c = b;
-            int16x8 a = d;
-            b = _mm_unpacklo_epi8(load4(prev + x), zero);
-            d = _mm_unpacklo_epi8(load4(scan + x), zero);
-            d = nearest_sse2(scan, prev, zero, a, b, c, d);
-            store4(scan + x, _mm_packus_epi16(d, d));
+            __m128i c = b;
+            __m128i a = d;
+            b = _mm_unpacklo_epi8(load_pixel<size>(prev + x), zero);
+            d = _mm_unpacklo_epi8(load_pixel<size>(scan + x), zero);
+            d = nearest_ssse3(a, b, c, d);
+            store_pixel<size>(scan + x, _mm_packus_epi16(d, d));
         }
     }
 
-#endif // MANGO_ENABLE_SSE2
+#endif // MANGO_ENABLE_TARGET_SSSE3
+
+#if defined(MANGO_ENABLE_TARGET_AVX2)
+
+    // -----------------------------------------------------------------------------------
+    // AVX2 Filters
+    // -----------------------------------------------------------------------------------
+
+    MANGO_TARGET_AVX2
+    void filter_up_avx2(u8* scan, const u8* prev, int bytes, int bpp)
+    {
+        MANGO_UNREFERENCED(bpp);
+
+        int x = 0;
+
+        for ( ; x <= bytes - 32; x += 32)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(scan + x));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + x));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(scan + x), _mm256_add_epi8(a, b));
+        }
+
+        for ( ; x < bytes; ++x)
+        {
+            scan[x] += prev[x];
+        }
+    }
+
+#endif // MANGO_ENABLE_TARGET_AVX2
 
 #if defined(MANGO_ENABLE_NEON__todo)
 
@@ -329,6 +453,69 @@ namespace
 
 #endif // MANGO_ENABLE_NEON
 
+    const DispatchVariant<FilterFunc> g_filter_up_variants[] =
+    {
+        { 0, "generic", filter_up },
+#if defined(MANGO_ENABLE_TARGET_AVX2)
+        { CPU_AVX2, "AVX2", filter_up_avx2 },
+#endif
+    };
+
+    const DispatchVariant<FilterFunc> g_filter_paeth_16bit_variants[] =
+    {
+        { 0, "generic", filter_paeth },
+#if defined(MANGO_ENABLE_SSE2)
+        { CPU_SSE2, "SSE2", filter_paeth_sse2<2> },
+#endif
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", filter_paeth_ssse3<2> },
+#endif
+    };
+
+    const DispatchVariant<FilterFunc> g_filter_paeth_24bit_variants[] =
+    {
+        { 0, "generic", filter_paeth },
+#if defined(MANGO_ENABLE_SSE2)
+        { CPU_SSE2, "SSE2", filter_paeth_sse2<3> },
+#endif
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", filter_paeth_ssse3<3> },
+#endif
+    };
+
+    const DispatchVariant<FilterFunc> g_filter_paeth_32bit_variants[] =
+    {
+        { 0, "generic", filter_paeth },
+#if defined(MANGO_ENABLE_SSE2)
+        { CPU_SSE2, "SSE2", filter_paeth_sse2<4> },
+#endif
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", filter_paeth_ssse3<4> },
+#endif
+    };
+
+    const DispatchVariant<FilterFunc> g_filter_paeth_48bit_variants[] =
+    {
+        { 0, "generic", filter_paeth },
+#if defined(MANGO_ENABLE_SSE2)
+        { CPU_SSE2, "SSE2", filter_paeth_sse2<6> },
+#endif
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", filter_paeth_ssse3<6> },
+#endif
+    };
+
+    const DispatchVariant<FilterFunc> g_filter_paeth_64bit_variants[] =
+    {
+        { 0, "generic", filter_paeth },
+#if defined(MANGO_ENABLE_SSE2)
+        { CPU_SSE2, "SSE2", filter_paeth_sse2<8> },
+#endif
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", filter_paeth_ssse3<8> },
+#endif
+    };
+
     struct FilterDispatcher
     {
         FilterFunc sub = filter_sub;
@@ -341,28 +528,51 @@ namespace
             switch (bpp)
             {
                 case 1:
+#if defined(MANGO_ENABLE_SSE2)
+                    sub = filter_sub_prefix_sse2<1>;
+#endif
+                    average = filter_average_8bit;
                     paeth = filter_paeth_8bit;
                     break;
-                case 3:
+                case 2:
 #if defined(MANGO_ENABLE_SSE2)
-                    sub = filter_sub_24bit_sse2;
-                    average = filter_average_24bit_sse2;
-                    paeth = filter_paeth_24bit_sse2;
+                    sub = filter_sub_prefix_sse2<2>;
+                    average = filter_average_sse2<2>;
 #endif
-#if defined(MANGO_ENABLE_NEON__todo)
+                    paeth = selectDispatchVariant("png.paeth.16bit", g_filter_paeth_16bit_variants).function;
+                    break;
+                case 3:
+#if defined(MANGO_ENABLE_SSE2)
+                    sub = filter_sub_sse2<3>;
+                    average = filter_average_sse2<3>;
 #endif
+                    paeth = selectDispatchVariant("png.paeth.24bit", g_filter_paeth_24bit_variants).function;
                     break;
                 case 4:
 #if defined(MANGO_ENABLE_SSE2)
-                    sub = filter_sub_32bit_sse2;
-                    average = filter_average_32bit_sse2;
-                    paeth = filter_paeth_32bit_sse2;
+                    sub = filter_sub_sse2<4>;
+                    average = filter_average_sse2<4>;
 #endif
-#if defined(MANGO_ENABLE_NEON__todo)
+                    paeth = selectDispatchVariant("png.paeth.32bit", g_filter_paeth_32bit_variants).function;
+                    break;
+                case 6:
+#if defined(MANGO_ENABLE_SSE2)
+                    sub = filter_sub_sse2<6>;
+                    average = filter_average_sse2<6>;
 #endif
+                    paeth = selectDispatchVariant("png.paeth.48bit", g_filter_paeth_48bit_variants).function;
+                    break;
+                case 8:
+#if defined(MANGO_ENABLE_SSE2)
+                    sub = filter_sub_sse2<8>;
+                    average = filter_average_sse2<8>;
+#endif
+                    paeth = selectDispatchVariant("png.paeth.64bit", g_filter_paeth_64bit_variants).function;
                     break;
             }
 
+            up = selectDispatchVariant("png.up", g_filter_up_variants).function;
+
 #if defined(MANGO_ENABLE_NEON__todo)
             up = filter_up_neon;
 #endif
@@ -396,6 +606,241 @@ namespace
         }
     };
 
+    // ------------------------------------------------------------
+    // Scanline conversions
+    // ------------------------------------------------------------
+
+    typedef void (*ConvertFunc)(u8* dest, const u8* src, int width);
+
+    void convert_rgb8(u8* dest, const u8* src, int width)
+    {
+        u32* d = reinterpret_cast<u32*>(dest);
+
+        for (int x = 0; x < width; ++x)
+        {
+            d[x] = ColorBGRA(src[0], src[1], src[2], 0xff);
+            src += 3;
+        }
+    }
+
+    void convert_rgba8(u8* dest, const u8* src, int width)
+    {
+        u32* d = reinterpret_cast<u32*>(dest);
+
+        for (int x = 0; x < width; ++x)
+        {
+            d[x] = ColorBGRA(src[0], src[1], src[2], src[3]);
+            src += 4;
+        }
+    }
+
+    void convert_rgb16(u8* dest, const u8* src, int width)
+    {
+        u16* d = reinterpret_cast<u16*>(dest);
+
+        for (int x = 0; x < width; ++x)
+        {
+            d[0] = (src[0] << 8) | src[1];
+            d[1] = (src[2] << 8) | src[3];
+            d[2] = (src[4] << 8) | src[5];
+            d[3] = 0xffff;
+            d += 4;
+            src += 6;
+        }
+    }
+
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+
+    // The 24 and 48 bit conversions load 16 bytes for 12 bytes of pixels; the
+    // blocks stop early enough to keep the loads inside the scanline.
+
+    MANGO_TARGET_SSSE3
+    void convert_rgb8_ssse3(u8* dest, const u8* src, int width)
+    {
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+        const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+        int x = 0;
+
+        for ( ; x <= width - 18; x += 16)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+            __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24));
+            __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 36));
+            v0 = _mm_or_si128(_mm_shuffle_epi8(v0, mask), alpha);
+            v1 = _mm_or_si128(_mm_shuffle_epi8(v1, mask), alpha);
+            v2 = _mm_or_si128(_mm_shuffle_epi8(v2, mask), alpha);
+            v3 = _mm_or_si128(_mm_shuffle_epi8(v3, mask), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 0), v0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 16), v1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 32), v2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 48), v3);
+            src += 48;
+            dest += 64;
+        }
+
+        convert_rgb8(dest, src, width - x);
+    }
+
+    MANGO_TARGET_SSSE3
+    void convert_rgba8_ssse3(u8* dest, const u8* src, int width)
+    {
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+        int x = 0;
+
+        for ( ; x <= width - 8; x += 8)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 0), _mm_shuffle_epi8(v0, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 16), _mm_shuffle_epi8(v1, mask));
+            src += 32;
+            dest += 32;
+        }
+
+        convert_rgba8(dest, src, width - x);
+    }
+
+    MANGO_TARGET_SSSE3
+    void convert_rgb16_ssse3(u8* dest, const u8* src, int width)
+    {
+        const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, -1, -1, 7, 6, 9, 8, 11, 10, -1, -1);
+        const __m128i alpha = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+
+        int x = 0;
+
+        for ( ; x <= width - 5; x += 4)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+            v0 = _mm_or_si128(_mm_shuffle_epi8(v0, mask), alpha);
+            v1 = _mm_or_si128(_mm_shuffle_epi8(v1, mask), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 0), v0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 16), v1);
+            src += 24;
+            dest += 32;
+        }
+
+        convert_rgb16(dest, src, width - x);
+    }
+
+#endif // MANGO_ENABLE_TARGET_SSSE3
+
+    const DispatchVariant<ConvertFunc> g_convert_rgb8_variants[] =
+    {
+        { 0, "generic", convert_rgb8 },
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", convert_rgb8_ssse3 },
+#endif
+    };
+
+    const DispatchVariant<ConvertFunc> g_convert_rgba8_variants[] =
+    {
+        { 0, "generic", convert_rgba8 },
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", convert_rgba8_ssse3 },
+#endif
+    };
+
+    const DispatchVariant<ConvertFunc> g_convert_rgb16_variants[] =
+    {
+        { 0, "generic", convert_rgb16 },
+#if defined(MANGO_ENABLE_SSE2) && defined(MANGO_ENABLE_TARGET_SSSE3)
+        { CPU_SSSE3, "SSSE3", convert_rgb16_ssse3 },
+#endif
+    };
+
+    // ------------------------------------------------------------
+    // UnpackTable
+    // ------------------------------------------------------------
+
+    // Expands a byte of packed 1, 2 or 4 bit samples into 8, 4 or 2 values with
+    // one lookup; the values are computed from the sample with func.
+
+    template <typename T>
+    struct UnpackTable
+    {
+        T table[256][8];
+        int bits;
+
+        template <typename Func>
+        UnpackTable(int bits, Func func)
+            : bits(bits)
+        {
+            const int samples = 8 / bits;
+            const int mask = (1 << bits) - 1;
+
+            for (int i = 0; i < 256; ++i)
+            {
+                for (int j = 0; j < samples; ++j)
+                {
+                    table[i][j] = func((i >> (8 - bits * (j + 1))) & mask);
+                }
+            }
+        }
+
+        template <int samples>
+        void unpack(T* dest, const u8* src, int width) const
+        {
+            const int count = width / samples;
+            const int left = width % samples;
+
+            for (int i = 0; i < count; ++i)
+            {
+                std::memcpy(dest, table[src[i]], samples * sizeof(T));
+                dest += samples;
+            }
+
+            if (left)
+            {
+                std::memcpy(dest, table[src[count]], left * sizeof(T));
+            }
+        }
+
+        void unpack(T* dest, const u8* src, int width) const
+        {
+            switch (bits)
+            {
+                case 1: unpack<8>(dest, src, width); break;
+                case 2: unpack<4>(dest, src, width); break;
+                case 4: unpack<2>(dest, src, width); break;
+            }
+        }
+    };
+
+    // ------------------------------------------------------------
+    // Adam7 scatter
+    // ------------------------------------------------------------
+
+    typedef void (*ScatterFunc)(u8* dest, const u8* src, int count, int step);
+
+    template <int size>
+    void scatter_pixels(u8* dest, const u8* src, int count, int step)
+    {
+        for (int x = 0; x < count; ++x)
+        {
+            std::memcpy(dest, src, size);
+            dest += step;
+            src += size;
+        }
+    }
+
+    ScatterFunc getScatterFunc(int size)
+    {
+        switch (size)
+        {
+            case 1: return scatter_pixels<1>;
+            case 2: return scatter_pixels<2>;
+            case 3: return scatter_pixels<3>;
+            case 4: return scatter_pixels<4>;
+            case 6: return scatter_pixels<6>;
+            case 8: return scatter_pixels<8>;
+        }
+        return nullptr;
+    }
+
     // ------------------------------------------------------------
     // AdamInterleave
     // ------------------------------------------------------------
@@ -425,6 +870,35 @@ namespace
         }
     };
 
+    // ------------------------------------------------------------
+    // ChunkInflater
+    // ------------------------------------------------------------
+
+    // The zlib stream continues from one IDAT (or fdAT) chunk to the next; the
+    // chunks are inflated where they are in memory instead of being gathered first.
+    class ChunkInflater
+    {
+    protected:
+        Inflater m_inflater;
+
+    public:
+        ChunkInflater(const std::vector<ConstMemory>& chunks)
+            : m_inflater(Inflater::ZLIB)
+        {
+            for (const ConstMemory& chunk : chunks)
+            {
+                m_inflater.append(chunk);
+            }
+        }
+
+        // inflate exactly bytes into the buffer; returns false when the
+        // compressed data is corrupted or ends before the buffer is full
+        bool read(u8* buffer, size_t bytes)
+        {
+            return m_inflater.read(Memory(buffer, bytes)) == bytes;
+        }
+    };
+
     // ------------------------------------------------------------
     // ParserPNG
     // ------------------------------------------------------------
@@ -501,7 +975,8 @@ namespace
         const u8* m_end = nullptr;
         const char* m_error = nullptr;
 
-        Buffer m_compressed;
+        // IDAT or fdAT chunks of the current image; inflated directly from the memory
+        std::vector<ConstMemory> m_compressed;
 
         // IHDR
         int m_width;
@@ -558,6 +1033,7 @@ namespace
 
         void parse();
         void filter(u8* buffer, int bytes, int height);
+        void filter(FilterDispatcher& dispatcher, u8* buffer, const u8* prev, int bytes, int height);
         void deinterlace1to4(u8* output, int width, int height, int stride, u8* buffer);
         void deinterlace8to16(u8* output, int width, int height, int stride, u8* buffer);
 
@@ -573,16 +1049,21 @@ namespace
         void process_ia16    (u8* dest, int width, int height, int stride, const u8* src);
         void process_rgba16  (u8* dest, int width, int height, int stride, const u8* src);
 
-        void process(u8* dest, int width, int height, int stride, u8* buffer, Palette* palette);
+        void process_interlaced(u8* dest, int width, int height, int stride, u8* buffer, Palette* palette);
+        void process_scanlines(u8* dest, int width, int height, int stride, const u8* buffer, Palette* palette);
+
+        using ScanlineFunc = std::function<void(const u8* buffer, int y, int height)>;
+        bool inflate_scanlines(int width, int height, int band, ScanlineFunc func);
 
-        void blend_ia8      (u8* dest, const u8* src, int width);
-        void blend_ia16     (u8* dest, const u8* src, int width);
-        void blend_bgra8    (u8* dest, const u8* src, int width);
-        void blend_rgba16   (u8* dest, const u8* src, int width);
         void blend_indexed  (u8* dest, const u8* src, int width);
 
         void blend(Surface& d, Surface& s, Palette* palette);
 
+        int getFilterBpp() const
+        {
+            return (m_bit_depth < 8) ? 1 : m_channels * m_bit_depth / 8;
+        }
+
         int getBytesPerLine(int width) const
         {
             return m_channels * ((m_bit_depth * width + 7) / 8);
@@ -596,6 +1077,7 @@ namespace
         }
 
         int getImageBufferSize(int width, int height) const;
+        ImageDecodeStatus decodeImage(Surface& dest, Palette* palette);
 
     public:
         ParserPNG(ConstMemory memory);
@@ -603,6 +1085,7 @@ namespace
 
         const ImageHeader& getHeader();
         ImageDecodeStatus decode(Surface& dest, Palette* palette);
+        ImageDecodeStatus decode(ImageDecodeRegion& region, const Format& format, Palette* palette);
     };
 
     // ------------------------------------------------------------
@@ -796,7 +1279,7 @@ namespace
 
     void ParserPNG::read_IDAT(BigEndianConstPointer p, u32 size)
     {
-        m_compressed.append(p, size);
+        m_compressed.emplace_back(p, size);
     }
 
     void ParserPNG::read_PLTE(BigEndianConstPointer p, u32 size)
@@ -963,7 +1446,7 @@ namespace
         debugPrint("  Sequence: %d\n", sequence_number);
         MANGO_UNREFERENCED(sequence_number);
 
-        m_compressed.append(p, size);
+        m_compressed.emplace_back(p, size);
     }
 
     void ParserPNG::parse()
@@ -1079,15 +1562,17 @@ namespace
 
     void ParserPNG::filter(u8* buffer, int bytes, int height)
     {
-        const int bpp = (m_bit_depth < 8) ? 1 : m_channels * m_bit_depth / 8;
-        if (bpp > 8)
-            return;
-
-        FilterDispatcher dispatcher(bpp);
-
         // zero scanline
         std::vector<u8> zeros(bytes, 0);
-        const u8* prev = zeros.data();
+        FilterDispatcher dispatcher(getFilterBpp());
+        filter(dispatcher, buffer, zeros.data(), bytes, height);
+    }
+
+    void ParserPNG::filter(FilterDispatcher& dispatcher, u8* buffer, const u8* prev, int bytes, int height)
+    {
+        const int bpp = getFilterBpp();
+        if (bpp > 8)
+            return;
 
         for (int y = 0; y < height; ++y)
         {
@@ -1114,16 +1599,25 @@ namespace
             debugPrint("  pass: %d (%d x %d)\n", pass, adam.w, adam.h);
 
             const int bw = FILTER_BYTE + ((adam.w + mask) >> shift);
-            filter(p, bw - FILTER_BYTE, adam.h);
 
+            // empty passes are not stored in the stream
             if (adam.w && adam.h)
             {
+                filter(p, bw - FILTER_BYTE, adam.h);
+
                 for (int y = 0; y < adam.h; ++y)
                 {
                     const int yoffset = (y << adam.yspc) + adam.yorig;
                     u8* dest = output + yoffset * stride + FILTER_BYTE;
                     u8* src = p + y * bw + FILTER_BYTE;
 
+                    if (!adam.xspc)
+                    {
+                        // the last pass has every pixel of odd scanlines
+                        std::memcpy(dest, src, bw - FILTER_BYTE);
+                        continue;
+                    }
+
                     for (int x = 0; x < adam.w; ++x)
                     {
                         const int xoffset = (x << adam.xspc) + adam.xorig;
@@ -1145,6 +1639,7 @@ namespace
     {
         u8* p = buffer;
         const int size = getBytesPerLine(width) / width;
+        ScatterFunc scatter = getScatterFunc(size);
 
         for (int pass = 0; pass < 7; ++pass)
         {
@@ -1152,10 +1647,12 @@ namespace
             debugPrint("  pass: %d (%d x %d)\n", pass, adam.w, adam.h);
 
             const int bw = FILTER_BYTE + adam.w * size;
-            filter(p, bw - FILTER_BYTE, adam.h);
 
+            // empty passes are not stored in the stream
             if (adam.w && adam.h)
             {
+                filter(p, bw - FILTER_BYTE, adam.h);
+
                 const int ps = adam.w * size + FILTER_BYTE;
 
                 for (int y = 0; y < adam.h; ++y)
@@ -1165,14 +1662,15 @@ namespace
                     u8* src = p + y * ps + FILTER_BYTE;
 
                     dest += adam.xorig * size;
-                    const int xmax = (adam.w * size) << adam.xspc;
-                    const int xstep = size << adam.xspc;
 
-                    for (int x = 0; x < xmax; x += xstep)
+                    if (!adam.xspc)
                     {
-                        std::memcpy(dest + x, src, size);
-                        src += size;
+                        // the last pass has every pixel of odd scanlines
+                        std::memcpy(dest, src, adam.w * size);
+                        continue;
                     }
+
+                    scatter(dest, src, adam.w, size << adam.xspc);
                 }
 
                 // next pass
@@ -1184,34 +1682,42 @@ namespace
     void ParserPNG::process_i1to4(u8* dest, int width, int height, int stride, const u8* src)
     {
         const int bits = m_bit_depth;
+        const int bytes = (width * bits + 7) / 8;
 
         const int maxValue = (1 << bits) - 1;
-        const int scale = (255 / maxValue) * 0x010101;
-        const u32 mask = (1 << bits) - 1;
+        const int scale = 255 / maxValue;
 
-        for (int y = 0; y < height; ++y)
+        if (m_transparent_enable)
         {
-            u8* d = dest;
-            dest += stride;
-            ++src; // skip filter byte
+            const int transparent = m_transparent_sample[0];
 
-            u32 data = 0;
-            int offset = -1;
+            UnpackTable<u16> table(bits, [=] (int value) -> u16
+            {
+                u8 sample[] = { u8(value * scale), u8(value == transparent ? 0 : 0xff) };
+                return uload16(sample);
+            });
 
-            for (int x = 0; x < width; ++x)
+            for (int y = 0; y < height; ++y)
             {
-                if (offset < 0)
-                {
-                    offset = 8 - bits;
-                    data = *src++;
-                }
-                int value = (data >> offset) & mask;
-                *d++ = value * scale;
-                if (m_transparent_enable)
-                {
-                    *d++ = value == m_transparent_sample[0] ? 0 : 0xff;
-                }
-                offset -= bits;
+                ++src; // skip filter byte
+                table.unpack(reinterpret_cast<u16*>(dest), src, width);
+                src += bytes;
+                dest += stride;
+            }
+        }
+        else
+        {
+            UnpackTable<u8> table(bits, [=] (int value)
+            {
+                return u8(value * scale);
+            });
+
+            for (int y = 0; y < height; ++y)
+            {
+                ++src; // skip filter byte
+                table.unpack(dest, src, width);
+                src += bytes;
+                dest += stride;
             }
         }
     }
@@ -1270,17 +1776,14 @@ namespace
         }
         else
         {
+            ConvertFunc convert = selectDispatchVariant("png.rgb8", g_convert_rgb8_variants).function;
+
             for (int y = 0; y < height; ++y)
             {
-                u32* d = reinterpret_cast<u32*>(dest);
-                dest += stride;
                 ++src; // skip filter byte
-
-                for (int x = 0; x < width; ++x)
-                {
-                    d[x] = ColorBGRA(src[0], src[1], src[2], 0xff);
-                    src += 3;
-                }
+                convert(dest, src, width);
+                src += width * 3;
+                dest += stride;
             }
         }
     }
@@ -1288,55 +1791,38 @@ namespace
     void ParserPNG::process_pal1to4(u8* dest, int width, int height, int stride, const u8* src, Palette* ptr_palette)
     {
         const int bits = m_bit_depth;
-
-        const u32 mask = (1 << bits) - 1;
+        const int bytes = (width * bits + 7) / 8;
 
         if (ptr_palette)
         {
             *ptr_palette = m_palette;
 
+            UnpackTable<u8> table(bits, [] (int value)
+            {
+                return u8(value);
+            });
+
             for (int y = 0; y < height; ++y)
             {
-                u8* d = reinterpret_cast<u8*>(dest);
-                dest += stride;
                 ++src; // skip filter byte
-
-                u32 data = 0;
-                int offset = -1;
-
-                for (int x = 0; x < width; ++x)
-                {
-                    if (offset < 0)
-                    {
-                        offset = 8 - bits;
-                        data = *src++;
-                    }
-                    *d++ = (data >> offset) & mask;
-                    offset -= bits;
-                }
+                table.unpack(dest, src, width);
+                src += bytes;
+                dest += stride;
             }
         }
         else
         {
+            UnpackTable<u32> table(bits, [this] (int value) -> u32
+            {
+                return m_palette[value];
+            });
+
             for (int y = 0; y < height; ++y)
             {
-                u32* d = reinterpret_cast<u32*>(dest);
-                dest += stride;
                 ++src; // skip filter byte
-
-                u32 data = 0;
-                int offset = -1;
-
-                for (int x = 0; x < width; ++x)
-                {
-                    if (offset < 0)
-                    {
-                        offset = 8 - bits;
-                        data = *src++;
-                    }
-                    d[x] = m_palette[(data >> offset) & mask];
-                    offset -= bits;
-                }
+                table.unpack(reinterpret_cast<u32*>(dest), src, width);
+                src += bytes;
+                dest += stride;
             }
         }
     }
@@ -1389,17 +1875,14 @@ namespace
 
     void ParserPNG::process_rgba8(u8* dest, int width, int height, int stride, const u8* src)
     {
+        ConvertFunc convert = selectDispatchVariant("png.rgba8", g_convert_rgba8_variants).function;
+
         for (int y = 0; y < height; ++y)
         {
-            u32* d = reinterpret_cast<u32*>(dest);
-            dest += stride;
             ++src; // skip filter byte
-
-            for (int x = 0; x < width; ++x)
-            {
-                *d++ = ColorBGRA(src[0], src[1], src[2], src[3]);
-                src += 4;
-            }
+            convert(dest, src, width);
+            src += width * 4;
+            dest += stride;
         }
     }
 
@@ -1416,7 +1899,7 @@ namespace
                 for (int x = 0; x < width; ++x)
                 {
                     u16 gray = (src[0] << 8) | src[1];
-                    u16 alpha = m_transparent_sample[0] == src[0] ? 0 : 0xffff;
+                    u16 alpha = m_transparent_sample[0] == gray ? 0 : 0xffff;
                     d[0] = gray;
                     d[1] = alpha;
                     d += 2;
@@ -1428,15 +1911,10 @@ namespace
         {
             for (int y = 0; y < height; ++y)
             {
-                u16* d = reinterpret_cast<u16*>(dest);
-                dest += stride;
                 ++src; // skip filter byte
-
-                for (int x = 0; x < width; ++x)
-                {
-                    *d++ = (src[0] << 8) | src[1];
-                    src += 2;
-                }
+                byteswap(reinterpret_cast<u16*>(dest), reinterpret_cast<const u16*>(src), width);
+                src += width * 2;
+                dest += stride;
             }
         }
     }
@@ -1459,7 +1937,7 @@ namespace
                     u16 alpha = 0xffff;
                     if (m_transparent_sample[0] == red &&
                         m_transparent_sample[1] == green &&
-                        m_transparent_sample[1] == blue) alpha = 0;
+                        m_transparent_sample[2] == blue) alpha = 0;
                     d[0] = red;
                     d[1] = green;
                     d[2] = blue;
@@ -1471,25 +1949,14 @@ namespace
         }
         else
         {
+            ConvertFunc convert = selectDispatchVariant("png.rgb16", g_convert_rgb16_variants).function;
+
             for (int y = 0; y < height; ++y)
             {
-                u16* d = reinterpret_cast<u16*>(dest);
-                dest += stride;
                 ++src; // skip filter byte
-
-                for (int x = 0; x < width; ++x)
-                {
-                    u16 red   = (src[0] << 8) | src[1];
-                    u16 green = (src[2] << 8) | src[3];
-                    u16 blue  = (src[4] << 8) | src[5];
-                    u16 alpha = 0xffff;
-                    d[0] = red;
-                    d[1] = green;
-                    d[2] = blue;
-                    d[3] = alpha;
-                    d += 4;
-                    src += 6;
-                }
+                convert(dest, src, width);
+                src += width * 6;
+                dest += stride;
             }
         }
     }
@@ -1498,19 +1965,10 @@ namespace
     {
         for (int y = 0; y < height; ++y)
         {
-            u16* d = reinterpret_cast<u16*>(dest);
-            dest += stride;
             ++src; // skip filter byte
-
-            for (int x = 0; x < width; ++x)
-            {
-                u16 gray  = (src[0] << 8) | src[1];
-                u16 alpha = (src[2] << 8) | src[3];
-                d[0] = gray;
-                d[1] = alpha;
-                d += 2;
-                src += 4;
-            }
+            byteswap(reinterpret_cast<u16*>(dest), reinterpret_cast<const u16*>(src), width * 2);
+            src += width * 4;
+            dest += stride;
         }
     }
 
@@ -1518,50 +1976,29 @@ namespace
     {
         for (int y = 0; y < height; ++y)
         {
-            u16* d = reinterpret_cast<u16*>(dest);
-            dest += stride;
             ++src; // skip filter byte
-
-            for (int x = 0; x < width; ++x)
-            {
-                u16 red   = (src[0] << 8) | src[1];
-                u16 green = (src[2] << 8) | src[3];
-                u16 blue  = (src[4] << 8) | src[5];
-                u16 alpha = (src[6] << 8) | src[7];
-                d[0] = blue;
-                d[1] = green;
-                d[2] = red;
-                d[3] = alpha;
-                d += 4;
-                src += 8;
-            }
+            byteswap(reinterpret_cast<u16*>(dest), reinterpret_cast<const u16*>(src), width * 4);
+            src += width * 8;
+            dest += stride;
         }
     }
 
-    void ParserPNG::process(u8* image, int width, int height, int stride, u8* buffer, Palette* ptr_palette)
+    void ParserPNG::process_interlaced(u8* image, int width, int height, int stride, u8* buffer, Palette* ptr_palette)
     {
-        Buffer temp;
+        const int rowsize = FILTER_BYTE + getBytesPerLine(width);
 
-        if (m_interlace)
-        {
-            const int stride = FILTER_BYTE + getBytesPerLine(width);
-
-            temp.resize(height * stride);
-            std::memset(temp, 0, height * stride);
+        Buffer temp(height * rowsize);
 
-            // deinterlace does filter for each pass
-            if (m_bit_depth < 8)
-                deinterlace1to4(temp, width, height, stride, buffer);
-            else
-                deinterlace8to16(temp, width, height, stride, buffer);
-
-            // use de-interlaced temp buffer as processing source
-            buffer = temp;
+        // deinterlace does filter for each pass
+        if (m_bit_depth < 8)
+        {
+            // the packed samples are combined with the existing ones
+            std::memset(temp, 0, height * rowsize);
+            deinterlace1to4(temp, width, height, rowsize, buffer);
         }
         else
         {
-            // filter the whole image in single pass
-            filter(buffer, getBytesPerLine(width), height);
+            deinterlace8to16(temp, width, height, rowsize, buffer);
         }
 
         if (m_error)
@@ -1569,6 +2006,11 @@ namespace
             return;
         }
 
+        process_scanlines(image, width, height, stride, temp, ptr_palette);
+    }
+
+    void ParserPNG::process_scanlines(u8* image, int width, int height, int stride, const u8* buffer, Palette* ptr_palette)
+    {
         if (m_color_type == COLOR_TYPE_I)
         {
             if (m_bit_depth < 8)
@@ -1594,77 +2036,17 @@ namespace
         }
         else if (m_color_type == COLOR_TYPE_IA)
         {
-            if (m_bit_depth == 8)
-                process_ia8(image, width, height, stride, buffer);
-            else
-                process_ia16(image, width, height, stride, buffer);
-        }
-        else if (m_color_type == COLOR_TYPE_RGBA)
-        {
-            if (m_bit_depth == 8)
-                process_rgba8(image, width, height, stride, buffer);
-            else
-                process_rgba16(image, width, height, stride, buffer);
-        }
-    }
-
-    void ParserPNG::blend_ia8(u8* dest, const u8* src, int width)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            u8 alpha = src[1];
-            u8 invalpha = 255 - alpha;
-            dest[0] = src[0] + ((dest[0] - src[0]) * invalpha) / 255;
-            dest[1] = alpha;
-            src += 2;
-            dest += 2;
-        }
-    }
-
-    void ParserPNG::blend_ia16(u8* dest8, const u8* src8, int width)
-    {
-        u16* dest = reinterpret_cast<u16*>(dest8);
-        const u16* src = reinterpret_cast<const u16*>(src8);
-        for (int x = 0; x < width; ++x)
-        {
-            u16 alpha = src[1];
-            u16 invalpha = 255 - alpha;
-            dest[0] = src[0] + ((dest[0] - src[0]) * invalpha) / 255;
-            dest[1] = alpha;
-            src += 2;
-            dest += 2;
-        }
-    }
-
-    void ParserPNG::blend_bgra8(u8* dest, const u8* src, int width)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            u8 alpha = src[3];
-            u8 invalpha = 255 - alpha;
-            dest[0] = src[0] + ((dest[0] - src[0]) * invalpha) / 255;
-            dest[1] = src[1] + ((dest[1] - src[1]) * invalpha) / 255;
-            dest[2] = src[2] + ((dest[2] - src[2]) * invalpha) / 255;
-            dest[3] = alpha;
-            src += 4;
-            dest += 4;
+            if (m_bit_depth == 8)
+                process_ia8(image, width, height, stride, buffer);
+            else
+                process_ia16(image, width, height, stride, buffer);
         }
-    }
-
-    void ParserPNG::blend_rgba16(u8* dest8, const u8* src8, int width)
-    {
-        u16* dest = reinterpret_cast<u16*>(dest8);
-        const u16* src = reinterpret_cast<const u16*>(src8);
-        for (int x = 0; x < width; ++x)
+        else if (m_color_type == COLOR_TYPE_RGBA)
         {
-            u16 alpha = src[3];
-            u16 invalpha = 255 - alpha;
-            dest[0] = src[0] + ((dest[0] - src[0]) * invalpha) / 65535;
-            dest[1] = src[1] + ((dest[1] - src[1]) * invalpha) / 65535;
-            dest[2] = src[2] + ((dest[2] - src[2]) * invalpha) / 65535;
-            dest[3] = alpha;
-            src += 4;
-            dest += 4;
+            if (m_bit_depth == 8)
+                process_rgba8(image, width, height, stride, buffer);
+            else
+                process_rgba16(image, width, height, stride, buffer);
         }
     }
 
@@ -1683,46 +2065,57 @@ namespace
 
     void ParserPNG::blend(Surface& d, Surface& s, Palette* palette)
     {
-        int width = s.width;
-        int height = s.height;
         if (m_frame.blend == Frame::SOURCE || !s.format.isAlpha())
         {
             d.blit(0, 0, s);
         }
         else if (m_frame.blend == Frame::OVER)
         {
-            for (int y = 0; y < height; ++y)
+            if (palette)
             {
-                const u8* src = s.address(0, y);
-                u8* dest = d.address(0, y);
-
-                if (palette)
+                // palette extract mode: blend with the main image palette
+                for (int y = 0; y < s.height; ++y)
                 {
-                    // palette extract mode: blend with the main image palette
-                    blend_indexed(dest, src, width);
-                }
-                else
-                {
-                    switch (s.format.bits)
-                    {
-                        case 8:
-                            blend_ia8(dest, src, width);
-                            break;
-                        case 16:
-                            blend_ia16(dest, src, width);
-                            break;
-                        case 32:
-                            blend_bgra8(dest, src, width);
-                            break;
-                        case 64:
-                            blend_rgba16(dest, src, width);
-                            break;
-                        default:
-                            break;
-                    }
+                    blend_indexed(d.address(0, y), s.address(0, y), s.width);
                 }
             }
+            else
+            {
+                composite(d, s, CompositeMode::OVER);
+            }
+        }
+    }
+
+    bool ParserPNG::inflate_scanlines(int width, int height, int band, ScanlineFunc func)
+    {
+        const int bytes = getBytesPerLine(width);
+        const int rowsize = FILTER_BYTE + bytes;
+
+        // two bands: the last scanline of the previous band is the reference for the filters
+        Buffer buffer(rowsize * band * 2);
+        std::vector<u8> zeros(bytes, 0);
+        const u8* prev = zeros.data();
+
+        FilterDispatcher dispatcher(getFilterBpp());
+        ChunkInflater inflater(m_compressed);
+
+        for (int y = 0; y < height; y += band)
+        {
+            const int h = std::min(band, height - y);
+            u8* scan = buffer + ((y / band) & 1) * rowsize * band;
+
+            if (!inflater.read(scan, h * rowsize))
+            {
+                return false;
+            }
+
+            filter(dispatcher, scan, prev, bytes, h);
+            prev = scan + (h - 1) * rowsize + FILTER_BYTE;
+
+            func(scan, y, h);
         }
+
+        return true;
     }
 
     int ParserPNG::getImageBufferSize(int width, int height) const
@@ -1753,14 +2146,13 @@ namespace
     {
         ImageDecodeStatus status;
 
-        m_compressed.reset();
+        m_compressed.clear();
 
         parse();
 
-        if (!m_compressed.size())
+        if (m_compressed.empty())
         {
             setError("No compressed data.");
-            return status;
         }
 
         if (!m_header.success)
@@ -1769,6 +2161,13 @@ namespace
             return status;
         }
 
+        return decodeImage(dest, ptr_palette);
+    }
+
+    ImageDecodeStatus ParserPNG::decodeImage(Surface& dest, Palette* ptr_palette)
+    {
+        ImageDecodeStatus status;
+
         // default: main image from "IHDR" chunk
         int width = m_width;
         int height = m_height;
@@ -1796,64 +2195,38 @@ namespace
             }
         }
 
-        // decompression
-        // - use STB for small buffers
-        // - use MINIZ for large buffers
+        if (m_interlace)
+        {
+            // the passes cover the whole image; inflate all of them before de-interlacing
+            const int buffer_size = getImageBufferSize(width, height);
+            debugPrint("  buffer bytes: %d\n", buffer_size);
 
-        int buffer_size = getImageBufferSize(width, height);
+            Buffer buffer(buffer_size);
+            ChunkInflater inflater(m_compressed);
 
-        if (m_compressed.size() <= 128 * 1024)
-        {
-            Memory mem = m_compressed;
-            int raw_len = buffer_size;
-            u8 *buffer = (u8*) stbi_zlib_decode_malloc_guesssize_headerflag(
-                reinterpret_cast<const char *>(mem.address),
-                int(mem.size),
-                raw_len,
-                &raw_len,
-                1);
-            if (buffer)
+            if (!inflater.read(buffer, buffer_size))
             {
-                debugPrint("  # total_out: %d \n", raw_len);
-
-                // process image
-                process(image, width, height, stride, buffer, ptr_palette);
-                STBI_FREE(buffer);
+                status.setError("[ImageDecoder.PNG] Inflate failed.");
+                return status;
             }
+
+            process_interlaced(image, width, height, stride, buffer, ptr_palette);
         }
         else
         {
-            // allocate output buffer
-            debugPrint("  buffer bytes: %d\n", buffer_size);
-            Buffer buffer(buffer_size);
+            // process the scanlines while they are still in the cache
+            const int rowsize = FILTER_BYTE + getBytesPerLine(width);
+            const int band = std::max(1, std::min(height, SCANLINE_BUFFER_SIZE / rowsize));
 
-            // decompress stream
-            mz_stream stream;
-            int status;
-            memset(&stream, 0, sizeof(stream));
-
-            stream.next_in   = m_compressed;
-            stream.avail_in  = (unsigned int)m_compressed.size();
-            stream.next_out  = buffer;
-            stream.avail_out = (unsigned int)buffer_size;
-
-            status = mz_inflateInit(&stream);
-            if (status != MZ_OK)
+            bool complete = inflate_scanlines(width, height, band, [=] (const u8* buffer, int y, int h)
             {
-                // TODO: error
-            }
+                process_scanlines(image + y * stride, width, h, stride, buffer, ptr_palette);
+            });
 
-            status = mz_inflate(&stream, MZ_FINISH);
-            if (status != MZ_STREAM_END)
+            if (!complete)
             {
-                // TODO: error
+                status.setError("[ImageDecoder.PNG] Not enough compressed data.");
             }
-
-            debugPrint("  # total_out: %d \n", int(stream.total_out));
-            status = mz_inflateEnd(&stream);
-
-            // process image
-            process(image, width, height, stride, buffer, ptr_palette);
         }
 
         if (m_number_of_frames > 0)
@@ -1869,23 +2242,79 @@ namespace
         return status;
     }
 
+    ImageDecodeStatus ParserPNG::decode(ImageDecodeRegion& region, const Format& format, Palette* ptr_palette)
+    {
+        ImageDecodeStatus status;
+
+        m_compressed.clear();
+
+        parse();
+
+        if (m_compressed.empty())
+        {
+            setError("No compressed data.");
+        }
+
+        if (!m_header.success)
+        {
+            status.setError(m_header.info);
+            return status;
+        }
+
+        if (m_interlace || m_number_of_frames > 0)
+        {
+            // de-interlacing and frame composition need the whole image
+            Bitmap temp(m_width, m_height, format);
+            status = decodeImage(temp, ptr_palette);
+            region.write(temp, 0, 0);
+            return status;
+        }
+
+        // inflate and filter the scanlines in bands down to the bottom of the region;
+        // only the scanlines inside the region are processed
+        Bitmap band(m_width, BAND_HEIGHT, format);
+
+        bool complete = inflate_scanlines(m_width, region.y + region.height, BAND_HEIGHT, [&] (const u8* buffer, int y, int height)
+        {
+            if (y + height > region.y)
+            {
+                process_scanlines(band.image, m_width, height, band.stride, buffer, ptr_palette);
+                region.write(Surface(band, 0, 0, m_width, height), 0, y);
+            }
+        });
+
+        if (!complete)
+        {
+            status.setError("[ImageDecoder.PNG] Not enough compressed data.");
+        }
+
+        return status;
+    }
+
     // ------------------------------------------------------------
     // writePNG()
     // ------------------------------------------------------------
 
     void writeChunk(Stream& stream, u32 chunkid, Memory memory)
     {
-        BigEndianStream s(stream);
+        u8 header[8];
+        ustore32be(header + 0, u32(memory.size));
+        ustore32be(header + 4, chunkid);
 
-        u8 temp[4];
-        ustore32be(temp, chunkid);
-        u32 crc = crc32(0, Memory(temp, 4));
+        u32 crc = crc32(0, Memory(header + 4, 4));
         crc = crc32(crc, memory);
 
-        s.write32(u32(memory.size));
-        s.write32(chunkid);
-        s.write(memory);
-        s.write32(crc);
+        u8 footer[4];
+        ustore32be(footer, crc);
+
+        // length + chunkid, data, crc
+        const ConstMemory segments[] =
+        {
+            ConstMemory(header, 8),
+            memory,
+            ConstMemory(footer, 4)
+        };
+        stream.writev(segments, 3);
     }
 
     void write_IHDR(Stream& stream, const Surface& surface, u8 color_bits, ColorType color_type)
@@ -1904,45 +2333,361 @@ namespace
         writeChunk(stream, u32_mask_rev('I', 'H', 'D', 'R'), buffer);
     }
 
-    void write_IDAT(Stream& stream, const Surface& surface)
+    // ------------------------------------------------------------
+    // encoding filters
+    // ------------------------------------------------------------
+
+    // The encoder computes the filters from unfiltered scanlines, so there is no
+    // dependency between neighbouring pixels and all filters vectorize. The
+    // residuals of every filter are stored and the one with the smallest sum of
+    // absolute (signed) values is selected for the scanline. The scanlines are
+    // padded with bpp zero bytes on the left.
+
+    struct FilterCandidates
+    {
+        u8* residual[4]; // sub, up, average, paeth
+        u32 cost[5];     // none, sub, up, average, paeth
+    };
+
+    static inline
+    int paeth_predictor(int a, int b, int c)
+    {
+        const int pa = std::abs(b - c);
+        const int pb = std::abs(a - c);
+        const int pc = std::abs(a + b - c - c);
+
+        if (pa <= pb && pa <= pc)
+            return a;
+        if (pb <= pc)
+            return b;
+        return c;
+    }
+
+    static inline
+    u32 residual_cost(u8 value)
+    {
+        return value < 128 ? value : 256 - value;
+    }
+
+    void encode_filters(FilterCandidates& candidates, const u8* scan, const u8* prev, int x, int bytes, int bpp)
+    {
+        for ( ; x < bytes; ++x)
+        {
+            const int s = scan[x];
+            const int a = scan[x - bpp];
+            const int b = prev[x];
+            const int c = prev[x - bpp];
+
+            const u8 sub = u8(s - a);
+            const u8 up = u8(s - b);
+            const u8 average = u8(s - ((a + b) >> 1));
+            const u8 paeth = u8(s - paeth_predictor(a, b, c));
+
+            candidates.residual[0][x] = sub;
+            candidates.residual[1][x] = up;
+            candidates.residual[2][x] = average;
+            candidates.residual[3][x] = paeth;
+
+            candidates.cost[0] += residual_cost(u8(s));
+            candidates.cost[1] += residual_cost(sub);
+            candidates.cost[2] += residual_cost(up);
+            candidates.cost[3] += residual_cost(average);
+            candidates.cost[4] += residual_cost(paeth);
+        }
+    }
+
+#if defined(MANGO_ENABLE_SSE2)
+
+    static inline
+    __m128i residual_cost_sse2(__m128i cost, __m128i value)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i magnitude = _mm_min_epu8(value, _mm_sub_epi8(zero, value));
+        return _mm_add_epi64(cost, _mm_sad_epu8(magnitude, zero));
+    }
+
+    static inline
+    u32 residual_sum_sse2(__m128i cost)
+    {
+        return u32(_mm_cvtsi128_si32(_mm_add_epi64(cost, _mm_unpackhi_epi64(cost, cost))));
+    }
+
+    // 16 bit lanes
+    static inline
+    __m128i paeth_predictor_sse2(__m128i a, __m128i b, __m128i c)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_add_epi16(pa, pb);
+        pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+        pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+        pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+        const __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+        const __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+        const __m128i nearest = _mm_or_si128(_mm_and_si128(not_b, c), _mm_andnot_si128(not_b, b));
+        return _mm_or_si128(_mm_and_si128(not_a, nearest), _mm_andnot_si128(not_a, a));
+    }
+
+    void encode_filters_sse2(FilterCandidates& candidates, const u8* scan, const u8* prev, int bytes, int bpp)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+
+        __m128i cost_none = zero;
+        __m128i cost_sub = zero;
+        __m128i cost_up = zero;
+        __m128i cost_average = zero;
+        __m128i cost_paeth = zero;
+
+        int x = 0;
+
+        for ( ; x <= bytes - 16; x += 16)
+        {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scan + x));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scan + x - bpp));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + x));
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + x - bpp));
+
+            const __m128i sub = _mm_sub_epi8(s, a);
+            const __m128i up = _mm_sub_epi8(s, b);
+
+            // the rounding of pavgb is corrected to floor((a + b) / 2)
+            __m128i average = _mm_avg_epu8(a, b);
+            average = _mm_sub_epi8(average, _mm_and_si128(_mm_xor_si128(a, b), one));
+            average = _mm_sub_epi8(s, average);
+
+            const __m128i lo = paeth_predictor_sse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+            const __m128i hi = paeth_predictor_sse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+            const __m128i paeth = _mm_sub_epi8(s, _mm_packus_epi16(lo, hi));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates.residual[0] + x), sub);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates.residual[1] + x), up);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates.residual[2] + x), average);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates.residual[3] + x), paeth);
+
+            cost_none = residual_cost_sse2(cost_none, s);
+            cost_sub = residual_cost_sse2(cost_sub, sub);
+            cost_up = residual_cost_sse2(cost_up, up);
+            cost_average = residual_cost_sse2(cost_average, average);
+            cost_paeth = residual_cost_sse2(cost_paeth, paeth);
+        }
+
+        candidates.cost[0] = residual_sum_sse2(cost_none);
+        candidates.cost[1] = residual_sum_sse2(cost_sub);
+        candidates.cost[2] = residual_sum_sse2(cost_up);
+        candidates.cost[3] = residual_sum_sse2(cost_average);
+        candidates.cost[4] = residual_sum_sse2(cost_paeth);
+
+        encode_filters(candidates, scan, prev, x, bytes, bpp);
+    }
+
+#endif // MANGO_ENABLE_SSE2
+
+    void filter_scanline(u8* dest, FilterCandidates& candidates, const u8* scan, const u8* prev, int bytes, int bpp)
+    {
+#if defined(MANGO_ENABLE_SSE2)
+        encode_filters_sse2(candidates, scan, prev, bytes, bpp);
+#else
+        std::fill(candidates.cost, candidates.cost + 5, 0);
+        encode_filters(candidates, scan, prev, 0, bytes, bpp);
+#endif
+
+        int method = FILTER_NONE;
+        for (int i = FILTER_SUB; i <= FILTER_PAETH; ++i)
+        {
+            if (candidates.cost[i] < candidates.cost[method])
+            {
+                method = i;
+            }
+        }
+
+        dest[0] = u8(method);
+        const u8* residual = method == FILTER_NONE ? scan : candidates.residual[method - 1];
+        std::memcpy(dest + FILTER_BYTE, residual, bytes);
+    }
+
+    void copy_scanline(u8* dest, const u8* src, int bytes, int color_bits)
+    {
+        if (color_bits == 16)
+        {
+            // 16 bit samples are stored in big endian order
+            for (int x = 0; x < bytes; x += 2)
+            {
+                ustore16be(dest + x, uload16(src + x));
+            }
+        }
+        else
+        {
+            std::memcpy(dest, src, bytes);
+        }
+    }
+
+    void filter_band(u8* output, const Surface& surface, int y0, int y1, int color_bits)
+    {
+        const int bpp = surface.format.bytes();
+        const int bytes = surface.width * bpp;
+        const int rowsize = FILTER_BYTE + bytes;
+        const int padded = bpp + bytes;
+
+        Buffer buffer(padded * 2 + bytes * 4);
+        std::memset(buffer, 0, padded * 2);
+
+        u8* scan = buffer + bpp;
+        u8* prev = buffer + padded + bpp;
+
+        FilterCandidates candidates;
+        for (int i = 0; i < 4; ++i)
+        {
+            candidates.residual[i] = buffer + padded * 2 + bytes * i;
+        }
+
+        if (y0 > 0)
+        {
+            copy_scanline(prev, surface.address<u8>(0, y0 - 1), bytes, color_bits);
+        }
+
+        for (int y = y0; y < y1; ++y)
+        {
+            copy_scanline(scan, surface.address<u8>(0, y), bytes, color_bits);
+            filter_scanline(output + y * rowsize, candidates, scan, prev, bytes, bpp);
+            std::swap(scan, prev);
+        }
+    }
+
+    // ------------------------------------------------------------
+    // parallel deflate
+    // ------------------------------------------------------------
+
+    // Each band of scanlines is compressed independently with the previous 32 KB
+    // of filtered data as the dictionary (pigz style). The bands end with a sync
+    // flush except the last one, so they concatenate into a single zlib stream.
+
+    constexpr size_t DEFLATE_WINDOW_SIZE = 32 * 1024;
+    constexpr int DEFLATE_BAND_SIZE = 512 * 1024;
+
+    struct DeflateBand
+    {
+        Buffer output;
+        bool discard = false;
+    };
+
+    mz_bool deflate_callback(const void* data, int len, void* user)
+    {
+        DeflateBand& band = *reinterpret_cast<DeflateBand*>(user);
+        if (!band.discard)
+        {
+            band.output.append(data, len);
+        }
+        return MZ_TRUE;
+    }
+
+    bool deflate_band(DeflateBand& band, ConstMemory dictionary, ConstMemory data, int level, bool last)
+    {
+        tdefl_compressor* compressor = tdefl_compressor_alloc();
+        if (!compressor)
+        {
+            return false;
+        }
+
+        const mz_uint flags = tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+        tdefl_status status = tdefl_init(compressor, deflate_callback, &band, flags);
+
+        if (status == TDEFL_STATUS_OKAY && dictionary.size)
+        {
+            // miniz has no preset dictionary; the dictionary is compressed and the output discarded
+            band.discard = true;
+            status = tdefl_compress_buffer(compressor, dictionary.address, dictionary.size, TDEFL_SYNC_FLUSH);
+            band.discard = false;
+        }
+
+        if (status == TDEFL_STATUS_OKAY)
+        {
+            status = tdefl_compress_buffer(compressor, data.address, data.size, last ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+        }
+
+        tdefl_compressor_free(compressor);
+
+        const tdefl_status expected = last ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY;
+        return status == expected;
+    }
+
+    bool write_IDAT(Stream& stream, const Surface& surface, int color_bits, int level)
     {
-        const int bytesPerLine = surface.width * surface.format.bytes();
-        const int bytes = (FILTER_BYTE + bytesPerLine) * surface.height;
+        const int bytes = surface.width * surface.format.bytes();
+        const int rowsize = FILTER_BYTE + bytes;
+        const int height = surface.height;
 
-        z_stream z = { 0 };
-        deflateInit(&z, -1);
+        // split the work only when there are threads to share it; the dictionary
+        // priming and sync flushes cost some time and compression
+        const int threads = ThreadPool::getInstanceSize();
+        const int band = threads > 1 ? std::max(1, DEFLATE_BAND_SIZE / rowsize) : height;
+        const int bands = (height + band - 1) / band;
 
-        z.avail_out = (unsigned int)deflateBound(&z, bytes);
-        Buffer buffer(z.avail_out);
+        Buffer filtered(size_t(rowsize) * height);
+        ConcurrentQueue queue;
 
-        z.next_out = buffer;
+        for (int y = 0; y < height; y += band)
+        {
+            const int y1 = std::min(height, y + band);
+            queue.enqueue([&surface, &filtered, y, y1, color_bits]
+            {
+                filter_band(filtered, surface, y, y1, color_bits);
+            });
+        }
+
+        queue.wait();
+
+        std::vector<DeflateBand> output(bands);
+
+        // zlib header: 32 KB window and the compression level hint
+        const u32 flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        u32 header = 0x7800 | (flevel << 6);
+        header |= (31 - header % 31) % 31;
+
+        u8 temp[4];
+        ustore16be(temp, u16(header));
+        output[0].output.append(temp, 2);
 
-        for (int y = 0; y < surface.height; ++y)
+        std::atomic<bool> success { true };
+
+        for (int i = 0; i < bands; ++i)
         {
-            bool last_scan = (y == surface.height - 1);
+            queue.enqueue([&, i]
+            {
+                const size_t begin = size_t(i) * band * rowsize;
+                const size_t end = std::min(size_t(i + 1) * band, size_t(height)) * rowsize;
+                const size_t window = std::min(begin, DEFLATE_WINDOW_SIZE);
+
+                ConstMemory dictionary(filtered + begin - window, window);
+                ConstMemory data(filtered + begin, end - begin);
+
+                if (!deflate_band(output[i], dictionary, data, level, i == bands - 1))
+                {
+                    success = false;
+                }
+            });
+        }
 
-            // compress filler byte
-            u8 zero = 0;
-            z.avail_in = 1;
-            z.next_in = &zero;
-            deflate(&z, Z_NO_FLUSH);
+        queue.wait();
 
-            // compress scanline
-            z.avail_in = bytesPerLine;
-            z.next_in = surface.address<u8>(0, y);
-            deflate(&z, last_scan ? Z_FINISH : Z_NO_FLUSH);
+        if (!success)
+        {
+            return false;
         }
 
-        // compressed size includes chunkID
-        const size_t compressed_size = int(z.next_out - buffer);
+        ustore32be(temp, adler32(1, ConstMemory(filtered, filtered.size())));
+        output[bands - 1].output.append(temp, 4);
 
-        deflateEnd(&z);
+        for (auto& band : output)
+        {
+            writeChunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), band.output);
+        }
 
-        // write chunkdID + compressed data
-        writeChunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), Memory(buffer, compressed_size));
+        return true;
     }
 
-    void writePNG(Stream& stream, const Surface& surface, u8 color_bits, ColorType color_type)
+    bool writePNG(Stream& stream, const Surface& surface, u8 color_bits, ColorType color_type, int level)
     {
         static const u8 magic[] =
         {
@@ -1955,12 +2700,18 @@ namespace
         s.write(magic, 8);
 
         write_IHDR(stream, surface, color_bits, color_type);
-        write_IDAT(stream, surface);
+
+        if (!write_IDAT(stream, surface, color_bits, level))
+        {
+            return false;
+        }
 
         // write IEND
         s.write32(0);
         s.write32(0x49454e44);
         s.write32(0xae426082);
+
+        return true;
     }
 
     // ------------------------------------------------------------
@@ -2031,6 +2782,39 @@ namespace
 
             return status;
         }
+
+        ImageDecodeStatus decode(Surface& dest, const ImageDecodeOptions& options, int level, int depth, int face) override
+        {
+            const ImageHeader& header = m_parser.getHeader();
+            if (!header.success)
+            {
+                ImageDecodeStatus status;
+                status.setError(header.info);
+                return status;
+            }
+
+            ImageDecodeRegion region(dest, options, header.width, header.height);
+
+            if (region.isWhole())
+            {
+                return decode(dest, options.palette, level, depth, face);
+            }
+
+            if (!region.width || !region.height)
+            {
+                // the region is outside of the image
+                return ImageDecodeStatus();
+            }
+
+            // the palette is resolved into indices when it is requested
+            Palette* ptr_palette = header.palette ? options.palette : nullptr;
+            Format format = ptr_palette ? dest.format : header.format;
+
+            ImageDecodeStatus status = m_parser.decode(region, format, ptr_palette);
+            status.direct = false;
+
+            return status;
+        }
     };
 
     ImageDecoderInterface* createInterface(ConstMemory memory)
@@ -2045,10 +2829,13 @@ namespace
 
     ImageEncodeStatus imageEncode(Stream& stream, const Surface& surface, const ImageEncodeOptions& options)
     {
-        MANGO_UNREFERENCED(options);
-
         ImageEncodeStatus status;
 
+        // quality selects the deflate level: 0.0 is the fastest and 1.0 the smallest;
+        // the levels above 5 cost a lot of time for little gain on filtered scanlines
+        static const int levels[] = { 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 9 };
+        const int level = levels[clamp(int(options.quality * 10.0f + 0.5f), 0, 10)];
+
         // defaults
         u8 color_bits = 8;
         ColorType color_type = COLOR_TYPE_RGBA;
@@ -2105,15 +2892,22 @@ namespace
             }
         }
 
+        bool success;
+
         if (surface.format == format)
         {
-            writePNG(stream, surface, color_bits, color_type);
+            success = writePNG(stream, surface, color_bits, color_type, level);
         }
         else
         {
             Bitmap temp(surface.width, surface.height, format);
             temp.blit(0, 0, surface);
-            writePNG(stream, temp, color_bits, color_type);
+            success = writePNG(stream, temp, color_bits, color_type, level);
+        }
+
+        if (!success)
+        {
+            status.setError("[ImageEncoder.PNG] Compression failed.");
         }
 
         return status;
@@ -483,14 +483,16 @@ namespace
                 else
                 {
                     BigEndianConstPointer e = p;
+                    std::vector<u16> scan(xcount);
 
                     for (int y = 0; y < m_header.height; ++y)
                     {
                         u8* image = dest.address<u8>(0, y);
+                        e.read16(scan.data(), xcount);
 
                         for (int x = 0; x < xcount; ++x)
                         {
-                            int value = e.read16();
+                            int value = scan[x];
                             image[x] = u8(value * 255 / m_header.maxvalue);
                         }
                     }
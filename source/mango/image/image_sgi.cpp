@@ -154,17 +154,10 @@ namespace
             int num = height * channels;
 
             std::vector<u32> offsets(num);
-            std::vector<s32> sizes(num);
+            std::vector<u32> sizes(num);
 
-            for (int i = 0; i < num; ++i)
-            {
-                offsets[i] = p.read32();
-            }
-
-            for (int i = 0; i < num; ++i)
-            {
-                sizes[i] = p.read32();
-            }
+            p.read32(offsets.data(), num);
+            p.read32(sizes.data(), num);
 
             for (int channel = 0; channel < channels; ++channel)
             {
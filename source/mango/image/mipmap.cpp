@@ -0,0 +1,321 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <mango/core/exception.hpp>
+#include <mango/core/bits.hpp>
+#include <mango/image/mipmap.hpp>
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // alpha coverage
+    // ----------------------------------------------------------------------------
+
+    // The levels are filtered in RGBA32F; the alpha is the fourth float of a texel.
+
+    size_t countCoverage(const Surface& surface, float reference)
+    {
+        size_t count = 0;
+
+        for (int y = 0; y < surface.height; ++y)
+        {
+            const float* scan = surface.address<float>(0, y);
+            for (int x = 0; x < surface.width; ++x)
+            {
+                count += scan[x * 4 + 3] >= reference;
+            }
+        }
+
+        return count;
+    }
+
+    // The largest level is only stored in the target format; it is converted to
+    // RGBA32F a band of scanlines at a time.
+    float computeCoverage(const Surface& surface, float reference)
+    {
+        size_t count = 0;
+
+        if (surface.format == FORMAT_RGBA32F)
+        {
+            count = countCoverage(surface, reference);
+        }
+        else
+        {
+            const int band = std::min(surface.height, 64);
+            Bitmap temp(surface.width, band, FORMAT_RGBA32F);
+
+            for (int y = 0; y < surface.height; y += band)
+            {
+                const int height = std::min(band, surface.height - y);
+                Surface dest(temp, 0, 0, surface.width, height);
+                dest.blit(0, 0, Surface(surface, 0, y, surface.width, height));
+                count += countCoverage(dest, reference);
+            }
+        }
+
+        return float(double(count) / (size_t(surface.width) * surface.height));
+    }
+
+    void scaleCoverage(const Surface& surface, float coverage, float reference)
+    {
+        const size_t size = size_t(surface.width) * surface.height;
+        const size_t count = size_t(coverage * size + 0.5f);
+
+        if (!count || count > size)
+            return;
+
+        std::vector<float> alpha(size);
+
+        for (int y = 0; y < surface.height; ++y)
+        {
+            const float* scan = surface.address<float>(0, y);
+            float* dest = alpha.data() + size_t(y) * surface.width;
+            for (int x = 0; x < surface.width; ++x)
+            {
+                dest[x] = scan[x * 4 + 3];
+            }
+        }
+
+        // the alpha of the count:th most opaque texel is scaled to the reference
+        auto nth = alpha.begin() + (count - 1);
+        std::nth_element(alpha.begin(), nth, alpha.end(), std::greater<float>());
+
+        const float threshold = *nth;
+        if (threshold <= 0.0f)
+            return;
+
+        const float scale = reference / threshold;
+
+        for (int y = 0; y < surface.height; ++y)
+        {
+            float* scan = surface.address<float>(0, y);
+            for (int x = 0; x < surface.width; ++x)
+            {
+                scan[x * 4 + 3] = std::min(1.0f, scan[x * 4 + 3] * scale);
+            }
+        }
+    }
+
+    void compressLevel(const Mipmap& mipmap, int level, const Surface& surface)
+    {
+        TextureCompressionStatus status = mipmap.info.compress(mipmap.memory(level), surface);
+        if (!status)
+        {
+            MANGO_EXCEPTION("[MipmapGenerator] %s", status.info.c_str());
+        }
+    }
+
+} // namespace
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // Mipmap
+    // ----------------------------------------------------------------------------
+
+    Mipmap::Mipmap(int width, int height, const Format& format, int levels)
+        : format(format)
+    {
+        allocate(width, height, levels, 1, 1, format.bytes());
+    }
+
+    Mipmap::Mipmap(int width, int height, TextureCompression compression, int levels)
+        : info(compression)
+    {
+        format = info.format;
+
+        if (compression == TextureCompression::NONE)
+        {
+            MANGO_EXCEPTION("[Mipmap] Uncompressed chains are created with a Format.");
+        }
+
+        allocate(width, height, levels, info.width, info.height, info.bytes);
+    }
+
+    Mipmap::~Mipmap()
+    {
+    }
+
+    void Mipmap::allocate(int width, int height, int levels, int xblock, int yblock, int bytes)
+    {
+        if (width < 1 || height < 1)
+        {
+            MANGO_EXCEPTION("[Mipmap] Incorrect dimensions (%d x %d).", width, height);
+        }
+
+        const int maxLevels = getMaxLevelCount(width, height);
+        levels = levels > 0 ? std::min(levels, maxLevels) : maxLevels;
+
+        size_t offset = 0;
+
+        for (int i = 0; i < levels; ++i)
+        {
+            Level level;
+
+            level.width = std::max(1, width >> i);
+            level.height = std::max(1, height >> i);
+            level.offset = offset;
+            level.bytes = size_t(ceil_div(level.width, xblock)) * ceil_div(level.height, yblock) * bytes;
+
+            m_levels.push_back(level);
+            offset += level.bytes;
+        }
+
+        m_buffer.resize(offset);
+    }
+
+    int Mipmap::getLevelCount() const
+    {
+        return int(m_levels.size());
+    }
+
+    int Mipmap::getWidth(int level) const
+    {
+        return m_levels[level].width;
+    }
+
+    int Mipmap::getHeight(int level) const
+    {
+        return m_levels[level].height;
+    }
+
+    Memory Mipmap::memory() const
+    {
+        return m_buffer;
+    }
+
+    Memory Mipmap::memory(int level) const
+    {
+        const Level& data = m_levels[level];
+        return Memory(m_buffer.data() + data.offset, data.bytes);
+    }
+
+    Surface Mipmap::surface(int level) const
+    {
+        if (info.compression != TextureCompression::NONE)
+        {
+            MANGO_EXCEPTION("[Mipmap] Compressed levels are not surfaces.");
+        }
+
+        const Level& data = m_levels[level];
+        const int stride = data.width * format.bytes();
+        return Surface(data.width, data.height, format, stride, m_buffer.data() + data.offset);
+    }
+
+    int Mipmap::getMaxLevelCount(int width, int height)
+    {
+        return u32_log2(std::max(std::max(width, height), 1)) + 1;
+    }
+
+    // ----------------------------------------------------------------------------
+    // MipmapGenerator
+    // ----------------------------------------------------------------------------
+
+    MipmapGenerator::MipmapGenerator(const MipmapOptions& options)
+        : m_options(options)
+    {
+    }
+
+    MipmapGenerator::~MipmapGenerator()
+    {
+    }
+
+    void MipmapGenerator::generate(const Mipmap& mipmap, const Surface& source) const
+    {
+        const bool compressed = mipmap.info.compression != TextureCompression::NONE;
+
+        if (compressed && !mipmap.info.encode)
+        {
+            MANGO_EXCEPTION("[MipmapGenerator] No encoder for 0x%x.", u32(mipmap.info.compression));
+        }
+
+        ResampleOptions options;
+        options.filter = m_options.filter;
+        options.srgb = m_options.srgb;
+        options.premultiply = m_options.premultiply;
+
+        // conversion from linear float RGBA to the storage format
+        ResampleOptions store = options;
+        store.filter = ResampleFilter::BOX;
+        store.premultiply = false;
+
+        const float reference = m_options.alphaCoverage;
+        float coverage = 0.0f;
+
+        // the previous level in linear float RGBA; the two largest levels are
+        // resampled from the source so the largest level has no float copy
+        std::unique_ptr<Bitmap> previous;
+
+        for (int level = 0; level < mipmap.getLevelCount(); ++level)
+        {
+            const int width = mipmap.getWidth(level);
+            const int height = mipmap.getHeight(level);
+
+            if (!level)
+            {
+                // a copy of the source when the size matches, otherwise resampled
+                // directly to the storage format
+                const bool copy = width == source.width && height == source.height;
+
+                if (compressed)
+                {
+                    Bitmap temp(width, height, mipmap.format);
+                    if (copy)
+                        temp.blit(0, 0, source);
+                    else
+                        resample(temp, source, options);
+
+                    if (reference > 0.0f)
+                        coverage = computeCoverage(temp, reference);
+
+                    compressLevel(mipmap, level, temp);
+                }
+                else
+                {
+                    Surface surface = mipmap.surface(level);
+                    if (copy)
+                        surface.blit(0, 0, source);
+                    else
+                        resample(surface, source, options);
+
+                    if (reference > 0.0f)
+                        coverage = computeCoverage(surface, reference);
+                }
+
+                continue;
+            }
+
+            std::unique_ptr<Bitmap> current(new Bitmap(width, height, FORMAT_RGBA32F));
+
+            resample(*current, previous ? *previous : source, options);
+
+            if (reference > 0.0f)
+            {
+                scaleCoverage(*current, coverage, reference);
+            }
+
+            // convert to the storage format
+            if (compressed)
+            {
+                Bitmap temp(width, height, mipmap.format);
+                resample(temp, *current, store);
+
+                compressLevel(mipmap, level, temp);
+            }
+            else
+            {
+                resample(mipmap.surface(level), *current, store);
+            }
+
+            previous = std::move(current);
+        }
+    }
+
+} // namespace mango
@@ -0,0 +1,1181 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/math/math.hpp>
+#include <mango/image/blitter.hpp>
+#include <mango/image/pixelops.hpp>
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // PixelBlock
+    // ----------------------------------------------------------------------------
+
+    // The operations work on blocks of pixels which are stored as separate float
+    // planes for the red, green, blue and alpha components with values in [0, 1].
+    // The planes are padded to whole vectors so the kernels don't have tails.
+
+    constexpr int BLOCK_SIZE = 256;
+
+    struct PixelBlock
+    {
+        alignas(16) float plane[4][BLOCK_SIZE];
+
+        PixelBlock()
+        {
+            std::memset(plane, 0, sizeof(plane));
+        }
+    };
+
+    bool is_bytes(const Format& format)
+    {
+        if (format.type != Format::UNORM || format.isIndexed())
+            return false;
+
+        if (!format.bits || format.bits > 32 || format.bits & 7)
+            return false;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (format.size[i] && (format.size[i] != 8 || format.offset[i] & 7))
+                return false;
+        }
+
+        return true;
+    }
+
+    void check_component(int component)
+    {
+        if (component < int(Format::RED) || component > int(Format::ALPHA))
+        {
+            MANGO_EXCEPTION("[PixelOps] Incorrect component (%d).", component);
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // bytes
+    // ----------------------------------------------------------------------------
+
+    template <int BYTES>
+    inline u32 load_word(const u8* p)
+    {
+        u32 value = 0;
+        for (int i = 0; i < BYTES; ++i)
+        {
+            value |= u32(p[i]) << (i * 8);
+        }
+        return value;
+    }
+
+    template <int BYTES>
+    inline void store_word(u8* p, u32 value)
+    {
+        for (int i = 0; i < BYTES; ++i)
+        {
+            p[i] = u8(value >> (i * 8));
+        }
+    }
+
+    // the pixels are loaded into 32 bit words, four at a time
+    template <int BYTES>
+    inline uint32x4 load_words(const u8* src, int count)
+    {
+        if (BYTES == 4 && count == 4)
+            return simd::u32x4_uload(reinterpret_cast<const u32*>(src));
+
+        u32 temp[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < count; ++i)
+        {
+            temp[i] = load_word<BYTES>(src + i * BYTES);
+        }
+        return simd::u32x4_uload(temp);
+    }
+
+    template <int BYTES>
+    inline void store_words(u8* dest, uint32x4 v, int count)
+    {
+        if (BYTES == 4 && count == 4)
+        {
+            simd::u32x4_ustore(reinterpret_cast<u32*>(dest), v);
+            return;
+        }
+
+        u32 temp[4];
+        simd::u32x4_ustore(temp, v);
+        for (int i = 0; i < count; ++i)
+        {
+            store_word<BYTES>(dest + i * BYTES, temp[i]);
+        }
+    }
+
+    struct ByteLayout
+    {
+        int shift[4];
+        u32 loadMask[4];
+        u32 storeMask[4];
+        float bias[4];
+        bool luminance;
+
+        // four 8 bit components; the component of every byte in the pixel
+        bool full;
+        int component[4];
+    };
+
+    template <int BYTES>
+    void read_bytes(PixelBlock& block, const u8* src, int count, const ByteLayout& layout)
+    {
+        const float32x4 scale(1.0f / 255.0f);
+
+        uint32x4 mask[4];
+        float32x4 bias[4];
+        int shift[4];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            mask[i] = uint32x4(layout.loadMask[i]);
+            bias[i] = float32x4(layout.bias[i]);
+            shift[i] = layout.shift[i];
+        }
+
+        for (int x = 0; x < count; x += 4)
+        {
+            const uint32x4 v = load_words<BYTES>(src + x * BYTES, std::min(4, count - x));
+
+            for (int i = 0; i < 4; ++i)
+            {
+                uint32x4 c = (v >> shift[i]) & mask[i];
+                float32x4 f = convert<float32x4>(reinterpret<int32x4>(c)) * scale + bias[i];
+                simd::f32x4_ustore(block.plane[i] + x, f);
+            }
+        }
+    }
+
+    template <int BYTES>
+    void write_bytes(u8* dest, const PixelBlock& block, int count, const ByteLayout& layout)
+    {
+        const float32x4 scale(255.0f);
+
+        uint32x4 mask[4];
+        int shift[4];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            mask[i] = uint32x4(layout.storeMask[i]);
+            shift[i] = layout.shift[i];
+        }
+
+        const bool luminance = layout.luminance;
+
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 c[4];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                c[i] = simd::f32x4_uload(block.plane[i] + x);
+            }
+
+            if (luminance)
+            {
+                c[0] = c[0] * 0.299f + c[1] * 0.587f + c[2] * 0.114f;
+            }
+
+            uint32x4 v(0);
+
+            for (int i = 0; i < 4; ++i)
+            {
+                float32x4 f = clamp(c[i], 0.0f, 1.0f) * scale;
+                uint32x4 u = reinterpret<uint32x4>(convert<int32x4>(f));
+                v = v | ((u & mask[i]) << shift[i]);
+            }
+
+            store_words<BYTES>(dest + x * BYTES, v, std::min(4, count - x));
+        }
+    }
+
+#if defined(MANGO_ENABLE_SSE2)
+
+    // Pixels with four 8 bit components are split into byte planes with constant
+    // shifts and packed back with saturating packs, which also clamp the values.
+
+    inline void unpack_bytes(float32x4* b, __m128i v)
+    {
+        const __m128i mask = _mm_set1_epi32(0xff);
+        const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+
+        __m128i b0 = _mm_and_si128(v, mask);
+        __m128i b1 = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+        __m128i b2 = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+        __m128i b3 = _mm_srli_epi32(v, 24);
+
+        b[0] = simd::f32x4(_mm_mul_ps(_mm_cvtepi32_ps(b0), scale));
+        b[1] = simd::f32x4(_mm_mul_ps(_mm_cvtepi32_ps(b1), scale));
+        b[2] = simd::f32x4(_mm_mul_ps(_mm_cvtepi32_ps(b2), scale));
+        b[3] = simd::f32x4(_mm_mul_ps(_mm_cvtepi32_ps(b3), scale));
+    }
+
+    inline __m128i pack_bytes(const float32x4* b)
+    {
+        const __m128 scale = _mm_set1_ps(255.0f);
+
+        __m128i b0 = _mm_cvtps_epi32(_mm_mul_ps(b[0].m, scale));
+        __m128i b1 = _mm_cvtps_epi32(_mm_mul_ps(b[1].m, scale));
+        __m128i b2 = _mm_cvtps_epi32(_mm_mul_ps(b[2].m, scale));
+        __m128i b3 = _mm_cvtps_epi32(_mm_mul_ps(b[3].m, scale));
+
+        // b0 x 4, b2 x 4, b1 x 4, b3 x 4
+        __m128i v = _mm_packus_epi16(_mm_packs_epi32(b0, b2), _mm_packs_epi32(b1, b3));
+
+        // 4x4 byte transpose
+        v = _mm_unpacklo_epi8(v, _mm_unpackhi_epi64(v, v));
+        v = _mm_unpacklo_epi16(v, _mm_unpackhi_epi64(v, v));
+        return v;
+    }
+
+    inline __m128i load_bytes(const u8* src, int count)
+    {
+        if (count >= 4)
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+
+        u32 temp[4] = { 0, 0, 0, 0 };
+        std::memcpy(temp, src, count * 4);
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(temp));
+    }
+
+    inline void store_bytes(u8* dest, __m128i v, int count)
+    {
+        if (count >= 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), v);
+            return;
+        }
+
+        u32 temp[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(temp), v);
+        std::memcpy(dest, temp, count * 4);
+    }
+
+    void read_bytes_full(PixelBlock& block, const u8* src, int count, const ByteLayout& layout)
+    {
+        float* plane[4];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            plane[i] = block.plane[layout.component[i]];
+        }
+
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 b[4];
+            unpack_bytes(b, load_bytes(src + x * 4, count - x));
+
+            for (int i = 0; i < 4; ++i)
+            {
+                simd::f32x4_ustore(plane[i] + x, b[i]);
+            }
+        }
+    }
+
+    void write_bytes_full(u8* dest, const PixelBlock& block, int count, const ByteLayout& layout)
+    {
+        const float* plane[4];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            plane[i] = block.plane[layout.component[i]];
+        }
+
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 b[4];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                b[i] = simd::f32x4_uload(plane[i] + x);
+            }
+
+            store_bytes(dest + x * 4, pack_bytes(b), count - x);
+        }
+    }
+
+    // The kernels which process the color components identically run directly
+    // on the byte planes when the alpha is the first or the last byte; the
+    // colors are passed in memory order.
+
+    template <int ALPHA>
+    inline void unpack_pixels(float32x4* c, const u8* src, int count)
+    {
+        float32x4 b[4];
+        unpack_bytes(b, load_bytes(src, count));
+
+        for (int i = 0; i < 3; ++i)
+        {
+            c[i] = b[ALPHA ? i : i + 1];
+        }
+
+        c[3] = b[ALPHA];
+    }
+
+    template <int ALPHA>
+    inline void pack_pixels(u8* dest, const float32x4* c, int count)
+    {
+        float32x4 b[4];
+
+        for (int i = 0; i < 3; ++i)
+        {
+            b[ALPHA ? i : i + 1] = c[i];
+        }
+
+        b[ALPHA] = c[3];
+        store_bytes(dest, pack_bytes(b), count);
+    }
+
+    template <int ALPHA, typename Kernel>
+    void process_pixels(u8* scan, int count, const Kernel& kernel)
+    {
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 c[4];
+            unpack_pixels<ALPHA>(c, scan + x * 4, count - x);
+            kernel(c);
+            pack_pixels<ALPHA>(scan + x * 4, c, count - x);
+        }
+    }
+
+    template <int ALPHA, typename Kernel>
+    void process_pixels(u8* dest, const u8* src, int count, const Kernel& kernel)
+    {
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 d[4];
+            float32x4 s[4];
+            unpack_pixels<ALPHA>(s, src + x * 4, count - x);
+            unpack_pixels<ALPHA>(d, dest + x * 4, count - x);
+            kernel(d, s);
+            pack_pixels<ALPHA>(dest + x * 4, d, count - x);
+        }
+    }
+
+#else
+
+    void read_bytes_full(PixelBlock& block, const u8* src, int count, const ByteLayout& layout)
+    {
+        read_bytes<4>(block, src, count, layout);
+    }
+
+    void write_bytes_full(u8* dest, const PixelBlock& block, int count, const ByteLayout& layout)
+    {
+        write_bytes<4>(dest, block, count, layout);
+    }
+
+#endif // MANGO_ENABLE_SSE2
+
+    // ----------------------------------------------------------------------------
+    // floats
+    // ----------------------------------------------------------------------------
+
+    void read_floats(PixelBlock& block, const float* src, int count)
+    {
+        int x = 0;
+
+        for ( ; x <= count - 4; x += 4)
+        {
+            const float* s = src + x * 4;
+            float32x4 p0 = simd::f32x4_uload(s + 0);
+            float32x4 p1 = simd::f32x4_uload(s + 4);
+            float32x4 p2 = simd::f32x4_uload(s + 8);
+            float32x4 p3 = simd::f32x4_uload(s + 12);
+
+            float32x4 t0 = unpacklo(p0, p1);
+            float32x4 t1 = unpacklo(p2, p3);
+            float32x4 t2 = unpackhi(p0, p1);
+            float32x4 t3 = unpackhi(p2, p3);
+
+            simd::f32x4_ustore(block.plane[0] + x, movelh(t0, t1));
+            simd::f32x4_ustore(block.plane[1] + x, movehl(t1, t0));
+            simd::f32x4_ustore(block.plane[2] + x, movelh(t2, t3));
+            simd::f32x4_ustore(block.plane[3] + x, movehl(t3, t2));
+        }
+
+        for ( ; x < count; ++x)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                block.plane[i][x] = src[x * 4 + i];
+            }
+        }
+    }
+
+    void write_floats(float* dest, const PixelBlock& block, int count)
+    {
+        int x = 0;
+
+        for ( ; x <= count - 4; x += 4)
+        {
+            float32x4 r = simd::f32x4_uload(block.plane[0] + x);
+            float32x4 g = simd::f32x4_uload(block.plane[1] + x);
+            float32x4 b = simd::f32x4_uload(block.plane[2] + x);
+            float32x4 a = simd::f32x4_uload(block.plane[3] + x);
+
+            float32x4 t0 = unpacklo(r, g);
+            float32x4 t1 = unpacklo(b, a);
+            float32x4 t2 = unpackhi(r, g);
+            float32x4 t3 = unpackhi(b, a);
+
+            float* d = dest + x * 4;
+            simd::f32x4_ustore(d + 0, movelh(t0, t1));
+            simd::f32x4_ustore(d + 4, movehl(t1, t0));
+            simd::f32x4_ustore(d + 8, movelh(t2, t3));
+            simd::f32x4_ustore(d + 12, movehl(t3, t2));
+        }
+
+        for ( ; x < count; ++x)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                dest[x * 4 + i] = block.plane[i][x];
+            }
+        }
+    }
+
+    void blit_scan(const Blitter& blitter, u8* dest, const u8* src, int count)
+    {
+        BlitRect rect;
+
+        rect.src.address = const_cast<u8*>(src);
+        rect.src.stride = 0;
+        rect.dest.address = dest;
+        rect.dest.stride = 0;
+        rect.width = count;
+        rect.height = 1;
+
+        blitter.convert(rect);
+    }
+
+    // ----------------------------------------------------------------------------
+    // PixelAccess
+    // ----------------------------------------------------------------------------
+
+    // Reads and writes blocks of pixels in one format. The formats with 8 bit
+    // components are unpacked with shifts and masks, RGBA32F is transposed and the
+    // other formats are converted to RGBA32F with the Blitter first.
+
+    class PixelAccess : private NonCopyable
+    {
+    protected:
+        enum Path
+        {
+            BYTES,
+            FLOATS,
+            CONVERT
+        };
+
+        Path m_path;
+        int m_bytes;
+        ByteLayout m_layout;
+        int m_fused;
+
+        std::unique_ptr<Blitter> m_load;  // RGBA32F <- format
+        std::unique_ptr<Blitter> m_store; // format <- RGBA32F
+
+    public:
+        PixelAccess(const Format& format)
+            : m_bytes(format.bytes())
+            , m_fused(-1)
+        {
+            if (format.isIndexed() || !format.bits)
+            {
+                MANGO_EXCEPTION("[PixelOps] Indexed formats are not supported.");
+            }
+
+            if (is_bytes(format))
+            {
+                m_path = BYTES;
+
+                ByteLayout& layout = m_layout;
+                layout.luminance = format.isLuminance();
+
+                for (int i = 0; i < 4; ++i)
+                {
+                    const bool present = format.size[i] != 0;
+
+                    layout.shift[i] = format.offset[i];
+                    layout.loadMask[i] = present ? 0xff : 0;
+                    layout.storeMask[i] = present ? 0xff : 0;
+                    layout.bias[i] = !present && i == Format::ALPHA ? 1.0f : 0.0f;
+                }
+
+                if (layout.luminance)
+                {
+                    // the luminance is stored from the red component
+                    layout.storeMask[Format::GREEN] = 0;
+                    layout.storeMask[Format::BLUE] = 0;
+                }
+
+                layout.full = m_bytes == 4 && !layout.luminance &&
+                              format.size[0] && format.size[1] && format.size[2] && format.size[3];
+
+                if (layout.full)
+                {
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        layout.component[format.offset[i] / 8] = i;
+                    }
+
+#if defined(MANGO_ENABLE_SSE2)
+                    const int alpha = format.offset[Format::ALPHA] / 8;
+                    if (alpha == 0 || alpha == 3)
+                    {
+                        m_fused = alpha;
+                    }
+#endif
+                }
+            }
+            else if (format == FORMAT_RGBA32F)
+            {
+                m_path = FLOATS;
+            }
+            else
+            {
+                m_path = CONVERT;
+
+                m_load.reset(new Blitter(FORMAT_RGBA32F, format));
+                m_store.reset(new Blitter(format, FORMAT_RGBA32F));
+
+                if (!m_load->convertFunc || !m_store->convertFunc)
+                {
+                    MANGO_EXCEPTION("[PixelOps] Unsupported format.");
+                }
+            }
+        }
+
+        int bytes() const
+        {
+            return m_bytes;
+        }
+
+        // the alpha byte of the formats which can be processed directly on the
+        // bytes with symmetric kernels, -1 otherwise
+        int fused() const
+        {
+            return m_fused;
+        }
+
+        // the surfaces can be processed together directly on the bytes
+        bool fused(const PixelAccess& access) const
+        {
+            return m_fused >= 0 && access.m_fused == m_fused &&
+                   !std::memcmp(m_layout.component, access.m_layout.component, sizeof(m_layout.component));
+        }
+
+        void read(PixelBlock& block, const u8* src, int count) const
+        {
+            switch (m_path)
+            {
+                case BYTES:
+                    if (m_layout.full)
+                    {
+                        read_bytes_full(block, src, count, m_layout);
+                        break;
+                    }
+
+                    switch (m_bytes)
+                    {
+                        case 1: read_bytes<1>(block, src, count, m_layout); break;
+                        case 2: read_bytes<2>(block, src, count, m_layout); break;
+                        case 3: read_bytes<3>(block, src, count, m_layout); break;
+                        case 4: read_bytes<4>(block, src, count, m_layout); break;
+                    }
+                    break;
+
+                case FLOATS:
+                    read_floats(block, reinterpret_cast<const float*>(src), count);
+                    break;
+
+                case CONVERT:
+                {
+                    alignas(16) float temp[BLOCK_SIZE * 4];
+                    blit_scan(*m_load, reinterpret_cast<u8*>(temp), src, count);
+                    read_floats(block, temp, count);
+                    break;
+                }
+            }
+        }
+
+        void write(u8* dest, const PixelBlock& block, int count) const
+        {
+            switch (m_path)
+            {
+                case BYTES:
+                    if (m_layout.full)
+                    {
+                        write_bytes_full(dest, block, count, m_layout);
+                        break;
+                    }
+
+                    switch (m_bytes)
+                    {
+                        case 1: write_bytes<1>(dest, block, count, m_layout); break;
+                        case 2: write_bytes<2>(dest, block, count, m_layout); break;
+                        case 3: write_bytes<3>(dest, block, count, m_layout); break;
+                        case 4: write_bytes<4>(dest, block, count, m_layout); break;
+                    }
+                    break;
+
+                case FLOATS:
+                    write_floats(reinterpret_cast<float*>(dest), block, count);
+                    break;
+
+                case CONVERT:
+                {
+                    alignas(16) float temp[BLOCK_SIZE * 4];
+                    write_floats(temp, block, count);
+                    blit_scan(*m_store, dest, reinterpret_cast<const u8*>(temp), count);
+                    break;
+                }
+            }
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // process
+    // ----------------------------------------------------------------------------
+
+    template <typename Func>
+    void process_bands(int width, int height, Func func)
+    {
+        const int threads = ThreadPool::getInstanceSize();
+
+        // small surfaces (animation frames, sub-surfaces) are processed in the caller
+        const bool parallel = threads > 1 && size_t(width) * height >= 128 * 1024;
+        const int bands = parallel ? std::max(1, std::min(threads * 2, height / 8)) : 1;
+
+        if (bands == 1)
+        {
+            func(0, height);
+            return;
+        }
+
+        ConcurrentQueue queue("pixelops", Priority::HIGH);
+
+        for (int i = 0; i < bands; ++i)
+        {
+            const int y0 = height * i / bands;
+            const int y1 = height * (i + 1) / bands;
+
+            queue.enqueue([&func, y0, y1]
+            {
+                func(y0, y1);
+            });
+        }
+
+        queue.wait();
+    }
+
+    // The kernels process four pixels in vectors of red, green, blue and alpha:
+    // - kernel(float32x4* c) for one surface
+    // - kernel(float32x4* dest, const float32x4* source) for two surfaces
+    // Kernel::SYMMETRIC kernels can receive the color components in any order and
+    // Kernel::LOAD kernels read the destination.
+
+    template <typename Kernel>
+    void process_block(PixelBlock& block, int count, const Kernel& kernel)
+    {
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 c[4];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                c[i] = simd::f32x4_uload(block.plane[i] + x);
+            }
+
+            kernel(c);
+
+            for (int i = 0; i < 4; ++i)
+            {
+                simd::f32x4_ustore(block.plane[i] + x, c[i]);
+            }
+        }
+    }
+
+    template <typename Kernel>
+    void process_block(PixelBlock& dest, const PixelBlock& source, int count, const Kernel& kernel)
+    {
+        for (int x = 0; x < count; x += 4)
+        {
+            float32x4 d[4];
+            float32x4 s[4];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                d[i] = simd::f32x4_uload(dest.plane[i] + x);
+                s[i] = simd::f32x4_uload(source.plane[i] + x);
+            }
+
+            kernel(d, s);
+
+            for (int i = 0; i < 4; ++i)
+            {
+                simd::f32x4_ustore(dest.plane[i] + x, d[i]);
+            }
+        }
+    }
+
+    template <typename Kernel>
+    void process(const Surface& surface, const Kernel& kernel)
+    {
+        const int width = surface.width;
+        const int height = surface.height;
+
+        if (width <= 0 || height <= 0)
+            return;
+
+        const PixelAccess access(surface.format);
+        const int bytes = access.bytes();
+        const int fused = Kernel::SYMMETRIC ? access.fused() : -1;
+
+        process_bands(width, height, [&] (int y0, int y1)
+        {
+#if defined(MANGO_ENABLE_SSE2)
+            if (fused >= 0)
+            {
+                for (int y = y0; y < y1; ++y)
+                {
+                    u8* scan = surface.address(0, y);
+                    if (fused)
+                        process_pixels<3>(scan, width, kernel);
+                    else
+                        process_pixels<0>(scan, width, kernel);
+                }
+                return;
+            }
+#endif
+
+            PixelBlock block;
+
+            for (int y = y0; y < y1; ++y)
+            {
+                u8* scan = surface.address(0, y);
+
+                for (int x = 0; x < width; x += BLOCK_SIZE)
+                {
+                    const int count = std::min(BLOCK_SIZE, width - x);
+                    u8* p = scan + x * bytes;
+
+                    access.read(block, p, count);
+                    process_block(block, count, kernel);
+                    access.write(p, block, count);
+                }
+            }
+        });
+    }
+
+    template <typename Kernel>
+    void process(const Surface& dest, const Surface& source, const Kernel& kernel)
+    {
+        const int width = std::min(dest.width, source.width);
+        const int height = std::min(dest.height, source.height);
+
+        if (width <= 0 || height <= 0)
+            return;
+
+        const PixelAccess destAccess(dest.format);
+        const PixelAccess sourceAccess(source.format);
+        const int destBytes = destAccess.bytes();
+        const int sourceBytes = sourceAccess.bytes();
+        const int fused = Kernel::SYMMETRIC && Kernel::LOAD && destAccess.fused(sourceAccess) ? destAccess.fused() : -1;
+
+        process_bands(width, height, [&] (int y0, int y1)
+        {
+#if defined(MANGO_ENABLE_SSE2)
+            if (fused >= 0)
+            {
+                for (int y = y0; y < y1; ++y)
+                {
+                    u8* dscan = dest.address(0, y);
+                    const u8* sscan = source.address(0, y);
+                    if (fused)
+                        process_pixels<3>(dscan, sscan, width, kernel);
+                    else
+                        process_pixels<0>(dscan, sscan, width, kernel);
+                }
+                return;
+            }
+#endif
+
+            PixelBlock d;
+            PixelBlock s;
+
+            for (int y = y0; y < y1; ++y)
+            {
+                u8* dscan = dest.address(0, y);
+                const u8* sscan = source.address(0, y);
+
+                for (int x = 0; x < width; x += BLOCK_SIZE)
+                {
+                    const int count = std::min(BLOCK_SIZE, width - x);
+                    u8* p = dscan + x * destBytes;
+
+                    sourceAccess.read(s, sscan + x * sourceBytes, count);
+                    if (Kernel::LOAD)
+                    {
+                        destAccess.read(d, p, count);
+                    }
+
+                    process_block(d, s, count, kernel);
+                    destAccess.write(p, d, count);
+                }
+            }
+        });
+    }
+
+    // ----------------------------------------------------------------------------
+    // kernels
+    // ----------------------------------------------------------------------------
+
+    struct Premultiply
+    {
+        enum { SYMMETRIC = 1 };
+
+        void operator () (float32x4* c) const
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                c[i] = c[i] * c[3];
+            }
+        }
+    };
+
+    struct Unpremultiply
+    {
+        enum { SYMMETRIC = 1 };
+
+        void operator () (float32x4* c) const
+        {
+            const float32x4 zero(0.0f);
+            const float32x4 one(1.0f);
+            const float32x4 inv = select(c[3] > zero, one / c[3], zero);
+
+            for (int i = 0; i < 3; ++i)
+            {
+                c[i] = c[i] * inv;
+            }
+        }
+    };
+
+    // Porter-Duff factors of the source and the destination:
+    // Fa = a0 + a1 * Da, Fb = b0 + b1 * Sa
+
+    struct CompositeFactor
+    {
+        float a0, a1;
+        float b0, b1;
+    };
+
+    const CompositeFactor g_composite_factors[] =
+    {
+        { 0.0f,  0.0f, 0.0f,  0.0f }, // CLEAR
+        { 1.0f,  0.0f, 0.0f,  0.0f }, // SOURCE
+        { 0.0f,  0.0f, 1.0f,  0.0f }, // DEST
+        { 1.0f,  0.0f, 1.0f, -1.0f }, // OVER
+        { 1.0f, -1.0f, 1.0f,  0.0f }, // DEST_OVER
+        { 0.0f,  1.0f, 0.0f,  0.0f }, // IN
+        { 0.0f,  0.0f, 0.0f,  1.0f }, // DEST_IN
+        { 1.0f, -1.0f, 0.0f,  0.0f }, // OUT
+        { 0.0f,  0.0f, 1.0f, -1.0f }, // DEST_OUT
+        { 0.0f,  1.0f, 1.0f, -1.0f }, // ATOP
+        { 1.0f, -1.0f, 0.0f,  1.0f }, // DEST_ATOP
+        { 1.0f, -1.0f, 1.0f, -1.0f }, // XOR
+    };
+
+    struct CompositePremultiplied
+    {
+        enum { SYMMETRIC = 1, LOAD = 1 };
+
+        float32x4 a0, a1;
+        float32x4 b0, b1;
+
+        CompositePremultiplied(const CompositeFactor& factor)
+            : a0(factor.a0), a1(factor.a1), b0(factor.b0), b1(factor.b1)
+        {
+        }
+
+        void operator () (float32x4* d, const float32x4* s) const
+        {
+            const float32x4 fa = a0 + a1 * d[3];
+            const float32x4 fb = b0 + b1 * s[3];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                d[i] = s[i] * fa + d[i] * fb;
+            }
+        }
+    };
+
+    struct CompositeStraight
+    {
+        enum { SYMMETRIC = 1, LOAD = 1 };
+
+        float32x4 a0, a1;
+        float32x4 b0, b1;
+
+        CompositeStraight(const CompositeFactor& factor)
+            : a0(factor.a0), a1(factor.a1), b0(factor.b0), b1(factor.b1)
+        {
+        }
+
+        void operator () (float32x4* d, const float32x4* s) const
+        {
+            const float32x4 zero(0.0f);
+            const float32x4 two(2.0f);
+
+            // weights of the straight colors
+            float32x4 wa = (a0 + a1 * d[3]) * s[3];
+            float32x4 wb = (b0 + b1 * s[3]) * d[3];
+            float32x4 ra = wa + wb;
+
+            // the reciprocal estimate is refined for the float formats
+            float32x4 inv = rcp(ra);
+            inv = inv * (two - ra * inv);
+            inv = select(ra > zero, inv, zero);
+            wa = wa * inv;
+            wb = wb * inv;
+
+            for (int i = 0; i < 3; ++i)
+            {
+                d[i] = s[i] * wa + d[i] * wb;
+            }
+
+            d[3] = ra;
+        }
+    };
+
+    struct Blend
+    {
+        enum { SYMMETRIC = 1, LOAD = 1 };
+
+        float32x4 alpha;
+
+        void operator () (float32x4* d, const float32x4* s) const
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                d[i] = d[i] + (s[i] - d[i]) * alpha;
+            }
+        }
+    };
+
+    struct ExtractChannel
+    {
+        enum { SYMMETRIC = 0, LOAD = 0 };
+
+        int component;
+
+        void operator () (float32x4* d, const float32x4* s) const
+        {
+            const float32x4 value = s[component];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                d[i] = value;
+            }
+        }
+    };
+
+    struct InsertChannel
+    {
+        enum { SYMMETRIC = 0, LOAD = 1 };
+
+        int component;
+        int lane;
+
+        void operator () (float32x4* d, const float32x4* s) const
+        {
+            d[component] = s[lane];
+        }
+    };
+
+    struct Swizzle
+    {
+        enum { SYMMETRIC = 0 };
+
+        int index[4];
+
+        void operator () (float32x4* c) const
+        {
+            const float32x4 temp[] = { c[0], c[1], c[2], c[3] };
+
+            for (int i = 0; i < 4; ++i)
+            {
+                c[i] = temp[index[i]];
+            }
+        }
+    };
+
+} // namespace
+
+namespace mango
+{
+
+    void premultiply(const Surface& surface)
+    {
+        if (!surface.format.isAlpha())
+            return;
+
+        process(surface, Premultiply());
+    }
+
+    void unpremultiply(const Surface& surface)
+    {
+        if (!surface.format.isAlpha())
+            return;
+
+        process(surface, Unpremultiply());
+    }
+
+    void composite(const Surface& dest, const Surface& source, CompositeMode mode, bool premultiplied)
+    {
+        const int index = int(mode);
+
+        if (index < 0 || index > int(CompositeMode::XOR))
+        {
+            MANGO_EXCEPTION("[PixelOps] Incorrect composite mode (%d).", index);
+        }
+
+        if (mode == CompositeMode::DEST)
+            return;
+
+        const CompositeFactor& factor = g_composite_factors[index];
+
+        if (premultiplied)
+            process(dest, source, CompositePremultiplied(factor));
+        else
+            process(dest, source, CompositeStraight(factor));
+    }
+
+    void blend(const Surface& dest, const Surface& source, float alpha)
+    {
+        Blend kernel;
+        kernel.alpha = clamp(alpha, 0.0f, 1.0f);
+        process(dest, source, kernel);
+    }
+
+    void extractChannel(const Surface& dest, const Surface& source, int component)
+    {
+        check_component(component);
+
+        ExtractChannel kernel;
+        kernel.component = component;
+        process(dest, source, kernel);
+    }
+
+    void insertChannel(const Surface& dest, const Surface& source, int component)
+    {
+        check_component(component);
+
+        InsertChannel kernel;
+        kernel.component = component;
+
+        // the first component of the source; the luminance is in all color components
+        kernel.lane = 0;
+        while (kernel.lane < int(Format::ALPHA) && !source.format.size[kernel.lane])
+        {
+            ++kernel.lane;
+        }
+
+        process(dest, source, kernel);
+    }
+
+    void swizzle(const Surface& surface, int red, int green, int blue, int alpha)
+    {
+        Swizzle kernel = { { red, green, blue, alpha } };
+
+        for (int i = 0; i < 4; ++i)
+        {
+            check_component(kernel.index[i]);
+        }
+
+        process(surface, kernel);
+    }
+
+    void applyLUT(const Surface& surface, const u8* red, const u8* green, const u8* blue, const u8* alpha)
+    {
+        const Format& format = surface.format;
+
+        if (!is_bytes(format))
+        {
+            MANGO_EXCEPTION("[PixelOps] The LUT requires a format with 8 bit components.");
+        }
+
+        if (surface.width <= 0 || surface.height <= 0)
+            return;
+
+        // the table of every byte in the pixel
+        u8 table[4][256];
+
+        for (int j = 0; j < 4; ++j)
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                table[j][i] = u8(i);
+            }
+        }
+
+        const u8* tables[] = { red, green, blue, alpha };
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (format.isLuminance() && (i == Format::GREEN || i == Format::BLUE))
+                continue;
+
+            if (format.size[i] && tables[i])
+            {
+                std::memcpy(table[format.offset[i] / 8], tables[i], 256);
+            }
+        }
+
+        const int bytes = format.bytes();
+        const int width = surface.width;
+
+        process_bands(width, surface.height, [&] (int y0, int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                u8* scan = surface.address(0, y);
+
+                if (bytes == 4)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        scan[0] = table[0][scan[0]];
+                        scan[1] = table[1][scan[1]];
+                        scan[2] = table[2][scan[2]];
+                        scan[3] = table[3][scan[3]];
+                        scan += 4;
+                    }
+                }
+                else
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        for (int j = 0; j < bytes; ++j)
+                        {
+                            scan[j] = table[j][scan[j]];
+                        }
+                        scan += bytes;
+                    }
+                }
+            }
+        });
+    }
+
+} // namespace mango
@@ -6,7 +6,13 @@
     Original NeuQuant implementation (C) 1994 Anthony Becker
     Based on Self Organizing Map (SOM) neural network algorithm by Kohonen
 */
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <limits>
 #include <mango/core/bits.hpp>
+#include <mango/core/memory.hpp>
+#include <mango/core/thread.hpp>
 #include <mango/math/math.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/image/quantize.hpp>
@@ -428,12 +434,690 @@ namespace
         }
     };
 
+    // ------------------------------------------------------------
+    // Wu
+    // ------------------------------------------------------------
+
+    // Xiaolin Wu, "Efficient Statistical Computations for Optimal Color Quantization",
+    // Graphics Gems II. The colors are counted in a 32x32x32 histogram; boxes of the
+    // histogram are split at the plane which minimizes the sum of the variances
+    // until there is a box for every palette entry.
+
+    constexpr int wusize = 33; // 32 cells and the zero plane per axis
+    constexpr int wucells = wusize * wusize * wusize;
+
+    inline int wuindex(int r, int g, int b)
+    {
+        return (r * wusize + g) * wusize + b;
+    }
+
+    struct Moments
+    {
+        std::vector<s64> wt;
+        std::vector<s64> mr;
+        std::vector<s64> mg;
+        std::vector<s64> mb;
+        std::vector<double> m2;
+
+        Moments()
+            : wt(wucells, 0)
+            , mr(wucells, 0)
+            , mg(wucells, 0)
+            , mb(wucells, 0)
+            , m2(wucells, 0.0)
+        {
+        }
+
+        void add(const Surface& surface, int y0, int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                const ColorBGRA* s = surface.address<ColorBGRA>(0, y);
+
+                for (int x = 0; x < surface.width; ++x)
+                {
+                    const int r = s[x].r;
+                    const int g = s[x].g;
+                    const int b = s[x].b;
+                    const int index = wuindex((r >> 3) + 1, (g >> 3) + 1, (b >> 3) + 1);
+
+                    wt[index] += 1;
+                    mr[index] += r;
+                    mg[index] += g;
+                    mb[index] += b;
+                    m2[index] += r * r + g * g + b * b;
+                }
+            }
+        }
+
+        void add(const Moments& moments)
+        {
+            for (int i = 0; i < wucells; ++i)
+            {
+                wt[i] += moments.wt[i];
+                mr[i] += moments.mr[i];
+                mg[i] += moments.mg[i];
+                mb[i] += moments.mb[i];
+                m2[i] += moments.m2[i];
+            }
+        }
+
+        // convert the histogram into cumulative moments so that the moments of
+        // any box can be computed from its eight corners
+        void cumulate()
+        {
+            for (int r = 1; r < wusize; ++r)
+            {
+                s64 area_wt[wusize] = { 0 };
+                s64 area_mr[wusize] = { 0 };
+                s64 area_mg[wusize] = { 0 };
+                s64 area_mb[wusize] = { 0 };
+                double area_m2[wusize] = { 0 };
+
+                for (int g = 1; g < wusize; ++g)
+                {
+                    s64 line_wt = 0;
+                    s64 line_mr = 0;
+                    s64 line_mg = 0;
+                    s64 line_mb = 0;
+                    double line_m2 = 0;
+
+                    for (int b = 1; b < wusize; ++b)
+                    {
+                        const int index = wuindex(r, g, b);
+
+                        line_wt += wt[index];
+                        line_mr += mr[index];
+                        line_mg += mg[index];
+                        line_mb += mb[index];
+                        line_m2 += m2[index];
+
+                        area_wt[b] += line_wt;
+                        area_mr[b] += line_mr;
+                        area_mg[b] += line_mg;
+                        area_mb[b] += line_mb;
+                        area_m2[b] += line_m2;
+
+                        const int previous = wuindex(r - 1, g, b);
+
+                        wt[index] = wt[previous] + area_wt[b];
+                        mr[index] = mr[previous] + area_mr[b];
+                        mg[index] = mg[previous] + area_mg[b];
+                        mb[index] = mb[previous] + area_mb[b];
+                        m2[index] = m2[previous] + area_m2[b];
+                    }
+                }
+            }
+        }
+    };
+
+    struct Box
+    {
+        int r0, r1; // r0 is exclusive
+        int g0, g1;
+        int b0, b1;
+        int volume;
+    };
+
+    template <typename T>
+    T volume(const Box& box, const std::vector<T>& m)
+    {
+        return m[wuindex(box.r1, box.g1, box.b1)]
+             - m[wuindex(box.r1, box.g1, box.b0)]
+             - m[wuindex(box.r1, box.g0, box.b1)]
+             + m[wuindex(box.r1, box.g0, box.b0)]
+             - m[wuindex(box.r0, box.g1, box.b1)]
+             + m[wuindex(box.r0, box.g1, box.b0)]
+             + m[wuindex(box.r0, box.g0, box.b1)]
+             - m[wuindex(box.r0, box.g0, box.b0)];
+    }
+
+    // the part of the volume which does not depend on the cutting plane position
+    s64 bottom(const Box& box, int axis, const std::vector<s64>& m)
+    {
+        switch (axis)
+        {
+            case 0:
+                return - m[wuindex(box.r0, box.g1, box.b1)]
+                       + m[wuindex(box.r0, box.g1, box.b0)]
+                       + m[wuindex(box.r0, box.g0, box.b1)]
+                       - m[wuindex(box.r0, box.g0, box.b0)];
+            case 1:
+                return - m[wuindex(box.r1, box.g0, box.b1)]
+                       + m[wuindex(box.r1, box.g0, box.b0)]
+                       + m[wuindex(box.r0, box.g0, box.b1)]
+                       - m[wuindex(box.r0, box.g0, box.b0)];
+            default:
+                return - m[wuindex(box.r1, box.g1, box.b0)]
+                       + m[wuindex(box.r1, box.g0, box.b0)]
+                       + m[wuindex(box.r0, box.g1, box.b0)]
+                       - m[wuindex(box.r0, box.g0, box.b0)];
+        }
+    }
+
+    // the rest of the volume when the box is cut at position
+    s64 top(const Box& box, int axis, int position, const std::vector<s64>& m)
+    {
+        switch (axis)
+        {
+            case 0:
+                return m[wuindex(position, box.g1, box.b1)]
+                     - m[wuindex(position, box.g1, box.b0)]
+                     - m[wuindex(position, box.g0, box.b1)]
+                     + m[wuindex(position, box.g0, box.b0)];
+            case 1:
+                return m[wuindex(box.r1, position, box.b1)]
+                     - m[wuindex(box.r1, position, box.b0)]
+                     - m[wuindex(box.r0, position, box.b1)]
+                     + m[wuindex(box.r0, position, box.b0)];
+            default:
+                return m[wuindex(box.r1, box.g1, position)]
+                     - m[wuindex(box.r1, box.g0, position)]
+                     - m[wuindex(box.r0, box.g1, position)]
+                     + m[wuindex(box.r0, box.g0, position)];
+        }
+    }
+
+    double variance(const Box& box, const Moments& m)
+    {
+        const double r = double(volume(box, m.mr));
+        const double g = double(volume(box, m.mg));
+        const double b = double(volume(box, m.mb));
+        const double w = double(volume(box, m.wt));
+        return volume(box, m.m2) - (r * r + g * g + b * b) / w;
+    }
+
+    double maximize(const Box& box, int axis, int first, int last, int& cut,
+                    double whole_r, double whole_g, double whole_b, double whole_w, const Moments& m)
+    {
+        const double base_r = double(bottom(box, axis, m.mr));
+        const double base_g = double(bottom(box, axis, m.mg));
+        const double base_b = double(bottom(box, axis, m.mb));
+        const double base_w = double(bottom(box, axis, m.wt));
+
+        double best = 0.0;
+        cut = -1;
+
+        for (int i = first; i < last; ++i)
+        {
+            double half_r = base_r + top(box, axis, i, m.mr);
+            double half_g = base_g + top(box, axis, i, m.mg);
+            double half_b = base_b + top(box, axis, i, m.mb);
+            double half_w = base_w + top(box, axis, i, m.wt);
+
+            if (half_w == 0)
+                continue; // the lower half is empty
+
+            double temp = (half_r * half_r + half_g * half_g + half_b * half_b) / half_w;
+
+            half_r = whole_r - half_r;
+            half_g = whole_g - half_g;
+            half_b = whole_b - half_b;
+            half_w = whole_w - half_w;
+
+            if (half_w == 0)
+                continue; // the upper half is empty
+
+            temp += (half_r * half_r + half_g * half_g + half_b * half_b) / half_w;
+
+            if (temp > best)
+            {
+                best = temp;
+                cut = i;
+            }
+        }
+
+        return best;
+    }
+
+    bool cut(Box& set1, Box& set2, const Moments& m)
+    {
+        const double whole_r = double(volume(set1, m.mr));
+        const double whole_g = double(volume(set1, m.mg));
+        const double whole_b = double(volume(set1, m.mb));
+        const double whole_w = double(volume(set1, m.wt));
+
+        int cutr, cutg, cutb;
+        const double maxr = maximize(set1, 0, set1.r0 + 1, set1.r1, cutr, whole_r, whole_g, whole_b, whole_w, m);
+        const double maxg = maximize(set1, 1, set1.g0 + 1, set1.g1, cutg, whole_r, whole_g, whole_b, whole_w, m);
+        const double maxb = maximize(set1, 2, set1.b0 + 1, set1.b1, cutb, whole_r, whole_g, whole_b, whole_w, m);
+
+        set2.r1 = set1.r1;
+        set2.g1 = set1.g1;
+        set2.b1 = set1.b1;
+
+        if (maxr >= maxg && maxr >= maxb)
+        {
+            if (cutr < 0)
+                return false; // the box cannot be split
+            set1.r1 = set2.r0 = cutr;
+            set2.g0 = set1.g0;
+            set2.b0 = set1.b0;
+        }
+        else if (maxg >= maxr && maxg >= maxb)
+        {
+            set1.g1 = set2.g0 = cutg;
+            set2.r0 = set1.r0;
+            set2.b0 = set1.b0;
+        }
+        else
+        {
+            set1.b1 = set2.b0 = cutb;
+            set2.r0 = set1.r0;
+            set2.g0 = set1.g0;
+        }
+
+        set1.volume = (set1.r1 - set1.r0) * (set1.g1 - set1.g0) * (set1.b1 - set1.b0);
+        set2.volume = (set2.r1 - set2.r0) * (set2.g1 - set2.g0) * (set2.b1 - set2.b0);
+
+        return true;
+    }
+
+    // ------------------------------------------------------------
+    // PaletteSearch
+    // ------------------------------------------------------------
+
+    // Exhaustive nearest color search which compares four palette entries at a time.
+
+    struct PaletteSearch
+    {
+        float32x4 r[64];
+        float32x4 g[64];
+        float32x4 b[64];
+        float32x4 color[256]; // BGR0 for the error diffusion
+        int groups;
+
+        PaletteSearch(const Palette& palette, int size)
+        {
+            float temp[3][256];
+
+            for (int i = 0; i < 256; ++i)
+            {
+                // unused entries are too far to be selected
+                const bool used = i < size;
+                temp[0][i] = used ? palette[i].r : 1e10f;
+                temp[1][i] = used ? palette[i].g : 1e10f;
+                temp[2][i] = used ? palette[i].b : 1e10f;
+                color[i] = float32x4(palette[i].b, palette[i].g, palette[i].r, 0.0f);
+            }
+
+            groups = (size + 3) / 4;
+
+            for (int i = 0; i < groups; ++i)
+            {
+                r[i] = float32x4(temp[0][i * 4 + 0], temp[0][i * 4 + 1], temp[0][i * 4 + 2], temp[0][i * 4 + 3]);
+                g[i] = float32x4(temp[1][i * 4 + 0], temp[1][i * 4 + 1], temp[1][i * 4 + 2], temp[1][i * 4 + 3]);
+                b[i] = float32x4(temp[2][i * 4 + 0], temp[2][i * 4 + 1], temp[2][i * 4 + 2], temp[2][i * 4 + 3]);
+            }
+        }
+
+        int nearest(float red, float green, float blue) const
+        {
+            const float32x4 sr(red);
+            const float32x4 sg(green);
+            const float32x4 sb(blue);
+
+            float32x4 best(std::numeric_limits<float>::max());
+            int32x4 bestIndex(0);
+            int32x4 index(0, 1, 2, 3);
+
+            for (int i = 0; i < groups; ++i)
+            {
+                const float32x4 dr = r[i] - sr;
+                const float32x4 dg = g[i] - sg;
+                const float32x4 db = b[i] - sb;
+                const float32x4 distance = dr * dr + dg * dg + db * db;
+
+                const mask32x4 mask = distance < best;
+                best = select(mask, distance, best);
+                bestIndex = select(mask, index, bestIndex);
+                index = index + int32x4(4);
+            }
+
+            int result = bestIndex[0];
+            float distance = best[0];
+
+            for (int i = 1; i < 4; ++i)
+            {
+                if (best[i] < distance || (best[i] == distance && bestIndex[i] < result))
+                {
+                    result = bestIndex[i];
+                    distance = best[i];
+                }
+            }
+
+            return result;
+        }
+    };
+
+    // ------------------------------------------------------------
+    // ColorCache
+    // ------------------------------------------------------------
+
+    // Nearest palette entries of a 64x64x64 grid. The entries are searched when
+    // a grid cell is first used; the threads which map the same cell store the
+    // same index so the cells can be filled concurrently.
+
+    struct ColorCache
+    {
+        const PaletteSearch& search;
+        std::unique_ptr<std::atomic<u16>[]> cells;
+
+        ColorCache(const PaletteSearch& search)
+            : search(search)
+            , cells(new std::atomic<u16>[64 * 64 * 64])
+        {
+            for (int i = 0; i < 64 * 64 * 64; ++i)
+            {
+                cells[i].store(0xffff, std::memory_order_relaxed);
+            }
+        }
+
+        u8 lookup(int r, int g, int b) const
+        {
+            const int index = ((r >> 2) << 12) | ((g >> 2) << 6) | (b >> 2);
+            u16 value = cells[index].load(std::memory_order_relaxed);
+
+            if (value > 255)
+            {
+                // cell center
+                value = u16(search.nearest((r & ~3) + 1.5f, (g & ~3) + 1.5f, (b & ~3) + 1.5f));
+                cells[index].store(value, std::memory_order_relaxed);
+            }
+
+            return u8(value);
+        }
+    };
+
+    // ------------------------------------------------------------
+    // quantize_wu()
+    // ------------------------------------------------------------
+
+    void kmeans(Palette& palette, int size, const Moments& histogram, int iterations)
+    {
+        struct Cell
+        {
+            float r, g, b;
+            double weight;
+        };
+
+        std::vector<Cell> cells;
+
+        for (int i = 0; i < wucells; ++i)
+        {
+            const s64 weight = histogram.wt[i];
+            if (weight)
+            {
+                const double scale = 1.0 / weight;
+                cells.push_back({ float(histogram.mr[i] * scale), float(histogram.mg[i] * scale),
+                                  float(histogram.mb[i] * scale), double(weight) });
+            }
+        }
+
+        for (int iteration = 0; iteration < iterations; ++iteration)
+        {
+            PaletteSearch search(palette, size);
+
+            double sum[256][4] = { { 0 } };
+
+            for (const Cell& cell : cells)
+            {
+                const int index = search.nearest(cell.r, cell.g, cell.b);
+                sum[index][0] += cell.r * cell.weight;
+                sum[index][1] += cell.g * cell.weight;
+                sum[index][2] += cell.b * cell.weight;
+                sum[index][3] += cell.weight;
+            }
+
+            for (int i = 0; i < size; ++i)
+            {
+                if (sum[i][3] > 0)
+                {
+                    const double scale = 1.0 / sum[i][3];
+                    palette[i].r = u8(clamp(int(sum[i][0] * scale + 0.5), 0, 255));
+                    palette[i].g = u8(clamp(int(sum[i][1] * scale + 0.5), 0, 255));
+                    palette[i].b = u8(clamp(int(sum[i][2] * scale + 0.5), 0, 255));
+                }
+            }
+        }
+    }
+
+    int palette_wu(Palette& palette, const Surface& pixels, int iterations)
+    {
+        const int threads = ThreadPool::getInstanceSize();
+        const int bands = std::max(1, std::min(threads, pixels.height / 64));
+
+        // the bands are counted into separate histograms which are merged
+        std::vector<Moments> moments(bands);
+
+        ConcurrentQueue queue("quantize", Priority::HIGH);
+
+        for (int i = 0; i < bands; ++i)
+        {
+            const int y0 = pixels.height * i / bands;
+            const int y1 = pixels.height * (i + 1) / bands;
+
+            queue.enqueue([&moments, &pixels, i, y0, y1]
+            {
+                moments[i].add(pixels, y0, y1);
+            });
+        }
+
+        queue.wait();
+
+        Moments& m = moments[0];
+
+        for (int i = 1; i < bands; ++i)
+        {
+            m.add(moments[i]);
+        }
+
+        // the histogram (before cumulating) for k-means
+        Moments histogram;
+        if (iterations > 0)
+        {
+            histogram = m;
+        }
+
+        m.cumulate();
+
+        Box cube[256];
+        double vv[256];
+
+        cube[0] = { 0, 32, 0, 32, 0, 32, 32 * 32 * 32 };
+
+        int size = 256;
+        int next = 0;
+
+        for (int i = 1; i < size; ++i)
+        {
+            if (cut(cube[next], cube[i], m))
+            {
+                vv[next] = cube[next].volume > 1 ? variance(cube[next], m) : 0.0;
+                vv[i] = cube[i].volume > 1 ? variance(cube[i], m) : 0.0;
+            }
+            else
+            {
+                vv[next] = 0.0;
+                --i;
+            }
+
+            next = 0;
+            double temp = vv[0];
+
+            for (int k = 1; k <= i; ++k)
+            {
+                if (vv[k] > temp)
+                {
+                    temp = vv[k];
+                    next = k;
+                }
+            }
+
+            if (temp <= 0.0)
+            {
+                size = i + 1;
+                break;
+            }
+        }
+
+        for (int i = 0; i < 256; ++i)
+        {
+            palette[i] = ColorBGRA(0, 0, 0, 0xff);
+
+            if (i < size)
+            {
+                const s64 weight = volume(cube[i], m.wt);
+                if (weight)
+                {
+                    palette[i].r = u8(volume(cube[i], m.mr) / weight);
+                    palette[i].g = u8(volume(cube[i], m.mg) / weight);
+                    palette[i].b = u8(volume(cube[i], m.mb) / weight);
+                }
+            }
+        }
+
+        if (iterations > 0)
+        {
+            kmeans(palette, size, histogram, iterations);
+        }
+
+        return size;
+    }
+
+    void map_band(const Surface& dest, const Surface& pixels, int y0, int y1,
+                  const PaletteSearch& search, const ColorCache& cache, bool dithering)
+    {
+        const int width = pixels.width;
+
+        if (!dithering)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                const ColorBGRA* s = pixels.address<ColorBGRA>(0, y);
+                u8* d = dest.address<u8>(0, y);
+
+                for (int x = 0; x < width; ++x)
+                {
+                    d[x] = cache.lookup(s[x].r, s[x].g, s[x].b);
+                }
+            }
+
+            return;
+        }
+
+        // Floyd-Steinberg error diffusion; the scanlines are processed in alternating
+        // directions. The error rows have one padding element at both ends. The error
+        // for the next pixel and for the next scanline is accumulated in registers;
+        // every element of the next error row is stored exactly once.
+        AlignedPointer<float32x4> buffer((width + 2) * 2);
+        float32x4* current = buffer + 1;
+        float32x4* next = buffer + width + 3;
+
+        for (int x = -1; x <= width; ++x)
+        {
+            current[x] = 0.0f;
+        }
+
+        const float32x4 w7(7.0f / 16.0f);
+        const float32x4 w5(5.0f / 16.0f);
+        const float32x4 w3(3.0f / 16.0f);
+        const float32x4 w1(1.0f / 16.0f);
+
+        for (int y = y0; y < y1; ++y)
+        {
+            const u32* s = pixels.address<u32>(0, y);
+            u8* d = dest.address<u8>(0, y);
+
+            const bool reverse = ((y - y0) & 1) != 0;
+            const int step = reverse ? -1 : 1;
+            int x = reverse ? width - 1 : 0;
+
+            float32x4 right = 0.0f; // error for the next pixel
+            float32x4 below0 = 0.0f; // error for next[x - step]
+            float32x4 below1 = 0.0f; // error for next[x]
+
+            for (int i = 0; i < width; ++i)
+            {
+                // BGR in the low components; alpha is ignored
+                float32x4 color;
+                color.unpack(s[x] & 0x00ffffff);
+                color = clamp(color + current[x] + right, 0.0f, 255.0f);
+
+                const u32 packed = color.pack();
+                const u8 index = cache.lookup((packed >> 16) & 0xff, (packed >> 8) & 0xff, packed & 0xff);
+                d[x] = index;
+
+                const float32x4 error = color - search.color[index];
+                right = error * w7;
+                next[x - step] = madd(below0, error, w3);
+                below0 = madd(below1, error, w5);
+                below1 = error * w1;
+
+                x += step;
+            }
+
+            // x is one past the last pixel
+            next[x - step] = below0;
+            next[x] = below1;
+
+            std::swap(current, next);
+        }
+    }
+
+    void quantize_wu(Palette& palette, const Surface& dest, const Surface& source, const image::ColorQuantizeOptions& options)
+    {
+        const int width = source.width;
+        const int height = source.height;
+
+        // the source is read in place when it already has the working format
+        std::unique_ptr<Bitmap> temp;
+
+        if (source.format != FORMAT_B8G8R8A8)
+        {
+            temp.reset(new Bitmap(width, height, FORMAT_B8G8R8A8));
+            temp->blit(0, 0, source);
+        }
+
+        const Surface& pixels = temp ? *temp : source;
+
+        const float quality = clamp(options.quality, 0.0f, 1.0f);
+        const int iterations = int(quality * 4.0f + 0.5f);
+
+        const int size = palette_wu(palette, pixels, iterations);
+        palette.size = 256;
+
+        const PaletteSearch search(palette, size);
+        const ColorCache cache(search);
+
+        // Error diffusion starts from zero error in every band; the bands are
+        // made tall so that the seams are rare.
+        const int threads = ThreadPool::getInstanceSize();
+        const int rows = options.dithering ? 128 : 16;
+        const int bands = std::max(1, std::min(threads * 2, height / rows));
+
+        ConcurrentQueue queue("quantize", Priority::HIGH);
+
+        for (int i = 0; i < bands; ++i)
+        {
+            const int y0 = height * i / bands;
+            const int y1 = height * (i + 1) / bands;
+
+            queue.enqueue([&, y0, y1]
+            {
+                map_band(dest, pixels, y0, y1, search, cache, options.dithering);
+            });
+        }
+
+        queue.wait();
+    }
+
 } // namespace
 
 namespace mango {
 namespace image {
 
-    void ColorQuantizer::quantize(const Surface& dest, const Surface& source, const ColorQuantizeOptions& options)
+    void ColorQuantizer::quantize(const Surface& dest, const Surface& source, const image::ColorQuantizeOptions& options)
     {
         float quality = clamp(options.quality, 0.0f, 1.0f);
 
@@ -450,6 +1134,12 @@ namespace image {
             MANGO_EXCEPTION("[ColorQuantizer] The destination and source dimensions must be identical.");
         }
 
+        if (options.method == ColorQuantizeOptions::WU)
+        {
+            quantize_wu(palette, dest, source, options);
+            return;
+        }
+
         // NOTE: don't try to "optimize" this even if the source is already in correct format;
         //       we need the storage to be continuous w/o padding for the NeuQuant
         Bitmap temp(width, height, FORMAT_B8G8R8A8);
@@ -0,0 +1,861 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/core/cpuinfo.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/core/half.hpp>
+#include <mango/core/memory.hpp>
+#include <mango/math/math.hpp>
+#include <mango/image/resample.hpp>
+#include "../core/target.hpp"
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // filters
+    // ----------------------------------------------------------------------------
+
+    constexpr float pi = 3.14159265358979f;
+
+    struct Filter
+    {
+        float support;
+        float (*evaluate)(float x);
+    };
+
+    float filter_box(float x)
+    {
+        return (x >= -0.5f && x < 0.5f) ? 1.0f : 0.0f;
+    }
+
+    float filter_triangle(float x)
+    {
+        x = std::abs(x);
+        return x < 1.0f ? 1.0f - x : 0.0f;
+    }
+
+    float filter_mitchell(float x)
+    {
+        const float B = 1.0f / 3.0f;
+        const float C = 1.0f / 3.0f;
+
+        x = std::abs(x);
+
+        if (x < 1.0f)
+        {
+            return ((12 - 9 * B - 6 * C) * x * x * x +
+                    (-18 + 12 * B + 6 * C) * x * x +
+                    (6 - 2 * B)) / 6;
+        }
+
+        if (x < 2.0f)
+        {
+            return ((-B - 6 * C) * x * x * x +
+                    (6 * B + 30 * C) * x * x +
+                    (-12 * B - 48 * C) * x +
+                    (8 * B + 24 * C)) / 6;
+        }
+
+        return 0.0f;
+    }
+
+    inline float sinc(float x)
+    {
+        if (x == 0.0f)
+            return 1.0f;
+        x *= pi;
+        return std::sin(x) / x;
+    }
+
+    float filter_lanczos(float x)
+    {
+        return std::abs(x) < 3.0f ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+    }
+
+    Filter getFilter(ResampleFilter filter)
+    {
+        switch (filter)
+        {
+            case ResampleFilter::BOX:
+                return { 0.5f, filter_box };
+            case ResampleFilter::BILINEAR:
+                return { 1.0f, filter_triangle };
+            case ResampleFilter::MITCHELL:
+                return { 2.0f, filter_mitchell };
+            case ResampleFilter::LANCZOS:
+            default:
+                return { 3.0f, filter_lanczos };
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // Contributions
+    // ----------------------------------------------------------------------------
+
+    // The source samples and normalized weights of every destination sample on one
+    // axis. Samples past the edges are clamped to the edge, so each destination
+    // sample is computed from a contiguous run of source samples.
+
+    struct Contributions
+    {
+        std::vector<int> start;
+        std::vector<int> count;
+        std::vector<float> weights;
+        int stride; // weights per destination sample
+        int taps; // largest count
+
+        Contributions(int dest_size, int source_size, const Filter& filter)
+            : start(dest_size)
+            , count(dest_size)
+        {
+            // the filter is stretched over the source samples when minifying
+            const double ratio = double(source_size) / dest_size;
+            const double scale = std::max(1.0, ratio);
+            const double support = filter.support * scale;
+
+            stride = std::min(source_size, int(std::ceil(support * 2)) + 2);
+            weights.resize(size_t(dest_size) * stride);
+
+            taps = 1;
+
+            for (int i = 0; i < dest_size; ++i)
+            {
+                const double center = (i + 0.5) * ratio;
+                const int left = int(std::floor(center - support));
+                const int right = int(std::ceil(center + support));
+                const int first = clamp(left, 0, source_size - 1);
+                const int last = clamp(right - 1, 0, source_size - 1);
+
+                float* w = weights.data() + size_t(i) * stride;
+                std::fill(w, w + stride, 0.0f);
+
+                double sum = 0.0;
+
+                for (int j = left; j < right; ++j)
+                {
+                    const float value = filter.evaluate(float((j + 0.5 - center) / scale));
+                    w[clamp(j, 0, source_size - 1) - first] += value;
+                    sum += value;
+                }
+
+                int n = last - first + 1;
+                int skip = 0;
+
+                if (sum == 0.0)
+                {
+                    // no sample inside the filter; use the nearest one
+                    skip = clamp(int(center) - first, 0, n - 1);
+                    w[skip] = 1.0f;
+                    sum = 1.0;
+                }
+
+                // trim the samples with zero weight
+                while (n > 1 && w[n - 1] == 0.0f)
+                    --n;
+                while (skip < n - 1 && w[skip] == 0.0f)
+                    ++skip;
+
+                n -= skip;
+                std::memmove(w, w + skip, n * sizeof(float));
+                std::fill(w + n, w + stride, 0.0f);
+
+                for (int k = 0; k < n; ++k)
+                {
+                    w[k] = float(w[k] / sum);
+                }
+
+                start[i] = first + skip;
+                count[i] = n;
+                taps = std::max(taps, n);
+            }
+        }
+
+        const float* getWeights(int index) const
+        {
+            return weights.data() + size_t(index) * stride;
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // PixelCodec
+    // ----------------------------------------------------------------------------
+
+    // Converts scanlines between a surface format and float RGBA. Missing color
+    // components read as zero and missing alpha as one; luminance formats store
+    // the luma of the color.
+
+    struct PixelCodec
+    {
+        enum Mode
+        {
+            RGBA8,
+            BGRA8,
+            RGBA32F,
+            UNORM,
+            FLOAT16,
+            FLOAT32,
+        };
+
+        Format format;
+        Mode mode;
+        int bytes;
+        bool alpha;
+        bool luminance;
+
+        // UNORM
+        u64 mask[4];
+        int offset[4];
+        float scale[4];
+
+        // FLOAT16, FLOAT32
+        int index[4];
+
+        PixelCodec(const Format& format)
+            : format(format)
+            , bytes(format.bytes())
+            , alpha(format.isAlpha())
+            , luminance(format.isLuminance())
+        {
+            if (format.isIndexed())
+            {
+                MANGO_EXCEPTION("[Resample] Indexed formats are not supported.");
+            }
+
+            const ColorRGBA& size = format.size;
+            const ColorRGBA& offs = format.offset;
+
+            switch (format.type)
+            {
+                case Format::UNORM:
+                {
+                    if (format.bits > 64 || format.bits & 7)
+                    {
+                        MANGO_EXCEPTION("[Resample] Unsupported UNORM format (%d bits).", format.bits);
+                    }
+
+                    const bool rgb8 = format.bits == 32 && !luminance &&
+                        size[0] == 8 && size[1] == 8 && size[2] == 8 && (size[3] == 8 || size[3] == 0);
+
+                    if (rgb8 && offs[0] == 0 && offs[1] == 8 && offs[2] == 16 && (!alpha || offs[3] == 24))
+                    {
+                        mode = RGBA8;
+                    }
+                    else if (rgb8 && offs[0] == 16 && offs[1] == 8 && offs[2] == 0 && (!alpha || offs[3] == 24))
+                    {
+                        mode = BGRA8;
+                    }
+                    else
+                    {
+                        mode = UNORM;
+                    }
+
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        mask[i] = size[i] ? (u64(1) << size[i]) - 1 : 0;
+                        offset[i] = offs[i];
+                        scale[i] = size[i] ? float(1.0 / double(mask[i])) : 0.0f;
+                    }
+
+                    break;
+                }
+
+                case Format::FLOAT16:
+                case Format::FLOAT32:
+                {
+                    const int bits = format.type == Format::FLOAT16 ? 16 : 32;
+
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        index[i] = size[i] ? offs[i] / bits : -1;
+                    }
+
+                    mode = format.type == Format::FLOAT16 ? FLOAT16 : FLOAT32;
+
+                    if (format.bits == 128 && !luminance &&
+                        index[0] == 0 && index[1] == 1 && index[2] == 2 && index[3] == 3)
+                    {
+                        mode = RGBA32F;
+                    }
+
+                    break;
+                }
+
+                default:
+                    MANGO_EXCEPTION("[Resample] Unsupported format type.");
+                    break;
+            }
+        }
+
+        u64 load(const u8* p) const
+        {
+            switch (bytes)
+            {
+                case 1: return p[0];
+                case 2: return uload16(p);
+                case 3: return uload16(p) | (u32(p[2]) << 16);
+                case 4: return uload32(p);
+                case 5: return uload32(p) | (u64(p[4]) << 32);
+                case 6: return uload32(p) | (u64(uload16(p + 4)) << 32);
+                case 7: return uload32(p) | (u64(uload16(p + 4)) << 32) | (u64(p[6]) << 48);
+                default: return uload64(p);
+            }
+        }
+
+        void store(u8* p, u64 value) const
+        {
+            switch (bytes)
+            {
+                case 8: ustore64(p, value); break;
+                default: std::memcpy(p, &value, bytes); break;
+            }
+        }
+
+        template <typename T>
+        float32x4 readFloat(const T* p) const
+        {
+            float s[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            for (int i = 0; i < 4; ++i)
+            {
+                if (index[i] >= 0)
+                    s[i] = float(p[index[i]]);
+            }
+            return float32x4(s[0], s[1], s[2], s[3]);
+        }
+
+        template <typename T>
+        void writeFloat(T* p, float32x4 color) const
+        {
+            float s[4] = { color[0], color[1], color[2], color[3] };
+
+            if (luminance)
+            {
+                s[0] = s[0] * 0.299f + s[1] * 0.587f + s[2] * 0.114f;
+                if (index[0] >= 0)
+                    p[index[0]] = T(s[0]);
+                if (index[3] >= 0)
+                    p[index[3]] = T(s[3]);
+                return;
+            }
+
+            for (int i = 0; i < 4; ++i)
+            {
+                if (index[i] >= 0)
+                    p[index[i]] = T(s[i]);
+            }
+        }
+
+        void read(float32x4* dest, const u8* src, int count) const
+        {
+            switch (mode)
+            {
+                case RGBA8:
+                case BGRA8:
+                {
+                    const float32x4 scale(1.0f / 255.0f);
+                    const u32 alphaMask = alpha ? 0 : 0xff000000;
+
+                    for (int x = 0; x < count; ++x)
+                    {
+                        float32x4 color;
+                        color.unpack(uload32(src + x * 4) | alphaMask);
+                        if (mode == BGRA8)
+                            color = color.zyxw;
+                        dest[x] = color * scale;
+                    }
+                    break;
+                }
+
+                case RGBA32F:
+                    std::memcpy(reinterpret_cast<void*>(dest), src, count * sizeof(float32x4));
+                    break;
+
+                case UNORM:
+                    for (int x = 0; x < count; ++x)
+                    {
+                        const u64 s = load(src);
+                        float c[4];
+                        for (int i = 0; i < 4; ++i)
+                        {
+                            c[i] = mask[i] ? float((s >> offset[i]) & mask[i]) * scale[i] : 0.0f;
+                        }
+                        dest[x] = float32x4(c[0], c[1], c[2], mask[3] ? c[3] : 1.0f);
+                        src += bytes;
+                    }
+                    break;
+
+                case FLOAT16:
+                    for (int x = 0; x < count; ++x)
+                    {
+                        dest[x] = readFloat(reinterpret_cast<const float16*>(src));
+                        src += bytes;
+                    }
+                    break;
+
+                case FLOAT32:
+                    for (int x = 0; x < count; ++x)
+                    {
+                        dest[x] = readFloat(reinterpret_cast<const float*>(src));
+                        src += bytes;
+                    }
+                    break;
+            }
+        }
+
+        void write(u8* dest, const float32x4* src, int count) const
+        {
+            switch (mode)
+            {
+                case RGBA8:
+                case BGRA8:
+                {
+                    const float32x4 scale(255.0f);
+
+                    for (int x = 0; x < count; ++x)
+                    {
+                        float32x4 color = clamp(src[x], 0.0f, 1.0f) * scale;
+                        if (mode == BGRA8)
+                            color = color.zyxw;
+                        ustore32(dest + x * 4, color.pack());
+                    }
+                    break;
+                }
+
+                case RGBA32F:
+                    std::memcpy(reinterpret_cast<void*>(dest), src, count * sizeof(float32x4));
+                    break;
+
+                case UNORM:
+                    for (int x = 0; x < count; ++x)
+                    {
+                        const float32x4 color = clamp(src[x], 0.0f, 1.0f);
+                        float c[4] = { color[0], color[1], color[2], color[3] };
+
+                        if (luminance)
+                        {
+                            // the color components share the same bits
+                            c[0] = c[0] * 0.299f + c[1] * 0.587f + c[2] * 0.114f;
+                            c[1] = c[2] = 0.0f;
+                        }
+
+                        u64 s = 0;
+                        for (int i = 0; i < 4; ++i)
+                        {
+                            if (mask[i])
+                                s |= u64(c[i] * mask[i] + 0.5f) << offset[i];
+                        }
+
+                        store(dest, s);
+                        dest += bytes;
+                    }
+                    break;
+
+                case FLOAT16:
+                    for (int x = 0; x < count; ++x)
+                    {
+                        writeFloat(reinterpret_cast<float16*>(dest), src[x]);
+                        dest += bytes;
+                    }
+                    break;
+
+                case FLOAT32:
+                    for (int x = 0; x < count; ++x)
+                    {
+                        writeFloat(reinterpret_cast<float*>(dest), src[x]);
+                        dest += bytes;
+                    }
+                    break;
+            }
+        }
+    };
+
+    // (a, a, a, 1) for the color components
+    inline float32x4 alpha_factor(float32x4 color)
+    {
+        const float32x4 temp = shuffle<3, 3, 0, 0>(color, float32x4(1.0f));
+        return shuffle<0, 1, 0, 2>(temp, temp);
+    }
+
+    // ----------------------------------------------------------------------------
+    // kernels
+    // ----------------------------------------------------------------------------
+
+    typedef void (*HorizontalFunc)(float32x4* dest, const float32x4* src, const Contributions& contrib);
+    typedef void (*VerticalFunc)(float32x4* dest, const float32x4* const* rows, const float* weights, int count, int width);
+
+    void horizontal_generic(float32x4* dest, const float32x4* src, const Contributions& contrib)
+    {
+        const int width = int(contrib.start.size());
+
+        for (int x = 0; x < width; ++x)
+        {
+            const float32x4* s = src + contrib.start[x];
+            const float* w = contrib.getWeights(x);
+            const int count = contrib.count[x];
+
+            // four partial sums of every fourth tap, reduced as (0 + 2) + (1 + 3),
+            // followed by the remaining taps; the AVX2 kernel sums in the same order
+            float32x4 sum0 = 0.0f;
+            float32x4 sum1 = 0.0f;
+            float32x4 sum2 = 0.0f;
+            float32x4 sum3 = 0.0f;
+            int i = 0;
+
+            for ( ; i < count - 3; i += 4)
+            {
+                sum0 = madd(sum0, s[i + 0], float32x4(w[i + 0]));
+                sum1 = madd(sum1, s[i + 1], float32x4(w[i + 1]));
+                sum2 = madd(sum2, s[i + 2], float32x4(w[i + 2]));
+                sum3 = madd(sum3, s[i + 3], float32x4(w[i + 3]));
+            }
+
+            float32x4 sum = (sum0 + sum2) + (sum1 + sum3);
+
+            for ( ; i < count; ++i)
+            {
+                sum = madd(sum, s[i], float32x4(w[i]));
+            }
+
+            dest[x] = sum;
+        }
+    }
+
+    void vertical_generic(float32x4* dest, const float32x4* const* rows, const float* weights, int count, int width)
+    {
+        int x = 0;
+
+        for ( ; x < width - 1; x += 2)
+        {
+            float32x4 sum0 = 0.0f;
+            float32x4 sum1 = 0.0f;
+
+            for (int i = 0; i < count; ++i)
+            {
+                const float32x4 w = weights[i];
+                sum0 = madd(sum0, rows[i][x + 0], w);
+                sum1 = madd(sum1, rows[i][x + 1], w);
+            }
+
+            dest[x + 0] = sum0;
+            dest[x + 1] = sum1;
+        }
+
+        if (x < width)
+        {
+            float32x4 sum = 0.0f;
+
+            for (int i = 0; i < count; ++i)
+            {
+                sum = madd(sum, rows[i][x], float32x4(weights[i]));
+            }
+
+            dest[x] = sum;
+        }
+    }
+
+#if defined(MANGO_ENABLE_TARGET_AVX2)
+
+    // The AVX2 kernels process two RGBA pixels in one register: the horizontal
+    // kernel two taps of one destination pixel and the vertical kernel two
+    // neighbouring destination pixels. They add the products in the same order
+    // as the generic kernels; the results are identical when the compiler keeps
+    // that order and does not fuse madd(), which ENABLE_FAST_MATH and FMA builds
+    // do not guarantee (the kernels then differ by a few ULPs).
+
+    MANGO_TARGET_AVX2
+    void horizontal_avx2(float32x4* dest, const float32x4* src, const Contributions& contrib)
+    {
+        const int width = int(contrib.start.size());
+        const __m256i pairs = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+
+        for (int x = 0; x < width; ++x)
+        {
+            const float* s = reinterpret_cast<const float*>(src + contrib.start[x]);
+            const float* w = contrib.getWeights(x);
+            const int count = contrib.count[x];
+
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+            int i = 0;
+
+            for ( ; i < count - 3; i += 4)
+            {
+                __m256 w0 = _mm256_castps128_ps256(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(w + i + 0))));
+                __m256 w1 = _mm256_castps128_ps256(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(w + i + 2))));
+                w0 = _mm256_permutevar8x32_ps(w0, pairs);
+                w1 = _mm256_permutevar8x32_ps(w1, pairs);
+                sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(s + i * 4 + 0), w0));
+                sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(s + i * 4 + 8), w1));
+            }
+
+            sum0 = _mm256_add_ps(sum0, sum1);
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+
+            for ( ; i < count; ++i)
+            {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(s + i * 4), _mm_set1_ps(w[i])));
+            }
+
+            _mm_storeu_ps(reinterpret_cast<float*>(dest + x), sum);
+        }
+    }
+
+    MANGO_TARGET_AVX2
+    void vertical_avx2(float32x4* dest, const float32x4* const* rows, const float* weights, int count, int width)
+    {
+        int x = 0;
+
+        for ( ; x < width - 3; x += 4)
+        {
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+
+            for (int i = 0; i < count; ++i)
+            {
+                const float* s = reinterpret_cast<const float*>(rows[i] + x);
+                const __m256 w = _mm256_set1_ps(weights[i]);
+                sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(s + 0), w));
+                sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(s + 8), w));
+            }
+
+            float* d = reinterpret_cast<float*>(dest + x);
+            _mm256_storeu_ps(d + 0, sum0);
+            _mm256_storeu_ps(d + 8, sum1);
+        }
+
+        for ( ; x < width; ++x)
+        {
+            __m128 sum = _mm_setzero_ps();
+
+            for (int i = 0; i < count; ++i)
+            {
+                const float* s = reinterpret_cast<const float*>(rows[i] + x);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(s), _mm_set1_ps(weights[i])));
+            }
+
+            _mm_storeu_ps(reinterpret_cast<float*>(dest + x), sum);
+        }
+    }
+
+#endif // MANGO_ENABLE_TARGET_AVX2
+
+    const DispatchVariant<HorizontalFunc> g_horizontal_variants[] =
+    {
+        { 0, "generic", horizontal_generic },
+#if defined(MANGO_ENABLE_TARGET_AVX2)
+        { CPU_AVX2, "AVX2", horizontal_avx2 },
+#endif
+    };
+
+    const DispatchVariant<VerticalFunc> g_vertical_variants[] =
+    {
+        { 0, "generic", vertical_generic },
+#if defined(MANGO_ENABLE_TARGET_AVX2)
+        { CPU_AVX2, "AVX2", vertical_avx2 },
+#endif
+    };
+
+    // ----------------------------------------------------------------------------
+    // Resampler
+    // ----------------------------------------------------------------------------
+
+    struct Resampler
+    {
+        const Surface& dest;
+        const Surface& source;
+
+        PixelCodec reader;
+        PixelCodec writer;
+        Contributions xcontrib;
+        Contributions ycontrib;
+
+        HorizontalFunc horizontal;
+        VerticalFunc vertical;
+
+        // sRGB is decoded and encoded only for UNORM formats; float formats are linear
+        bool srgbRead;
+        bool srgbWrite;
+        bool premultiply;
+
+        // sRGB to linear for 8 bit components
+        float linear[256];
+
+        Resampler(const Surface& dest, const Surface& source, const ResampleOptions& options)
+            : dest(dest)
+            , source(source)
+            , reader(source.format)
+            , writer(dest.format)
+            , xcontrib(dest.width, source.width, getFilter(options.filter))
+            , ycontrib(dest.height, source.height, getFilter(options.filter))
+            , srgbRead(options.srgb && source.format.type == Format::UNORM)
+            , srgbWrite(options.srgb && dest.format.type == Format::UNORM)
+            , premultiply(options.premultiply && (source.format.isAlpha() || source.format.isFloat()))
+        {
+            horizontal = selectDispatchVariant("resample.horizontal", g_horizontal_variants).function;
+            vertical = selectDispatchVariant("resample.vertical", g_vertical_variants).function;
+
+            if (srgbRead)
+            {
+                for (int i = 0; i < 256; ++i)
+                {
+                    linear[i] = srgb_to_linear(i / 255.0f);
+                }
+            }
+        }
+
+        // source scanline to linear, premultiplied float RGBA
+        void readScanline(float32x4* temp, int y) const
+        {
+            const u8* src = source.address(0, y);
+            const int width = source.width;
+
+            reader.read(temp, src, width);
+
+            if (srgbRead)
+            {
+                if (reader.mode == PixelCodec::RGBA8 || reader.mode == PixelCodec::BGRA8)
+                {
+                    // the 8 bit components are linearized with a table
+                    const int r = reader.mode == PixelCodec::RGBA8 ? 0 : 2;
+                    const int b = 2 - r;
+
+                    for (int x = 0; x < width; ++x)
+                    {
+                        const u8* s = src + x * 4;
+                        temp[x] = float32x4(linear[s[r]], linear[s[1]], linear[s[b]], temp[x].w);
+                    }
+                }
+                else
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        float32x4 color = srgb_to_linear(clamp(temp[x], 0.0f, 1.0f));
+                        color.w = temp[x].w;
+                        temp[x] = color;
+                    }
+                }
+            }
+
+            if (premultiply)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    temp[x] = temp[x] * alpha_factor(temp[x]);
+                }
+            }
+        }
+
+        // filtered scanline to the destination
+        void writeScanline(int y, float32x4* temp) const
+        {
+            const int width = dest.width;
+
+            if (premultiply)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    const float32x4 color = temp[x];
+                    const float a = color.w;
+                    const float scale = a > 0.0f ? 1.0f / a : 0.0f;
+                    temp[x] = color * float32x4(scale, scale, scale, 1.0f);
+                }
+            }
+
+            if (srgbWrite)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    float32x4 color = linear_to_srgb(clamp(temp[x], 0.0f, 1.0f));
+                    color.w = temp[x].w;
+                    temp[x] = color;
+                }
+            }
+
+            writer.write(dest.address(0, y), temp, width);
+        }
+
+        // Destination scanlines y0..y1; the horizontally filtered source scanlines
+        // are kept in a ring of as many scanlines as the vertical filter has taps.
+        void band(int y0, int y1) const
+        {
+            const int width = dest.width;
+            const int window = ycontrib.taps;
+
+            AlignedPointer<float32x4> temp(std::max(source.width, width));
+            AlignedPointer<float32x4> cache(size_t(window) * width);
+            std::vector<const float32x4*> rows(window);
+
+            int next = ycontrib.start[y0];
+
+            for (int y = y0; y < y1; ++y)
+            {
+                const int start = ycontrib.start[y];
+                const int count = ycontrib.count[y];
+
+                next = std::max(next, start);
+
+                for ( ; next < start + count; ++next)
+                {
+                    readScanline(temp, next);
+                    horizontal(cache + (next % window) * width, temp, xcontrib);
+                }
+
+                for (int i = 0; i < count; ++i)
+                {
+                    rows[i] = cache + ((start + i) % window) * width;
+                }
+
+                vertical(temp, rows.data(), ycontrib.getWeights(y), count, width);
+                writeScanline(y, temp);
+            }
+        }
+    };
+
+} // namespace
+
+namespace mango
+{
+
+    void resample(const Surface& dest, const Surface& source, const ResampleOptions& options)
+    {
+        if (!dest.width || !dest.height || !source.width || !source.height)
+            return;
+
+        Resampler resampler(dest, source, options);
+
+        const int threads = ThreadPool::getInstanceSize();
+
+        // every band filters the source scanlines under the vertical filter
+        // again, so the bands are not made smaller than needed
+        const int bands = threads > 1 ? std::max(1, std::min(threads * 2, dest.height / 16)) : 1;
+
+        if (bands == 1)
+        {
+            resampler.band(0, dest.height);
+            return;
+        }
+
+        ConcurrentQueue queue("resample", Priority::HIGH);
+
+        for (int i = 0; i < bands; ++i)
+        {
+            const int y0 = dest.height * i / bands;
+            const int y1 = dest.height * (i + 1) / bands;
+
+            queue.enqueue([&resampler, y0, y1]
+            {
+                resampler.band(y0, y1);
+            });
+        }
+
+        queue.wait();
+    }
+
+} // namespace mango
@@ -171,6 +171,20 @@ namespace
         return size;
     }
 
+    // ----------------------------------------------------------------------------
+    // allocate_image()
+    // ----------------------------------------------------------------------------
+
+    u8* allocate_image(size_t bytes, u32 policy)
+    {
+        void* ptr = large_malloc(bytes, policy);
+        if (!ptr)
+        {
+            MANGO_EXCEPTION("[Bitmap] Out of memory (%d bytes).", int(bytes));
+        }
+        return reinterpret_cast<u8*>(ptr);
+    }
+
     // ----------------------------------------------------------------------------
     // load_surface()
     // ----------------------------------------------------------------------------
@@ -189,7 +203,7 @@ namespace
             surface.height = header.height;
             surface.format = format ? *format : header.format;
             surface.stride = surface.width * surface.format.bytes();
-            surface.image  = new u8[surface.height * surface.stride];
+            surface.image  = allocate_image(surface.height * surface.stride, ALLOCATE_HUGE_PAGES);
 
             // decode
             ImageDecodeStatus status = decoder.decode(surface);
@@ -222,7 +236,7 @@ namespace
                 surface.height = header.height;
                 surface.format = IndexedFormat(8);
                 surface.stride = surface.width;
-                surface.image  = new u8[surface.height * surface.stride];
+                surface.image  = allocate_image(surface.height * surface.stride, ALLOCATE_HUGE_PAGES);
 
                 // decode
                 ImageDecodeOptions options;
@@ -246,6 +260,71 @@ namespace
         return surface;
     }
 
+    // ----------------------------------------------------------------------------
+    // blit_surface()
+    // ----------------------------------------------------------------------------
+
+    void blit_surface(const Blitter& blitter, const Surface& dest, const Surface& source, bool fast)
+    {
+        BlitRect rect;
+
+        rect.src.address = source.image;
+        rect.src.stride = source.stride;
+        rect.dest.address = dest.image;
+        rect.dest.stride = dest.stride;
+        rect.width = dest.width;
+        rect.height = dest.height;
+
+        ConcurrentQueue queue("blit", Priority::HIGH);
+
+        const int threads = ThreadPool::getInstanceSize();
+        const int tasksize = (rect.width * rect.height) / threads;
+
+        // don't use thread pool for:
+        // - really small tasks
+        // - when the pixel formats are identical ("fast mode")
+        const int N = (tasksize < 8192) || fast ? 1 : threads;
+        const int section = rect.height / N;
+
+        int ypos = 0;
+
+        // queue conversion tasks
+        for (int i = 0; i < N; ++i)
+        {
+            const bool last = (i == (N - 1));
+            const int ycount = last ? rect.height - ypos : section;
+
+            if (N == 1)
+            {
+                // execute on main thread
+                BlitRect temp = rect;
+
+                temp.dest.address += ypos * rect.dest.stride;
+                temp.src.address += ypos * rect.src.stride;
+                temp.height = ycount;
+
+                blitter.convert(temp);
+            }
+            else
+            {
+                queue.enqueue([=, &blitter]
+                {
+                    BlitRect temp = rect;
+
+                    temp.dest.address += ypos * rect.dest.stride;
+                    temp.src.address += ypos * rect.src.stride;
+                    temp.height = ycount;
+
+                    blitter.convert(temp);
+                });
+            }
+
+            ypos += section;
+        }
+
+        queue.wait();
+    }
+
 } // namespace
 
 namespace mango
@@ -395,67 +474,22 @@ namespace mango
         if (!dest.width || !dest.height)
             return;
 
-        BlitRect rect;
-
-        rect.src.address = source.image;
-        rect.src.stride = source.stride;
-        rect.dest.address = dest.image;
-        rect.dest.stride = dest.stride;
-        rect.width = dest.width;
-        rect.height = dest.height;
-
-        ConcurrentQueue queue("blit", Priority::HIGH);
-
         Blitter blitter(dest.format, source.format);
+        blit_surface(blitter, dest, source, dest.format == source.format);
+    }
 
-        const int threads = ThreadPool::getInstanceSize();
-        const int tasksize = (rect.width * rect.height) / threads;
-
-        const bool fast = dest.format == source.format;
-
-        // don't use thread pool for:
-        // - really small tasks
-        // - when the pixel formats are identical ("fast mode")
-        const int N = (tasksize < 8192) || fast ? 1 : threads;
-        const int section = rect.height / N;
-
-        int ypos = 0;
-
-        // queue conversion tasks
-        for (int i = 0; i < N; ++i)
-        {
-            const bool last = (i == (N - 1));
-            const int ycount = last ? rect.height - ypos : section;
-
-            if (N == 1)
-            {
-                // execute on main thread
-                BlitRect temp = rect;
-
-                temp.dest.address += ypos * rect.dest.stride;
-                temp.src.address += ypos * rect.src.stride;
-                temp.height = ycount;
-
-                blitter.convert(temp);
-            }
-            else
-            {
-                queue.enqueue([=, &blitter]
-                {
-                    BlitRect temp = rect;
-
-                    temp.dest.address += ypos * rect.dest.stride;
-                    temp.src.address += ypos * rect.src.stride;
-                    temp.height = ycount;
+    void Surface::blit(int x, int y, const Surface& source, const Palette& palette) const
+    {
+        if (!source.width || !source.height || !source.format.bits || !format.bits)
+            return;
 
-                    blitter.convert(temp);
-                });
-            }
+        Surface dest(*this, x, y, source.width, source.height);
 
-            ypos += section;
-        }
+        if (!dest.width || !dest.height)
+            return;
 
-        queue.wait();
+        Blitter blitter(dest.format, source.format, palette);
+        blit_surface(blitter, dest, source, false);
     }
 
     void Surface::xflip() const
@@ -523,7 +557,7 @@ namespace mango
     // Bitmap
     // ----------------------------------------------------------------------------
 
-    Bitmap::Bitmap(int w, int h, const Format& f, int s)
+    Bitmap::Bitmap(int w, int h, const Format& f, int s, u32 policy)
         : Surface(w, h, f, s, nullptr)
     {
         if (!stride)
@@ -531,7 +565,7 @@ namespace mango
             stride = width * format.bytes();
         }
 
-        image = new u8[stride * height];
+        image = allocate_image(size_t(stride) * height, policy);
     }
 
     Bitmap::Bitmap(ConstMemory memory, const std::string& extension)
@@ -573,7 +607,7 @@ namespace mango
 
     Bitmap::~Bitmap()
     {
-        delete[] image;
+        large_free(image);
     }
 
     Bitmap& Bitmap::operator = (Bitmap&& bitmap)
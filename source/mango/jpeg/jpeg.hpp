@@ -15,6 +15,7 @@
 #include <mango/core/core.hpp>
 #include <mango/image/image.hpp>
 #include <mango/math/math.hpp>
+#include "../core/target.hpp"
 
 #define JPEG_MAX_BLOCKS_IN_MCU   10  // Maximum # of blocks per MCU in the JPEG specification
 #define JPEG_MAX_COMPS_IN_SCAN   4   // JPEG limit on # of components in one scan
@@ -30,14 +31,22 @@
         #define JPEG_ENABLE_SSE2
     #endif
 
+    #if defined(MANGO_ENABLE_TARGET_SSSE3)
+        #define JPEG_ENABLE_SSSE3
+    #endif
+
     #if defined(MANGO_ENABLE_SSE4_1)
         #define JPEG_ENABLE_SSE4
     #endif
 
-    #if defined(MANGO_ENABLE_AVX2)
+    #if defined(MANGO_ENABLE_TARGET_AVX2)
         #define JPEG_ENABLE_AVX2
     #endif
 
+    #if defined(MANGO_ENABLE_TARGET_AVX512BW)
+        #define JPEG_ENABLE_AVX512
+    #endif
+
     #if defined(MANGO_ENABLE_NEON)
         #define JPEG_ENABLE_NEON
     #endif
@@ -73,6 +82,15 @@ namespace jpeg {
     using DataType = u32;
     #define JPEG_REGISTER_BITS 32
 
+#endif
+
+#if defined(JPEG_ENABLE_MODERN_HUFFMAN) && defined(MANGO_CPU_64BIT)
+
+    // wide look-ahead decoder which needs the bits of two symbols in the bit buffer
+    #define JPEG_ENABLE_FAST_HUFFMAN
+    #define JPEG_HUFF_FAST_BITS      11
+    #define JPEG_HUFF_FAST_SIZE      (1 << JPEG_HUFF_FAST_BITS)
+
 #endif
 
     // supported external data formats (encode from, decode to)
@@ -134,6 +152,27 @@ namespace jpeg {
         void configure();
     };
 
+#endif
+
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+
+    struct HuffFastTable
+    {
+        // JPEG_HUFF_FAST_BITS look-ahead; each entry has the code length, run and the
+        // extended coefficient of one or two symbols, zero length selects the bit-serial path
+        u32 entry[JPEG_HUFF_FAST_SIZE];
+
+        enum : u32
+        {
+            PAIR    = 0x20, // two symbols: run 8..11 and 12..15, value 20..25 and 26..31,
+                            // length of the second symbol 16..19
+            EOB     = 0x40, // end of block after the (first) coefficient
+            RECEIVE = 0x80, // the coefficient bits follow the code, size is in bits 12..15
+        };
+
+        void configure(const HuffTable& table, bool ac);
+    };
+
 #endif
 
     struct jpegBuffer
@@ -172,6 +211,26 @@ namespace jpeg {
             }
         }
 
+        // fill the register with whole bytes; remain must be less than 56
+        void fill()
+        {
+            const int count = (63 - remain) >> 3;
+            DataType temp;
+
+            if (ptr + 8 <= nextFF)
+            {
+                temp = mango::uload64be(ptr) >> (64 - count * 8);
+                ptr += count;
+            }
+            else
+            {
+                temp = bytes(count);
+            }
+
+            data = (data << (count * 8)) | temp;
+            remain += count * 8;
+        }
+
 #else
 
         // 32 bit register
@@ -256,6 +315,13 @@ namespace jpeg {
                 HuffTable* ac;
             } table;
         };
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+        struct
+        {
+            const HuffFastTable* dc;
+            const HuffFastTable* ac;
+        } fast;
+#endif
     };
 
     struct DecodeState
@@ -293,8 +359,15 @@ namespace jpeg {
         int frames;
         ColorSpace colorspace;
 
+        int xblocks; // MCU width in blocks
+        int idct_size; // idct output is idct_size x idct_size pixels (8, or 4, 2, 1 at reduced size)
+
 	    void (*idct) (u8* dest, const s16* data, const s16* qt);
 
+        // transforms `count` consecutive blocks of the MCU into consecutive 8x8 results;
+        // nullptr when there is no multi-block implementation for the current CPU
+        void (*idct_blocks) (u8* dest, const s16* data, const Block* block, int count);
+
         void (*process            ) (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
         void (*clipped            ) (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
         void (*process_y          ) (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
@@ -304,6 +377,55 @@ namespace jpeg {
         void (*process_ycbcr_8x16 ) (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
         void (*process_ycbcr_16x8 ) (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
         void (*process_ycbcr_16x16) (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+        void (*process_ycbcr_scaled) (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    };
+
+    struct ProgressiveScan
+    {
+        // Huffman scans are decoded after the whole stream has been parsed so the tables
+        // are copied as they can be redefined between the scans
+        DecodeState state;
+        HuffTable huffTable[2][JPEG_MAX_COMPS_IN_SCAN];
+
+        int restartInterval;
+        int restartCounter;
+
+        bool interleaved; // MCU order; otherwise blocks of a single component
+        int hsf;
+        int vsf;
+        int offset;
+
+        u32 components; // bitmask of frames in the scan
+        int spectralStart;
+        int spectralEnd;
+
+        // earlier scans which write the same coefficients
+        std::vector<ProgressiveScan*> dependencies;
+        std::vector<ProgressiveScan*> dependents;
+
+        std::atomic<int> progress { 0 }; // number of decoded bands
+        std::mutex mutex;
+        bool parked = false;
+        int band = 0;
+    };
+
+    struct Coefficients
+    {
+        // quantized DCT coefficients in natural order; blocks_in_mcu blocks for each MCU
+        // in raster order, the blocks of the components are stored at their frame offset
+        std::vector<s16> blocks;
+
+        std::vector<Frame> frames; // the sampling factors are the ones in the frame header
+        s16 qt[JPEG_MAX_COMPS_IN_SCAN][64]; // quantization tables in natural order
+
+        int width;
+        int height;
+        int precision;
+        int hmax; // MCU size in blocks
+        int vmax;
+        int xmcu;
+        int ymcu;
+        int blocks_in_mcu;
     };
 
     // ----------------------------------------------------------------------------
@@ -316,12 +438,19 @@ namespace jpeg {
         QuantTable quantTable[JPEG_MAX_COMPS_IN_SCAN];
         HuffTable huffTable[2][JPEG_MAX_COMPS_IN_SCAN];
 
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+        HuffFastTable huffFastTable[2][JPEG_MAX_COMPS_IN_SCAN];
+        u32 huffFastValid; // bitmask of the fast tables which match huffTable
+#endif
+
         AlignedPointer<s16> quantTableVector;
         s16* blockVector;
 
         std::vector<Frame> frames;
         Frame* scanFrame; // current Progressive AC scan frame
 
+        std::vector<std::unique_ptr<ProgressiveScan>> progressiveScans;
+
         DecodeState decodeState;
         ProcessState processState;
 
@@ -332,8 +461,11 @@ namespace jpeg {
         std::string m_compression;
         std::string m_idct_name;
         std::string m_ycbcr_name;
+        std::string m_huffman_name;
 
         Surface* m_surface;
+        ImageDecodeRegion* m_region; // band decoding: MCU rows are written into the region one at a time
+        bool m_coefficients; // the MCUs are stored into blockVector instead of being processed
         u64 cpu_flags;
 
         int width;  // Image width, does include alignment
@@ -357,11 +489,19 @@ namespace jpeg {
         int xmcu;
         int ymcu;
         int mcus;
+        int m_scale; // output is 1/m_scale of the image size
+
+        // decoding window in MCUs; m_surface origin is at the top-left MCU of the window
+        int m_mcu_x0;
+        int m_mcu_y0;
+        int m_mcu_x1;
+        int m_mcu_y1;
 
         bool isJPEG(ConstMemory memory) const;
 
         const u8* stepMarker(const u8* p) const;
         const u8* seekMarker(const u8* p, const u8* end) const;
+        const u8* skipScan(const u8* p, const u8* end) const;
 
         void processSOI();
         void processEOI();
@@ -385,18 +525,28 @@ namespace jpeg {
 
         void restart();
         bool handleRestart();
+        bool isIntervalInWindow(int n) const;
+
+        void processMCU(int x, int y, const s16* data);
+        void writeBand(int y);
 
         void decodeLossless();
         void decodeSequential();
         void decodeSequentialST();
         void decodeSequentialMT();
+        bool decodeSequentialSpeculative();
         void decodeMultiScan();
         void decodeProgressive();
+        const u8* deferProgressive(const u8* end);
+        void decodeProgressiveScan(ProgressiveScan& scan, int y0, int y1);
         void finishProgressive();
         void finishProgressiveST();
         void finishProgressiveMT();
 
+        void configureHuffman();
         void configureCPU(Sample sample);
+        void configureScale(int scale);
+        int getScale(int scale) const;
         std::string getInfo() const;
 
     public:
@@ -408,7 +558,9 @@ namespace jpeg {
         Parser(ConstMemory memory);
         ~Parser();
 
-        ImageDecodeStatus decode(Surface& target);
+        ImageHeader getHeader(int scale) const;
+        ImageDecodeStatus decode(Surface& target, const ImageDecodeOptions& options = ImageDecodeOptions());
+        ImageDecodeStatus decodeCoefficients(Coefficients& coefficients);
     };
 
     // ----------------------------------------------------------------------------
@@ -424,6 +576,10 @@ namespace jpeg {
     void huff_decode_ac_first       (s16* output, DecodeState* state);
     void huff_decode_ac_refine      (s16* output, DecodeState* state);
 
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+    void huff_decode_mcu_fast       (s16* output, DecodeState* state);
+#endif
+
 #ifdef MANGO_ENABLE_LICENSE_BSD
 
     void arith_decode_mcu_lossless  (s16* output, DecodeState* state);
@@ -438,6 +594,14 @@ namespace jpeg {
     void idct8                          (u8* dest, const s16* data, const s16* qt);
     void idct12                         (u8* dest, const s16* data, const s16* qt);
 
+    // reduced size iDCT: the output is written with 8 byte stride like in the full size iDCT
+    void idct8_4x4                      (u8* dest, const s16* data, const s16* qt);
+    void idct8_2x2                      (u8* dest, const s16* data, const s16* qt);
+    void idct8_1x1                      (u8* dest, const s16* data, const s16* qt);
+    void idct12_4x4                     (u8* dest, const s16* data, const s16* qt);
+    void idct12_2x2                     (u8* dest, const s16* data, const s16* qt);
+    void idct12_1x1                     (u8* dest, const s16* data, const s16* qt);
+
     void process_y_8bit                 (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_y_24bit                (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_y_32bit                (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
@@ -497,6 +661,7 @@ namespace jpeg {
 #if defined(JPEG_ENABLE_SSE2)
 
     void idct_sse2                      (u8* dest, const s16* data, const s16* qt);
+    void idct4x4_sse2                   (u8* dest, const s16* data, const s16* qt);
 
     void process_ycbcr_bgra_8x8_sse2    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_bgra_8x16_sse2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
@@ -507,10 +672,14 @@ namespace jpeg {
     void process_ycbcr_rgba_8x16_sse2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_rgba_16x8_sse2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_rgba_16x16_sse2  (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgra_scaled_sse2 (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgba_scaled_sse2 (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+
+    void process_y_32bit_sse2           (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
 
 #endif // JPEG_ENABLE_SSE2
 
-#if defined(JPEG_ENABLE_SSE4)
+#if defined(JPEG_ENABLE_SSSE3)
 
     void process_ycbcr_bgr_8x8_ssse3    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_bgr_8x16_ssse3   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
@@ -521,11 +690,48 @@ namespace jpeg {
     void process_ycbcr_rgb_8x16_ssse3   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_rgb_16x8_ssse3   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_rgb_16x16_ssse3  (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgr_scaled_ssse3 (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgb_scaled_ssse3 (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+
+    void process_y_24bit_ssse3          (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+
+#endif // JPEG_ENABLE_SSSE3
+
+#if defined(JPEG_ENABLE_AVX2)
+
+    void idct_avx2                      (u8* dest, const s16* data, const Block* block, int count);
+
+    void process_ycbcr_bgra_8x8_avx2    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgra_8x16_avx2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgra_16x8_avx2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgra_16x16_avx2  (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+
+    void process_ycbcr_rgba_8x8_avx2    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgba_8x16_avx2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgba_16x8_avx2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgba_16x16_avx2  (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+
+    void process_ycbcr_bgr_8x8_avx2     (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgr_8x16_avx2    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgr_16x8_avx2    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgr_16x16_avx2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+
+    void process_ycbcr_rgb_8x8_avx2     (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgb_8x16_avx2    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgb_16x8_avx2    (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgb_16x16_avx2   (u8* dest, int stride, const s16* data, ProcessState* state, int width, int height);
+
+#endif // JPEG_ENABLE_AVX2
+
+#if defined(JPEG_ENABLE_AVX512)
+
+    void idct_avx512                    (u8* dest, const s16* data, const Block* block, int count);
 
-#endif // JPEG_ENABLE_SSE4
+#endif // JPEG_ENABLE_AVX512
 
     SampleFormat getSampleFormat(const Format& format);
-	ImageEncodeStatus encodeImage(Stream& stream, const Surface& surface, float quality);
+	ImageEncodeStatus encodeImage(Stream& stream, const Surface& surface, const ImageEncodeOptions& options);
+    ImageEncodeStatus transformImage(Stream& stream, ConstMemory memory, const ImageTransformOptions& options);
 
 } // namespace jpeg
 } // namespace mango
@@ -21,6 +21,9 @@ namespace jpeg {
         29, 22, 15, 23, 30, 37, 44, 51,
         58, 59, 52, 45, 38, 31, 39, 46,
         53, 60, 61, 54, 47, 55, 62, 63,
+        // corrupted data can run-length past the last coefficient
+        63, 63, 63, 63, 63, 63, 63, 63,
+        63, 63, 63, 63, 63, 63, 63, 63,
     };
 
     // ----------------------------------------------------------------------------
@@ -219,39 +222,30 @@ namespace jpeg {
         }
 
         m_surface = nullptr;
+        m_region = nullptr;
+        m_coefficients = false;
+        m_scale = 1;
 
-        cpu_flags = getCPUFlags();
+        m_mcu_x0 = 0;
+        m_mcu_y0 = 0;
+        m_mcu_x1 = 0;
+        m_mcu_y1 = 0;
 
-        // configure default implementation
-        processState.idct = idct8;
-        processState.colorspace = ColorSpace::CMYK;
+        processState.xblocks = 1;
+        processState.idct_size = 8;
 
-#if defined(JPEG_ENABLE_NEON)
-        processState.idct = idct_neon;
-        m_idct_name = "NEON iDCT";
-#endif
+        cpu_flags = getCPUFlags();
 
-#if defined(JPEG_ENABLE_SSE2)
-        if (cpu_flags & CPU_SSE2)
-        {
-            processState.idct = idct_sse2;
-        m_idct_name = "SSE2 iDCT";
-        }
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+        huffFastValid = 0;
 #endif
 
+        processState.colorspace = ColorSpace::CMYK;
+
         if (isJPEG(memory))
         {
             parse(memory, false);
         }
-
-        // precision is not known until parse() above is complete
-        if (precision == 12)
-        {
-            // Force 12 bit idct
-            // This will round down to 8 bit precision until we have a 12 bit capable color conversion
-            processState.idct = idct12;
-            m_idct_name = "12 bit iDCT";
-        }
     }
 
     Parser::~Parser()
@@ -655,6 +649,7 @@ namespace jpeg {
 
         xblock = 8 * Hmax;
         yblock = 8 * Vmax;
+        processState.xblocks = Hmax;
 
         if (!xblock || !yblock)
         {
@@ -791,6 +786,17 @@ namespace jpeg {
         bool dc_scan = (decodeState.spectralStart == 0);
         bool refine_scan = (decodeState.successiveHigh != 0);
 
+        if (is_progressive && !dc_scan && m_scale > 1)
+        {
+            // highest zigzag index the reduced size iDCT reads (4x4, 2x2, 1x1)
+            const int last = m_scale == 2 ? 24 : m_scale == 4 ? 4 : 0;
+            if (Ss > last)
+            {
+                debugPrint("  Skipped: not used at 1/%d scale\n", m_scale);
+                return skipScan(p, end);
+            }
+        }
+
         decodeState.zigzagTable = g_zigzag_table;
 
         restartCounter = restartInterval;
@@ -872,7 +878,7 @@ namespace jpeg {
             }
             else if (is_multiscan)
             {
-                decodeState.decode = huff_decode_mcu;
+                configureHuffman();
                 decodeMultiScan();
             }
             else if (is_progressive)
@@ -903,15 +909,30 @@ namespace jpeg {
                         decodeState.decode = huff_decode_ac_refine;
                     }
                 }
+
+#ifdef JPEG_ENABLE_THREAD
+                if (ThreadPool::getInstanceSize() > 1 && !m_region)
+                {
+                    // decode the scans in parallel after the whole stream has been parsed
+                    return deferProgressive(end);
+                }
+#endif
+
                 decodeProgressive();
             }
             else
             {
-                decodeState.decode = huff_decode_mcu;
+                configureHuffman();
                 decodeSequential();
             }
         }
 
+        if (m_mcu_y1 < ymcu && !is_lossless)
+        {
+            // the decoding window ends before the image; the rest of the scan is not needed
+            decodeState.buffer.ptr = skipScan(decodeState.buffer.ptr, end);
+        }
+
         // TODO: we should sync here since the decoder has prefetched more bytes that it could consume
         p = decodeState.buffer.ptr;
         p -= 8; // hack
@@ -1022,6 +1043,10 @@ namespace jpeg {
 
             Lh -= count;
             table.configure();
+
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+            huffFastValid &= ~(1u << (Tc * 4 + Th));
+#endif
         }
     }
 
@@ -1273,7 +1298,8 @@ namespace jpeg {
 
                 default:
                     debugPrint("[ 0x%x ]\n", marker);
-                    p = seekMarker(p, end);
+                    // the second byte can be the start of the next marker when resyncing after a scan
+                    p = seekMarker(p - 1, end);
                     break;
             }
 
@@ -1294,9 +1320,23 @@ namespace jpeg {
             int index = p[1] - 0xd0;
             is = index >= 0 && index <= 7;
         }
+
         return is;
     }
 
+    const u8* Parser::skipScan(const u8* p, const u8* end) const
+    {
+        // skip the entropy coded segment, including the restart intervals
+        for ( ; p < end; p += 2)
+        {
+            p = seekMarker(p, end);
+            if (p >= end || !isRestartMarker(p))
+                break;
+        }
+
+        return p;
+    }
+
     void Parser::restart()
     {
         if (is_arithmetic)
@@ -1318,10 +1358,12 @@ namespace jpeg {
         {
             restartCounter = restartInterval;
 
-            if (isRestartMarker(decodeState.buffer.ptr))
+            // the padding bits at the end of the interval are not always read
+            const u8* p = seekMarker(decodeState.buffer.ptr, decodeState.buffer.end);
+            if (isRestartMarker(p))
             {
+                decodeState.buffer.ptr = p + 2;
                 restart();
-                decodeState.buffer.ptr += 2;
                 return true;
             }
         }
@@ -1329,10 +1371,180 @@ namespace jpeg {
         return false;
     }
 
+    bool Parser::isIntervalInWindow(int n) const
+    {
+        if (m_mcu_x0 == 0 && m_mcu_x1 == xmcu && m_mcu_y0 == 0)
+        {
+            // decoding stops at the last row of the window
+            return true;
+        }
+
+        // check the MCU rows which the restart interval [n, n + restartInterval) covers
+        const int last = std::min(n + restartInterval, mcus) - 1;
+        const int y0 = n / xmcu;
+        const int y1 = last / xmcu;
+
+        for (int y = std::max(y0, m_mcu_y0); y <= std::min(y1, m_mcu_y1 - 1); ++y)
+        {
+            const int x0 = y == y0 ? n % xmcu : 0;
+            const int x1 = y == y1 ? last % xmcu + 1 : xmcu;
+            if (x0 < m_mcu_x1 && x1 > m_mcu_x0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void Parser::processMCU(int x, int y, const s16* data)
+    {
+        if (x < m_mcu_x0 || x >= m_mcu_x1 || y < m_mcu_y0 || y >= m_mcu_y1)
+        {
+            // outside of the decoding window
+            return;
+        }
+
+        if (m_coefficients)
+        {
+            // the progressive and multi-scan decoders already work in blockVector
+            const int mcu_data_size = blocks_in_mcu * 64;
+            s16* dest = blockVector + (y * xmcu + x) * mcu_data_size;
+            if (dest != data)
+            {
+                std::memcpy(dest, data, mcu_data_size * sizeof(s16));
+            }
+            return;
+        }
+
+        ProcessFunc process = processState.process;
+        int width = xblock;
+        int height = yblock;
+
+        if (xclip && x == xmcu - 1)
+        {
+            process = processState.clipped;
+            width = xclip;
+        }
+
+        if (yclip && y == ymcu - 1)
+        {
+            process = processState.clipped;
+            height = yclip;
+        }
+
+        // band decoding keeps reusing the same MCU row
+        const int row = m_region ? 0 : y - m_mcu_y0;
+
+        u8* dest = m_surface->address((x - m_mcu_x0) * xblock, row * yblock);
+        process(dest, m_surface->stride, data, &processState, width, height);
+    }
+
+    void Parser::writeBand(int y)
+    {
+        if (m_region && y >= m_mcu_y0 && y < m_mcu_y1)
+        {
+            m_region->write(*m_surface, m_mcu_x0 * xblock, y * yblock);
+        }
+    }
+
+    void Parser::configureHuffman()
+    {
+        // sequential Huffman MCU decoder
+        using DecodeFunc = void (*)(s16* output, DecodeState* state);
+
+        static const DispatchVariant<DecodeFunc> huffman_variants[] =
+        {
+            { 0, "Huffman", huff_decode_mcu },
+#if defined(JPEG_ENABLE_FAST_HUFFMAN)
+            { 0, "Fast Huffman", huff_decode_mcu_fast },
+#endif
+        };
+
+        const auto& huffman = selectDispatchVariant("jpeg.huffman", huffman_variants);
+        decodeState.decode = huffman.function;
+        m_huffman_name = huffman.name;
+
+#if defined(JPEG_ENABLE_FAST_HUFFMAN)
+        if (decodeState.decode == huff_decode_mcu_fast)
+        {
+            // the look-ahead tables are built when a scan first uses them
+            for (int i = 0; i < decodeState.blocks; ++i)
+            {
+                DecodeBlock& block = decodeState.block[i];
+
+                int dc = int(block.table.dc - huffTable[0]);
+                int ac = int(block.table.ac - huffTable[1]);
+
+                if (!(huffFastValid & (1 << dc)))
+                {
+                    huffFastValid |= 1 << dc;
+                    huffFastTable[0][dc].configure(huffTable[0][dc], false);
+                }
+
+                if (!(huffFastValid & (16 << ac)))
+                {
+                    huffFastValid |= 16 << ac;
+                    huffFastTable[1][ac].configure(huffTable[1][ac], true);
+                }
+
+                block.fast.dc = &huffFastTable[0][dc];
+                block.fast.ac = &huffFastTable[1][ac];
+            }
+        }
+#endif
+    }
+
     void Parser::configureCPU(Sample sample)
     {
         const char* simd = "";
 
+        // configure iDCT
+        using IDCTFunc = void (*)(u8* dest, const s16* data, const s16* qt);
+
+        static const DispatchVariant<IDCTFunc> idct_variants[] =
+        {
+            { 0, "Scalar iDCT", idct8 },
+#if defined(JPEG_ENABLE_NEON)
+            { 0, "NEON iDCT", idct_neon },
+#endif
+#if defined(JPEG_ENABLE_SSE2)
+            { CPU_SSE2, "SSE2 iDCT", idct_sse2 },
+#endif
+        };
+
+        const auto& idct = selectDispatchVariant("jpeg.idct", idct_variants);
+        processState.idct = idct.function;
+        m_idct_name = idct.name;
+
+        // multi-block iDCT for the wide color conversion functions
+        using IDCTBlocksFunc = void (*)(u8* dest, const s16* data, const Block* block, int count);
+
+        static const DispatchVariant<IDCTBlocksFunc> idct_blocks_variants[] =
+        {
+            { 0, "none", nullptr },
+#if defined(JPEG_ENABLE_AVX2)
+            { CPU_AVX2, "AVX2 iDCT", idct_avx2 },
+#endif
+#if defined(JPEG_ENABLE_AVX512)
+            { CPU_AVX2 | CPU_AVX512F | CPU_AVX512BW, "AVX-512 iDCT", idct_avx512 },
+#endif
+        };
+
+        processState.idct_blocks = selectDispatchVariant("jpeg.idct.blocks", idct_blocks_variants).function;
+
+        // precision is not known until the frame header has been parsed
+        if (precision == 12)
+        {
+            // Force 12 bit idct
+            // This will round down to 8 bit precision until we have a 12 bit capable color conversion
+            processState.idct = idct12;
+            processState.idct_blocks = nullptr;
+            m_idct_name = "12 bit iDCT";
+            setDispatchVariant("jpeg.idct", m_idct_name);
+            setDispatchVariant("jpeg.idct.blocks", "none");
+        }
+
         // configure default implementation
         switch (sample)
         {
@@ -1343,6 +1555,7 @@ namespace jpeg {
                 processState.process_ycbcr_8x16  = nullptr;
                 processState.process_ycbcr_16x8  = nullptr;
                 processState.process_ycbcr_16x16 = nullptr;
+                processState.process_ycbcr_scaled = process_ycbcr_8bit;
                 break;
             case JPEG_U8_BGR:
                 processState.process_y           = process_y_24bit;
@@ -1351,6 +1564,7 @@ namespace jpeg {
                 processState.process_ycbcr_8x16  = process_ycbcr_bgr_8x16;
                 processState.process_ycbcr_16x8  = process_ycbcr_bgr_16x8;
                 processState.process_ycbcr_16x16 = process_ycbcr_bgr_16x16;
+                processState.process_ycbcr_scaled = process_ycbcr_bgr;
                 break;
             case JPEG_U8_RGB:
                 processState.process_y           = process_y_24bit;
@@ -1359,6 +1573,7 @@ namespace jpeg {
                 processState.process_ycbcr_8x16  = process_ycbcr_rgb_8x16;
                 processState.process_ycbcr_16x8  = process_ycbcr_rgb_16x8;
                 processState.process_ycbcr_16x16 = process_ycbcr_rgb_16x16;
+                processState.process_ycbcr_scaled = process_ycbcr_rgb;
                 break;
             case JPEG_U8_BGRA:
                 processState.process_y           = process_y_32bit;
@@ -1367,6 +1582,7 @@ namespace jpeg {
                 processState.process_ycbcr_8x16  = process_ycbcr_bgra_8x16;
                 processState.process_ycbcr_16x8  = process_ycbcr_bgra_16x8;
                 processState.process_ycbcr_16x16 = process_ycbcr_bgra_16x16;
+                processState.process_ycbcr_scaled = process_ycbcr_bgra;
                 break;
             case JPEG_U8_RGBA:
                 processState.process_y           = process_y_32bit;
@@ -1375,6 +1591,7 @@ namespace jpeg {
                 processState.process_ycbcr_8x16  = process_ycbcr_rgba_8x16;
                 processState.process_ycbcr_16x8  = process_ycbcr_rgba_16x8;
                 processState.process_ycbcr_16x16 = process_ycbcr_rgba_16x16;
+                processState.process_ycbcr_scaled = process_ycbcr_rgba;
                 break;
         }
 
@@ -1431,17 +1648,21 @@ namespace jpeg {
                 case JPEG_U8_RGB:
                     break;
                 case JPEG_U8_BGRA:
+                    processState.process_y           = process_y_32bit_sse2;
                     processState.process_ycbcr_8x8   = process_ycbcr_bgra_8x8_sse2;
                     processState.process_ycbcr_8x16  = process_ycbcr_bgra_8x16_sse2;
                     processState.process_ycbcr_16x8  = process_ycbcr_bgra_16x8_sse2;
                     processState.process_ycbcr_16x16 = process_ycbcr_bgra_16x16_sse2;
+                    processState.process_ycbcr_scaled = process_ycbcr_bgra_scaled_sse2;
                     simd = "SSE2";
                     break;
                 case JPEG_U8_RGBA:
+                    processState.process_y           = process_y_32bit_sse2;
                     processState.process_ycbcr_8x8   = process_ycbcr_rgba_8x8_sse2;
                     processState.process_ycbcr_8x16  = process_ycbcr_rgba_8x16_sse2;
                     processState.process_ycbcr_16x8  = process_ycbcr_rgba_16x8_sse2;
                     processState.process_ycbcr_16x16 = process_ycbcr_rgba_16x16_sse2;
+                    processState.process_ycbcr_scaled = process_ycbcr_rgba_scaled_sse2;
                     simd = "SSE2";
                     break;
             }
@@ -1449,7 +1670,7 @@ namespace jpeg {
 
 #endif // JPEG_ENABLE_SSE2
 
-#if defined(JPEG_ENABLE_SSE4)
+#if defined(JPEG_ENABLE_SSSE3)
 
         if (cpu_flags & CPU_SSSE3)
         {
@@ -1458,17 +1679,21 @@ namespace jpeg {
                 case JPEG_U8_Y:
                     break;
                 case JPEG_U8_BGR:
+                    processState.process_y           = process_y_24bit_ssse3;
                     processState.process_ycbcr_8x8   = process_ycbcr_bgr_8x8_ssse3;
                     processState.process_ycbcr_8x16  = process_ycbcr_bgr_8x16_ssse3;
                     processState.process_ycbcr_16x8  = process_ycbcr_bgr_16x8_ssse3;
                     processState.process_ycbcr_16x16 = process_ycbcr_bgr_16x16_ssse3;
+                    processState.process_ycbcr_scaled = process_ycbcr_bgr_scaled_ssse3;
                     simd = "SSSE3";
                     break;
                 case JPEG_U8_RGB:
+                    processState.process_y           = process_y_24bit_ssse3;
                     processState.process_ycbcr_8x8   = process_ycbcr_rgb_8x8_ssse3;
                     processState.process_ycbcr_8x16  = process_ycbcr_rgb_8x16_ssse3;
                     processState.process_ycbcr_16x8  = process_ycbcr_rgb_16x8_ssse3;
                     processState.process_ycbcr_16x16 = process_ycbcr_rgb_16x16_ssse3;
+                    processState.process_ycbcr_scaled = process_ycbcr_rgb_scaled_ssse3;
                     simd = "SSSE3";
                     break;
                 case JPEG_U8_BGRA:
@@ -1478,7 +1703,52 @@ namespace jpeg {
             }
         }
 
-#endif // JPEG_ENABLE_SSE4
+#endif // JPEG_ENABLE_SSSE3
+
+#if defined(JPEG_ENABLE_AVX2)
+
+        // the AVX2 color conversion transforms the blocks with idct_blocks, which is only
+        // available for 8 bit samples
+        if ((cpu_flags & CPU_AVX2) && processState.idct_blocks)
+        {
+            switch (sample)
+            {
+                case JPEG_U8_Y:
+                    break;
+                case JPEG_U8_BGR:
+                    processState.process_ycbcr_8x8   = process_ycbcr_bgr_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_bgr_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_bgr_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_bgr_16x16_avx2;
+                    simd = "AVX2";
+                    break;
+                case JPEG_U8_RGB:
+                    processState.process_ycbcr_8x8   = process_ycbcr_rgb_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_rgb_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_rgb_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_rgb_16x16_avx2;
+                    simd = "AVX2";
+                    break;
+                case JPEG_U8_BGRA:
+                    processState.process_ycbcr_8x8   = process_ycbcr_bgra_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_bgra_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_bgra_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_bgra_16x16_avx2;
+                    simd = "AVX2";
+                    break;
+                case JPEG_U8_RGBA:
+                    processState.process_ycbcr_8x8   = process_ycbcr_rgba_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_rgba_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_rgba_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_rgba_16x16_avx2;
+                    simd = "AVX2";
+                    break;
+            }
+        }
+
+#endif // JPEG_ENABLE_AVX2
+
+        setDispatchVariant("jpeg.ycbcr", *simd ? simd : "generic");
 
         std::string id;
 
@@ -1548,7 +1818,106 @@ namespace jpeg {
         debugPrint("  Decoder: %s\n", id.c_str());
     }
 
-    ImageDecodeStatus Parser::decode(Surface& target)
+    void Parser::configureScale(int scale)
+    {
+        m_scale = scale;
+
+        // output block and MCU size
+        const int N = 8 / scale;
+        processState.idct_size = N;
+        xblock = N * Hmax;
+        yblock = N * Vmax;
+
+        // the output is rounded up to the next pixel at reduced size
+        xclip = ((xsize + scale - 1) / scale) % xblock;
+        yclip = ((ysize + scale - 1) / scale) % yblock;
+
+        if (scale > 1)
+        {
+            using IDCTFunc = void (*)(u8* dest, const s16* data, const s16* qt);
+
+            static const DispatchVariant<IDCTFunc> idct4x4_variants[] =
+            {
+                { 0, "Scalar 4x4 iDCT", idct8_4x4 },
+#if defined(JPEG_ENABLE_SSE2)
+                { CPU_SSE2, "SSE2 4x4 iDCT", idct4x4_sse2 },
+#endif
+            };
+
+            switch (scale)
+            {
+                case 2:
+                    if (precision == 12)
+                    {
+                        processState.idct = idct12_4x4;
+                        m_idct_name = "12 bit 4x4 iDCT";
+                    }
+                    else
+                    {
+                        const auto& idct = selectDispatchVariant("jpeg.idct.4x4", idct4x4_variants);
+                        processState.idct = idct.function;
+                        m_idct_name = idct.name;
+                    }
+                    break;
+                case 4:
+                    processState.idct = precision == 12 ? idct12_2x2 : idct8_2x2;
+                    m_idct_name = "2x2 iDCT";
+                    break;
+                case 8:
+                    processState.idct = precision == 12 ? idct12_1x1 : idct8_1x1;
+                    m_idct_name = "1x1 iDCT";
+                    break;
+            }
+
+            processState.idct_blocks = nullptr;
+
+            // the specialized color conversion functions only handle full size blocks
+            if (components == 3)
+            {
+                processState.clipped = processState.process_ycbcr_scaled;
+                m_ycbcr_name = "YCbCr scaled";
+            }
+
+            processState.process = processState.clipped;
+
+            debugPrint("  Scale: 1/%d, MCU: %d x %d\n", scale, xblock, yblock);
+        }
+    }
+
+    int Parser::getScale(int scale) const
+    {
+        if (is_lossless)
+        {
+            // no DCT blocks to scale
+            return 1;
+        }
+
+        // round down to the supported scales: 1, 2, 4, 8
+        int s = 1;
+        while (s < 8 && s * 2 <= scale)
+        {
+            s *= 2;
+        }
+
+        return s;
+    }
+
+    ImageHeader Parser::getHeader(int scale) const
+    {
+        ImageHeader temp = header;
+
+        if (scan_memory.address)
+        {
+            scale = getScale(scale);
+            temp.width = (xsize + scale - 1) / scale;
+            temp.height = (ysize + scale - 1) / scale;
+            temp.scale = scale;
+        }
+
+        return temp;
+    }
+
+    ImageDecodeStatus Parser::decode(Surface& target, const ImageDecodeOptions& options)
     {
         ImageDecodeStatus status;
 
@@ -1561,16 +1930,21 @@ namespace jpeg {
             return status;
         }
 
-        // allocate blocks
-        AlignedPointer<s16> tempBlockVector(mcus * blocks_in_mcu * 64);
-        blockVector = tempBlockVector.data();
-
         // find best matching format
         SampleFormat sf = getSampleFormat(target.format);
 
         // configure innerloops based on CPU caps
         configureCPU(sf.sample);
 
+        // configure reduced size decoding
+        const int scale = getScale(options.scale);
+        configureScale(scale);
+
+        const int scaled_width = (xsize + scale - 1) / scale;
+        const int scaled_height = (ysize + scale - 1) / scale;
+
+        ImageDecodeRegion region(target, options, scaled_width, scaled_height);
+
         if (is_lossless)
         {
             // lossless only supports L8 and BGRA
@@ -1592,98 +1966,199 @@ namespace jpeg {
             sf.format = FORMAT_B8G8R8A8;
         }
 
+        // decoding window: the MCUs which cover the region
+        m_mcu_x0 = 0;
+        m_mcu_y0 = 0;
+        m_mcu_x1 = xmcu;
+        m_mcu_y1 = ymcu;
+
+        if (!is_lossless)
+        {
+            // lossless decoding is done in scanlines over the whole image
+            m_mcu_x0 = region.x / xblock;
+            m_mcu_y0 = region.y / yblock;
+            m_mcu_x1 = std::max(m_mcu_x0, (region.x + region.width + xblock - 1) / xblock);
+            m_mcu_y1 = std::max(m_mcu_y0, (region.y + region.height + yblock - 1) / yblock);
+        }
+
+        if (!region.width || !region.height)
+        {
+            // the region is outside of the image
+            status.direct = false;
+            return status;
+        }
+
+        const bool band = region.isBand() && !is_lossless;
+
+        // allocate blocks; band decoding of sequential images only needs one MCU at a time
+        const bool blocks = !band || is_progressive || is_multiscan;
+        AlignedPointer<s16> tempBlockVector(blocks ? mcus * blocks_in_mcu * 64 : 64);
+        blockVector = tempBlockVector.data();
+
         // target surface size has to match (clipping isn't yet supported)
-        if (target.width != xsize || target.height != ysize)
+        if (target.width != scaled_width || target.height != scaled_height)
         {
             status.direct = false;
         }
 
-        if (target.format != sf.format)
+        if (target.format != sf.format || !region.isWhole())
         {
             status.direct = false;
         }
 
+        m_region = band ? &region : nullptr;
+
         if (status.direct)
         {
             m_surface = &target;
 
             parse(scan_memory, true);
 
-            if (!header.success)
+            if (header.success && (is_progressive || is_multiscan))
             {
-                status.setError(header.info);
-                return status;
+                finishProgressive();
             }
-
-            if (is_progressive || is_multiscan)
-			{
-	            finishProgressive();
-			}
         }
         else
         {
-            Bitmap temp(width, height, sf.format);
+            // decoding window; band decoding needs only one MCU row of it
+            const int window_width = (m_mcu_x1 - m_mcu_x0) * xblock;
+            const int window_height = band ? yblock : (m_mcu_y1 - m_mcu_y0) * yblock;
+
+            Bitmap temp(window_width, window_height, sf.format);
             m_surface = &temp;
 
             parse(scan_memory, true);
 
-            if (!header.success)
+            if (header.success && (is_progressive || is_multiscan))
             {
-                status.setError(header.info);
-                return status;
+                finishProgressive();
             }
 
-            if (is_progressive || is_multiscan)
-			{
-	            finishProgressive();
-			}
-
-            target.blit(0, 0, temp);
+            if (header.success && !band)
+            {
+                region.write(temp, m_mcu_x0 * xblock, m_mcu_y0 * yblock);
+            }
         }
 
+        m_surface = nullptr;
+        m_region = nullptr;
         blockVector = nullptr;
+
+        if (!header.success)
+        {
+            status.setError(header.info);
+            return status;
+        }
+
         status.info = getInfo();
 
         return status;
     }
 
-    std::string Parser::getInfo() const
+    ImageDecodeStatus Parser::decodeCoefficients(Coefficients& coefficients)
     {
-        std::string info = m_encoding;
-
-        info += ", ";
-        info += m_compression;
+        ImageDecodeStatus status;
 
-        if (!m_idct_name.empty())
+        if (!scan_memory.address)
         {
-            info += ", ";
-            info += m_idct_name;
+            status.setError("No scan data.");
+            return status;
         }
 
-        if (!m_ycbcr_name.empty())
+        if (is_lossless)
         {
-            info += ", ";
-            info += m_ycbcr_name;
+            status.setError("Lossless JPEG does not have DCT coefficients.");
+            return status;
         }
 
-        return info;
-    }
+        configureCPU(JPEG_U8_Y);
+        configureScale(1);
 
-    void Parser::decodeLossless()
-    {
-        int predictor = decodeState.spectralStart;
-        int pointTransform = decodeState.successiveLow;
+        m_mcu_x0 = 0;
+        m_mcu_y0 = 0;
+        m_mcu_x1 = xmcu;
+        m_mcu_y1 = ymcu;
 
-        auto decodeFunction = huff_decode_mcu_lossless;
-        int* previousDC = decodeState.huffman.last_dc_value;
+        // the blocks which are not coded in the scans (outside of the component) stay zero
+        coefficients.blocks.assign(size_t(mcus) * blocks_in_mcu * 64, 0);
+        blockVector = coefficients.blocks.data();
+        m_coefficients = true;
 
-        if (is_arithmetic)
+        parse(scan_memory, true);
+
+        if (header.success && (is_progressive || is_multiscan))
         {
-#ifdef MANGO_ENABLE_LICENSE_BSD
-            decodeFunction = arith_decode_mcu_lossless;
-            previousDC = decodeState.arithmetic.last_dc_value;
-#else
-            // We don't have a license for arithmetic decoder
+            finishProgressive();
+        }
+
+        m_coefficients = false;
+        blockVector = nullptr;
+
+        if (!header.success)
+        {
+            status.setError(header.info);
+            return status;
+        }
+
+        coefficients.frames = frames;
+
+        for (int i = 0; i < JPEG_MAX_COMPS_IN_SCAN; ++i)
+        {
+            std::memcpy(coefficients.qt[i], quantTable[i].table, 64 * sizeof(s16));
+        }
+
+        coefficients.width = xsize;
+        coefficients.height = ysize;
+        coefficients.precision = precision;
+        coefficients.hmax = Hmax;
+        coefficients.vmax = Vmax;
+        coefficients.xmcu = xmcu;
+        coefficients.ymcu = ymcu;
+        coefficients.blocks_in_mcu = blocks_in_mcu;
+
+        status.info = m_encoding + ", " + m_compression;
+
+        return status;
+    }
+
+    std::string Parser::getInfo() const
+    {
+        std::string info = m_encoding;
+
+        info += ", ";
+        info += m_huffman_name.empty() ? m_compression : m_huffman_name;
+
+        if (!m_idct_name.empty())
+        {
+            info += ", ";
+            info += m_idct_name;
+        }
+
+        if (!m_ycbcr_name.empty())
+        {
+            info += ", ";
+            info += m_ycbcr_name;
+        }
+
+        return info;
+    }
+
+    void Parser::decodeLossless()
+    {
+        int predictor = decodeState.spectralStart;
+        int pointTransform = decodeState.successiveLow;
+
+        auto decodeFunction = huff_decode_mcu_lossless;
+        int* previousDC = decodeState.huffman.last_dc_value;
+
+        if (is_arithmetic)
+        {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            decodeFunction = arith_decode_mcu_lossless;
+            previousDC = decodeState.arithmetic.last_dc_value;
+#else
+            // We don't have a license for arithmetic decoder
             return;
 #endif
         }
@@ -1772,6 +2247,98 @@ namespace jpeg {
         }
     }
 
+    // ----------------------------------------------------------------------------
+    // speculative decoding
+    // ----------------------------------------------------------------------------
+
+    /*
+        Without restart markers the MCU boundaries are not known until all of the preceding
+        entropy coded data has been decoded. Huffman codes resynchronize quickly, though: a decoder
+        started from an arbitrary byte decodes garbage for a few MCUs and then falls on the same
+        MCU boundaries as the decoder which started from the beginning of the scan.
+
+        The scan is split into byte ranges which are decoded in parallel. Each range records the bit
+        position where its MCUs begin. The decoder of the previous range is then run forward until
+        it reaches one of these positions; from there on both decoders produce identical results
+        except for the DC predictors which differ by a constant for each component.
+
+        The ranges have to keep their coefficients until they are synchronized, so the scan is
+        decoded in rounds which buffer a bounded amount of coefficients. The first range of a round
+        continues from the exact decoder state where the previous round ended and is processed
+        while it is decoded.
+    */
+
+    constexpr size_t SPECULATIVE_ROUND_MEMORY = 32 * 1024 * 1024;
+
+    struct SpeculativeSegment
+    {
+        struct Position
+        {
+            const u8* ptr;
+            int remain;
+        };
+
+        Buffer buffer;
+        std::vector<Position> positions;
+        DecodeState state;
+        int mcu_data_size = 0;
+        int count = 0;  // number of decoded MCUs
+        bool direct = false; // the MCUs are processed as they are decoded; only the last one is kept
+
+        int first = 0;  // first MCU which is in sync with the previous segment
+        int last = 0;   // first MCU which belongs to the next segment
+        int offset = 0; // image MCU index of the first MCU
+        int delta[JPEG_MAX_COMPS_IN_SCAN] = { 0 };
+
+        s16* data(int index) const
+        {
+            index = direct ? 0 : index;
+            return reinterpret_cast<s16*>(buffer.data()) + index * mcu_data_size;
+        }
+
+        void decode()
+        {
+            const size_t bytes = (direct ? 1 : count + 1) * mcu_data_size * sizeof(s16);
+            if (buffer.size() < bytes)
+            {
+                buffer.resize(std::max(bytes, buffer.size() * 2));
+            }
+
+            state.decode(data(count), &state);
+            ++count;
+        }
+    };
+
+    static inline
+    u64 getBitPosition(const u8* base, const u8* ptr, int remain)
+    {
+        // step back over the bytes still in the bit buffer; stuffed zero bytes are not data
+        while (remain > 0)
+        {
+            --ptr;
+            ptr -= (ptr[0] == 0 && ptr[-1] == 0xff);
+            remain -= 8;
+        }
+
+        return u64(ptr - base) * 8 - remain;
+    }
+
+    static inline
+    int getLastDC(const s16* data, const DecodeState& state, int pred)
+    {
+        int value = 0;
+
+        for (int i = 0; i < state.blocks; ++i)
+        {
+            if (state.block[i].pred == pred)
+            {
+                value = data[i * 64];
+            }
+        }
+
+        return value;
+    }
+
     void Parser::decodeSequential()
     {
 #ifdef JPEG_ENABLE_THREAD
@@ -1779,7 +2346,7 @@ namespace jpeg {
 #else
         const int count = 1;
 #endif
-        if (count > 1)
+        if (count > 1 && !m_region)
         {
             decodeSequentialMT();
         }
@@ -1791,57 +2358,66 @@ namespace jpeg {
 
     void Parser::decodeSequentialST()
     {
-        const int stride = m_surface->stride;
-        const int xstride = m_surface->format.bytes() * xblock;
-        const int ystride = stride * yblock;
-        u8* image = m_surface->address<u8>(0, 0);
-
         s16 data[640];
 
-        for (int y = 0; y < ymcu; ++y)
-        {
-            u8* dest = image;
+        const int last = m_mcu_y1 * xmcu;
 
-            ProcessFunc process = processState.process;
-            int width = xblock;
-            int height = yblock;
+        int x = 0;
+        int y = 0;
 
-            if (yclip && y == ymcu - 1)
+        auto next = [&] ()
+        {
+            if (++x == xmcu)
             {
-                process = processState.clipped;
-                height = yclip;
+                writeBand(y);
+                x = 0;
+                ++y;
             }
+        };
 
-            for (int x = 0; x < xmcu; ++x)
+        for (int n = 0; n < last; )
+        {
+            if (restartInterval && restartCounter == restartInterval && !isIntervalInWindow(n))
             {
-                decodeState.decode(data, &decodeState);
-                handleRestart();
-
-                if (xclip && x == xmcu - 1)
+                // seek over the restart interval; it has no MCUs inside the decoding window
+                // NOTE: the last interval is not terminated with a restart marker
+                const u8* p = seekMarker(decodeState.buffer.ptr, decodeState.buffer.end);
+                if (p + 1 < decodeState.buffer.end && isRestartMarker(p))
                 {
-                    process = processState.clipped;
-                    width = xclip;
-                }
+                    decodeState.buffer.ptr = p + 2;
+                    restart();
+
+                    for (int i = 0; i < restartInterval && n < last; ++i, ++n)
+                    {
+                        next();
+                    }
 
-                process(dest, stride, data, &processState, width, height);
-                dest += xstride;
+                    continue;
+                }
             }
 
-            image += ystride;
+            decodeState.decode(data, &decodeState);
+            handleRestart();
+
+            processMCU(x, y, data);
+
+            next();
+            ++n;
         }
     }
 
     void Parser::decodeSequentialMT()
     {
-        const int stride = m_surface->stride;
-        const int xstride = m_surface->format.bytes() * xblock;
-        const int ystride = stride * yblock;
-        u8* image = m_surface->address<u8>(0, 0);
-
         ConcurrentQueue queue("jpeg.sequential", Priority::HIGH);
 
         if (!restartInterval)
         {
+            // speculative decoding goes through the whole scan
+            if (!is_arithmetic && m_mcu_y1 == ymcu && decodeSequentialSpeculative())
+            {
+                return;
+            }
+
             s16* data = blockVector;
             const int mcu_data_size = blocks_in_mcu * 64;
 
@@ -1851,10 +2427,10 @@ namespace jpeg {
             const int N = std::max(ymcu / S, pool_size);
 
             // use threadpool to process blocks
-            for (int y = 0; y < ymcu; y += N)
+            for (int y = 0; y < m_mcu_y1; y += N)
             {
                 const int y0 = y;
-                const int y1 = std::min(y + N, ymcu);
+                const int y1 = std::min(y + N, m_mcu_y1);
                 const int count = (y1 - y0) * xmcu;
                 debugPrint("  Process: [%d, %d] --> ThreadPool.\n", y0, y1 - 1);
 
@@ -1866,35 +2442,23 @@ namespace jpeg {
                     handleRestart();
                 }
 
+                if (y1 <= m_mcu_y0)
+                {
+                    // above the decoding window
+                    continue;
+                }
+
                 // enqueue task
                 queue.enqueue([=]
                 {
                     for (int y = y0; y < y1; ++y)
                     {
-                        u8* dest = image + y * ystride;
-                        s16* source = data + y * xmcu * mcu_data_size;
-
-                        ProcessFunc process = processState.process;
-                        int width = xblock;
-                        int height = yblock;
-
-                        if (yclip && y == ymcu - 1)
-                        {
-                            process = processState.clipped;
-                            height = yclip;
-                        }
+                        const s16* source = data + y * xmcu * mcu_data_size;
 
                         for (int x = 0; x < xmcu; ++x)
                         {
-                            if (xclip && x == xmcu - 1)
-                            {
-                                process = processState.clipped;
-                                width = xclip;
-                            }
-
-                            process(dest, stride, source, &processState, width, height);
+                            processMCU(x, y, source);
                             source += mcu_data_size;
-                            dest += xstride;
                         }
                     }
                 });
@@ -1903,60 +2467,317 @@ namespace jpeg {
         else
         {
             const u8* p = decodeState.buffer.ptr;
+            const int last = m_mcu_y1 * xmcu;
 
-            for (int i = 0; i < mcus; i += restartInterval)
+            for (int i = 0; i < last; i += restartInterval)
             {
-                // enqueue task
-                queue.enqueue([=]
+                if (isIntervalInWindow(i))
                 {
-                    AlignedPointer<s16> data(640);
+                    // enqueue task
+                    queue.enqueue([=]
+                    {
+                        AlignedPointer<s16> data(640);
 
-                    DecodeState state = decodeState;
-                    state.buffer.ptr = p;
+                        DecodeState state = decodeState;
+                        state.buffer.ptr = p;
 
-                    const int left = std::min(restartInterval, mcus - i);
+                        const int left = std::min(restartInterval, mcus - i);
 
-                    for (int j = 0; j < left; ++j)
-                    {
-                        int n = i + j;
+                        for (int j = 0; j < left; ++j)
+                        {
+                            int n = i + j;
 
-                        state.decode(data, &state);
+                            state.decode(data, &state);
 
-                        int x = n % xmcu;
-                        int y = n / xmcu;
+                            int x = n % xmcu;
+                            int y = n / xmcu;
+
+                            processMCU(x, y, data);
+                        }
+                    });
+                }
+
+                // seek next restart marker
+                p = seekMarker(p, decodeState.buffer.end);
+                p += 2;
+            }
+
+            decodeState.buffer.ptr = p;
+        }
+
+        // synchronize
+        queue.wait();
+    }
+
+    bool Parser::decodeSequentialSpeculative()
+    {
+        const u8* start = decodeState.buffer.ptr;
+        const u8* end = seekMarker(start, decodeState.buffer.end);
+
+        const size_t bytes = end - start;
+        const size_t min_segment_size = 64 * 1024;
+
+        const int pool_size = ThreadPool::getInstanceSize();
+        const int S = int(std::min(size_t(4 * pool_size), bytes / min_segment_size));
+
+        if (S < 2)
+        {
+            return false;
+        }
+
+        const int mcu_data_size = blocks_in_mcu * 64;
+
+        // split the scan into rounds which buffer at most SPECULATIVE_ROUND_MEMORY of coefficients;
+        // every round must still have room for two segments
+        const size_t coefficient_bytes = size_t(mcus) * mcu_data_size * sizeof(s16);
+        const size_t max_rounds = std::max(size_t(1), bytes / (2 * min_segment_size));
+        const size_t rounds = std::min(max_rounds, (coefficient_bytes + SPECULATIVE_ROUND_MEMORY - 1) / SPECULATIVE_ROUND_MEMORY);
+
+        debugPrint("  Speculative: %d rounds of %d segments.\n", int(rounds), S);
+
+        ConcurrentQueue queue("jpeg.speculative", Priority::HIGH);
+
+        // decoder state at the beginning of the round; it is always in sync
+        DecodeState carry = decodeState;
+        int offset = 0;
+
+        for (size_t round = 0; round < rounds && offset < mcus; ++round)
+        {
+            const u8* round_start = std::max(carry.buffer.ptr, start + bytes * round / rounds);
+            const u8* round_end = round + 1 < rounds ? start + bytes * (round + 1) / rounds : end;
+            const bool last_round = round + 1 == rounds;
+
+            const size_t round_bytes = round_end > round_start ? round_end - round_start : 0;
+            const int segment_count = std::max(1, int(std::min(size_t(S), round_bytes / min_segment_size)));
+            const size_t segment_size = round_bytes / segment_count;
+            const size_t estimate = size_t(mcus) * segment_size / bytes + xmcu;
+
+            std::vector<SpeculativeSegment> segments(segment_count);
+
+            for (int i = 0; i < segment_count; ++i)
+            {
+                const u8* p = round_start + i * segment_size;
+                const u8* limit = i < segment_count - 1 ? p + segment_size : round_end;
+
+                if (i > 0 && p[-1] == 0xff)
+                {
+                    // don't start from a stuffed zero byte
+                    ++p;
+                }
+
+                SpeculativeSegment& segment = segments[i];
+
+                // enqueue task
+                queue.enqueue([=, &segment]
+                {
+                    segment.mcu_data_size = mcu_data_size;
 
-                        u8* dest = image + y * ystride + x * xstride;
+                    DecodeState& state = segment.state;
 
-                        ProcessFunc process = processState.process;
-                        int width = xblock;
-                        int height = yblock;
+                    if (!i)
+                    {
+                        // continue from where the previous round ended
+                        segment.direct = true;
+                        segment.offset = offset;
+                        state = carry;
+                    }
+                    else
+                    {
+                        segment.buffer.reserve(estimate * mcu_data_size * sizeof(s16));
+                        segment.positions.reserve(estimate);
+
+                        state = carry;
+                        state.buffer.ptr = p;
+                        state.buffer.restart();
+                        state.huffman.restart();
+                    }
 
-                        if (xclip && x == xmcu - 1)
+                    while (state.buffer.ptr < limit && segment.offset + segment.count < mcus)
+                    {
+                        if (segment.direct)
+                        {
+                            segment.decode();
+
+                            int n = segment.offset + segment.count - 1;
+                            processMCU(n % xmcu, n / xmcu, segment.data(n));
+                        }
+                        else
                         {
-                            process = processState.clipped;
-                            width = xclip;
+                            segment.positions.push_back({ state.buffer.ptr, state.buffer.remain });
+                            segment.decode();
                         }
+                    }
+                });
+            }
+
+            queue.wait();
+
+            // synchronize the segments
+            bool synchronized = true;
+
+            for (int i = 0; i < segment_count - 1 && synchronized; ++i)
+            {
+                SpeculativeSegment& prev = segments[i];
+                SpeculativeSegment& next = segments[i + 1];
+
+                int j = 0;
+
+                for (;;)
+                {
+                    const u64 position = getBitPosition(start, prev.state.buffer.ptr, prev.state.buffer.remain);
+
+                    u64 candidate = 0;
+
+                    for ( ; j < next.count; ++j)
+                    {
+                        candidate = getBitPosition(start, next.positions[j].ptr, next.positions[j].remain);
+                        if (candidate >= position)
+                            break;
+                    }
+
+                    if (j == next.count || prev.offset + prev.count - prev.first >= mcus)
+                    {
+                        // the next segment never got in sync
+                        debugPrint("  Speculative: segment %d failed to synchronize.\n", i + 1);
+                        synchronized = false;
+                        break;
+                    }
+
+                    if (candidate == position)
+                    {
+                        break;
+                    }
+
+                    prev.decode();
+
+                    if (prev.direct)
+                    {
+                        int n = prev.offset + prev.count - 1;
+                        processMCU(n % xmcu, n / xmcu, prev.data(n));
+                    }
+                }
+
+                if (!synchronized)
+                {
+                    break;
+                }
+
+                prev.last = prev.count;
+
+                next.first = j;
+                next.offset = prev.offset + prev.last - prev.first;
+
+                if (next.offset > mcus)
+                {
+                    synchronized = false;
+                    break;
+                }
+
+                for (int c = 0; c < JPEG_MAX_COMPS_IN_SCAN; ++c)
+                {
+                    int predictor = prev.state.huffman.last_dc_value[c] + prev.delta[c];
+                    int local = j ? getLastDC(next.data(j - 1), decodeState, c) : 0;
+                    next.delta[c] = predictor - local;
+                }
+
+                debugPrint("  Speculative: segment %d in sync after %d MCUs.\n", i + 1, j);
+            }
 
-                        if (yclip && y == ymcu - 1)
+            if (!synchronized)
+            {
+                if (!offset)
+                {
+                    // nothing is lost yet; decode the scan sequentially
+                    return false;
+                }
+
+                // decode the rest of the scan on this thread
+                AlignedPointer<s16> data(mcu_data_size);
+
+                for (int n = offset; n < mcus; ++n)
+                {
+                    carry.decode(data, &carry);
+                    processMCU(n % xmcu, n / xmcu, data);
+                }
+
+                decodeState.buffer = carry.buffer;
+                return true;
+            }
+
+            SpeculativeSegment& tail = segments[segment_count - 1];
+
+            if (last_round)
+            {
+                // the tail segment stopped when it ran into the end of the scan;
+                // decode whatever was still left in the bit buffer
+                tail.last = tail.first + mcus - tail.offset;
+
+                while (tail.count < tail.last)
+                {
+                    tail.decode();
+
+                    if (tail.direct)
+                    {
+                        int n = tail.offset + tail.count - 1;
+                        processMCU(n % xmcu, n / xmcu, tail.data(n));
+                    }
+                }
+            }
+            else
+            {
+                tail.last = tail.count;
+            }
+
+            for (int i = 0; i < segment_count; ++i)
+            {
+                const SpeculativeSegment& segment = segments[i];
+
+                if (segment.direct)
+                {
+                    // already processed
+                    continue;
+                }
+
+                // enqueue task
+                queue.enqueue([=, &segment]
+                {
+                    for (int k = segment.first; k < segment.last; ++k)
+                    {
+                        s16* data = segment.data(k);
+
+                        // correct the DC predictors
+                        for (int b = 0; b < decodeState.blocks; ++b)
                         {
-                            process = processState.clipped;
-                            height = yclip;
+                            data[b * 64] += s16(segment.delta[decodeState.block[b].pred]);
                         }
 
-                        process(dest, stride, data, &processState, width, height);
+                        int n = segment.offset + k - segment.first;
+
+                        int x = n % xmcu;
+                        int y = n / xmcu;
+
+                        processMCU(x, y, data);
                     }
                 });
+            }
 
-                // seek next restart marker
-                p = seekMarker(p, decodeState.buffer.end);
-                p += 2;
+            // the next round continues from the tail with the corrected DC predictors
+            carry = tail.state;
+
+            for (int c = 0; c < JPEG_MAX_COMPS_IN_SCAN; ++c)
+            {
+                carry.huffman.last_dc_value[c] += tail.delta[c];
             }
 
-            decodeState.buffer.ptr = p;
+            offset = tail.offset + tail.last - tail.first;
+
+            // synchronize
+            queue.wait();
         }
 
-        // synchronize
-        queue.wait();
+        decodeState.buffer = carry.buffer;
+
+        return true;
     }
 
     void Parser::decodeMultiScan()
@@ -2010,7 +2831,7 @@ namespace jpeg {
         const int scan_offset = scanFrame->offset;
 
         const int xs = ((xsize + hsize - 1) / hsize);
-        const int ys = ((ysize + vsize - 1) / vsize);
+        const int ys = std::min((ysize + vsize - 1) / vsize, m_mcu_y1 << vsf);
 
         debugPrint("    blocks: %d x %d (%d x %d)\n", xs, ys, xs * hsize, ys * vsize);
 
@@ -2035,6 +2856,162 @@ namespace jpeg {
         }
     }
 
+    const u8* Parser::deferProgressive(const u8* end)
+    {
+        ProgressiveScan* scan = new ProgressiveScan();
+        progressiveScans.emplace_back(scan);
+
+        const bool dc_scan = (decodeState.spectralStart == 0);
+        const bool refine_scan = (decodeState.successiveHigh != 0);
+
+        scan->state = decodeState;
+        scan->restartInterval = restartInterval;
+        scan->restartCounter = restartInterval;
+
+        // copy the Huffman tables the scan is using
+        u32 configured = 0;
+
+        for (int i = 0; i < decodeState.blocks; ++i)
+        {
+            DecodeBlock& block = scan->state.block[i];
+
+            if (dc_scan && !refine_scan)
+            {
+                int index = int(block.table.dc - huffTable[0]);
+                if (!(configured & (1 << index)))
+                {
+                    configured |= 1 << index;
+                    scan->huffTable[0][index] = huffTable[0][index];
+                    scan->huffTable[0][index].configure();
+                }
+                block.table.dc = &scan->huffTable[0][index];
+            }
+
+            if (!dc_scan)
+            {
+                int index = int(block.table.ac - huffTable[1]);
+                if (!(configured & (16 << index)))
+                {
+                    configured |= 16 << index;
+                    scan->huffTable[1][index] = huffTable[1][index];
+                    scan->huffTable[1][index].configure();
+                }
+                block.table.ac = &scan->huffTable[1][index];
+            }
+        }
+
+        scan->components = 0;
+        for (int i = 0; i < decodeState.blocks; ++i)
+        {
+            scan->components |= 1 << decodeState.block[i].pred;
+        }
+
+        scan->interleaved = dc_scan;
+        scan->hsf = u32_log2(scanFrame->Hsf);
+        scan->vsf = u32_log2(scanFrame->Vsf);
+        scan->offset = scanFrame->offset;
+
+        if (dc_scan && decodeState.comps_in_scan == 1 && decodeState.blocks > 1)
+        {
+            // same as decodeProgressive(): decode the 8x8 blocks individually
+            scan->interleaved = false;
+            scan->state.block[0].offset = 0;
+            scan->state.blocks = 1;
+        }
+
+        // the first DC scan clears the whole block
+        scan->spectralStart = decodeState.spectralStart;
+        scan->spectralEnd = dc_scan && !refine_scan ? 63 : decodeState.spectralEnd;
+
+        for (auto& previous : progressiveScans)
+        {
+            ProgressiveScan* s = previous.get();
+            if (s != scan && (s->components & scan->components) &&
+                s->spectralStart <= scan->spectralEnd && scan->spectralStart <= s->spectralEnd)
+            {
+                scan->dependencies.push_back(s);
+                s->dependents.push_back(scan);
+            }
+        }
+
+        // skip the entropy coded segment
+        const u8* p = skipScan(decodeState.buffer.ptr, end);
+
+        debugPrint("  Deferred: %d bytes, %d dependencies\n",
+            int(p - decodeState.buffer.ptr), int(scan->dependencies.size()));
+
+        return p;
+    }
+
+    void Parser::decodeProgressiveScan(ProgressiveScan& scan, int y0, int y1)
+    {
+        DecodeState& state = scan.state;
+        s16* data = blockVector;
+
+        auto restart = [this, &scan, &state]
+        {
+            if (scan.restartInterval > 0 && !--scan.restartCounter)
+            {
+                scan.restartCounter = scan.restartInterval;
+
+                // the padding bits at the end of the interval are not always read
+                const u8* p = seekMarker(state.buffer.ptr, state.buffer.end);
+                if (isRestartMarker(p))
+                {
+                    state.buffer.ptr = p + 2;
+                    state.huffman.restart();
+                    state.buffer.restart();
+                }
+            }
+        };
+
+        if (scan.interleaved)
+        {
+            const int mcu_data_size = blocks_in_mcu * 64;
+            data += y0 * xmcu * mcu_data_size;
+
+            for (int i = y0 * xmcu; i < y1 * xmcu; ++i)
+            {
+                state.decode(data, &state);
+                restart();
+                data += mcu_data_size;
+            }
+
+            return;
+        }
+
+        const int hsf = scan.hsf;
+        const int vsf = scan.vsf;
+        const int hsize = (Hmax >> hsf) * 8;
+        const int vsize = (Vmax >> vsf) * 8;
+
+        const int xs = ((xsize + hsize - 1) / hsize);
+        const int ys = ((ysize + vsize - 1) / vsize);
+
+        const int HMask = (1 << hsf) - 1;
+        const int VMask = (1 << vsf) - 1;
+
+        y0 = y0 << vsf;
+        y1 = std::min(y1 << vsf, ys);
+
+        for (int y = y0; y < y1; ++y)
+        {
+            int mcu_yoffset = (y >> vsf) * xmcu;
+            int block_yoffset = ((y & VMask) << hsf) + scan.offset;
+
+            for (int x = 0; x < xs; ++x)
+            {
+                int mcu_offset = (mcu_yoffset + (x >> hsf)) * blocks_in_mcu;
+                int block_offset = (x & HMask) + block_yoffset;
+                s16* mcudata = data + (block_offset + mcu_offset) * 64;
+
+                // decode
+                state.decode(mcudata, &state);
+                restart();
+            }
+        }
+    }
+
     void Parser::finishProgressive()
     {
 #ifdef JPEG_ENABLE_THREAD
@@ -2042,7 +3019,7 @@ namespace jpeg {
 #else
         const int count = 1;
 #endif
-        if (count > 1)
+        if (count > 1 && !m_region)
         {
             finishProgressiveMT();
         }
@@ -2054,50 +3031,24 @@ namespace jpeg {
 
     void Parser::finishProgressiveST()
     {
-        const int stride = m_surface->stride;
-        const int xstride = m_surface->format.bytes() * xblock;
-        const int ystride = stride * yblock;
-        u8* image = m_surface->address<u8>(0, 0);
-
         const int mcu_data_size = blocks_in_mcu * 64;
-        s16* data = blockVector;
 
-        for (int y = 0; y < ymcu; ++y)
+        for (int y = m_mcu_y0; y < m_mcu_y1; ++y)
         {
-            u8* dest = image + y * ystride;
-
-            ProcessFunc process = processState.process;
-            int width = xblock;
-            int height = yblock;
-
-            if (yclip && y == ymcu - 1)
-            {
-                process = processState.clipped;
-                height = yclip;
-            }
+            const s16* data = blockVector + (y * xmcu + m_mcu_x0) * mcu_data_size;
 
-            for (int x = 0; x < xmcu; ++x)
+            for (int x = m_mcu_x0; x < m_mcu_x1; ++x)
             {
-                if (xclip && x == xmcu - 1)
-                {
-                    process = processState.clipped;
-                    width = xclip;
-                }
-
-                process(dest, stride, data, &processState, width, height);
+                processMCU(x, y, data);
                 data += mcu_data_size;
-                dest += xstride;
             }
+
+            writeBand(y);
         }
     }
 
     void Parser::finishProgressiveMT()
     {
-        const int stride = m_surface->stride;
-        const int xstride = m_surface->format.bytes() * xblock;
-        const int ystride = stride * yblock;
-        u8* image = m_surface->address<u8>(0, 0);
-
         const int mcu_data_size = blocks_in_mcu * 64;
         s16* data = blockVector;
 
@@ -2107,49 +3058,133 @@ namespace jpeg {
         const int S = pool_size > 1 ? 4 * pool_size : 1;
         const int N = std::max(ymcu / S, pool_size);
 
-        // use threadpool to process blocks
-        for (int y = 0; y < ymcu; y += N)
+        auto process_rows = [=] (int y0, int y1)
         {
-            const int y0 = y;
-            const int y1 = std::min(y + N, ymcu);
-            debugPrint("  Process: [%d, %d] --> ThreadPool.\n", y0, y1 - 1);
+            for (int y = std::max(y0, m_mcu_y0); y < y1; ++y)
+            {
+                const s16* source = data + (y * xmcu + m_mcu_x0) * mcu_data_size;
 
-            // enqueue task
-            queue.enqueue([=]
+                for (int x = m_mcu_x0; x < m_mcu_x1; ++x)
+                {
+                    processMCU(x, y, source);
+                    source += mcu_data_size;
+                }
+            }
+        };
+
+        if (progressiveScans.empty())
+        {
+            // use threadpool to process blocks
+            for (int y = m_mcu_y0; y < m_mcu_y1; y += N)
             {
-                for (int y = y0; y < y1; ++y)
+                const int y0 = y;
+                const int y1 = std::min(y + N, m_mcu_y1);
+                debugPrint("  Process: [%d, %d] --> ThreadPool.\n", y0, y1 - 1);
+
+                // enqueue task
+                queue.enqueue([=]
                 {
-                    u8* dest = image + y * ystride;
-                    s16* source = data + y * xmcu * mcu_data_size;
+                    process_rows(y0, y1);
+                });
+            }
 
-                    ProcessFunc process = processState.process;
-                    int width = xblock;
-                    int height = yblock;
+            // synchronize
+            queue.wait();
+            return;
+        }
 
-                    if (yclip && y == ymcu - 1)
+        /*
+            The deferred scans are decoded in bands of MCU rows. A scan can decode a band
+            once the scans it depends on have decoded the same band, so scans of different
+            components run in parallel and refinement scans follow the earlier scans of the
+            same coefficients band by band. When every scan is done with a band the band
+            is handed to IDCT and color conversion while the scans continue.
+        */
+
+        // the scans are decoded down to the last MCU row of the decoding window
+        const int bands = (m_mcu_y1 + N - 1) / N;
+        const int scans = int(progressiveScans.size());
+
+        std::unique_ptr<std::atomic<int>[]> remaining(new std::atomic<int>[bands]);
+        for (int i = 0; i < bands; ++i)
+        {
+            remaining[i] = scans;
+        }
+
+        auto is_ready = [] (const ProgressiveScan* scan)
+        {
+            for (const ProgressiveScan* dependency : scan->dependencies)
+            {
+                if (dependency->progress.load() <= scan->band)
+                    return false;
+            }
+            return true;
+        };
+
+        std::function<void(ProgressiveScan*)> run;
+
+        run = [&] (ProgressiveScan* scan)
+        {
+            while (scan->band < bands)
+            {
+                const int band = scan->band;
+
+                {
+                    std::lock_guard<std::mutex> lock(scan->mutex);
+                    if (!is_ready(scan))
                     {
-                        process = processState.clipped;
-                        height = yclip;
+                        // resumed by the scan which completes the dependency
+                        scan->parked = true;
+                        return;
                     }
+                }
+
+                const int y0 = band * N;
+                const int y1 = std::min(y0 + N, m_mcu_y1);
 
-                    for (int x = 0; x < xmcu; ++x)
+                decodeProgressiveScan(*scan, y0, y1);
+
+                scan->band = band + 1;
+                scan->progress.store(band + 1);
+
+                if (!--remaining[band])
+                {
+                    debugPrint("  Process: [%d, %d] --> ThreadPool.\n", y0, y1 - 1);
+
+                    queue.enqueue([=]
                     {
-                        if (xclip && x == xmcu - 1)
-                        {
-                            process = processState.clipped;
-                            width = xclip;
-                        }
+                        process_rows(y0, y1);
+                    });
+                }
 
-                        process(dest, stride, source, &processState, width, height);
-                        source += mcu_data_size;
-                        dest += xstride;
+                for (ProgressiveScan* dependent : scan->dependents)
+                {
+                    std::lock_guard<std::mutex> lock(dependent->mutex);
+                    if (dependent->parked && is_ready(dependent))
+                    {
+                        dependent->parked = false;
+                        queue.enqueue([&run, dependent]
+                        {
+                            run(dependent);
+                        });
                     }
                 }
+            }
+        };
+
+        for (auto& scan : progressiveScans)
+        {
+            ProgressiveScan* s = scan.get();
+            queue.enqueue([&run, s]
+            {
+                run(s);
             });
         }
 
         // synchronize
         queue.wait();
+
+        progressiveScans.clear();
     }
 
 } // namespace jpeg
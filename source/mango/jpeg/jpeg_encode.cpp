@@ -29,6 +29,7 @@
 #include <mango/core/pointer.hpp>
 #include "jpeg.hpp"
 #include <cstring>
+#include <mutex>
 
 // enable different implementations...
 #define TABLE_SYMBOL
@@ -339,6 +340,227 @@ namespace
 
 #endif
 
+    // ----------------------------------------------------------------------------
+    // huffman tables
+    // ----------------------------------------------------------------------------
+
+    // The AC tables are indexed with runLength * 10 + size; index 0 is EOB and 161 is ZRL
+
+    static inline
+    u8 getSymbolAC(int index)
+    {
+        if (index == 0)
+            return 0x00;
+        if (index == 161)
+            return 0xf0;
+        index--;
+        return u8(((index / 10) << 4) | (index % 10 + 1));
+    }
+
+    struct HuffmanCodes
+    {
+        u16 dc_code[12];
+        u16 dc_size[12];
+        u16 ac_code[162];
+        u16 ac_size[162];
+
+        void init(const u16* dcCode, const u16* dcSize, const u16* acCode, const u16* acSize)
+        {
+            std::memcpy(dc_code, dcCode, sizeof(dc_code));
+            std::memcpy(dc_size, dcSize, sizeof(dc_size));
+            std::memcpy(ac_code, acCode, sizeof(ac_code));
+            std::memcpy(ac_size, acSize, sizeof(ac_size));
+        }
+    };
+
+    struct HuffmanStatistics
+    {
+        // symbol frequencies for luminance and chrominance tables
+        u32 dc[2][12];
+        u32 ac[2][162];
+
+        HuffmanStatistics()
+        {
+            std::memset(dc, 0, sizeof(dc));
+            std::memset(ac, 0, sizeof(ac));
+        }
+
+        void add(const HuffmanStatistics& stats)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                for (int j = 0; j < 12; ++j)
+                    dc[i][j] += stats.dc[i][j];
+                for (int j = 0; j < 162; ++j)
+                    ac[i][j] += stats.ac[i][j];
+            }
+        }
+    };
+
+    struct HuffmanTable
+    {
+        u8 bits[17];
+        u8 values[256];
+        int count;
+
+        // Compute code lengths limited to 16 bits from the symbol frequencies
+        // (ITU T.81 Annex K.2) and assign canonical codes (Annex C).
+        void build(u16* code, u16* size, const u32* frequency, int symbols, u8 (*symbol)(int))
+        {
+            // one extra symbol reserves the all ones code word
+            u64 freq[257];
+            int codesize[257];
+            int others[257];
+
+            for (int i = 0; i < symbols; ++i)
+            {
+                freq[i] = frequency[i];
+            }
+
+            freq[symbols] = 1;
+
+            for (int i = 0; i <= symbols; ++i)
+            {
+                codesize[i] = 0;
+                others[i] = -1;
+            }
+
+            for (;;)
+            {
+                // find the two least frequent symbols
+                int c1 = -1;
+                int c2 = -1;
+                u64 v1 = ~0ull;
+                u64 v2 = ~0ull;
+
+                for (int i = 0; i <= symbols; ++i)
+                {
+                    if (freq[i] && freq[i] <= v1)
+                    {
+                        v2 = v1;
+                        c2 = c1;
+                        v1 = freq[i];
+                        c1 = i;
+                    }
+                    else if (freq[i] && freq[i] <= v2)
+                    {
+                        v2 = freq[i];
+                        c2 = i;
+                    }
+                }
+
+                if (c2 < 0)
+                    break;
+
+                // merge the trees
+                freq[c1] += freq[c2];
+                freq[c2] = 0;
+
+                ++codesize[c1];
+                while (others[c1] >= 0)
+                {
+                    c1 = others[c1];
+                    ++codesize[c1];
+                }
+
+                others[c1] = c2;
+
+                ++codesize[c2];
+                while (others[c2] >= 0)
+                {
+                    c2 = others[c2];
+                    ++codesize[c2];
+                }
+            }
+
+            int length[258] = { 0 };
+
+            for (int i = 0; i <= symbols; ++i)
+            {
+                if (codesize[i])
+                {
+                    length[codesize[i]]++;
+                }
+            }
+
+            // limit code lengths to 16 bits
+            for (int i = symbols; i > 16; --i)
+            {
+                while (length[i] > 0)
+                {
+                    int j = i - 2;
+                    while (length[j] == 0)
+                        --j;
+
+                    length[i] -= 2;
+                    length[i - 1]++;
+                    length[j + 1] += 2;
+                    length[j]--;
+                }
+            }
+
+            // remove the reserved code word; it has no code when every frequency is zero
+            int i = 16;
+            while (i > 0 && length[i] == 0)
+                --i;
+            if (i > 0)
+                length[i]--;
+
+            // symbols sorted by code length
+            u8 index[256];
+            count = 0;
+
+            for (int n = 1; n <= symbols; ++n)
+            {
+                for (int j = 0; j < symbols; ++j)
+                {
+                    if (codesize[j] == n)
+                    {
+                        index[count] = u8(j);
+                        values[count] = symbol(j);
+                        ++count;
+                    }
+                }
+            }
+
+            bits[0] = 0;
+            for (int n = 1; n <= 16; ++n)
+            {
+                bits[n] = u8(length[n]);
+            }
+
+            // canonical codes
+            for (int j = 0; j < symbols; ++j)
+            {
+                code[j] = 0;
+                size[j] = 0;
+            }
+
+            u32 value = 0;
+            int k = 0;
+
+            for (int n = 1; n <= 16; ++n)
+            {
+                for (int j = 0; j < bits[n]; ++j)
+                {
+                    code[index[k]] = u16(value++);
+                    size[index[k]] = u16(n);
+                    ++k;
+                }
+                value <<= 1;
+            }
+        }
+
+        void write(BigEndianStream& p, u8 id) const
+        {
+            p.write16(0xffc4);
+            p.write16(u16(2 + 1 + 16 + count));
+            p.write8(id);
+            p.write(bits + 1, 16);
+            p.write(values, count);
+        }
+    };
+
     struct jpeg_chan
     {
         int     component;
@@ -364,17 +586,35 @@ namespace
         // MCU configuration
         jpeg_chan   channel[3];
         int         channel_count;
+        int         bytes_per_pixel;
+
+        // blocks in MCU: luminance blocks followed by one block for each chrominance channel
+        int         blocks_in_mcu;
+        jpeg_chan   block[6];
+
+        // huffman tables: [0] luminance, [1] chrominance
+        HuffmanCodes codes[2];
+        HuffmanTable dc_table[2];
+        HuffmanTable ac_table[2];
+        bool         optimize;
+        bool         progressive;
 
         std::string info;
 
         void (*read_8x8) (s16* block, const u8* input, int stride, int rows, int cols);
         void (*read)     (s16* block, const u8* input, int stride, int rows, int cols);
+        void (*fdct)     (s16* dest, const s16* data, const s16* quant_table);
+        void (*downsample) (s16* dest, const s16* source);
 
-        jpeg_encode(Sample sample, u32 width, u32 height, u32 stride, u32 quality);
+        jpeg_encode(Sample sample, u32 width, u32 height, u32 stride, u32 quality, int subsampling, bool optimize, bool progressive);
         ~jpeg_encode();
 
         void init_quantization_tables(u32 quality);
+        void init_huffman_tables(const HuffmanStatistics& stats);
         void write_markers(BigEndianStream& p, Sample sample, u32 width, u32 height);
+
+        void read_mcu(s16* dest, const u8* input, int stride, int rows, int cols) const;
+        void transform_mcu(s16* dest, const u8* input, int stride, int rows, int cols) const;
     };
 
     struct EncodeBuffer : Buffer
@@ -384,6 +624,7 @@ namespace
 
     struct HuffmanEncoder
     {
+        const HuffmanCodes* codes;
         int ldc[3];
 
         DataType code;
@@ -393,7 +634,8 @@ namespace
         int bitindex;
 #endif
 
-        HuffmanEncoder()
+        HuffmanEncoder(const HuffmanCodes* codes)
+            : codes(codes)
         {
             ldc[0] = 0;
             ldc[1] = 0;
@@ -470,25 +712,11 @@ namespace
 
         u8* encode(u8* p, int component, const s16* input)
         {
-            const u16* dcCodeTable;
-            const u16* dcSizeTable;
-            const u16* acCodeTable;
-            const u16* acSizeTable;
-
-            if (component == 1)
-            {
-                dcCodeTable = g_luminance_dc_code_table;
-                dcSizeTable = g_luminance_dc_size_table;
-                acCodeTable = g_luminance_ac_code_table;
-                acSizeTable = g_luminance_ac_size_table;
-            }
-            else
-            {
-                dcCodeTable = g_chrominance_dc_code_table;
-                dcSizeTable = g_chrominance_dc_size_table;
-                acCodeTable = g_chrominance_ac_code_table;
-                acSizeTable = g_chrominance_ac_size_table;
-            }
+            const HuffmanCodes& table = codes[component == 1 ? 0 : 1];
+            const u16* dcCodeTable = table.dc_code;
+            const u16* dcSizeTable = table.dc_size;
+            const u16* acCodeTable = table.ac_code;
+            const u16* acSizeTable = table.ac_size;
 
             int coeff = input[0];
             int lastDc = ldc[component - 1];
@@ -539,1374 +767,2737 @@ namespace
 
             return p;
         }
-    };
 
-#if defined(JPEG_ENABLE_SSE2)
+        // gather the symbols encode() would emit
+        void count(HuffmanStatistics& stats, int component, const s16* input)
+        {
+            const int table = component == 1 ? 0 : 1;
+            u32* dc = stats.dc[table];
+            u32* ac = stats.ac[table];
 
-#if defined(JPEG_ENABLE_AVX2)
-    constexpr const char* fdct_name = "AVX2 DCT";
-#else
-    constexpr const char* fdct_name = "SSE2 DCT";
-#endif
+            int coeff = input[0];
+            int lastDc = ldc[component - 1];
+            ldc[component - 1] = coeff;
 
-    // ----------------------------------------------------------------------------
-    // fdct sse2
-    // ----------------------------------------------------------------------------
+            coeff -= lastDc;
+            dc[getSymbolSize(std::abs(coeff))]++;
 
-    static inline void interleave16(__m128i& a, __m128i& b)
-    {
-        __m128i c = a;
-        a = _mm_unpacklo_epi16(a, b);
-        b = _mm_unpackhi_epi16(c, b);
-    }
+            int runLength = 0;
 
-    #define JPEG_CONST16(x, y) \
-        _mm_setr_epi16(x, y, x, y, x, y, x, y)
+            for (int i = 1; i < 64; ++i)
+            {
+                int coeff = input[zigzag_table_inverse[i]];
+                if (coeff)
+                {
+                    while (runLength > 15)
+                    {
+                        runLength -= 16;
+                        ac[161]++;
+                    }
 
-    #define JPEG_TRANSPOSE16() \
-        interleave16(v0, v4); \
-        interleave16(v2, v6); \
-        interleave16(v1, v5); \
-        interleave16(v3, v7); \
-        interleave16(v0, v2); \
-        interleave16(v1, v3); \
-        interleave16(v4, v6); \
-        interleave16(v5, v7); \
-        interleave16(v0, v1); \
-        interleave16(v2, v3); \
-        interleave16(v4, v5); \
-        interleave16(v6, v7)
+                    ac[runLength * 10 + getSymbolSize(std::abs(coeff))]++;
+                    runLength = 0;
+                }
+                else
+                {
+                    ++runLength;
+                }
+            }
 
-    #define JPEG_TRANSFORM(n) { \
-        __m128i a_lo; \
-        __m128i a_hi; \
-        __m128i b_lo; \
-        __m128i b_hi; \
-        \
-        a_lo = _mm_madd_epi16(x87_lo, c26p); \
-        a_hi = _mm_madd_epi16(x87_hi, c26p); \
-        a_lo = _mm_srai_epi32(a_lo, n); \
-        a_hi = _mm_srai_epi32(a_hi, n); \
-        v2 = _mm_packs_epi32(a_lo, a_hi); \
-        \
-        a_lo = _mm_madd_epi16(x87_lo, c62n); \
-        a_hi = _mm_madd_epi16(x87_hi, c62n); \
-        a_lo = _mm_srai_epi32(a_lo, n); \
-        a_hi = _mm_srai_epi32(a_hi, n); \
-        v6 = _mm_packs_epi32(a_lo, a_hi); \
-        \
-        a_lo = _mm_madd_epi16(x01_lo, c75n); \
-        a_hi = _mm_madd_epi16(x01_hi, c75n); \
-        b_lo = _mm_madd_epi16(x23_lo, c31n); \
-        b_hi = _mm_madd_epi16(x23_hi, c31n); \
-        a_lo = _mm_add_epi32(a_lo, b_lo); \
-        a_hi = _mm_add_epi32(a_hi, b_hi); \
-        a_lo = _mm_srai_epi32(a_lo, n); \
-        a_hi = _mm_srai_epi32(a_hi, n); \
-        v7 = _mm_packs_epi32(a_lo, a_hi); \
-        \
-        a_lo = _mm_madd_epi16(x01_lo, c51n); \
-        a_hi = _mm_madd_epi16(x01_hi, c51n); \
-        b_lo = _mm_madd_epi16(x23_lo, c73p); \
-        b_hi = _mm_madd_epi16(x23_hi, c73p); \
-        a_lo = _mm_add_epi32(a_lo, b_lo); \
-        a_hi = _mm_add_epi32(a_hi, b_hi); \
-        a_lo = _mm_srai_epi32(a_lo, n); \
-        a_hi = _mm_srai_epi32(a_hi, n); \
-        v5 = _mm_packs_epi32(a_lo, a_hi); \
-        \
-        a_lo = _mm_madd_epi16(x01_lo, c37n); \
-        a_hi = _mm_madd_epi16(x01_hi, c37n); \
-        b_lo = _mm_madd_epi16(x23_lo, c15p); \
-        b_hi = _mm_madd_epi16(x23_hi, c15p); \
-        a_lo = _mm_sub_epi32(a_lo, b_lo); \
-        a_hi = _mm_sub_epi32(a_hi, b_hi); \
-        a_lo = _mm_srai_epi32(a_lo, n); \
-        a_hi = _mm_srai_epi32(a_hi, n); \
-        v3 = _mm_packs_epi32(a_lo, a_hi); \
-        \
-        a_lo = _mm_madd_epi16(x01_lo, c13p); \
-        a_hi = _mm_madd_epi16(x01_hi, c13p); \
-        b_lo = _mm_madd_epi16(x23_lo, c57p); \
-        b_hi = _mm_madd_epi16(x23_hi, c57p); \
-        a_lo = _mm_add_epi32(a_lo, b_lo); \
-        a_hi = _mm_add_epi32(a_hi, b_hi); \
-        a_lo = _mm_srai_epi32(a_lo, n); \
-        a_hi = _mm_srai_epi32(a_hi, n); \
-        v1 = _mm_packs_epi32(a_lo, a_hi); }
+            if (runLength != 0)
+            {
+                ac[0]++;
+            }
+        }
+    };
 
-#if defined(JPEG_ENABLE_AVX2)
+    // ----------------------------------------------------------------------------
+    // ProgressiveEncoder
+    // ----------------------------------------------------------------------------
 
-    static inline
-    __m256i quantize(__m256i v, __m256i q, __m256i one, __m256i bias)
+    struct ProgressiveScan
     {
-        __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(v, one), _mm256_unpacklo_epi16(q, bias));
-        __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(v, one), _mm256_unpackhi_epi16(q, bias));
-        lo = _mm256_srai_epi32(lo, 15);
-        hi = _mm256_srai_epi32(hi, 15);
-        v = _mm256_packs_epi32(lo, hi);
-        return v;
-    }
+        int count;          // number of components in scan
+        int component[3];   // component indices
+        int Ss;             // spectral selection start
+        int Se;             // spectral selection end
+        int Ah;             // successive approximation high bit
+        int Al;             // successive approximation low bit
+    };
 
-#else
+    // Default scan scripts (the same as libjpeg uses). The DC scans are interleaved,
+    // the AC scans code one component each.
 
-    static inline
-    __m128i quantize(__m128i v, __m128i q, __m128i one, __m128i bias)
+    const ProgressiveScan g_progressive_scans_y [] =
     {
-        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(v, one), _mm_unpacklo_epi16(q, bias));
-        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(v, one), _mm_unpackhi_epi16(q, bias));
-        lo = _mm_srai_epi32(lo, 15);
-        hi = _mm_srai_epi32(hi, 15);
-        v = _mm_packs_epi32(lo, hi);
-        return v;
-    }
+        { 1, { 0 }, 0,  0, 0, 1 },
+        { 1, { 0 }, 1,  5, 0, 2 },
+        { 1, { 0 }, 6, 63, 0, 2 },
+        { 1, { 0 }, 1, 63, 2, 1 },
+        { 1, { 0 }, 0,  0, 1, 0 },
+        { 1, { 0 }, 1, 63, 1, 0 },
+    };
 
-#endif
+    const ProgressiveScan g_progressive_scans_ycbcr [] =
+    {
+        { 3, { 0, 1, 2 }, 0,  0, 0, 1 },
+        { 1, { 0 },       1,  5, 0, 2 },
+        { 1, { 2 },       1, 63, 0, 1 },
+        { 1, { 1 },       1, 63, 0, 1 },
+        { 1, { 0 },       6, 63, 0, 2 },
+        { 1, { 0 },       1, 63, 2, 1 },
+        { 3, { 0, 1, 2 }, 0,  0, 1, 0 },
+        { 1, { 2 },       1, 63, 1, 0 },
+        { 1, { 1 },       1, 63, 1, 0 },
+        { 1, { 0 },       1, 63, 1, 0 },
+    };
 
-    static
-    void fdct(s16* dest, const s16* data, const s16* quant_table)
+    struct ScanCodes
     {
-        constexpr s16 c1 = 1420; // cos 1PI/16 * root(2)
-        constexpr s16 c2 = 1338; // cos 2PI/16 * root(2)
-        constexpr s16 c3 = 1204; // cos 3PI/16 * root(2)
-        constexpr s16 c5 = 805;  // cos 5PI/16 * root(2)
-        constexpr s16 c6 = 554;  // cos 6PI/16 * root(2)
-        constexpr s16 c7 = 283;  // cos 7PI/16 * root(2)
+        u16 code[256];
+        u16 size[256];
+    };
 
-        __m128i c26p = JPEG_CONST16(c2, c6);
-        __m128i c62n = JPEG_CONST16(c6,-c2);
-        __m128i c75n = JPEG_CONST16(c7,-c5);
-        __m128i c31n = JPEG_CONST16(c3,-c1);
-        __m128i c51n = JPEG_CONST16(c5,-c1);
-        __m128i c73p = JPEG_CONST16(c7, c3);
-        __m128i c37n = JPEG_CONST16(c3,-c7);
-        __m128i c15p = JPEG_CONST16(c1, c5);
-        __m128i c13p = JPEG_CONST16(c1, c3);
-        __m128i c57p = JPEG_CONST16(c5, c7);
+    // The progressive encoder is run twice for each scan; first with the counter
+    // to build the optimized huffman tables and then with the writer.
 
-        // load
+    struct SymbolCounter
+    {
+        u32 (*frequency)[256];
 
-        const __m128i* s = reinterpret_cast<const __m128i *>(data);
-        __m128i v0 = _mm_loadu_si128(s + 0);
-        __m128i v1 = _mm_loadu_si128(s + 1);
-        __m128i v2 = _mm_loadu_si128(s + 2);
-        __m128i v3 = _mm_loadu_si128(s + 3);
-        __m128i v4 = _mm_loadu_si128(s + 4);
-        __m128i v5 = _mm_loadu_si128(s + 5);
-        __m128i v6 = _mm_loadu_si128(s + 6);
-        __m128i v7 = _mm_loadu_si128(s + 7);
+        u8* symbol(u8* p, int table, int value)
+        {
+            frequency[table][value]++;
+            return p;
+        }
 
-        // pass 1
+        u8* bits(u8* p, u32 value, int count)
+        {
+            MANGO_UNREFERENCED(value);
+            MANGO_UNREFERENCED(count);
+            return p;
+        }
 
-        JPEG_TRANSPOSE16();
+        u8* flush(u8* p)
+        {
+            return p;
+        }
+    };
 
-        __m128i x8 = _mm_add_epi16(v0, v7);
-        __m128i x7 = _mm_add_epi16(v1, v6);
-        __m128i x6 = _mm_add_epi16(v2, v5);
-        __m128i x5 = _mm_add_epi16(v3, v4);
-        __m128i x0 = _mm_sub_epi16(v0, v7);
-        __m128i x1 = _mm_sub_epi16(v1, v6);
-        __m128i x2 = _mm_sub_epi16(v2, v5);
-        __m128i x3 = _mm_sub_epi16(v3, v4);
-        __m128i x4 = _mm_add_epi16(x8, x5);
+    struct SymbolWriter
+    {
+        HuffmanEncoder encoder { nullptr };
+        const ScanCodes* codes;
 
-        x8 = _mm_sub_epi16(x8, x5);
-        x5 = _mm_add_epi16(x7, x6);
-        x7 = _mm_sub_epi16(x7, x6);
+        u8* symbol(u8* p, int table, int value)
+        {
+            return encoder.putbits(p, codes[table].code[value], codes[table].size[value]);
+        }
 
-        __m128i x87_lo = _mm_unpacklo_epi16(x8, x7);
-        __m128i x87_hi = _mm_unpackhi_epi16(x8, x7);
-        __m128i x01_lo = _mm_unpacklo_epi16(x0, x1);
-        __m128i x01_hi = _mm_unpackhi_epi16(x0, x1);
-        __m128i x23_lo = _mm_unpacklo_epi16(x2, x3);
-        __m128i x23_hi = _mm_unpackhi_epi16(x2, x3);
+        u8* bits(u8* p, u32 value, int count)
+        {
+            return encoder.putbits(p, value & ((1u << count) - 1), count);
+        }
 
-        v0 = _mm_add_epi16(x4, x5);
-        v4 = _mm_sub_epi16(x4, x5);
+        u8* flush(u8* p)
+        {
+            return encoder.flush(p);
+        }
+    };
 
-        JPEG_TRANSFORM(10);
+    template <typename Emitter>
+    struct ProgressiveEncoder
+    {
+        static constexpr int MAX_CORRECTION_BITS = 1000;
 
-        // pass 2
+        Emitter emit;
+        int ldc[3];
+        int eobrun;
 
-        JPEG_TRANSPOSE16();
+        // correction bits buffered for the EOB run
+        u8 correction[MAX_CORRECTION_BITS];
+        int be;
 
-        x8 = _mm_add_epi16(v0, v7);
-        x0 = _mm_sub_epi16(v0, v7);
-        x7 = _mm_add_epi16(v1, v6);
-        x1 = _mm_sub_epi16(v1, v6);
-        x6 = _mm_add_epi16(v2, v5);
-        x2 = _mm_sub_epi16(v2, v5);
-        x5 = _mm_add_epi16(v3, v4);
-        x3 = _mm_sub_epi16(v3, v4);
-        x4 = _mm_add_epi16(x8, x5);
+        ProgressiveEncoder(const Emitter& emitter)
+            : emit(emitter)
+            , eobrun(0)
+            , be(0)
+        {
+            ldc[0] = 0;
+            ldc[1] = 0;
+            ldc[2] = 0;
+        }
 
-        x8 = _mm_sub_epi16(x8, x5);
-        x5 = _mm_add_epi16(x7, x6);
-        x7 = _mm_sub_epi16(x7, x6);
+        u8* encode(u8* p, int table, int component, const s16* input, const ProgressiveScan& scan)
+        {
+            if (!scan.Ss)
+            {
+                if (!scan.Ah)
+                    p = dc_first(p, table, component, input, scan.Al);
+                else
+                    p = dc_refine(p, input, scan.Al);
+            }
+            else
+            {
+                if (!scan.Ah)
+                    p = ac_first(p, input, scan.Ss, scan.Se, scan.Al);
+                else
+                    p = ac_refine(p, input, scan.Ss, scan.Se, scan.Al);
+            }
+            return p;
+        }
 
-        x87_lo = _mm_unpacklo_epi16(x8, x7);
-        x87_hi = _mm_unpackhi_epi16(x8, x7);
-        x01_lo = _mm_unpacklo_epi16(x0, x1);
-        x01_hi = _mm_unpackhi_epi16(x0, x1);
-        x23_lo = _mm_unpacklo_epi16(x2, x3);
-        x23_hi = _mm_unpackhi_epi16(x2, x3);
+        u8* flush(u8* p)
+        {
+            p = flush_eobrun(p);
+            p = emit.flush(p);
+            return p;
+        }
 
-        v0 = _mm_srai_epi16(_mm_add_epi16(x4, x5), 3);
-        v4 = _mm_srai_epi16(_mm_sub_epi16(x4, x5), 3);
+        u8* flush_eobrun(u8* p)
+        {
+            if (eobrun > 0)
+            {
+                int size = getSymbolSize(eobrun) - 1;
+                p = emit.symbol(p, 0, size << 4);
+                if (size)
+                {
+                    p = emit.bits(p, eobrun, size);
+                }
 
-        JPEG_TRANSFORM(13);
+                eobrun = 0;
 
-#if defined(JPEG_ENABLE_AVX2)
+                p = emit_correction(p, correction, be);
+                be = 0;
+            }
+            return p;
+        }
 
-        __m256i v01 = _mm256_setr_m128i(v0, v1);
-        __m256i v23 = _mm256_setr_m128i(v2, v3);
-        __m256i v45 = _mm256_setr_m128i(v4, v5);
-        __m256i v67 = _mm256_setr_m128i(v6, v7);
+        u8* emit_correction(u8* p, const u8* bits, int count)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                p = emit.bits(p, bits[i], 1);
+            }
+            return p;
+        }
 
-        // quantize
+        u8* dc_first(u8* p, int table, int component, const s16* input, int Al)
+        {
+            int value = input[0] >> Al;
+            int diff = value - ldc[component];
+            ldc[component] = value;
 
-        const __m256i one = _mm256_set1_epi16(1);
-        const __m256i bias = _mm256_set1_epi16(0x4000);
-        const __m256i* q = reinterpret_cast<const __m256i*>(quant_table);
+            int size = getSymbolSize(std::abs(diff));
+            if (diff < 0)
+            {
+                --diff;
+            }
 
-        v01 = quantize(v01, q[0], one, bias);
-        v23 = quantize(v23, q[1], one, bias);
-        v45 = quantize(v45, q[2], one, bias);
-        v67 = quantize(v67, q[3], one, bias);
+            p = emit.symbol(p, table, size);
+            if (size)
+            {
+                p = emit.bits(p, diff, size);
+            }
 
-        // store
+            return p;
+        }
 
-        __m256i* d = reinterpret_cast<__m256i *>(dest);
-        _mm256_storeu_si256(d + 0, v01);
-        _mm256_storeu_si256(d + 1, v23);
-        _mm256_storeu_si256(d + 2, v45);
-        _mm256_storeu_si256(d + 3, v67);
+        u8* dc_refine(u8* p, const s16* input, int Al)
+        {
+            return emit.bits(p, (input[0] >> Al) & 1, 1);
+        }
 
-#else
+        u8* ac_first(u8* p, const s16* input, int Ss, int Se, int Al)
+        {
+            int run = 0;
 
-        // quantize
+            for (int k = Ss; k <= Se; ++k)
+            {
+                int coeff = input[zigzag_table_inverse[k]];
+                int value = std::abs(coeff) >> Al;
+                if (!value)
+                {
+                    ++run;
+                    continue;
+                }
 
-        const __m128i one = _mm_set1_epi16(1);
-        const __m128i bias = _mm_set1_epi16(0x4000);
-        const __m128i* q = reinterpret_cast<const __m128i*>(quant_table);
+                p = flush_eobrun(p);
 
-        v0 = quantize(v0, q[0], one, bias);
-        v1 = quantize(v1, q[1], one, bias);
-        v2 = quantize(v2, q[2], one, bias);
-        v3 = quantize(v3, q[3], one, bias);
-        v4 = quantize(v4, q[4], one, bias);
-        v5 = quantize(v5, q[5], one, bias);
-        v6 = quantize(v6, q[6], one, bias);
-        v7 = quantize(v7, q[7], one, bias);
+                while (run > 15)
+                {
+                    p = emit.symbol(p, 0, 0xf0);
+                    run -= 16;
+                }
 
-        // store
+                // negative values are coded as one's complement
+                int size = getSymbolSize(value);
+                p = emit.symbol(p, 0, (run << 4) | size);
+                p = emit.bits(p, coeff < 0 ? ~value : value, size);
 
-        __m128i* d = reinterpret_cast<__m128i *>(dest);
-        _mm_storeu_si128(d + 0, v0);
-        _mm_storeu_si128(d + 1, v1);
-        _mm_storeu_si128(d + 2, v2);
-        _mm_storeu_si128(d + 3, v3);
-        _mm_storeu_si128(d + 4, v4);
-        _mm_storeu_si128(d + 5, v5);
-        _mm_storeu_si128(d + 6, v6);
-        _mm_storeu_si128(d + 7, v7);
+                run = 0;
+            }
 
-#endif
-    }
+            if (run > 0)
+            {
+                if (++eobrun == 0x7fff)
+                {
+                    p = flush_eobrun(p);
+                }
+            }
 
-#elif defined(JPEG_ENABLE_NEON)
+            return p;
+        }
 
-    constexpr const char* fdct_name = "NEON DCT";
+        u8* ac_refine(u8* p, const s16* input, int Ss, int Se, int Al)
+        {
+            int absvalue[64];
+            int eob = 0;
 
-    // ----------------------------------------------------------------------------
-    // fdct neon
-    // ----------------------------------------------------------------------------
+            for (int k = Ss; k <= Se; ++k)
+            {
+                absvalue[k] = std::abs(input[zigzag_table_inverse[k]]) >> Al;
+                if (absvalue[k] == 1)
+                {
+                    // last newly non-zero coefficient
+                    eob = k;
+                }
+            }
 
-    static inline
-    void dct_trn16(int16x8_t& x, int16x8_t& y)
-    {
-        int16x8x2_t t = vtrnq_s16(x, y);
-        x = t.val[0];
-        y = t.val[1];
-    }
+            int run = 0;
 
-    static inline
-    void dct_trn32(int16x8_t& x, int16x8_t& y)
-    {
-        int32x4x2_t t = vtrnq_s32(vreinterpretq_s32_s16(x), vreinterpretq_s32_s16(y));
-        x = vreinterpretq_s16_s32(t.val[0]);
-        y = vreinterpretq_s16_s32(t.val[1]);
-    }
+            // correction bits of this block follow the bits of the EOB run
+            u8* buffer = correction + be;
+            int br = 0;
 
-    static inline
-    void dct_trn64(int16x8_t& x, int16x8_t& y)
-    {
-        int16x8_t x0 = x;
-        int16x8_t y0 = y;
-        x = vcombine_s16(vget_low_s16(x0), vget_low_s16(y0));
-        y = vcombine_s16(vget_high_s16(x0), vget_high_s16(y0));
-    }
+            for (int k = Ss; k <= Se; ++k)
+            {
+                int value = absvalue[k];
+                if (!value)
+                {
+                    ++run;
+                    continue;
+                }
 
-    static inline
-    int16x8_t packs_s32(int32x4_t a, int32x4_t b)
-    {
-        return vcombine_s16(vqmovn_s32(a), vqmovn_s32(b));
-    }
+                while (run > 15 && k <= eob)
+                {
+                    p = flush_eobrun(p);
+                    p = emit.symbol(p, 0, 0xf0);
+                    run -= 16;
 
-    static inline
-    int16x8_t quantize(int16x8_t v, int16x8_t q, int32x4_t bias)
-    {
-        int32x4_t lo = vmlal_s16(bias, vget_low_s16(v), vget_low_s16(q));
-        int32x4_t hi = vmlal_s16(bias, vget_high_s16(v), vget_high_s16(q));
-        lo = vshrq_n_s32(lo, 15);
-        hi = vshrq_n_s32(hi, 15);
-        v = packs_s32(lo, hi);
-        return v;
-    }
+                    p = emit_correction(p, buffer, br);
+                    buffer = correction;
+                    br = 0;
+                }
 
-    #define JPEG_TRANSPOSE16() \
-        dct_trn16(v0, v1); \
-        dct_trn16(v2, v3); \
-        dct_trn16(v4, v5); \
-        dct_trn16(v6, v7); \
-        dct_trn32(v0, v2); \
-        dct_trn32(v1, v3); \
-        dct_trn32(v4, v6); \
-        dct_trn32(v5, v7); \
-        dct_trn64(v0, v4); \
-        dct_trn64(v1, v5); \
-        dct_trn64(v2, v6); \
-        dct_trn64(v3, v7)
+                if (value > 1)
+                {
+                    // previously non-zero coefficient: buffer the correction bit
+                    buffer[br++] = u8(value & 1);
+                    continue;
+                }
 
-    #define JPEG_MUL2(v, x0, c0, x1, c1, f1, n) { \
-        int32x4_t lo; \
-        int32x4_t hi; \
-        lo = vmull_s16(vget_low_s16(x0), c0); \
-        lo = vml##f1##l_s16(lo, vget_low_s16(x1), c1); \
-        lo = vshrq_n_s32(lo, n); \
-        hi = vmull_s16(vget_high_s16(x0), c0); \
-        hi = vml##f1##l_s16(hi, vget_high_s16(x1), c1); \
-        hi = vshrq_n_s32(hi, n); \
-        v = packs_s32(lo, hi); }
+                // newly non-zero coefficient
+                p = flush_eobrun(p);
+                p = emit.symbol(p, 0, (run << 4) | 1);
+                p = emit.bits(p, input[zigzag_table_inverse[k]] < 0 ? 0 : 1, 1);
 
-    #define JPEG_MUL4(v, x0, c0, x1, c1, x2, c2, x3, c3, f1, f2, f3, n) { \
-        int32x4_t lo; \
-        int32x4_t hi; \
-        lo = vmull_s16(vget_low_s16(x0), c0); \
-        lo = vml##f1##l_s16(lo, vget_low_s16(x1), c1); \
-        lo = vml##f2##l_s16(lo, vget_low_s16(x2), c2); \
-        lo = vml##f3##l_s16(lo, vget_low_s16(x3), c3); \
-        lo = vshrq_n_s32(lo, n); \
-        hi = vmull_s16(vget_high_s16(x0), c0); \
-        hi = vml##f1##l_s16(hi, vget_high_s16(x1), c1); \
-        hi = vml##f2##l_s16(hi, vget_high_s16(x2), c2); \
-        hi = vml##f3##l_s16(hi, vget_high_s16(x3), c3); \
-        hi = vshrq_n_s32(hi, n); \
-        v = packs_s32(lo, hi); }
+                p = emit_correction(p, buffer, br);
+                buffer = correction;
+                br = 0;
+                run = 0;
+            }
 
-    #define JPEG_TRANSFORM(n) \
-        JPEG_MUL2(v2, x8, c2, x7, c6, a, n); \
-        JPEG_MUL2(v6, x8, c6, x7, c2, s, n); \
-        JPEG_MUL4(v7, x0, c7, x1, c5, x2, c3, x3, c1, s, a, s, n); \
-        JPEG_MUL4(v5, x0, c5, x1, c1, x2, c7, x3, c3, s, a, a, n); \
-        JPEG_MUL4(v3, x0, c3, x1, c7, x2, c1, x3, c5, s, s, s, n); \
-        JPEG_MUL4(v1, x0, c1, x1, c3, x2, c5, x3, c7, a, a, a, n);
+            if (run > 0 || br > 0)
+            {
+                ++eobrun;
+                be += br;
 
-    static
-    void fdct(s16* dest, const s16* data, const s16* quant_table)
-    {
-        const int16x4_t c1 = vdup_n_s16(1420); // cos 1PI/16 * root(2)
-        const int16x4_t c2 = vdup_n_s16(1338); // cos 2PI/16 * root(2)
-        const int16x4_t c3 = vdup_n_s16(1204); // cos 3PI/16 * root(2)
+                if (eobrun == 0x7fff || be > MAX_CORRECTION_BITS - BLOCK_SIZE + 1)
+                {
+                    p = flush_eobrun(p);
+                }
+            }
+
+            return p;
+        }
+    };
+
+#if defined(JPEG_ENABLE_SSE2)
+
+    // ----------------------------------------------------------------------------
+    // fdct sse2
+    // ----------------------------------------------------------------------------
+
+    static inline void interleave16(__m128i& a, __m128i& b)
+    {
+        __m128i c = a;
+        a = _mm_unpacklo_epi16(a, b);
+        b = _mm_unpackhi_epi16(c, b);
+    }
+
+    #define JPEG_CONST16(x, y) \
+        _mm_setr_epi16(x, y, x, y, x, y, x, y)
+
+    #define JPEG_TRANSPOSE16() \
+        interleave16(v0, v4); \
+        interleave16(v2, v6); \
+        interleave16(v1, v5); \
+        interleave16(v3, v7); \
+        interleave16(v0, v2); \
+        interleave16(v1, v3); \
+        interleave16(v4, v6); \
+        interleave16(v5, v7); \
+        interleave16(v0, v1); \
+        interleave16(v2, v3); \
+        interleave16(v4, v5); \
+        interleave16(v6, v7)
+
+    #define JPEG_TRANSFORM(n) { \
+        __m128i a_lo; \
+        __m128i a_hi; \
+        __m128i b_lo; \
+        __m128i b_hi; \
+        \
+        a_lo = _mm_madd_epi16(x87_lo, c26p); \
+        a_hi = _mm_madd_epi16(x87_hi, c26p); \
+        a_lo = _mm_srai_epi32(a_lo, n); \
+        a_hi = _mm_srai_epi32(a_hi, n); \
+        v2 = _mm_packs_epi32(a_lo, a_hi); \
+        \
+        a_lo = _mm_madd_epi16(x87_lo, c62n); \
+        a_hi = _mm_madd_epi16(x87_hi, c62n); \
+        a_lo = _mm_srai_epi32(a_lo, n); \
+        a_hi = _mm_srai_epi32(a_hi, n); \
+        v6 = _mm_packs_epi32(a_lo, a_hi); \
+        \
+        a_lo = _mm_madd_epi16(x01_lo, c75n); \
+        a_hi = _mm_madd_epi16(x01_hi, c75n); \
+        b_lo = _mm_madd_epi16(x23_lo, c31n); \
+        b_hi = _mm_madd_epi16(x23_hi, c31n); \
+        a_lo = _mm_add_epi32(a_lo, b_lo); \
+        a_hi = _mm_add_epi32(a_hi, b_hi); \
+        a_lo = _mm_srai_epi32(a_lo, n); \
+        a_hi = _mm_srai_epi32(a_hi, n); \
+        v7 = _mm_packs_epi32(a_lo, a_hi); \
+        \
+        a_lo = _mm_madd_epi16(x01_lo, c51n); \
+        a_hi = _mm_madd_epi16(x01_hi, c51n); \
+        b_lo = _mm_madd_epi16(x23_lo, c73p); \
+        b_hi = _mm_madd_epi16(x23_hi, c73p); \
+        a_lo = _mm_add_epi32(a_lo, b_lo); \
+        a_hi = _mm_add_epi32(a_hi, b_hi); \
+        a_lo = _mm_srai_epi32(a_lo, n); \
+        a_hi = _mm_srai_epi32(a_hi, n); \
+        v5 = _mm_packs_epi32(a_lo, a_hi); \
+        \
+        a_lo = _mm_madd_epi16(x01_lo, c37n); \
+        a_hi = _mm_madd_epi16(x01_hi, c37n); \
+        b_lo = _mm_madd_epi16(x23_lo, c15p); \
+        b_hi = _mm_madd_epi16(x23_hi, c15p); \
+        a_lo = _mm_sub_epi32(a_lo, b_lo); \
+        a_hi = _mm_sub_epi32(a_hi, b_hi); \
+        a_lo = _mm_srai_epi32(a_lo, n); \
+        a_hi = _mm_srai_epi32(a_hi, n); \
+        v3 = _mm_packs_epi32(a_lo, a_hi); \
+        \
+        a_lo = _mm_madd_epi16(x01_lo, c13p); \
+        a_hi = _mm_madd_epi16(x01_hi, c13p); \
+        b_lo = _mm_madd_epi16(x23_lo, c57p); \
+        b_hi = _mm_madd_epi16(x23_hi, c57p); \
+        a_lo = _mm_add_epi32(a_lo, b_lo); \
+        a_hi = _mm_add_epi32(a_hi, b_hi); \
+        a_lo = _mm_srai_epi32(a_lo, n); \
+        a_hi = _mm_srai_epi32(a_hi, n); \
+        v1 = _mm_packs_epi32(a_lo, a_hi); }
+
+    static inline
+    __m128i quantize(__m128i v, __m128i q, __m128i one, __m128i bias)
+    {
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(v, one), _mm_unpacklo_epi16(q, bias));
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(v, one), _mm_unpackhi_epi16(q, bias));
+        lo = _mm_srai_epi32(lo, 15);
+        hi = _mm_srai_epi32(hi, 15);
+        v = _mm_packs_epi32(lo, hi);
+        return v;
+    }
+
+#if defined(JPEG_ENABLE_AVX2)
+
+    static inline MANGO_TARGET_AVX2
+    __m256i quantize(__m256i v, __m256i q, __m256i one, __m256i bias)
+    {
+        __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(v, one), _mm256_unpacklo_epi16(q, bias));
+        __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(v, one), _mm256_unpackhi_epi16(q, bias));
+        lo = _mm256_srai_epi32(lo, 15);
+        hi = _mm256_srai_epi32(hi, 15);
+        v = _mm256_packs_epi32(lo, hi);
+        return v;
+    }
+
+#endif
+
+    // The transform is shared by the SSE2 and AVX2 variants; only the
+    // quantization differs.
+
+    static inline
+    void fdct_transform(__m128i (&v)[8], const s16* data)
+    {
+        constexpr s16 c1 = 1420; // cos 1PI/16 * root(2)
+        constexpr s16 c2 = 1338; // cos 2PI/16 * root(2)
+        constexpr s16 c3 = 1204; // cos 3PI/16 * root(2)
+        constexpr s16 c5 = 805;  // cos 5PI/16 * root(2)
+        constexpr s16 c6 = 554;  // cos 6PI/16 * root(2)
+        constexpr s16 c7 = 283;  // cos 7PI/16 * root(2)
+
+        __m128i c26p = JPEG_CONST16(c2, c6);
+        __m128i c62n = JPEG_CONST16(c6,-c2);
+        __m128i c75n = JPEG_CONST16(c7,-c5);
+        __m128i c31n = JPEG_CONST16(c3,-c1);
+        __m128i c51n = JPEG_CONST16(c5,-c1);
+        __m128i c73p = JPEG_CONST16(c7, c3);
+        __m128i c37n = JPEG_CONST16(c3,-c7);
+        __m128i c15p = JPEG_CONST16(c1, c5);
+        __m128i c13p = JPEG_CONST16(c1, c3);
+        __m128i c57p = JPEG_CONST16(c5, c7);
+
+        // load
+
+        const __m128i* s = reinterpret_cast<const __m128i *>(data);
+        __m128i v0 = _mm_loadu_si128(s + 0);
+        __m128i v1 = _mm_loadu_si128(s + 1);
+        __m128i v2 = _mm_loadu_si128(s + 2);
+        __m128i v3 = _mm_loadu_si128(s + 3);
+        __m128i v4 = _mm_loadu_si128(s + 4);
+        __m128i v5 = _mm_loadu_si128(s + 5);
+        __m128i v6 = _mm_loadu_si128(s + 6);
+        __m128i v7 = _mm_loadu_si128(s + 7);
+
+        // pass 1
+
+        JPEG_TRANSPOSE16();
+
+        __m128i x8 = _mm_add_epi16(v0, v7);
+        __m128i x7 = _mm_add_epi16(v1, v6);
+        __m128i x6 = _mm_add_epi16(v2, v5);
+        __m128i x5 = _mm_add_epi16(v3, v4);
+        __m128i x0 = _mm_sub_epi16(v0, v7);
+        __m128i x1 = _mm_sub_epi16(v1, v6);
+        __m128i x2 = _mm_sub_epi16(v2, v5);
+        __m128i x3 = _mm_sub_epi16(v3, v4);
+        __m128i x4 = _mm_add_epi16(x8, x5);
+
+        x8 = _mm_sub_epi16(x8, x5);
+        x5 = _mm_add_epi16(x7, x6);
+        x7 = _mm_sub_epi16(x7, x6);
+
+        __m128i x87_lo = _mm_unpacklo_epi16(x8, x7);
+        __m128i x87_hi = _mm_unpackhi_epi16(x8, x7);
+        __m128i x01_lo = _mm_unpacklo_epi16(x0, x1);
+        __m128i x01_hi = _mm_unpackhi_epi16(x0, x1);
+        __m128i x23_lo = _mm_unpacklo_epi16(x2, x3);
+        __m128i x23_hi = _mm_unpackhi_epi16(x2, x3);
+
+        v0 = _mm_add_epi16(x4, x5);
+        v4 = _mm_sub_epi16(x4, x5);
+
+        JPEG_TRANSFORM(10);
+
+        // pass 2
+
+        JPEG_TRANSPOSE16();
+
+        x8 = _mm_add_epi16(v0, v7);
+        x0 = _mm_sub_epi16(v0, v7);
+        x7 = _mm_add_epi16(v1, v6);
+        x1 = _mm_sub_epi16(v1, v6);
+        x6 = _mm_add_epi16(v2, v5);
+        x2 = _mm_sub_epi16(v2, v5);
+        x5 = _mm_add_epi16(v3, v4);
+        x3 = _mm_sub_epi16(v3, v4);
+        x4 = _mm_add_epi16(x8, x5);
+
+        x8 = _mm_sub_epi16(x8, x5);
+        x5 = _mm_add_epi16(x7, x6);
+        x7 = _mm_sub_epi16(x7, x6);
+
+        x87_lo = _mm_unpacklo_epi16(x8, x7);
+        x87_hi = _mm_unpackhi_epi16(x8, x7);
+        x01_lo = _mm_unpacklo_epi16(x0, x1);
+        x01_hi = _mm_unpackhi_epi16(x0, x1);
+        x23_lo = _mm_unpacklo_epi16(x2, x3);
+        x23_hi = _mm_unpackhi_epi16(x2, x3);
+
+        v0 = _mm_srai_epi16(_mm_add_epi16(x4, x5), 3);
+        v4 = _mm_srai_epi16(_mm_sub_epi16(x4, x5), 3);
+
+        JPEG_TRANSFORM(13);
+
+        v[0] = v0;
+        v[1] = v1;
+        v[2] = v2;
+        v[3] = v3;
+        v[4] = v4;
+        v[5] = v5;
+        v[6] = v6;
+        v[7] = v7;
+    }
+
+    static
+    void fdct_sse2(s16* dest, const s16* data, const s16* quant_table)
+    {
+        __m128i v[8];
+        fdct_transform(v, data);
+
+        // quantize
+
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i bias = _mm_set1_epi16(0x4000);
+        const __m128i* q = reinterpret_cast<const __m128i*>(quant_table);
+
+        // store
+
+        __m128i* d = reinterpret_cast<__m128i *>(dest);
+        for (int i = 0; i < 8; ++i)
+        {
+            _mm_storeu_si128(d + i, quantize(v[i], q[i], one, bias));
+        }
+    }
+
+#if defined(JPEG_ENABLE_AVX2)
+
+    static MANGO_TARGET_AVX2
+    void fdct_avx2(s16* dest, const s16* data, const s16* quant_table)
+    {
+        __m128i v[8];
+        fdct_transform(v, data);
+
+        __m256i v01 = _mm256_setr_m128i(v[0], v[1]);
+        __m256i v23 = _mm256_setr_m128i(v[2], v[3]);
+        __m256i v45 = _mm256_setr_m128i(v[4], v[5]);
+        __m256i v67 = _mm256_setr_m128i(v[6], v[7]);
+
+        // quantize
+
+        const __m256i one = _mm256_set1_epi16(1);
+        const __m256i bias = _mm256_set1_epi16(0x4000);
+        const __m256i* q = reinterpret_cast<const __m256i*>(quant_table);
+
+        v01 = quantize(v01, _mm256_loadu_si256(q + 0), one, bias);
+        v23 = quantize(v23, _mm256_loadu_si256(q + 1), one, bias);
+        v45 = quantize(v45, _mm256_loadu_si256(q + 2), one, bias);
+        v67 = quantize(v67, _mm256_loadu_si256(q + 3), one, bias);
+
+        // store
+
+        __m256i* d = reinterpret_cast<__m256i *>(dest);
+        _mm256_storeu_si256(d + 0, v01);
+        _mm256_storeu_si256(d + 1, v23);
+        _mm256_storeu_si256(d + 2, v45);
+        _mm256_storeu_si256(d + 3, v67);
+    }
+
+#endif // JPEG_ENABLE_AVX2
+
+#elif defined(JPEG_ENABLE_NEON)
+
+    // ----------------------------------------------------------------------------
+    // fdct neon
+    // ----------------------------------------------------------------------------
+
+    static inline
+    void dct_trn16(int16x8_t& x, int16x8_t& y)
+    {
+        int16x8x2_t t = vtrnq_s16(x, y);
+        x = t.val[0];
+        y = t.val[1];
+    }
+
+    static inline
+    void dct_trn32(int16x8_t& x, int16x8_t& y)
+    {
+        int32x4x2_t t = vtrnq_s32(vreinterpretq_s32_s16(x), vreinterpretq_s32_s16(y));
+        x = vreinterpretq_s16_s32(t.val[0]);
+        y = vreinterpretq_s16_s32(t.val[1]);
+    }
+
+    static inline
+    void dct_trn64(int16x8_t& x, int16x8_t& y)
+    {
+        int16x8_t x0 = x;
+        int16x8_t y0 = y;
+        x = vcombine_s16(vget_low_s16(x0), vget_low_s16(y0));
+        y = vcombine_s16(vget_high_s16(x0), vget_high_s16(y0));
+    }
+
+    static inline
+    int16x8_t packs_s32(int32x4_t a, int32x4_t b)
+    {
+        return vcombine_s16(vqmovn_s32(a), vqmovn_s32(b));
+    }
+
+    static inline
+    int16x8_t quantize(int16x8_t v, int16x8_t q, int32x4_t bias)
+    {
+        int32x4_t lo = vmlal_s16(bias, vget_low_s16(v), vget_low_s16(q));
+        int32x4_t hi = vmlal_s16(bias, vget_high_s16(v), vget_high_s16(q));
+        lo = vshrq_n_s32(lo, 15);
+        hi = vshrq_n_s32(hi, 15);
+        v = packs_s32(lo, hi);
+        return v;
+    }
+
+    #define JPEG_TRANSPOSE16() \
+        dct_trn16(v0, v1); \
+        dct_trn16(v2, v3); \
+        dct_trn16(v4, v5); \
+        dct_trn16(v6, v7); \
+        dct_trn32(v0, v2); \
+        dct_trn32(v1, v3); \
+        dct_trn32(v4, v6); \
+        dct_trn32(v5, v7); \
+        dct_trn64(v0, v4); \
+        dct_trn64(v1, v5); \
+        dct_trn64(v2, v6); \
+        dct_trn64(v3, v7)
+
+    #define JPEG_MUL2(v, x0, c0, x1, c1, f1, n) { \
+        int32x4_t lo; \
+        int32x4_t hi; \
+        lo = vmull_s16(vget_low_s16(x0), c0); \
+        lo = vml##f1##l_s16(lo, vget_low_s16(x1), c1); \
+        lo = vshrq_n_s32(lo, n); \
+        hi = vmull_s16(vget_high_s16(x0), c0); \
+        hi = vml##f1##l_s16(hi, vget_high_s16(x1), c1); \
+        hi = vshrq_n_s32(hi, n); \
+        v = packs_s32(lo, hi); }
+
+    #define JPEG_MUL4(v, x0, c0, x1, c1, x2, c2, x3, c3, f1, f2, f3, n) { \
+        int32x4_t lo; \
+        int32x4_t hi; \
+        lo = vmull_s16(vget_low_s16(x0), c0); \
+        lo = vml##f1##l_s16(lo, vget_low_s16(x1), c1); \
+        lo = vml##f2##l_s16(lo, vget_low_s16(x2), c2); \
+        lo = vml##f3##l_s16(lo, vget_low_s16(x3), c3); \
+        lo = vshrq_n_s32(lo, n); \
+        hi = vmull_s16(vget_high_s16(x0), c0); \
+        hi = vml##f1##l_s16(hi, vget_high_s16(x1), c1); \
+        hi = vml##f2##l_s16(hi, vget_high_s16(x2), c2); \
+        hi = vml##f3##l_s16(hi, vget_high_s16(x3), c3); \
+        hi = vshrq_n_s32(hi, n); \
+        v = packs_s32(lo, hi); }
+
+    #define JPEG_TRANSFORM(n) \
+        JPEG_MUL2(v2, x8, c2, x7, c6, a, n); \
+        JPEG_MUL2(v6, x8, c6, x7, c2, s, n); \
+        JPEG_MUL4(v7, x0, c7, x1, c5, x2, c3, x3, c1, s, a, s, n); \
+        JPEG_MUL4(v5, x0, c5, x1, c1, x2, c7, x3, c3, s, a, a, n); \
+        JPEG_MUL4(v3, x0, c3, x1, c7, x2, c1, x3, c5, s, s, s, n); \
+        JPEG_MUL4(v1, x0, c1, x1, c3, x2, c5, x3, c7, a, a, a, n);
+
+    static
+    void fdct_neon(s16* dest, const s16* data, const s16* quant_table)
+    {
+        const int16x4_t c1 = vdup_n_s16(1420); // cos 1PI/16 * root(2)
+        const int16x4_t c2 = vdup_n_s16(1338); // cos 2PI/16 * root(2)
+        const int16x4_t c3 = vdup_n_s16(1204); // cos 3PI/16 * root(2)
         const int16x4_t c5 = vdup_n_s16(805);  // cos 5PI/16 * root(2)
         const int16x4_t c6 = vdup_n_s16(554);  // cos 6PI/16 * root(2)
         const int16x4_t c7 = vdup_n_s16(283);  // cos 7PI/16 * root(2)
 
-        // load
+        // load
+
+        int16x8_t v0 = vld1q_s16(data + 0 * 8);
+        int16x8_t v1 = vld1q_s16(data + 1 * 8);
+        int16x8_t v2 = vld1q_s16(data + 2 * 8);
+        int16x8_t v3 = vld1q_s16(data + 3 * 8);
+        int16x8_t v4 = vld1q_s16(data + 4 * 8);
+        int16x8_t v5 = vld1q_s16(data + 5 * 8);
+        int16x8_t v6 = vld1q_s16(data + 6 * 8);
+        int16x8_t v7 = vld1q_s16(data + 7 * 8);
+
+        // pass 1
+
+        JPEG_TRANSPOSE16();
+
+        int16x8_t x8 = vaddq_s16(v0, v7);
+        int16x8_t x0 = vsubq_s16(v0, v7);
+        int16x8_t x7 = vaddq_s16(v1, v6);
+        int16x8_t x1 = vsubq_s16(v1, v6);
+        int16x8_t x6 = vaddq_s16(v2, v5);
+        int16x8_t x2 = vsubq_s16(v2, v5);
+        int16x8_t x5 = vaddq_s16(v3, v4);
+        int16x8_t x3 = vsubq_s16(v3, v4);
+        int16x8_t x4 = vaddq_s16(x8, x5);
+        x8 = vsubq_s16(x8, x5);
+        x5 = vaddq_s16(x7, x6);
+        x7 = vsubq_s16(x7, x6);
+
+        v0 = vaddq_s16(x4, x5);
+        v4 = vsubq_s16(x4, x5);
+
+        JPEG_TRANSFORM(10);
+
+        // pass 2
+
+        JPEG_TRANSPOSE16();
+
+        x8 = vaddq_s16(v0, v7);
+        x0 = vsubq_s16(v0, v7);
+        x7 = vaddq_s16(v1, v6);
+        x1 = vsubq_s16(v1, v6);
+        x6 = vaddq_s16(v2, v5);
+        x2 = vsubq_s16(v2, v5);
+        x5 = vaddq_s16(v3, v4);
+        x3 = vsubq_s16(v3, v4);
+        x4 = vaddq_s16(x8, x5);
+        x8 = vsubq_s16(x8, x5);
+        x5 = vaddq_s16(x7, x6);
+        x7 = vsubq_s16(x7, x6);
+
+        v0 = vshrq_n_s16(vaddq_s16(x4, x5), 3);
+        v4 = vshrq_n_s16(vsubq_s16(x4, x5), 3);
+
+        JPEG_TRANSFORM(13);
+
+        // quantize
+
+        const int32x4_t bias = vdupq_n_s32(0x4000);
+        const int16x8_t* q = reinterpret_cast<const int16x8_t *>(quant_table);
+
+        v0 = quantize(v0, q[0], bias);
+        v1 = quantize(v1, q[1], bias);
+        v2 = quantize(v2, q[2], bias);
+        v3 = quantize(v3, q[3], bias);
+        v4 = quantize(v4, q[4], bias);
+        v5 = quantize(v5, q[5], bias);
+        v6 = quantize(v6, q[6], bias);
+        v7 = quantize(v7, q[7], bias);
+
+        // store
+
+        vst1q_s16(dest + 0 * 8, v0);
+        vst1q_s16(dest + 1 * 8, v1);
+        vst1q_s16(dest + 2 * 8, v2);
+        vst1q_s16(dest + 3 * 8, v3);
+        vst1q_s16(dest + 4 * 8, v4);
+        vst1q_s16(dest + 5 * 8, v5);
+        vst1q_s16(dest + 6 * 8, v6);
+        vst1q_s16(dest + 7 * 8, v7);
+    }
+
+#else
+
+    // ----------------------------------------------------------------------------
+    // fdct scalar
+    // ----------------------------------------------------------------------------
+
+    static
+    void fdct_scalar(s16* dest, const s16* data, const s16* quant_table)
+    {
+        constexpr s16 c1 = 1420; // cos 1PI/16 * root(2)
+        constexpr s16 c2 = 1338; // cos 2PI/16 * root(2)
+        constexpr s16 c3 = 1204; // cos 3PI/16 * root(2)
+        constexpr s16 c5 = 805;  // cos 5PI/16 * root(2)
+        constexpr s16 c6 = 554;  // cos 6PI/16 * root(2)
+        constexpr s16 c7 = 283;  // cos 7PI/16 * root(2)
+
+        s16 temp[64];
+
+        for (int i = 0; i < 8; ++i)
+        {
+            s16 x8 = data [0] + data [7];
+            s16 x0 = data [0] - data [7];
+            s16 x7 = data [1] + data [6];
+            s16 x1 = data [1] - data [6];
+            s16 x6 = data [2] + data [5];
+            s16 x2 = data [2] - data [5];
+            s16 x5 = data [3] + data [4];
+            s16 x3 = data [3] - data [4];
+            s16 x4 = x8 + x5;
+            x8 = x8 - x5;
+            x5 = x7 + x6;
+            x7 = x7 - x6;
+            temp[i * 8 + 0] = x4 + x5;
+            temp[i * 8 + 4] = x4 - x5;
+            temp[i * 8 + 2] = (x8 * c2 + x7 * c6) >> 10;
+            temp[i * 8 + 6] = (x8 * c6 - x7 * c2) >> 10;
+            temp[i * 8 + 7] = (x0 * c7 - x1 * c5 + x2 * c3 - x3 * c1) >> 10;
+            temp[i * 8 + 5] = (x0 * c5 - x1 * c1 + x2 * c7 + x3 * c3) >> 10;
+            temp[i * 8 + 3] = (x0 * c3 - x1 * c7 - x2 * c1 - x3 * c5) >> 10;
+            temp[i * 8 + 1] = (x0 * c1 + x1 * c3 + x2 * c5 + x3 * c7) >> 10;
+            data += 8;
+        }
+
+        for (int i = 0; i < 8; ++i)
+        {
+            s16 x8 = temp [i +  0] + temp [i + 56];
+            s16 x0 = temp [i +  0] - temp [i + 56];
+            s16 x7 = temp [i +  8] + temp [i + 48];
+            s16 x1 = temp [i +  8] - temp [i + 48];
+            s16 x6 = temp [i + 16] + temp [i + 40];
+            s16 x2 = temp [i + 16] - temp [i + 40];
+            s16 x5 = temp [i + 24] + temp [i + 32];
+            s16 x3 = temp [i + 24] - temp [i + 32];
+            s16 x4 = x8 + x5;
+            x8 = x8 - x5;
+            x5 = x7 + x6;
+            x7 = x7 - x6;
+            s16 v0 = (x4 + x5) >> 3;
+            s16 v4 = (x4 - x5) >> 3;
+            s16 v2 = (x8 * c2 + x7 * c6) >> 13;
+            s16 v6 = (x8 * c6 - x7 * c2) >> 13;
+            s16 v7 = (x0 * c7 - x1 * c5 + x2 * c3 - x3 * c1) >> 13;
+            s16 v5 = (x0 * c5 - x1 * c1 + x2 * c7 + x3 * c3) >> 13;
+            s16 v3 = (x0 * c3 - x1 * c7 - x2 * c1 - x3 * c5) >> 13;
+            s16 v1 = (x0 * c1 + x1 * c3 + x2 * c5 + x3 * c7) >> 13;
+            dest[i + 8 * 0] = (v0 * quant_table[i + 8 * 0] + 0x4000) >> 15;
+            dest[i + 8 * 1] = (v1 * quant_table[i + 8 * 1] + 0x4000) >> 15;
+            dest[i + 8 * 2] = (v2 * quant_table[i + 8 * 2] + 0x4000) >> 15;
+            dest[i + 8 * 3] = (v3 * quant_table[i + 8 * 3] + 0x4000) >> 15;
+            dest[i + 8 * 4] = (v4 * quant_table[i + 8 * 4] + 0x4000) >> 15;
+            dest[i + 8 * 5] = (v5 * quant_table[i + 8 * 5] + 0x4000) >> 15;
+            dest[i + 8 * 6] = (v6 * quant_table[i + 8 * 6] + 0x4000) >> 15;
+            dest[i + 8 * 7] = (v7 * quant_table[i + 8 * 7] + 0x4000) >> 15;
+        }
+    }
+
+#endif
+
+    using FDCTFunc = void (*)(s16* dest, const s16* data, const s16* quant_table);
+
+    const DispatchVariant<FDCTFunc> g_fdct_variants[] =
+    {
+#if defined(JPEG_ENABLE_SSE2)
+        { 0, "SSE2 DCT", fdct_sse2 },
+#if defined(JPEG_ENABLE_AVX2)
+        { CPU_AVX2, "AVX2 DCT", fdct_avx2 },
+#endif
+#elif defined(JPEG_ENABLE_NEON)
+        { 0, "NEON DCT", fdct_neon },
+#else
+        { 0, "Scalar DCT", fdct_scalar },
+#endif
+    };
+
+    // ----------------------------------------------------------------------------
+    // read_xxx_format
+    // ----------------------------------------------------------------------------
+
+    static
+    void read_y_format(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            const u8* scan = input;
+            for (int j = cols; j > 0; --j)
+            {
+                *block++ = (*scan++) - 128;
+            }
+
+            // replicate last column
+            for (int j = 8 - cols; j > 0; --j)
+            {
+                *block = *(block - 1);
+                ++block;
+            }
+
+            input += stride;
+        }
+
+        // replicate last row
+        for (int i = 8 - rows; i > 0; --i)
+        {
+            for (int j = 8; j > 0; --j)
+            {
+                *block = *(block - 8);
+                ++block;
+            }
+        }
+    }
+
+    static
+    void read_bgr_format(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            const u8* scan = input;
+            for (int j = 0; j < cols; ++j)
+            {
+                int r = scan[2];
+                int g = scan[1];
+                int b = scan[0];
+                int y = (76 * r + 151 * g + 29 * b) >> 8;
+                int cr = ((r - y) * 182) >> 8;
+                int cb = ((b - y) * 144) >> 8;
+                block[0 * 64] = s16(y - 128);
+                block[1 * 64] = s16(cb);
+                block[2 * 64] = s16(cr);
+                ++block;
+                scan += 3;
+            }
+
+            // replicate last column
+            for (int j = 8 - cols; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 1];
+                block[1 * 64] = block[1 * 64 - 1];
+                block[2 * 64] = block[2 * 64 - 1];
+                ++block;
+            }
+
+            input += stride;
+
+        }
+        // replicate last row
+        for (int i = 8 - rows; i > 0; --i)
+        {
+            for (int j = 8; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 8];
+                block[1 * 64] = block[1 * 64 - 8];
+                block[2 * 64] = block[2 * 64 - 8];
+                ++block;
+            }
+        }
+    }
+
+    static
+    void read_rgb_format(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            const u8* scan = input;
+            for (int j = 0; j < cols; ++j)
+            {
+                int r = scan[0];
+                int g = scan[1];
+                int b = scan[2];
+                int y = (76 * r + 151 * g + 29 * b) >> 8;
+                int cr = ((r - y) * 182) >> 8;
+                int cb = ((b - y) * 144) >> 8;
+                block[0 * 64] = s16(y - 128);
+                block[1 * 64] = s16(cb);
+                block[2 * 64] = s16(cr);
+                ++block;
+                scan += 3;
+            }
+
+            // replicate last column
+            for (int j = 8 - cols; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 1];
+                block[1 * 64] = block[1 * 64 - 1];
+                block[2 * 64] = block[2 * 64 - 1];
+                ++block;
+            }
+
+            input += stride;
+        }
+
+        // replicate last row
+        for (int i = 8 - rows; i > 0; --i)
+        {
+            for (int j = 8; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 8];
+                block[1 * 64] = block[1 * 64 - 8];
+                block[2 * 64] = block[2 * 64 - 8];
+                ++block;
+            }
+        }
+    }
+
+    static
+    void read_bgra_format(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            const u8* scan = input;
+            for (int j = 0; j < cols; ++j)
+            {
+                s16 r = scan[2];
+                s16 g = scan[1];
+                s16 b = scan[0];
+                s16 y = (76 * r + 151 * g + 29 * b) >> 8;
+                s16 cr = ((r - y) * 182) >> 8;
+                s16 cb = ((b - y) * 144) >> 8;
+                block[0 * 64] = s16(y - 128);
+                block[1 * 64] = s16(cb);
+                block[2 * 64] = s16(cr);
+                ++block;
+                scan += 4;
+            }
+
+            // replicate last column
+            for (int j = 8 - cols; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 1];
+                block[1 * 64] = block[1 * 64 - 1];
+                block[2 * 64] = block[2 * 64 - 1];
+                ++block;
+            }
+
+            input += stride;
+        }
+
+        // replicate last row
+        for (int i = 8 - rows; i > 0; --i)
+        {
+            for (int j = 8; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 8];
+                block[1 * 64] = block[1 * 64 - 8];
+                block[2 * 64] = block[2 * 64 - 8];
+                ++block;
+            }
+        }
+    }
+
+    static
+    void read_rgba_format(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            const u8* scan = input;
+            for (int j = 0; j < cols; ++j)
+            {
+                int r = scan[0];
+                int g = scan[1];
+                int b = scan[2];
+                int y = (76 * r + 151 * g + 29 * b) >> 8;
+                int cr = ((r - y) * 182) >> 8;
+                int cb = ((b - y) * 144) >> 8;
+                block[0 * 64] = s16(y - 128);
+                block[1 * 64] = s16(cb);
+                block[2 * 64] = s16(cr);
+                ++block;
+                scan += 4;
+            }
+
+            // replicate last column
+            for (int j = 8 - cols; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 1];
+                block[1 * 64] = block[1 * 64 - 1];
+                block[2 * 64] = block[2 * 64 - 1];
+                ++block;
+            }
+
+            input += stride;
+        }
+
+        // replicate last row
+        for (int i = 8 - rows; i > 0; --i)
+        {
+            for (int j = 8; j > 0; --j)
+            {
+                block[0 * 64] = block[0 * 64 - 8];
+                block[1 * 64] = block[1 * 64 - 8];
+                block[2 * 64] = block[2 * 64 - 8];
+                ++block;
+            }
+        }
+    }
+
+#if defined(JPEG_ENABLE_SSE2)
+
+    static
+    void read_y_format_sse2(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        // load
+        __m128i v0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
+        __m128i v1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
+        __m128i v2 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
+        __m128i v3 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
+        __m128i v4 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
+        __m128i v5 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
+        __m128i v6 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
+        __m128i v7 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input));
+
+        // adjust bias
+        __m128i bias = _mm_set1_epi8(-128);
+        v0 = _mm_sub_epi8(v0, bias);
+        v1 = _mm_sub_epi8(v1, bias);
+        v2 = _mm_sub_epi8(v2, bias);
+        v3 = _mm_sub_epi8(v3, bias);
+        v4 = _mm_sub_epi8(v4, bias);
+        v5 = _mm_sub_epi8(v5, bias);
+        v6 = _mm_sub_epi8(v6, bias);
+        v7 = _mm_sub_epi8(v7, bias);
+
+        // sign-extend
+#if defined(JPEG_ENABLE_SSE4)
+        v0 = _mm_cvtepi8_epi16(v0);
+        v1 = _mm_cvtepi8_epi16(v1);
+        v2 = _mm_cvtepi8_epi16(v2);
+        v3 = _mm_cvtepi8_epi16(v3);
+        v4 = _mm_cvtepi8_epi16(v4);
+        v5 = _mm_cvtepi8_epi16(v5);
+        v6 = _mm_cvtepi8_epi16(v6);
+        v7 = _mm_cvtepi8_epi16(v7);
+#else
+        __m128i zero = _mm_setzero_si128();
+        v0 = _mm_unpacklo_epi8(v0, _mm_cmpgt_epi8(zero, v0));
+        v1 = _mm_unpacklo_epi8(v1, _mm_cmpgt_epi8(zero, v1));
+        v2 = _mm_unpacklo_epi8(v2, _mm_cmpgt_epi8(zero, v2));
+        v3 = _mm_unpacklo_epi8(v3, _mm_cmpgt_epi8(zero, v3));
+        v4 = _mm_unpacklo_epi8(v4, _mm_cmpgt_epi8(zero, v4));
+        v5 = _mm_unpacklo_epi8(v5, _mm_cmpgt_epi8(zero, v5));
+        v6 = _mm_unpacklo_epi8(v6, _mm_cmpgt_epi8(zero, v6));
+        v7 = _mm_unpacklo_epi8(v7, _mm_cmpgt_epi8(zero, v7));
+#endif
+
+        // store
+        __m128i* dest = reinterpret_cast<__m128i*>(block);
+        _mm_storeu_si128(dest + 0, v0);
+        _mm_storeu_si128(dest + 1, v1);
+        _mm_storeu_si128(dest + 2, v2);
+        _mm_storeu_si128(dest + 3, v3);
+        _mm_storeu_si128(dest + 4, v4);
+        _mm_storeu_si128(dest + 5, v5);
+        _mm_storeu_si128(dest + 6, v6);
+        _mm_storeu_si128(dest + 7, v7);
+    }
+
+    static
+    void read_bgra_format_sse2(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        __m128i* dest = reinterpret_cast<__m128i*>(block);
+
+        const __m128i mask = _mm_set1_epi32(0xff);
+        const __m128i c76 = _mm_set1_epi16(76);
+        const __m128i c151 = _mm_set1_epi16(151);
+        const __m128i c29 = _mm_set1_epi16(29);
+        const __m128i c128 = _mm_set1_epi16(128);
+        const __m128i c182 = _mm_set1_epi16(182);
+        const __m128i c144 = _mm_set1_epi16(144);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
+            input += stride;
+
+            // load, unpack
+            __m128i b0 = _mm_loadu_si128(ptr + 0);
+            __m128i b1 = _mm_loadu_si128(ptr + 1);
+            __m128i g0 = _mm_srli_epi32(b0, 8);
+            __m128i r0 = _mm_srli_epi32(b0, 16);
+            __m128i g1 = _mm_srli_epi32(b1, 8);
+            __m128i r1 = _mm_srli_epi32(b1, 16);
+            b0 = _mm_and_si128(b0, mask);
+            b1 = _mm_and_si128(b1, mask);
+            g0 = _mm_and_si128(g0, mask);
+            g1 = _mm_and_si128(g1, mask);
+            r0 = _mm_and_si128(r0, mask);
+            r1 = _mm_and_si128(r1, mask);
+            __m128i b = _mm_packs_epi32(b0, b1);
+            __m128i g = _mm_packs_epi32(g0, g1);
+            __m128i r = _mm_packs_epi32(r0, r1);
+
+            // compute luminance
+            __m128i s0 = _mm_mullo_epi16(r, c76);
+            __m128i s1 = _mm_mullo_epi16(g, c151);
+            __m128i s2 = _mm_mullo_epi16(b, c29);
+            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
+            s = _mm_srli_epi16(s, 8);
+
+            // compute chroma
+            __m128i cr = _mm_sub_epi16(r, s);
+            __m128i cb = _mm_sub_epi16(b, s);
+            cr = _mm_mullo_epi16(cr, c182);
+            cb = _mm_mullo_epi16(cb, c144);
+            cr = _mm_srai_epi16(cr, 8);
+            cb = _mm_srai_epi16(cb, 8);
+
+            // adjust bias
+            s = _mm_sub_epi16(s, c128);
+
+            // store
+            _mm_storeu_si128(dest + y + 0, s);
+            _mm_storeu_si128(dest + y + 8, cb);
+            _mm_storeu_si128(dest + y + 16, cr);
+        }
+    }
+
+    static
+    void read_rgba_format_sse2(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        __m128i* dest = reinterpret_cast<__m128i*>(block);
+
+        const __m128i mask = _mm_set1_epi32(0xff);
+        const __m128i c76 = _mm_set1_epi16(76);
+        const __m128i c151 = _mm_set1_epi16(151);
+        const __m128i c29 = _mm_set1_epi16(29);
+        const __m128i c128 = _mm_set1_epi16(128);
+        const __m128i c182 = _mm_set1_epi16(182);
+        const __m128i c144 = _mm_set1_epi16(144);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
+            input += stride;
+
+            // load, unpack
+            __m128i r0 = _mm_loadu_si128(ptr + 0);
+            __m128i r1 = _mm_loadu_si128(ptr + 1);
+            __m128i g0 = _mm_srli_epi32(r0, 8);
+            __m128i b0 = _mm_srli_epi32(r0, 16);
+            __m128i g1 = _mm_srli_epi32(r1, 8);
+            __m128i b1 = _mm_srli_epi32(r1, 16);
+            b0 = _mm_and_si128(b0, mask);
+            b1 = _mm_and_si128(b1, mask);
+            g0 = _mm_and_si128(g0, mask);
+            g1 = _mm_and_si128(g1, mask);
+            r0 = _mm_and_si128(r0, mask);
+            r1 = _mm_and_si128(r1, mask);
+            __m128i b = _mm_packs_epi32(b0, b1);
+            __m128i g = _mm_packs_epi32(g0, g1);
+            __m128i r = _mm_packs_epi32(r0, r1);
+
+            // compute luminance
+            __m128i s0 = _mm_mullo_epi16(r, c76);
+            __m128i s1 = _mm_mullo_epi16(g, c151);
+            __m128i s2 = _mm_mullo_epi16(b, c29);
+            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
+            s = _mm_srli_epi16(s, 8);
+
+            // compute chroma
+            __m128i cr = _mm_sub_epi16(r, s);
+            __m128i cb = _mm_sub_epi16(b, s);
+            cr = _mm_mullo_epi16(cr, c182);
+            cb = _mm_mullo_epi16(cb, c144);
+            cr = _mm_srai_epi16(cr, 8);
+            cb = _mm_srai_epi16(cb, 8);
+
+            // adjust bias
+            s = _mm_sub_epi16(s, c128);
+
+            // store
+            _mm_storeu_si128(dest + y + 0, s);
+            _mm_storeu_si128(dest + y + 8, cb);
+            _mm_storeu_si128(dest + y + 16, cr);
+        }
+    }
+
+#endif // JPEG_ENABLE_SSE2
+
+#if defined(JPEG_ENABLE_SSSE3)
+
+    static MANGO_TARGET_SSSE3
+    void read_bgr_format_ssse3(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        __m128i* dest = reinterpret_cast<__m128i*>(block);
+
+        const __m128i c76 = _mm_set1_epi16(76);
+        const __m128i c151 = _mm_set1_epi16(151);
+        const __m128i c29 = _mm_set1_epi16(29);
+        const __m128i c128 = _mm_set1_epi16(128);
+        const __m128i c182 = _mm_set1_epi16(182);
+        const __m128i c144 = _mm_set1_epi16(144);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
+            input += stride;
+
+            // load
+            __m128i v0 = _mm_loadu_si128(ptr + 0);
+            __m128i v1 = _mm_loadl_epi64(ptr + 1);
+
+            // unpack
+            constexpr u8 n = 0x80;
+            __m128i b0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(0, n, 3, n, 6, n, 9, n, 12, n, 15, n, n, n, n, n));
+            __m128i b1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, n, n, 2, n, 5, n));
+            __m128i g0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(1, n, 4, n, 7, n, 10, n, 13, n, n, n, n, n, n, n));
+            __m128i g1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 0, n, 3, n, 6, n));
+            __m128i r0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(2, n, 5, n, 8, n, 11, n, 14, n, n, n, n, n, n, n));
+            __m128i r1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 1, n, 4, n, 7, n));
+           __m128i b = _mm_or_si128(b0, b1);
+           __m128i g = _mm_or_si128(g0, g1);
+           __m128i r = _mm_or_si128(r0, r1);
+
+            // compute luminance
+            __m128i s0 = _mm_mullo_epi16(r, c76);
+            __m128i s1 = _mm_mullo_epi16(g, c151);
+            __m128i s2 = _mm_mullo_epi16(b, c29);
+            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
+            s = _mm_srli_epi16(s, 8);
+
+            // compute chroma
+            __m128i cr = _mm_sub_epi16(r, s);
+            __m128i cb = _mm_sub_epi16(b, s);
+            cr = _mm_mullo_epi16(cr, c182);
+            cb = _mm_mullo_epi16(cb, c144);
+            cr = _mm_srai_epi16(cr, 8);
+            cb = _mm_srai_epi16(cb, 8);
+
+            // adjust bias
+            s = _mm_sub_epi16(s, c128);
+
+            // store
+            _mm_storeu_si128(dest + y + 0, s);
+            _mm_storeu_si128(dest + y + 8, cb);
+            _mm_storeu_si128(dest + y + 16, cr);
+        }
+    }
+
+    static MANGO_TARGET_SSSE3
+    void read_rgb_format_ssse3(s16* block, const u8* input, int stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        __m128i* dest = reinterpret_cast<__m128i*>(block);
+
+        const __m128i c76 = _mm_set1_epi16(76);
+        const __m128i c151 = _mm_set1_epi16(151);
+        const __m128i c29 = _mm_set1_epi16(29);
+        const __m128i c128 = _mm_set1_epi16(128);
+        const __m128i c182 = _mm_set1_epi16(182);
+        const __m128i c144 = _mm_set1_epi16(144);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
+            input += stride;
+
+            // load
+            __m128i v0 = _mm_loadu_si128(ptr + 0);
+            __m128i v1 = _mm_loadl_epi64(ptr + 1);
+
+            // unpack
+            constexpr u8 n = 0x80;
+            __m128i r0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(0, n, 3, n, 6, n, 9, n, 12, n, 15, n, n, n, n, n));
+            __m128i r1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, n, n, 2, n, 5, n));
+            __m128i g0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(1, n, 4, n, 7, n, 10, n, 13, n, n, n, n, n, n, n));
+            __m128i g1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 0, n, 3, n, 6, n));
+            __m128i b0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(2, n, 5, n, 8, n, 11, n, 14, n, n, n, n, n, n, n));
+            __m128i b1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 1, n, 4, n, 7, n));
+           __m128i b = _mm_or_si128(b0, b1);
+           __m128i g = _mm_or_si128(g0, g1);
+           __m128i r = _mm_or_si128(r0, r1);
+
+            // compute luminance
+            __m128i s0 = _mm_mullo_epi16(r, c76);
+            __m128i s1 = _mm_mullo_epi16(g, c151);
+            __m128i s2 = _mm_mullo_epi16(b, c29);
+            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
+            s = _mm_srli_epi16(s, 8);
+
+            // compute chroma
+            __m128i cr = _mm_sub_epi16(r, s);
+            __m128i cb = _mm_sub_epi16(b, s);
+            cr = _mm_mullo_epi16(cr, c182);
+            cb = _mm_mullo_epi16(cb, c144);
+            cr = _mm_srai_epi16(cr, 8);
+            cb = _mm_srai_epi16(cb, 8);
+
+            // adjust bias
+            s = _mm_sub_epi16(s, c128);
+
+            // store
+            _mm_storeu_si128(dest + y + 0, s);
+            _mm_storeu_si128(dest + y + 8, cb);
+            _mm_storeu_si128(dest + y + 16, cr);
+        }
+    }
+
+#endif // JPEG_ENABLE_SSSE3
+
+    // ----------------------------------------------------------------------------
+    // downsample_xxx
+    // ----------------------------------------------------------------------------
+
+    // The source is a chroma block in the first 8x8 block of the MCU; the blocks
+    // are read at full resolution with Y, Cb and Cr interleaved (3 * BLOCK_SIZE apart).
+
+    static
+    void downsample_422(s16* dest, const s16* source)
+    {
+        for (int y = 0; y < 8; ++y)
+        {
+            for (int x = 0; x < 8; ++x)
+            {
+                const s16* s = source + (x >> 2) * BLOCK_SIZE * 3 + y * 8 + (x & 3) * 2;
+                dest[y * 8 + x] = s16((s[0] + s[1] + 1) >> 1);
+            }
+        }
+    }
+
+    static
+    void downsample_420(s16* dest, const s16* source)
+    {
+        for (int y = 0; y < 8; ++y)
+        {
+            for (int x = 0; x < 8; ++x)
+            {
+                const s16* s = source + ((y >> 2) * 2 + (x >> 2)) * BLOCK_SIZE * 3 + (y & 3) * 16 + (x & 3) * 2;
+                dest[y * 8 + x] = s16((s[0] + s[1] + s[8] + s[9] + 2) >> 2);
+            }
+        }
+    }
+
+#if defined(JPEG_ENABLE_SSE2)
+
+    static
+    void downsample_422_sse2(s16* dest, const s16* source)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const __m128i* s = reinterpret_cast<const __m128i*>(source + y * 8);
+            __m128i a = _mm_madd_epi16(_mm_loadu_si128(s), one);
+            __m128i b = _mm_madd_epi16(_mm_loadu_si128(s + BLOCK_SIZE * 3 / 8), one);
+            __m128i v = _mm_packs_epi32(a, b);
+            v = _mm_srai_epi16(_mm_add_epi16(v, one), 1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + y * 8), v);
+        }
+    }
+
+    static
+    void downsample_420_sse2(s16* dest, const s16* source)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i two = _mm_set1_epi32(2);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const __m128i* s = reinterpret_cast<const __m128i*>(source + (y >> 2) * BLOCK_SIZE * 6 + (y & 3) * 16);
+            __m128i a = _mm_add_epi16(_mm_loadu_si128(s + 0), _mm_loadu_si128(s + 1));
+            __m128i b = _mm_add_epi16(_mm_loadu_si128(s + BLOCK_SIZE * 3 / 8 + 0), _mm_loadu_si128(s + BLOCK_SIZE * 3 / 8 + 1));
+            a = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(a, one), two), 2);
+            b = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(b, one), two), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + y * 8), _mm_packs_epi32(a, b));
+        }
+    }
+
+#endif // JPEG_ENABLE_SSE2
+
+    // ----------------------------------------------------------------------------
+    // jpeg_encode
+    // ----------------------------------------------------------------------------
+
+    jpeg_encode::jpeg_encode(Sample sample, u32 width, u32 height, u32 stride, u32 quality, int subsampling, bool optimize, bool progressive)
+        : ILqt(64)
+        , ICqt(64)
+        , optimize(optimize)
+        , progressive(progressive)
+    {
+        bytes_per_pixel = 0;
+        channel_count = 0;
+
+        channel[0].component = 1;
+        channel[0].qtable = ILqt;
 
-        int16x8_t v0 = vld1q_s16(data + 0 * 8);
-        int16x8_t v1 = vld1q_s16(data + 1 * 8);
-        int16x8_t v2 = vld1q_s16(data + 2 * 8);
-        int16x8_t v3 = vld1q_s16(data + 3 * 8);
-        int16x8_t v4 = vld1q_s16(data + 4 * 8);
-        int16x8_t v5 = vld1q_s16(data + 5 * 8);
-        int16x8_t v6 = vld1q_s16(data + 6 * 8);
-        int16x8_t v7 = vld1q_s16(data + 7 * 8);
+        channel[1].component = 2;
+        channel[1].qtable = ICqt;
 
-        // pass 1
+        channel[2].component = 3;
+        channel[2].qtable = ICqt;
 
-        JPEG_TRANSPOSE16();
+        read_8x8 = nullptr;
 
-        int16x8_t x8 = vaddq_s16(v0, v7);
-        int16x8_t x0 = vsubq_s16(v0, v7);
-        int16x8_t x7 = vaddq_s16(v1, v6);
-        int16x8_t x1 = vsubq_s16(v1, v6);
-        int16x8_t x6 = vaddq_s16(v2, v5);
-        int16x8_t x2 = vsubq_s16(v2, v5);
-        int16x8_t x5 = vaddq_s16(v3, v4);
-        int16x8_t x3 = vsubq_s16(v3, v4);
-        int16x8_t x4 = vaddq_s16(x8, x5);
-        x8 = vsubq_s16(x8, x5);
-        x5 = vaddq_s16(x7, x6);
-        x7 = vsubq_s16(x7, x6);
+        const auto& fdct_variant = selectDispatchVariant("jpeg.fdct", g_fdct_variants);
+        fdct = fdct_variant.function;
 
-        v0 = vaddq_s16(x4, x5);
-        v4 = vsubq_s16(x4, x5);
+        u64 cpu_flags = getCPUFlags();
+        MANGO_UNREFERENCED(cpu_flags);
 
-        JPEG_TRANSFORM(10);
+        const char* sampler_name = nullptr;
 
-        // pass 2
+        switch (sample)
+        {
+            case JPEG_U8_Y:
+#if defined(JPEG_ENABLE_SSE2)
+                if (cpu_flags & CPU_SSE2)
+                {
+                    read_8x8 = read_y_format_sse2;
+                    sampler_name = "SSE2 Y 8x8";
+                }
+#endif
+                read = read_y_format;
+                bytes_per_pixel = 1;
+                channel_count = 1;
+                break;
 
-        JPEG_TRANSPOSE16();
+            case JPEG_U8_BGR:
+#if defined(JPEG_ENABLE_SSSE3)
+				if (cpu_flags & CPU_SSSE3)
+                {
+                    read_8x8 = read_bgr_format_ssse3;
+                    sampler_name = "SSSE3 BGR 8x8";
+                }
+#endif
+                read = read_bgr_format;
+                bytes_per_pixel = 3;
+                channel_count = 3;
+                break;
 
-        x8 = vaddq_s16(v0, v7);
-        x0 = vsubq_s16(v0, v7);
-        x7 = vaddq_s16(v1, v6);
-        x1 = vsubq_s16(v1, v6);
-        x6 = vaddq_s16(v2, v5);
-        x2 = vsubq_s16(v2, v5);
-        x5 = vaddq_s16(v3, v4);
-        x3 = vsubq_s16(v3, v4);
-        x4 = vaddq_s16(x8, x5);
-        x8 = vsubq_s16(x8, x5);
-        x5 = vaddq_s16(x7, x6);
-        x7 = vsubq_s16(x7, x6);
+            case JPEG_U8_RGB:
+#if defined(JPEG_ENABLE_SSSE3)
+                if (cpu_flags & CPU_SSSE3)
+                {
+                    read_8x8 = read_rgb_format_ssse3;
+                    sampler_name = "SSSE3 RGB 8x8";
+                }
+#endif
+                read = read_rgb_format;
+                bytes_per_pixel = 3;
+                channel_count = 3;
+                break;
 
-        v0 = vshrq_n_s16(vaddq_s16(x4, x5), 3);
-        v4 = vshrq_n_s16(vsubq_s16(x4, x5), 3);
+            case JPEG_U8_BGRA:
+#if defined(JPEG_ENABLE_SSE2)
+                if (cpu_flags & CPU_SSE2)
+                {
+                    read_8x8 = read_bgra_format_sse2;
+                    sampler_name = "SSE2 BGRA 8x8";
+                }
+#endif
+                read = read_bgra_format;
+                bytes_per_pixel = 4;
+                channel_count = 3;
+                break;
 
-        JPEG_TRANSFORM(13);
+            case JPEG_U8_RGBA:
+#if defined(JPEG_ENABLE_SSE2)
+                if (cpu_flags & CPU_SSE2)
+                {
+                    read_8x8 = read_rgba_format_sse2;
+                    sampler_name = "SSE2 RGBA 8x8";
+                }
+#endif
+                read = read_rgba_format;
+                bytes_per_pixel = 4;
+                channel_count = 3;
+                break;
+        }
 
-        // quantize
+        if (!read_8x8)
+        {
+            read_8x8 = read;
+        }
 
-        const int32x4_t bias = vdupq_n_s32(0x4000);
-        const int16x8_t* q = reinterpret_cast<const int16x8_t *>(quant_table);
+        // chroma subsampling
+        mcu_width = 8;
+        mcu_height = 8;
+        downsample = nullptr;
 
-        v0 = quantize(v0, q[0], bias);
-        v1 = quantize(v1, q[1], bias);
-        v2 = quantize(v2, q[2], bias);
-        v3 = quantize(v3, q[3], bias);
-        v4 = quantize(v4, q[4], bias);
-        v5 = quantize(v5, q[5], bias);
-        v6 = quantize(v6, q[6], bias);
-        v7 = quantize(v7, q[7], bias);
+        const char* subsampling_name = nullptr;
 
-        // store
+        if (channel_count == 3)
+        {
+            switch (subsampling)
+            {
+                case 422:
+                    mcu_width = 16;
+                    downsample = downsample_422;
+#if defined(JPEG_ENABLE_SSE2)
+                    if (cpu_flags & CPU_SSE2)
+                    {
+                        downsample = downsample_422_sse2;
+                    }
+#endif
+                    subsampling_name = "4:2:2";
+                    break;
 
-        vst1q_s16(dest + 0 * 8, v0);
-        vst1q_s16(dest + 1 * 8, v1);
-        vst1q_s16(dest + 2 * 8, v2);
-        vst1q_s16(dest + 3 * 8, v3);
-        vst1q_s16(dest + 4 * 8, v4);
-        vst1q_s16(dest + 5 * 8, v5);
-        vst1q_s16(dest + 6 * 8, v6);
-        vst1q_s16(dest + 7 * 8, v7);
-    }
+                case 420:
+                    mcu_width = 16;
+                    mcu_height = 16;
+                    downsample = downsample_420;
+#if defined(JPEG_ENABLE_SSE2)
+                    if (cpu_flags & CPU_SSE2)
+                    {
+                        downsample = downsample_420_sse2;
+                    }
+#endif
+                    subsampling_name = "4:2:0";
+                    break;
 
-#else
+                default:
+                    break;
+            }
+        }
 
-    constexpr const char* fdct_name = "Scalar DCT";
+        const int luminance_blocks = (mcu_width / 8) * (mcu_height / 8);
+        blocks_in_mcu = luminance_blocks + channel_count - 1;
 
-    // ----------------------------------------------------------------------------
-    // fdct scalar
-    // ----------------------------------------------------------------------------
+        for (int i = 0; i < luminance_blocks; ++i)
+        {
+            block[i] = channel[0];
+        }
 
-    static
-    void fdct(s16* dest, const s16* data, const s16* quant_table)
-    {
-        constexpr s16 c1 = 1420; // cos 1PI/16 * root(2)
-        constexpr s16 c2 = 1338; // cos 2PI/16 * root(2)
-        constexpr s16 c3 = 1204; // cos 3PI/16 * root(2)
-        constexpr s16 c5 = 805;  // cos 5PI/16 * root(2)
-        constexpr s16 c6 = 554;  // cos 6PI/16 * root(2)
-        constexpr s16 c7 = 283;  // cos 7PI/16 * root(2)
+        for (int i = 1; i < channel_count; ++i)
+        {
+            block[luminance_blocks + i - 1] = channel[i];
+        }
 
-        s16 temp[64];
+        codes[0].init(g_luminance_dc_code_table, g_luminance_dc_size_table,
+                      g_luminance_ac_code_table, g_luminance_ac_size_table);
+        codes[1].init(g_chrominance_dc_code_table, g_chrominance_dc_size_table,
+                      g_chrominance_ac_code_table, g_chrominance_ac_size_table);
 
-        for (int i = 0; i < 8; ++i)
+        // build encoder info string
+        info = "JPEG Encoder: ";
+        info += fdct_variant.name;
+        if (sampler_name)
         {
-            s16 x8 = data [0] + data [7];
-            s16 x0 = data [0] - data [7];
-            s16 x7 = data [1] + data [6];
-            s16 x1 = data [1] - data [6];
-            s16 x6 = data [2] + data [5];
-            s16 x2 = data [2] - data [5];
-            s16 x5 = data [3] + data [4];
-            s16 x3 = data [3] - data [4];
-            s16 x4 = x8 + x5;
-            x8 = x8 - x5;
-            x5 = x7 + x6;
-            x7 = x7 - x6;
-            temp[i * 8 + 0] = x4 + x5;
-            temp[i * 8 + 4] = x4 - x5;
-            temp[i * 8 + 2] = (x8 * c2 + x7 * c6) >> 10;
-            temp[i * 8 + 6] = (x8 * c6 - x7 * c2) >> 10;
-            temp[i * 8 + 7] = (x0 * c7 - x1 * c5 + x2 * c3 - x3 * c1) >> 10;
-            temp[i * 8 + 5] = (x0 * c5 - x1 * c1 + x2 * c7 + x3 * c3) >> 10;
-            temp[i * 8 + 3] = (x0 * c3 - x1 * c7 - x2 * c1 - x3 * c5) >> 10;
-            temp[i * 8 + 1] = (x0 * c1 + x1 * c3 + x2 * c5 + x3 * c7) >> 10;
-            data += 8;
+            info += " ";
+            info += sampler_name;
+        }
+        if (subsampling_name)
+        {
+            info += " ";
+            info += subsampling_name;
+        }
+        if (progressive)
+        {
+            info += " Progressive";
+        }
+        else if (optimize)
+        {
+            info += " Optimized Huffman";
         }
 
-        for (int i = 0; i < 8; ++i)
+        horizontal_mcus = (width + mcu_width - 1) / mcu_width;
+        vertical_mcus   = (height + mcu_height - 1) / mcu_height;
+
+        rows_in_bottom_mcus = height - (vertical_mcus - 1) * mcu_height;
+        cols_in_right_mcus  = width  - (horizontal_mcus - 1) * mcu_width;
+
+        mcu_width_size = mcu_width * bytes_per_pixel;
+
+        init_quantization_tables(quality);
+    }
+
+    jpeg_encode::~jpeg_encode()
+    {
+    }
+
+    void jpeg_encode::init_quantization_tables(u32 quality)
+    {
+        for (int i = 0; i < 64; ++i)
         {
-            s16 x8 = temp [i +  0] + temp [i + 56];
-            s16 x0 = temp [i +  0] - temp [i + 56];
-            s16 x7 = temp [i +  8] + temp [i + 48];
-            s16 x1 = temp [i +  8] - temp [i + 48];
-            s16 x6 = temp [i + 16] + temp [i + 40];
-            s16 x2 = temp [i + 16] - temp [i + 40];
-            s16 x5 = temp [i + 24] + temp [i + 32];
-            s16 x3 = temp [i + 24] - temp [i + 32];
-            s16 x4 = x8 + x5;
-            x8 = x8 - x5;
-            x5 = x7 + x6;
-            x7 = x7 - x6;
-            s16 v0 = (x4 + x5) >> 3;
-            s16 v4 = (x4 - x5) >> 3;
-            s16 v2 = (x8 * c2 + x7 * c6) >> 13;
-            s16 v6 = (x8 * c6 - x7 * c2) >> 13;
-            s16 v7 = (x0 * c7 - x1 * c5 + x2 * c3 - x3 * c1) >> 13;
-            s16 v5 = (x0 * c5 - x1 * c1 + x2 * c7 + x3 * c3) >> 13;
-            s16 v3 = (x0 * c3 - x1 * c7 - x2 * c1 - x3 * c5) >> 13;
-            s16 v1 = (x0 * c1 + x1 * c3 + x2 * c5 + x3 * c7) >> 13;
-            dest[i + 8 * 0] = (v0 * quant_table[i + 8 * 0] + 0x4000) >> 15;
-            dest[i + 8 * 1] = (v1 * quant_table[i + 8 * 1] + 0x4000) >> 15;
-            dest[i + 8 * 2] = (v2 * quant_table[i + 8 * 2] + 0x4000) >> 15;
-            dest[i + 8 * 3] = (v3 * quant_table[i + 8 * 3] + 0x4000) >> 15;
-            dest[i + 8 * 4] = (v4 * quant_table[i + 8 * 4] + 0x4000) >> 15;
-            dest[i + 8 * 5] = (v5 * quant_table[i + 8 * 5] + 0x4000) >> 15;
-            dest[i + 8 * 6] = (v6 * quant_table[i + 8 * 6] + 0x4000) >> 15;
-            dest[i + 8 * 7] = (v7 * quant_table[i + 8 * 7] + 0x4000) >> 15;
+            u16 index = zigzag_table [i];
+            u32 value;
+
+            // luminance quantization table * quality factor
+            value = luminance_quant_table [i] * quality;
+            value = (value + 0x200) >> 10;
+
+            if (value < 2)
+                value = 2;
+            else if (value > 255)
+                value = 255;
+
+            Lqt [index] = (u8) value;
+            ILqt [i] = u16(0x8000 / value);
+
+            // chrominance quantization table * quality factor
+            value = chrominance_quant_table [i] * quality;
+            value = (value + 0x200) >> 10;
+
+            if (value < 2)
+                value = 2;
+            else if (value > 255)
+                value = 255;
+
+            Cqt [index] = (u8) value;
+            ICqt [i] = u16(0x8000 / value);
         }
     }
 
-#endif
+    static
+    u8 getSymbol(int index)
+    {
+        return u8(index);
+    }
 
-    // ----------------------------------------------------------------------------
-    // read_xxx_format
-    // ----------------------------------------------------------------------------
+    void jpeg_encode::init_huffman_tables(const HuffmanStatistics& stats)
+    {
+        const int tables = channel_count > 1 ? 2 : 1;
 
-    static
-    void read_y_format(s16* block, const u8* input, int stride, int rows, int cols)
+        for (int i = 0; i < tables; ++i)
+        {
+            dc_table[i].build(codes[i].dc_code, codes[i].dc_size, stats.dc[i], 12, getSymbol);
+            ac_table[i].build(codes[i].ac_code, codes[i].ac_size, stats.ac[i], 162, getSymbolAC);
+        }
+    }
+
+    void jpeg_encode::read_mcu(s16* dest, const u8* input, int stride, int rows, int cols) const
     {
-        for (int i = 0; i < rows; ++i)
+        if (!downsample)
         {
-            const u8* scan = input;
-            for (int j = cols; j > 0; --j)
-            {
-                *block++ = (*scan++) - 128;
-            }
+            auto func = (rows == 8 && cols == 8) ? read_8x8 : read;
+            func(dest, input, stride, rows, cols);
+            return;
+        }
 
-            // replicate last column
-            for (int j = 8 - cols; j > 0; --j)
-            {
-                *block = *(block - 1);
-                ++block;
-            }
+        // read the MCU in 8x8 blocks at full resolution and downsample the chroma
+        const int xblocks = mcu_width / 8;
+        const int yblocks = mcu_height / 8;
+        const int luminance_blocks = xblocks * yblocks;
 
-            input += stride;
-        }
+        s16 temp[BLOCK_SIZE * 3 * 4];
 
-        // replicate last row
-        for (int i = 8 - rows; i > 0; --i)
+        for (int y = 0; y < yblocks; ++y)
         {
-            for (int j = 8; j > 0; --j)
+            // blocks outside of the image replicate the last row
+            const int y0 = std::min(y * 8, rows - 1);
+            const int height = std::min(8, rows - y0);
+
+            for (int x = 0; x < xblocks; ++x)
             {
-                *block = *(block - 8);
-                ++block;
+                // blocks outside of the image replicate the last column
+                const int x0 = std::min(x * 8, cols - 1);
+                const int width = std::min(8, cols - x0);
+
+                const int index = y * xblocks + x;
+                s16* block = temp + index * BLOCK_SIZE * 3;
+
+                auto func = (height == 8 && width == 8) ? read_8x8 : read;
+                func(block, input + y0 * stride + x0 * bytes_per_pixel, stride, height, width);
+
+                std::memcpy(dest + index * BLOCK_SIZE, block, BLOCK_SIZE * sizeof(s16));
             }
         }
+
+        downsample(dest + (luminance_blocks + 0) * BLOCK_SIZE, temp + BLOCK_SIZE * 1);
+        downsample(dest + (luminance_blocks + 1) * BLOCK_SIZE, temp + BLOCK_SIZE * 2);
     }
 
-    static
-    void read_bgr_format(s16* block, const u8* input, int stride, int rows, int cols)
+    void jpeg_encode::transform_mcu(s16* dest, const u8* input, int stride, int rows, int cols) const
     {
-        for (int i = 0; i < rows; ++i)
+        s16 temp[BLOCK_SIZE * 6];
+        read_mcu(temp, input, stride, rows, cols);
+
+        for (int i = 0; i < blocks_in_mcu; ++i)
         {
-            const u8* scan = input;
-            for (int j = 0; j < cols; ++j)
-            {
-                int r = scan[2];
-                int g = scan[1];
-                int b = scan[0];
-                int y = (76 * r + 151 * g + 29 * b) >> 8;
-                int cr = ((r - y) * 182) >> 8;
-                int cb = ((b - y) * 144) >> 8;
-                block[0 * 64] = s16(y - 128);
-                block[1 * 64] = s16(cb);
-                block[2 * 64] = s16(cr);
-                ++block;
-                scan += 3;
-            }
+            fdct(dest + i * BLOCK_SIZE, temp + i * BLOCK_SIZE, block[i].qtable);
+        }
+    }
 
-            // replicate last column
-            for (int j = 8 - cols; j > 0; --j)
-            {
-                block[0 * 64] = block[0 * 64 - 1];
-                block[1 * 64] = block[1 * 64 - 1];
-                block[2 * 64] = block[2 * 64 - 1];
-                ++block;
-            }
+    void jpeg_encode::write_markers(BigEndianStream& p, Sample sample, u32 width, u32 height)
+    {
+        // Start of image marker
+        p.write16(0xffd8);
 
-            input += stride;
+        // Quantization table marker
+        p.write16(0xffdb);
+        p.write16(0x43); // quantization table length
+        p.write8(0x00); // Pq, Tq
 
-        }
-        // replicate last row
-        for (int i = 8 - rows; i > 0; --i)
+        // Lqt table
+        p.write(Lqt, 64);
+
+        // Quantization table marker
+        p.write16(0xffdb);
+        p.write16(0x43); // quantization table length
+        p.write8(0x01); // Pq, Tq
+
+        // Cqt table
+        p.write(Cqt, 64);
+
+        // Start of frame marker
+        p.write16(progressive ? 0xffc2 : 0xffc0);
+
+        u8 number_of_components = 0;
+
+        switch (sample)
         {
-            for (int j = 8; j > 0; --j)
-            {
-                block[0 * 64] = block[0 * 64 - 8];
-                block[1 * 64] = block[1 * 64 - 8];
-                block[2 * 64] = block[2 * 64 - 8];
-                ++block;
-            }
+            case JPEG_U8_Y:
+                number_of_components = 1;
+                break;
+
+            case JPEG_U8_RGB:
+            case JPEG_U8_BGR:
+            case JPEG_U8_BGRA:
+            case JPEG_U8_RGBA:
+                number_of_components = 3;
+                break;
         }
-    }
 
-    static
-    void read_rgb_format(s16* block, const u8* input, int stride, int rows, int cols)
-    {
-        for (int i = 0; i < rows; ++i)
+        u16 header_length = 8 + 3 * number_of_components;
+
+        p.write16(header_length); // frame header length
+        p.write8(8); // precision
+        p.write16(u16(height)); // image height
+        p.write16(u16(width)); // image width
+        p.write8(number_of_components); // Nf
+
+        u8 nfdata[] =
         {
-            const u8* scan = input;
-            for (int j = 0; j < cols; ++j)
-            {
-                int r = scan[0];
-                int g = scan[1];
-                int b = scan[2];
-                int y = (76 * r + 151 * g + 29 * b) >> 8;
-                int cr = ((r - y) * 182) >> 8;
-                int cb = ((b - y) * 144) >> 8;
-                block[0 * 64] = s16(y - 128);
-                block[1 * 64] = s16(cb);
-                block[2 * 64] = s16(cr);
-                ++block;
-                scan += 3;
-            }
+            0x01, 0x11, 0x00, // component 1
+            0x00, 0x00, 0x00, // padding
+            0x01, 0x11, 0x00, // component 1
+            0x02, 0x11, 0x01, // component 2
+            0x03, 0x11, 0x01, // component 3
+        };
 
-            // replicate last column
-            for (int j = 8 - cols; j > 0; --j)
-            {
-                block[0 * 64] = block[0 * 64 - 1];
-                block[1 * 64] = block[1 * 64 - 1];
-                block[2 * 64] = block[2 * 64 - 1];
-                ++block;
-            }
+        // luminance sampling factors
+        nfdata[7] = u8(((mcu_width / 8) << 4) | (mcu_height / 8));
 
-            input += stride;
+        p.write(nfdata + (number_of_components - 1) * 3, number_of_components * 3);
+
+        if (progressive)
+        {
+            // each scan writes its own huffman tables and header
+            return;
         }
 
-        // replicate last row
-        for (int i = 8 - rows; i > 0; --i)
+        // huffman table(DHT)
+        if (optimize)
         {
-            for (int j = 8; j > 0; --j)
+            dc_table[0].write(p, 0x00);
+            ac_table[0].write(p, 0x10);
+
+            if (number_of_components > 1)
             {
-                block[0 * 64] = block[0 * 64 - 8];
-                block[1 * 64] = block[1 * 64 - 8];
-                block[2 * 64] = block[2 * 64 - 8];
-                ++block;
+                dc_table[1].write(p, 0x01);
+                ac_table[1].write(p, 0x11);
             }
         }
+        else
+        {
+            p.write(marker_data, sizeof(marker_data));
+        }
+
+        // Define Restart Interval marker
+        p.write16(0xffdd);
+        p.write16(4);
+        p.write16(horizontal_mcus);
+
+        // Start of scan marker
+        p.write16(0xffda);
+        p.write16(6 + number_of_components * 2); // header length
+        p.write8(number_of_components); // Ns
+
+        const u8 nsdata[] =
+        {
+            0x01, 0x00,
+            0x02, 0x11,
+            0x03, 0x11,
+        };
+
+        p.write(nsdata, number_of_components * 2);
+        p.write8(0x00);
+        p.write8(0x3f);
+        p.write8(0x00);
     }
 
-    static
-    void read_bgra_format(s16* block, const u8* input, int stride, int rows, int cols)
+    // ----------------------------------------------------------------------------
+    // encodeJPEG()
+    // ----------------------------------------------------------------------------
+
+    // Encode one MCU scan; the MCUs are transformed on the fly or read from
+    // the coefficients computed in the optimization pass.
+    void encodeScan(EncodeBuffer& buffer, const jpeg_encode& jp, const u8* image, int stride, int rows, const s16* coefficients)
     {
-        for (int i = 0; i < rows; ++i)
+        HuffmanEncoder huffman(jp.codes);
+
+        constexpr int buffer_size = 2048;
+        constexpr int flush_threshold = buffer_size - 512;
+
+        u8 huff_temp[buffer_size]; // encoding buffer
+        u8* ptr = huff_temp;
+
+        const int right_mcu = jp.horizontal_mcus - 1;
+
+        for (int x = 0; x < jp.horizontal_mcus; ++x)
         {
-            const u8* scan = input;
-            for (int j = 0; j < cols; ++j)
-            {
-                s16 r = scan[2];
-                s16 g = scan[1];
-                s16 b = scan[0];
-                s16 y = (76 * r + 151 * g + 29 * b) >> 8;
-                s16 cr = ((r - y) * 182) >> 8;
-                s16 cb = ((b - y) * 144) >> 8;
-                block[0 * 64] = s16(y - 128);
-                block[1 * 64] = s16(cb);
-                block[2 * 64] = s16(cr);
-                ++block;
-                scan += 4;
-            }
+            s16 temp[BLOCK_SIZE * 6];
+            const s16* data = coefficients;
 
-            // replicate last column
-            for (int j = 8 - cols; j > 0; --j)
+            if (coefficients)
             {
-                block[0 * 64] = block[0 * 64 - 1];
-                block[1 * 64] = block[1 * 64 - 1];
-                block[2 * 64] = block[2 * 64 - 1];
-                ++block;
+                coefficients += jp.blocks_in_mcu * BLOCK_SIZE;
             }
+            else
+            {
+                // clipping
+                int cols = x < right_mcu ? jp.mcu_width : jp.cols_in_right_mcus;
 
-            input += stride;
-        }
+                jp.transform_mcu(temp, image, stride, rows, cols);
+                data = temp;
 
-        // replicate last row
-        for (int i = 8 - rows; i > 0; --i)
-        {
-            for (int j = 8; j > 0; --j)
+                image += jp.mcu_width_size;
+            }
+
+            // encode the data in MCU
+            for (int i = 0; i < jp.blocks_in_mcu; ++i)
             {
-                block[0 * 64] = block[0 * 64 - 8];
-                block[1 * 64] = block[1 * 64 - 8];
-                block[2 * 64] = block[2 * 64 - 8];
-                ++block;
+                ptr = huffman.encode(ptr, jp.block[i].component, data + i * BLOCK_SIZE);
+
+                // flush encoding buffer
+                if (ptr - huff_temp > flush_threshold)
+                {
+                    buffer.append(huff_temp, ptr - huff_temp);
+                    ptr = huff_temp;
+                }
             }
         }
+
+        // flush encoding buffer
+        ptr = huffman.flush(ptr);
+        buffer.append(huff_temp, ptr - huff_temp);
+
+        // mark buffer ready for writing
+        buffer.ready = true;
     }
 
-    static
-    void read_rgba_format(s16* block, const u8* input, int stride, int rows, int cols)
+    // Encode progressive scans from the quantized coefficients. Each block row of
+    // a scan is a restart interval so that the statistics and the bitstream for
+    // all scans can be computed in parallel.
+
+    struct ProgressiveComponent
     {
-        for (int i = 0; i < rows; ++i)
+        int h;          // horizontal blocks in MCU
+        int v;          // vertical blocks in MCU
+        int offset;     // first block in MCU
+        int xblocks;    // blocks in restart interval
+        int yblocks;    // restart intervals in scan
+    };
+
+    struct ProgressiveScanState
+    {
+        const ProgressiveScan* scan;
+        int intervals;
+        int blocks;
+        int first;  // first encode buffer
+
+        std::mutex mutex;
+        u32 frequency[2][256];
+        HuffmanTable table[2];
+        ScanCodes codes[2];
+    };
+
+    template <typename Emitter>
+    void encodeProgressiveInterval(const Emitter& emitter, const jpeg_encode& jp, const ProgressiveComponent* components,
+                                   const ProgressiveScan& scan, const s16* coefficients, int y, EncodeBuffer* buffer)
+    {
+        ProgressiveEncoder<Emitter> encoder(emitter);
+
+        constexpr int buffer_size = 2048;
+        constexpr int flush_threshold = buffer_size - 512;
+
+        u8 huff_temp[buffer_size]; // encoding buffer
+        u8* ptr = huff_temp;
+
+        const int mcu_size = jp.blocks_in_mcu * BLOCK_SIZE;
+
+        auto flush = [&] (int threshold)
         {
-            const u8* scan = input;
-            for (int j = 0; j < cols; ++j)
+            if (ptr - huff_temp > threshold)
             {
-                int r = scan[0];
-                int g = scan[1];
-                int b = scan[2];
-                int y = (76 * r + 151 * g + 29 * b) >> 8;
-                int cr = ((r - y) * 182) >> 8;
-                int cb = ((b - y) * 144) >> 8;
-                block[0 * 64] = s16(y - 128);
-                block[1 * 64] = s16(cb);
-                block[2 * 64] = s16(cr);
-                ++block;
-                scan += 4;
+                buffer->append(huff_temp, ptr - huff_temp);
+                ptr = huff_temp;
             }
+        };
 
-            // replicate last column
-            for (int j = 8 - cols; j > 0; --j)
+        if (scan.count > 1)
+        {
+            // interleaved scan: every block in the MCU
+            const s16* data = coefficients + size_t(y) * jp.horizontal_mcus * mcu_size;
+
+            for (int x = 0; x < jp.horizontal_mcus; ++x)
             {
-                block[0 * 64] = block[0 * 64 - 1];
-                block[1 * 64] = block[1 * 64 - 1];
-                block[2 * 64] = block[2 * 64 - 1];
-                ++block;
-            }
+                for (int i = 0; i < jp.blocks_in_mcu; ++i)
+                {
+                    int component = jp.block[i].component - 1;
+                    ptr = encoder.encode(ptr, component ? 1 : 0, component, data + i * BLOCK_SIZE, scan);
+                }
 
-            input += stride;
+                flush(flush_threshold);
+                data += mcu_size;
+            }
         }
-
-        // replicate last row
-        for (int i = 8 - rows; i > 0; --i)
+        else
         {
-            for (int j = 8; j > 0; --j)
+            // non-interleaved scan: blocks of one component in raster order
+            const int component = scan.component[0];
+            const ProgressiveComponent& c = components[component];
+
+            const s16* data = coefficients + size_t(y / c.v) * jp.horizontal_mcus * mcu_size;
+            data += (c.offset + (y % c.v) * c.h) * BLOCK_SIZE;
+
+            for (int x = 0; x < c.xblocks; ++x)
             {
-                block[0 * 64] = block[0 * 64 - 8];
-                block[1 * 64] = block[1 * 64 - 8];
-                block[2 * 64] = block[2 * 64 - 8];
-                ++block;
+                const s16* block = data + (x / c.h) * mcu_size + (x % c.h) * BLOCK_SIZE;
+                ptr = encoder.encode(ptr, 0, component, block, scan);
+                flush(flush_threshold);
             }
         }
-    }
 
-#if defined(JPEG_ENABLE_SSE2)
+        ptr = encoder.flush(ptr);
 
-    static
-    void read_y_format_sse2(s16* block, const u8* input, int stride, int rows, int cols)
+        if (buffer)
+        {
+            flush(0);
+            buffer->ready = true;
+        }
+    }
+
+    void encodeProgressive(jpeg_encode& jp, const s16* coefficients, int width, int height, Sample sample, Stream& stream, ConcurrentQueue& queue)
     {
-        MANGO_UNREFERENCED(rows);
-        MANGO_UNREFERENCED(cols);
+        ProgressiveComponent components[3];
 
-        // load
-        __m128i v0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
-        __m128i v1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
-        __m128i v2 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
-        __m128i v3 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
-        __m128i v4 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
-        __m128i v5 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
-        __m128i v6 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)); input += stride;
-        __m128i v7 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input));
+        const int hmax = jp.mcu_width / 8;
+        const int vmax = jp.mcu_height / 8;
 
-        // adjust bias
-        __m128i bias = _mm_set1_epi8(-128);
-        v0 = _mm_sub_epi8(v0, bias);
-        v1 = _mm_sub_epi8(v1, bias);
-        v2 = _mm_sub_epi8(v2, bias);
-        v3 = _mm_sub_epi8(v3, bias);
-        v4 = _mm_sub_epi8(v4, bias);
-        v5 = _mm_sub_epi8(v5, bias);
-        v6 = _mm_sub_epi8(v6, bias);
-        v7 = _mm_sub_epi8(v7, bias);
+        for (int i = 0; i < jp.channel_count; ++i)
+        {
+            ProgressiveComponent& c = components[i];
+            c.h = i ? 1 : hmax;
+            c.v = i ? 1 : vmax;
+            c.offset = i ? hmax * vmax + i - 1 : 0;
+
+            // component dimensions are rounded up from the image dimensions
+            int w = ceil_div(width * c.h, hmax);
+            int h = ceil_div(height * c.v, vmax);
+            c.xblocks = ceil_div(w, 8);
+            c.yblocks = ceil_div(h, 8);
+        }
 
-        // sign-extend
-#if defined(JPEG_ENABLE_SSE4)
-        v0 = _mm_cvtepi8_epi16(v0);
-        v1 = _mm_cvtepi8_epi16(v1);
-        v2 = _mm_cvtepi8_epi16(v2);
-        v3 = _mm_cvtepi8_epi16(v3);
-        v4 = _mm_cvtepi8_epi16(v4);
-        v5 = _mm_cvtepi8_epi16(v5);
-        v6 = _mm_cvtepi8_epi16(v6);
-        v7 = _mm_cvtepi8_epi16(v7);
-#else
-        __m128i zero = _mm_setzero_si128();
-        v0 = _mm_unpacklo_epi8(v0, _mm_cmpgt_epi8(zero, v0));
-        v1 = _mm_unpacklo_epi8(v1, _mm_cmpgt_epi8(zero, v1));
-        v2 = _mm_unpacklo_epi8(v2, _mm_cmpgt_epi8(zero, v2));
-        v3 = _mm_unpacklo_epi8(v3, _mm_cmpgt_epi8(zero, v3));
-        v4 = _mm_unpacklo_epi8(v4, _mm_cmpgt_epi8(zero, v4));
-        v5 = _mm_unpacklo_epi8(v5, _mm_cmpgt_epi8(zero, v5));
-        v6 = _mm_unpacklo_epi8(v6, _mm_cmpgt_epi8(zero, v6));
-        v7 = _mm_unpacklo_epi8(v7, _mm_cmpgt_epi8(zero, v7));
-#endif
+        const ProgressiveScan* script = g_progressive_scans_y;
+        int scan_count = int(sizeof(g_progressive_scans_y) / sizeof(ProgressiveScan));
 
-        // store
-        __m128i* dest = reinterpret_cast<__m128i*>(block);
-        _mm_storeu_si128(dest + 0, v0);
-        _mm_storeu_si128(dest + 1, v1);
-        _mm_storeu_si128(dest + 2, v2);
-        _mm_storeu_si128(dest + 3, v3);
-        _mm_storeu_si128(dest + 4, v4);
-        _mm_storeu_si128(dest + 5, v5);
-        _mm_storeu_si128(dest + 6, v6);
-        _mm_storeu_si128(dest + 7, v7);
-    }
+        if (jp.channel_count > 1)
+        {
+            script = g_progressive_scans_ycbcr;
+            scan_count = int(sizeof(g_progressive_scans_ycbcr) / sizeof(ProgressiveScan));
+        }
 
-    static
-    void read_bgra_format_sse2(s16* block, const u8* input, int stride, int rows, int cols)
-    {
-        MANGO_UNREFERENCED(rows);
-        MANGO_UNREFERENCED(cols);
+        std::vector<ProgressiveScanState> scans(scan_count);
+        int buffer_count = 0;
 
-        __m128i* dest = reinterpret_cast<__m128i*>(block);
+        for (int i = 0; i < scan_count; ++i)
+        {
+            ProgressiveScanState& state = scans[i];
+            state.scan = script + i;
 
-        const __m128i mask = _mm_set1_epi32(0xff);
-        const __m128i c76 = _mm_set1_epi16(76);
-        const __m128i c151 = _mm_set1_epi16(151);
-        const __m128i c29 = _mm_set1_epi16(29);
-        const __m128i c128 = _mm_set1_epi16(128);
-        const __m128i c182 = _mm_set1_epi16(182);
-        const __m128i c144 = _mm_set1_epi16(144);
+            if (state.scan->count > 1)
+            {
+                state.intervals = jp.vertical_mcus;
+                state.blocks = jp.horizontal_mcus;
+            }
+            else
+            {
+                const ProgressiveComponent& c = components[state.scan->component[0]];
+                state.intervals = c.yblocks;
+                state.blocks = c.xblocks;
+            }
 
-        for (int y = 0; y < 8; ++y)
+            state.first = buffer_count;
+            buffer_count += state.intervals;
+
+            std::memset(state.frequency, 0, sizeof(state.frequency));
+        }
+
+        // gather symbol statistics
+        for (auto& state : scans)
         {
-            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
-            input += stride;
+            // DC refinement scans do not use huffman coding
+            if (state.scan->Ss == 0 && state.scan->Ah)
+                continue;
 
-            // load, unpack
-            __m128i b0 = _mm_loadu_si128(ptr + 0);
-            __m128i b1 = _mm_loadu_si128(ptr + 1);
-            __m128i g0 = _mm_srli_epi32(b0, 8);
-            __m128i r0 = _mm_srli_epi32(b0, 16);
-            __m128i g1 = _mm_srli_epi32(b1, 8);
-            __m128i r1 = _mm_srli_epi32(b1, 16);
-            b0 = _mm_and_si128(b0, mask);
-            b1 = _mm_and_si128(b1, mask);
-            g0 = _mm_and_si128(g0, mask);
-            g1 = _mm_and_si128(g1, mask);
-            r0 = _mm_and_si128(r0, mask);
-            r1 = _mm_and_si128(r1, mask);
-            __m128i b = _mm_packs_epi32(b0, b1);
-            __m128i g = _mm_packs_epi32(g0, g1);
-            __m128i r = _mm_packs_epi32(r0, r1);
+            for (int y = 0; y < state.intervals; ++y)
+            {
+                queue.enqueue([&jp, &components, &state, coefficients, y]
+                {
+                    u32 frequency[2][256] = { { 0 } };
+                    SymbolCounter counter { frequency };
 
-            // compute luminance
-            __m128i s0 = _mm_mullo_epi16(r, c76);
-            __m128i s1 = _mm_mullo_epi16(g, c151);
-            __m128i s2 = _mm_mullo_epi16(b, c29);
-            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
-            s = _mm_srli_epi16(s, 8);
+                    encodeProgressiveInterval(counter, jp, components, *state.scan, coefficients, y, nullptr);
 
-            // compute chroma
-            __m128i cr = _mm_sub_epi16(r, s);
-            __m128i cb = _mm_sub_epi16(b, s);
-            cr = _mm_mullo_epi16(cr, c182);
-            cb = _mm_mullo_epi16(cb, c144);
-            cr = _mm_srai_epi16(cr, 8);
-            cb = _mm_srai_epi16(cb, 8);
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    for (int i = 0; i < 2; ++i)
+                    {
+                        for (int j = 0; j < 256; ++j)
+                        {
+                            state.frequency[i][j] += frequency[i][j];
+                        }
+                    }
+                });
+            }
+        }
 
-            // adjust bias
-            s = _mm_sub_epi16(s, c128);
+        queue.wait();
 
-            // store
-            _mm_storeu_si128(dest + y + 0, s);
-            _mm_storeu_si128(dest + y + 8, cb);
-            _mm_storeu_si128(dest + y + 16, cr);
+        // build huffman tables
+        for (auto& state : scans)
+        {
+            const ProgressiveScan& scan = *state.scan;
+            if (scan.Ss == 0 && scan.Ah)
+                continue;
+
+            const int tables = (scan.Ss == 0 && scan.count > 1) ? 2 : 1;
+            for (int i = 0; i < tables; ++i)
+            {
+                state.table[i].build(state.codes[i].code, state.codes[i].size, state.frequency[i], 256, getSymbol);
+            }
         }
-    }
 
-    static
-    void read_rgba_format_sse2(s16* block, const u8* input, int stride, int rows, int cols)
-    {
-        MANGO_UNREFERENCED(rows);
-        MANGO_UNREFERENCED(cols);
+        // encode scans
+        std::vector<EncodeBuffer> buffers(buffer_count);
 
-        __m128i* dest = reinterpret_cast<__m128i*>(block);
+        for (auto& state : scans)
+        {
+            for (int y = 0; y < state.intervals; ++y)
+            {
+                EncodeBuffer* buffer = &buffers[state.first + y];
 
-        const __m128i mask = _mm_set1_epi32(0xff);
-        const __m128i c76 = _mm_set1_epi16(76);
-        const __m128i c151 = _mm_set1_epi16(151);
-        const __m128i c29 = _mm_set1_epi16(29);
-        const __m128i c128 = _mm_set1_epi16(128);
-        const __m128i c182 = _mm_set1_epi16(182);
-        const __m128i c144 = _mm_set1_epi16(144);
+                queue.enqueue([&jp, &components, &state, coefficients, y, buffer]
+                {
+                    SymbolWriter writer;
+                    writer.codes = state.codes;
 
-        for (int y = 0; y < 8; ++y)
+                    encodeProgressiveInterval(writer, jp, components, *state.scan, coefficients, y, buffer);
+                });
+            }
+        }
+
+        BigEndianStream s(stream);
+
+        // writing marker data
+        jp.write_markers(s, sample, width, height);
+
+        for (auto& state : scans)
         {
-            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
-            input += stride;
+            const ProgressiveScan& scan = *state.scan;
 
-            // load, unpack
-            __m128i r0 = _mm_loadu_si128(ptr + 0);
-            __m128i r1 = _mm_loadu_si128(ptr + 1);
-            __m128i g0 = _mm_srli_epi32(r0, 8);
-            __m128i b0 = _mm_srli_epi32(r0, 16);
-            __m128i g1 = _mm_srli_epi32(r1, 8);
-            __m128i b1 = _mm_srli_epi32(r1, 16);
-            b0 = _mm_and_si128(b0, mask);
-            b1 = _mm_and_si128(b1, mask);
-            g0 = _mm_and_si128(g0, mask);
-            g1 = _mm_and_si128(g1, mask);
-            r0 = _mm_and_si128(r0, mask);
-            r1 = _mm_and_si128(r1, mask);
-            __m128i b = _mm_packs_epi32(b0, b1);
-            __m128i g = _mm_packs_epi32(g0, g1);
-            __m128i r = _mm_packs_epi32(r0, r1);
+            // huffman tables (DHT)
+            if (scan.Ss == 0)
+            {
+                if (!scan.Ah)
+                {
+                    state.table[0].write(s, 0x00);
+                    if (scan.count > 1)
+                    {
+                        state.table[1].write(s, 0x01);
+                    }
+                }
+            }
+            else
+            {
+                state.table[0].write(s, 0x10);
+            }
 
-            // compute luminance
-            __m128i s0 = _mm_mullo_epi16(r, c76);
-            __m128i s1 = _mm_mullo_epi16(g, c151);
-            __m128i s2 = _mm_mullo_epi16(b, c29);
-            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
-            s = _mm_srli_epi16(s, 8);
+            // Define Restart Interval marker
+            s.write16(0xffdd);
+            s.write16(4);
+            s.write16(u16(state.blocks));
+
+            // Start of scan marker
+            s.write16(0xffda);
+            s.write16(u16(6 + scan.count * 2)); // header length
+            s.write8(u8(scan.count)); // Ns
 
-            // compute chroma
-            __m128i cr = _mm_sub_epi16(r, s);
-            __m128i cb = _mm_sub_epi16(b, s);
-            cr = _mm_mullo_epi16(cr, c182);
-            cb = _mm_mullo_epi16(cb, c144);
-            cr = _mm_srai_epi16(cr, 8);
-            cb = _mm_srai_epi16(cb, 8);
+            for (int i = 0; i < scan.count; ++i)
+            {
+                int component = scan.component[i];
+                s.write8(u8(component + 1));
+                s.write8(scan.Ss == 0 && component ? 0x10 : 0x00);
+            }
 
-            // adjust bias
-            s = _mm_sub_epi16(s, c128);
+            s.write8(u8(scan.Ss));
+            s.write8(u8(scan.Se));
+            s.write8(u8((scan.Ah << 4) | scan.Al));
 
-            // store
-            _mm_storeu_si128(dest + y + 0, s);
-            _mm_storeu_si128(dest + y + 8, cb);
-            _mm_storeu_si128(dest + y + 16, cr);
+            for (int y = 0; y < state.intervals; ++y)
+            {
+                EncodeBuffer& buffer = buffers[state.first + y];
+
+                for ( ; !buffer.ready; )
+                {
+                    // buffer is not processed yet; help the thread pool while waiting
+                    queue.steal();
+                }
+
+                stream.write(buffer.data(), buffer.size());
+
+                // restart marker between intervals
+                if (y < state.intervals - 1)
+                {
+                    s.write16(0xffd0 + (y & 7));
+                }
+            }
         }
+
+        // EOI marker
+        s.write16(0xffd9);
     }
 
-#endif // JPEG_ENABLE_SSE2
+    void encodeJPEG(ImageEncodeStatus& status, const Surface& surface, Stream& stream, int quality, Sample sample, int subsampling, bool optimize, bool progressive)
+    {
+        jpeg_encode jp(sample, surface.width, surface.height, surface.stride, quality, subsampling, optimize, progressive);
 
-#if defined(JPEG_ENABLE_SSE4)
+        const u8* input = surface.image;
+        int stride = surface.stride;
 
-    static
-    void read_bgr_format_ssse3(s16* block, const u8* input, int stride, int rows, int cols)
-    {
-        MANGO_UNREFERENCED(rows);
-        MANGO_UNREFERENCED(cols);
+        const int bottom_mcu = jp.vertical_mcus - 1;
+        const size_t scan_size = size_t(jp.horizontal_mcus) * jp.blocks_in_mcu * BLOCK_SIZE;
 
-        __m128i* dest = reinterpret_cast<__m128i*>(block);
+        // bitstream for each MCU scan
+        std::vector<EncodeBuffer> buffers(jp.vertical_mcus);
 
-        const __m128i c76 = _mm_set1_epi16(76);
-        const __m128i c151 = _mm_set1_epi16(151);
-        const __m128i c29 = _mm_set1_epi16(29);
-        const __m128i c128 = _mm_set1_epi16(128);
-        const __m128i c182 = _mm_set1_epi16(182);
-        const __m128i c144 = _mm_set1_epi16(144);
+        // quantized coefficients for the two-pass and progressive encoding
+        const bool multipass = optimize || progressive;
+        AlignedPointer<s16> coefficients(multipass ? scan_size * jp.vertical_mcus : 0);
 
-        for (int y = 0; y < 8; ++y)
+        ConcurrentQueue queue;
+        BigEndianStream s(stream);
+
+        if (multipass)
         {
-            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
-            input += stride;
+            // transform the image and gather symbol statistics for each MCU scan
+            std::vector<HuffmanStatistics> statistics(jp.vertical_mcus);
 
-            // load
-            __m128i v0 = _mm_loadu_si128(ptr + 0);
-            __m128i v1 = _mm_loadl_epi64(ptr + 1);
+            for (int y = 0; y < jp.vertical_mcus; ++y)
+            {
+                // clipping
+                int rows = y < bottom_mcu ? jp.mcu_height : jp.rows_in_bottom_mcus;
 
-            // unpack
-            constexpr u8 n = 0x80;
-            __m128i b0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(0, n, 3, n, 6, n, 9, n, 12, n, 15, n, n, n, n, n));
-            __m128i b1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, n, n, 2, n, 5, n));
-            __m128i g0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(1, n, 4, n, 7, n, 10, n, 13, n, n, n, n, n, n, n));
-            __m128i g1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 0, n, 3, n, 6, n));
-            __m128i r0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(2, n, 5, n, 8, n, 11, n, 14, n, n, n, n, n, n, n));
-            __m128i r1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 1, n, 4, n, 7, n));
-           __m128i b = _mm_or_si128(b0, b1);
-           __m128i g = _mm_or_si128(g0, g1);
-           __m128i r = _mm_or_si128(r0, r1);
+                s16* data = coefficients + y * scan_size;
+                const u8* image = input + y * jp.mcu_height * stride;
 
-            // compute luminance
-            __m128i s0 = _mm_mullo_epi16(r, c76);
-            __m128i s1 = _mm_mullo_epi16(g, c151);
-            __m128i s2 = _mm_mullo_epi16(b, c29);
-            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
-            s = _mm_srli_epi16(s, 8);
+                queue.enqueue([&jp, &statistics, y, data, image, stride, rows]
+                {
+                    HuffmanEncoder huffman(jp.codes);
+                    HuffmanStatistics& stats = statistics[y];
 
-            // compute chroma
-            __m128i cr = _mm_sub_epi16(r, s);
-            __m128i cb = _mm_sub_epi16(b, s);
-            cr = _mm_mullo_epi16(cr, c182);
-            cb = _mm_mullo_epi16(cb, c144);
-            cr = _mm_srai_epi16(cr, 8);
-            cb = _mm_srai_epi16(cb, 8);
+                    const int right_mcu = jp.horizontal_mcus - 1;
 
-            // adjust bias
-            s = _mm_sub_epi16(s, c128);
+                    s16* dest = data;
+                    const u8* source = image;
 
-            // store
-            _mm_storeu_si128(dest + y + 0, s);
-            _mm_storeu_si128(dest + y + 8, cb);
-            _mm_storeu_si128(dest + y + 16, cr);
-        }
-    }
+                    for (int x = 0; x < jp.horizontal_mcus; ++x)
+                    {
+                        // clipping
+                        int cols = x < right_mcu ? jp.mcu_width : jp.cols_in_right_mcus;
 
-    static
-    void read_rgb_format_ssse3(s16* block, const u8* input, int stride, int rows, int cols)
-    {
-        MANGO_UNREFERENCED(rows);
-        MANGO_UNREFERENCED(cols);
+                        jp.transform_mcu(dest, source, stride, rows, cols);
 
-        __m128i* dest = reinterpret_cast<__m128i*>(block);
+                        for (int i = 0; i < jp.blocks_in_mcu && !jp.progressive; ++i)
+                        {
+                            huffman.count(stats, jp.block[i].component, dest + i * BLOCK_SIZE);
+                        }
 
-        const __m128i c76 = _mm_set1_epi16(76);
-        const __m128i c151 = _mm_set1_epi16(151);
-        const __m128i c29 = _mm_set1_epi16(29);
-        const __m128i c128 = _mm_set1_epi16(128);
-        const __m128i c182 = _mm_set1_epi16(182);
-        const __m128i c144 = _mm_set1_epi16(144);
+                        dest += jp.blocks_in_mcu * BLOCK_SIZE;
+                        source += jp.mcu_width_size;
+                    }
+                });
+            }
 
-        for (int y = 0; y < 8; ++y)
+            queue.wait();
+
+            if (progressive)
+            {
+                encodeProgressive(jp, coefficients, surface.width, surface.height, sample, stream, queue);
+                status.info = jp.info;
+                return;
+            }
+
+            HuffmanStatistics stats;
+
+            for (auto& scan : statistics)
+            {
+                stats.add(scan);
+            }
+
+            jp.init_huffman_tables(stats);
+        }
+
+        // encode MCUs
+        for (int y = 0; y < jp.vertical_mcus; ++y)
         {
-            const __m128i* ptr = reinterpret_cast<const __m128i*>(input);
-            input += stride;
+            // clipping
+            int rows = y < bottom_mcu ? jp.mcu_height : jp.rows_in_bottom_mcus;
 
-            // load
-            __m128i v0 = _mm_loadu_si128(ptr + 0);
-            __m128i v1 = _mm_loadl_epi64(ptr + 1);
+            const s16* data = optimize ? coefficients + y * scan_size : nullptr;
+            const u8* image = input + y * jp.mcu_height * stride;
 
-            // unpack
-            constexpr u8 n = 0x80;
-            __m128i r0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(0, n, 3, n, 6, n, 9, n, 12, n, 15, n, n, n, n, n));
-            __m128i r1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, n, n, 2, n, 5, n));
-            __m128i g0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(1, n, 4, n, 7, n, 10, n, 13, n, n, n, n, n, n, n));
-            __m128i g1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 0, n, 3, n, 6, n));
-            __m128i b0 = _mm_shuffle_epi8(v0, _mm_setr_epi8(2, n, 5, n, 8, n, 11, n, 14, n, n, n, n, n, n, n));
-            __m128i b1 = _mm_shuffle_epi8(v1, _mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 1, n, 4, n, 7, n));
-           __m128i b = _mm_or_si128(b0, b1);
-           __m128i g = _mm_or_si128(g0, g1);
-           __m128i r = _mm_or_si128(r0, r1);
+            queue.enqueue([&jp, &buffers, y, data, image, stride, rows]
+            {
+                encodeScan(buffers[y], jp, image, stride, rows, data);
+            });
+        }
 
-            // compute luminance
-            __m128i s0 = _mm_mullo_epi16(r, c76);
-            __m128i s1 = _mm_mullo_epi16(g, c151);
-            __m128i s2 = _mm_mullo_epi16(b, c29);
-            __m128i s = _mm_add_epi16(s0, _mm_add_epi16(s1, s2));
-            s = _mm_srli_epi16(s, 8);
+        // writing marker data
+        jp.write_markers(s, sample, surface.width, surface.height);
 
-            // compute chroma
-            __m128i cr = _mm_sub_epi16(r, s);
-            __m128i cb = _mm_sub_epi16(b, s);
-            cr = _mm_mullo_epi16(cr, c182);
-            cb = _mm_mullo_epi16(cb, c144);
-            cr = _mm_srai_epi16(cr, 8);
-            cb = _mm_srai_epi16(cb, 8);
+        for (int y = 0; y < jp.vertical_mcus; ++y)
+        {
+            EncodeBuffer& buffer = buffers[y];
 
-            // adjust bias
-            s = _mm_sub_epi16(s, c128);
+            for ( ; !buffer.ready; )
+            {
+                // buffer is not processed yet; help the thread pool while waiting
+                queue.steal();
+            }
 
-            // store
-            _mm_storeu_si128(dest + y + 0, s);
-            _mm_storeu_si128(dest + y + 8, cb);
-            _mm_storeu_si128(dest + y + 16, cr);
+            // write huffman bitstream and restart marker
+            const u8 marker[] = { 0xff, u8(0xd0 + (y & 7)) };
+            const ConstMemory segments[] =
+            {
+                ConstMemory(buffer.data(), buffer.size()),
+                ConstMemory(marker, 2)
+            };
+            stream.writev(segments, 2);
         }
-    }
 
-#endif // JPEG_ENABLE_SSE4
+        // EOI marker
+        s.write16(0xffd9);
+
+        status.info = jp.info;
+    }
 
     // ----------------------------------------------------------------------------
-    // jpeg_encode
+    // lossless transform
     // ----------------------------------------------------------------------------
 
-    jpeg_encode::jpeg_encode(Sample sample, u32 width, u32 height, u32 stride, u32 quality)
-        : ILqt(64)
-        , ICqt(64)
+    // The transforms as 2x2 matrices which map the source coordinates into the
+    // transformed coordinates; in the same order as ImageTransform.
+    static const int g_transform_matrix [][4] =
     {
-        int bytes_per_pixel = 0;
-
-        channel_count = 0;
+        {  1,  0,  0,  1 }, // NONE
+        { -1,  0,  0,  1 }, // FLIP_HORIZONTAL
+        {  1,  0,  0, -1 }, // FLIP_VERTICAL
+        {  0,  1,  1,  0 }, // TRANSPOSE
+        {  0, -1, -1,  0 }, // TRANSVERSE
+        {  0, -1,  1,  0 }, // ROTATE_90
+        { -1,  0,  0, -1 }, // ROTATE_180
+        {  0,  1, -1,  0 }, // ROTATE_270
+    };
 
-        channel[0].component = 1;
-        channel[0].qtable = ILqt;
+    static
+    int getTransformedOrientation(int orientation, ImageTransform transform)
+    {
+        // the image is displayed with the EXIF orientation; the new orientation must
+        // display the transformed image the same way: O' = O * T^-1 (T^-1 = transpose of T)
+        const int* a = g_transform_matrix[int(getImageTransform(orientation))];
+        const int* b = g_transform_matrix[int(transform)];
 
-        channel[1].component = 2;
-        channel[1].qtable = ICqt;
+        const int m[] =
+        {
+            a[0] * b[0] + a[1] * b[1], a[0] * b[2] + a[1] * b[3],
+            a[2] * b[0] + a[3] * b[1], a[2] * b[2] + a[3] * b[3],
+        };
 
-        channel[2].component = 3;
-        channel[2].qtable = ICqt;
+        for (int i = 1; i <= 8; ++i)
+        {
+            const int* c = g_transform_matrix[int(getImageTransform(i))];
+            if (!std::memcmp(c, m, sizeof(m)))
+            {
+                return i;
+            }
+        }
 
-        read_8x8 = nullptr;
+        return 1;
+    }
 
-        u64 cpu_flags = getCPUFlags();
-        MANGO_UNREFERENCED(cpu_flags);
+    // update the orientation tag in the first IFD of the EXIF segment (APP1 payload)
+    static
+    void updateOrientation(u8* p, size_t size, ImageTransform transform)
+    {
+        const u8 magicExif[] = { 0x45, 0x78, 0x69, 0x66, 0 }; // 'Exif', 0
+        if (size < 14 || std::memcmp(p, magicExif, 5))
+            return;
 
-        const char* sampler_name = nullptr;
+        u8* tiff = p + 6;
+        u8* end = p + size;
 
-        switch (sample)
-        {
-            case JPEG_U8_Y:
-#if defined(JPEG_ENABLE_SSE2)
-                if (cpu_flags & CPU_SSE2)
-                {
-                    read_8x8 = read_y_format_sse2;
-                    sampler_name = "SSE2 Y 8x8";
-                }
-#endif
-                read = read_y_format;
-                bytes_per_pixel = 1;
-                channel_count = 1;
-                break;
+        const bool le = tiff[0] == 0x49;
+        auto read16 = [le] (const u8* p) { return le ? uload16le(p) : uload16be(p); };
+        auto read32 = [le] (const u8* p) { return le ? uload32le(p) : uload32be(p); };
 
-            case JPEG_U8_BGR:
-#if defined(JPEG_ENABLE_SSE4)
-				if (cpu_flags & CPU_SSSE3)
-                {
-                    read_8x8 = read_bgr_format_ssse3;
-                    sampler_name = "SSSE3 BGR 8x8";
-                }
-#endif
-                read = read_bgr_format;
-                bytes_per_pixel = 3;
-                channel_count = 3;
-                break;
+        u32 offset = read32(tiff + 4);
+        if (offset > u32(end - tiff - 2))
+            return;
 
-            case JPEG_U8_RGB:
-#if defined(JPEG_ENABLE_SSE4)
-                if (cpu_flags & CPU_SSSE3)
-                {
-                    read_8x8 = read_rgb_format_ssse3;
-                    sampler_name = "SSSE3 RGB 8x8";
-                }
-#endif
-                read = read_rgb_format;
-                bytes_per_pixel = 3;
-                channel_count = 3;
-                break;
+        u8* ifd = tiff + offset;
+        int count = read16(ifd);
+        ifd += 2;
 
-            case JPEG_U8_BGRA:
-#if defined(JPEG_ENABLE_SSE2)
-                if (cpu_flags & CPU_SSE2)
-                {
-                    read_8x8 = read_bgra_format_sse2;
-                    sampler_name = "SSE2 BGRA 8x8";
-                }
-#endif
-                read = read_bgra_format;
-                bytes_per_pixel = 4;
-                channel_count = 3;
+        for (int i = 0; i < count && ifd + 12 <= end; ++i, ifd += 12)
+        {
+            if (read16(ifd) == 0x0112)
+            {
+                int orientation = getTransformedOrientation(read16(ifd + 8), transform);
+                if (le)
+                    ustore16le(ifd + 8, u16(orientation));
+                else
+                    ustore16be(ifd + 8, u16(orientation));
                 break;
+            }
+        }
+    }
 
-            case JPEG_U8_RGBA:
-#if defined(JPEG_ENABLE_SSE2)
-                if (cpu_flags & CPU_SSE2)
+    struct TransformComponent
+    {
+        int h;          // output blocks in MCU
+        int v;
+        int offset;     // first output block in MCU
+        int xblocks;    // output blocks in MCU row
+        int yblocks;
+        int x0;         // crop offset in source blocks
+        int y0;
+        const Frame* frame;
+    };
+
+    struct BlockTransform
+    {
+        u8 index[64];   // source coefficient for each output coefficient
+        s16 sign[64];
+        bool transpose;
+        bool xflip;     // output is mirrored horizontally
+        bool yflip;
+
+        BlockTransform(ImageTransform transform)
+        {
+            const int* m = g_transform_matrix[int(transform)];
+            transpose = m[0] == 0;
+            xflip = (m[0] + m[1]) < 0;
+            yflip = (m[2] + m[3]) < 0;
+
+            // mirroring negates the odd frequencies of the mirrored direction
+            for (int v = 0; v < 8; ++v)
+            {
+                for (int u = 0; u < 8; ++u)
                 {
-                    read_8x8 = read_rgba_format_sse2;
-                    sampler_name = "SSE2 RGBA 8x8";
+                    index[v * 8 + u] = u8(transpose ? u * 8 + v : v * 8 + u);
+                    sign[v * 8 + u] = ((xflip && (u & 1)) != (yflip && (v & 1))) ? -1 : 1;
                 }
-#endif
-                read = read_rgba_format;
-                bytes_per_pixel = 4;
-                channel_count = 3;
-                break;
+            }
         }
 
-        if (!read_8x8)
+        void apply(s16* dest, const s16* source) const
         {
-            read_8x8 = read;
+            for (int i = 0; i < 64; ++i)
+            {
+                dest[i] = source[index[i]] * sign[i];
+            }
         }
+    };
 
-        // build encoder info string
-        info = "JPEG Encoder: ";
-        info += fdct_name;
-        if (sampler_name)
+    // Transform one output MCU row; the output blocks are mapped back into the source blocks.
+    void transformRow(s16* dest, const Coefficients& source, const BlockTransform& transform,
+                      const TransformComponent* components, int count, int xmcu, int blocks_in_mcu, int y)
+    {
+        for (int x = 0; x < xmcu; ++x)
         {
-            info += " ";
-            info += sampler_name;
-        }
+            for (int i = 0; i < count; ++i)
+            {
+                const TransformComponent& c = components[i];
+                const Frame& frame = *c.frame;
 
-        mcu_width = 8;
-        mcu_height = 8;
+                for (int by = 0; by < c.v; ++by)
+                {
+                    for (int bx = 0; bx < c.h; ++bx)
+                    {
+                        int tx = x * c.h + bx;
+                        int ty = y * c.v + by;
 
-        horizontal_mcus = (width + mcu_width - 1) >> 3;
-        vertical_mcus   = (height + mcu_height - 1) >> 3;
+                        if (transform.xflip)
+                            tx = c.xblocks - 1 - tx;
+                        if (transform.yflip)
+                            ty = c.yblocks - 1 - ty;
 
-        rows_in_bottom_mcus = height - (vertical_mcus - 1) * mcu_height;
-        cols_in_right_mcus  = width  - (horizontal_mcus - 1) * mcu_width;
+                        int sx = (transform.transpose ? ty : tx) + c.x0;
+                        int sy = (transform.transpose ? tx : ty) + c.y0;
 
-        mcu_width_size = mcu_width * bytes_per_pixel;
+                        size_t mcu = size_t(sy / frame.Vsf) * source.xmcu + sx / frame.Hsf;
+                        size_t index = frame.offset + (sy % frame.Vsf) * frame.Hsf + sx % frame.Hsf;
+                        const s16* block = source.blocks.data() + (mcu * source.blocks_in_mcu + index) * BLOCK_SIZE;
 
-        init_quantization_tables(quality);
-    }
+                        transform.apply(dest + (c.offset + by * c.h + bx) * BLOCK_SIZE, block);
+                    }
+                }
+            }
 
-    jpeg_encode::~jpeg_encode()
-    {
+            dest += blocks_in_mcu * BLOCK_SIZE;
+        }
     }
 
-    void jpeg_encode::init_quantization_tables(u32 quality)
+    void transformCoefficients(ImageEncodeStatus& status, Stream& stream, ConstMemory memory, const ImageTransformOptions& options)
     {
-        for (int i = 0; i < 64; ++i)
+        Parser parser(memory);
+        if (!parser.header.success)
         {
-            u16 index = zigzag_table [i];
-            u32 value;
-
-            // luminance quantization table * quality factor
-            value = luminance_quant_table [i] * quality;
-            value = (value + 0x200) >> 10;
+            status.setError(parser.header.info);
+            return;
+        }
 
-            if (value < 2)
-                value = 2;
-            else if (value > 255)
-                value = 255;
+        Coefficients source;
+        ImageDecodeStatus decode_status = parser.decodeCoefficients(source);
+        if (!decode_status)
+        {
+            status.setError(decode_status.info);
+            return;
+        }
 
-            Lqt [index] = (u8) value;
-            ILqt [i] = u16(0x8000 / value);
+        const int components = int(source.frames.size());
 
-            // chrominance quantization table * quality factor
-            value = chrominance_quant_table [i] * quality;
-            value = (value + 0x200) >> 10;
+        // the huffman encoder supports one luminance and two chrominance components
+        if (source.precision != 8 || components > 3)
+        {
+            status.setError("Unsupported JPEG (%d bits, %d components).", source.precision, components);
+            return;
+        }
 
-            if (value < 2)
-                value = 2;
-            else if (value > 255)
-                value = 255;
+        const BlockTransform transform(options.transform);
 
-            Cqt [index] = (u8) value;
-            ICqt [i] = u16(0x8000 / value);
-        }
-    }
+        // crop rectangle; the top-left corner is aligned to the MCU grid
+        const int xblock = source.hmax * 8;
+        const int yblock = source.vmax * 8;
 
-    void jpeg_encode::write_markers(BigEndianStream& p, Sample sample, u32 width, u32 height)
-    {
-        // Start of image marker
-        p.write16(0xffd8);
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = source.width;
+        int y1 = source.height;
 
-        // Quantization table marker
-        p.write16(0xffdb);
-        p.write16(0x43); // quantization table length
-        p.write8(0x00); // Pq, Tq
+        if (options.crop.width > 0 && options.crop.height > 0)
+        {
+            x0 = clamp(options.crop.x, 0, source.width);
+            y0 = clamp(options.crop.y, 0, source.height);
+            x1 = std::min(x0 + options.crop.width, source.width);
+            y1 = std::min(y0 + options.crop.height, source.height);
+        }
 
-        // Lqt table
-        p.write(Lqt, 64);
+        x0 -= x0 % xblock;
+        y0 -= y0 % yblock;
 
-        // Quantization table marker
-        p.write16(0xffdb);
-        p.write16(0x43); // quantization table length
-        p.write8(0x01); // Pq, Tq
+        int width = x1 - x0;
+        int height = y1 - y0;
 
-        // Cqt table
-        p.write(Cqt, 64);
+        // the partial MCUs can only stay at the right and bottom edge
+        const bool xmirror = transform.transpose ? transform.yflip : transform.xflip;
+        const bool ymirror = transform.transpose ? transform.xflip : transform.yflip;
 
-        // Start of frame marker
-        p.write16(0xffc0);
+        if (xmirror)
+        {
+            width -= width % xblock;
+        }
 
-        u8 number_of_components = 0;
+        if (ymirror)
+        {
+            height -= height % yblock;
+        }
 
-        switch (sample)
+        if (width <= 0 || height <= 0)
         {
-            case JPEG_U8_Y:
-                number_of_components = 1;
-                break;
+            status.setError("The transformed image would be empty.");
+            return;
+        }
 
-            case JPEG_U8_RGB:
-            case JPEG_U8_BGR:
-            case JPEG_U8_BGRA:
-            case JPEG_U8_RGBA:
-                number_of_components = 3;
-                break;
+        // output frame
+        if (transform.transpose)
+        {
+            std::swap(width, height);
         }
 
-        u16 header_length = 8 + 3 * number_of_components;
+        const int hmax = transform.transpose ? source.vmax : source.hmax;
+        const int vmax = transform.transpose ? source.hmax : source.vmax;
+        const int xmcu = ceil_div(width, hmax * 8);
+        const int ymcu = ceil_div(height, vmax * 8);
 
-        p.write16(header_length); // frame header length
-        p.write8(8); // precision
-        p.write16(u16(height)); // image height
-        p.write16(u16(width)); // image width
-        p.write8(number_of_components); // Nf
+        TransformComponent component[3];
+        int blocks_in_mcu = 0;
 
-        const u8 nfdata[] =
+        for (int i = 0; i < components; ++i)
         {
-            0x01, 0x11, 0x00, // component 1
-            0x00, 0x00, 0x00, // padding
-            0x01, 0x11, 0x00, // component 1
-            0x02, 0x11, 0x01, // component 2
-            0x03, 0x11, 0x01, // component 3
-        };
-
-        p.write(nfdata + (number_of_components - 1) * 3, number_of_components * 3);
+            const Frame& frame = source.frames[i];
+            TransformComponent& c = component[i];
+
+            c.h = transform.transpose ? frame.Vsf : frame.Hsf;
+            c.v = transform.transpose ? frame.Hsf : frame.Vsf;
+            c.offset = blocks_in_mcu;
+            c.xblocks = xmcu * c.h;
+            c.yblocks = ymcu * c.v;
+            c.x0 = (x0 / xblock) * frame.Hsf;
+            c.y0 = (y0 / yblock) * frame.Vsf;
+            c.frame = &frame;
+
+            blocks_in_mcu += c.h * c.v;
+        }
 
-        // huffman table(DHT)
-        p.write(marker_data, sizeof(marker_data));
+        const size_t mcu_size = size_t(blocks_in_mcu) * BLOCK_SIZE;
+        const size_t scan_size = xmcu * mcu_size;
 
-        // Define Restart Interval marker
-        p.write16(0xffdd);
-        p.write16(4);
-        p.write16(horizontal_mcus);
+        AlignedPointer<s16> coefficients(scan_size * ymcu);
+        std::vector<HuffmanStatistics> statistics(ymcu);
 
-        // Start of scan marker
-        p.write16(0xffda);
-        p.write16(6 + number_of_components * 2); // header length
-        p.write8(number_of_components); // Ns
+        ConcurrentQueue queue;
 
-        const u8 nsdata[] =
+        // transform the coefficients and gather symbol statistics for each MCU row
+        for (int y = 0; y < ymcu; ++y)
         {
-            0x01, 0x00,
-            0x02, 0x11,
-            0x03, 0x11,
-        };
+            s16* data = coefficients + y * scan_size;
 
-        p.write(nsdata, number_of_components * 2);
-        p.write8(0x00);
-        p.write8(0x3f);
-        p.write8(0x00);
-    }
+            queue.enqueue([&, data, y]
+            {
+                transformRow(data, source, transform, component, components, xmcu, blocks_in_mcu, y);
 
-    // ----------------------------------------------------------------------------
-    // encodeJPEG()
-    // ----------------------------------------------------------------------------
+                HuffmanEncoder huffman(nullptr);
+                const s16* block = data;
 
-    void encodeJPEG(ImageEncodeStatus& status, const Surface& surface, Stream& stream, int quality, Sample sample)
-    {
-        jpeg_encode jp(sample, surface.width, surface.height, surface.stride, quality);
+                for (int x = 0; x < xmcu; ++x)
+                {
+                    for (int i = 0; i < components; ++i)
+                    {
+                        for (int j = 0; j < component[i].h * component[i].v; ++j)
+                        {
+                            huffman.count(statistics[y], i + 1, block);
+                            block += BLOCK_SIZE;
+                        }
+                    }
+                }
+            });
+        }
 
-        const u8* input = surface.image;
-        int stride = surface.stride;
+        queue.wait();
+        HuffmanStatistics stats;
 
-        // bitstream for each MCU scan
-        std::vector<EncodeBuffer> buffers(jp.vertical_mcus);
+        for (auto& row : statistics)
+        {
+            stats.add(row);
+        }
 
-        ConcurrentQueue queue;
+        const int tables = components > 1 ? 2 : 1;
 
-        // encode MCUs
-        for (int y = 0; y < jp.vertical_mcus; ++y)
+        HuffmanCodes codes[2];
+        HuffmanTable dc_table[2];
+        HuffmanTable ac_table[2];
+
+        for (int i = 0; i < tables; ++i)
         {
-            auto read_func = jp.read_8x8; // default: optimized 8x8 reader
+            dc_table[i].build(codes[i].dc_code, codes[i].dc_size, stats.dc[i], 12, getSymbol);
+            ac_table[i].build(codes[i].ac_code, codes[i].ac_size, stats.ac[i], 162, getSymbolAC);
+        }
 
-            int rows;
-            const int bottom_mcu = jp.vertical_mcus - 1;
-            if (y < bottom_mcu)
-            {
-                rows = jp.mcu_height;
-            }
-            else
-            {
-                // clipping
-                rows = jp.rows_in_bottom_mcus;
-                read_func = jp.read; // clipping reader
-            }
+        // encode MCU rows
+        std::vector<EncodeBuffer> buffers(ymcu);
 
-            queue.enqueue([&jp, y, &buffers, input, stride, rows, read_func]
-            {
-                auto read = read_func;
-                const u8* image = input;
+        for (int y = 0; y < ymcu; ++y)
+        {
+            const s16* data = coefficients + y * scan_size;
 
-                HuffmanEncoder huffman;
-                EncodeBuffer& buffer = buffers[y];
+            queue.enqueue([&, data, y]
+            {
+                HuffmanEncoder huffman(codes);
 
                 constexpr int buffer_size = 2048;
                 constexpr int flush_threshold = buffer_size - 512;
@@ -1914,63 +3505,163 @@ namespace
                 u8 huff_temp[buffer_size]; // encoding buffer
                 u8* ptr = huff_temp;
 
-                const int right_mcu = jp.horizontal_mcus - 1;
+                EncodeBuffer& buffer = buffers[y];
+                const s16* block = data;
 
-                for (int x = 0; x < jp.horizontal_mcus; ++x)
+                for (int x = 0; x < xmcu; ++x)
                 {
-                    int cols;
-                    if (x < right_mcu)
-                    {
-                        cols = jp.mcu_width;
-                    }
-                    else
+                    for (int i = 0; i < components; ++i)
                     {
-                        // clipping
-                        cols = jp.cols_in_right_mcus;
-                        read = jp.read; // clipping reader
+                        for (int j = 0; j < component[i].h * component[i].v; ++j)
+                        {
+                            ptr = huffman.encode(ptr, i + 1, block);
+                            block += BLOCK_SIZE;
+
+                            // flush encoding buffer
+                            if (ptr - huff_temp > flush_threshold)
+                            {
+                                buffer.append(huff_temp, ptr - huff_temp);
+                                ptr = huff_temp;
+                            }
+                        }
                     }
+                }
 
-                    s16 block[BLOCK_SIZE * 3];
+                ptr = huffman.flush(ptr);
+                buffer.append(huff_temp, ptr - huff_temp);
+                buffer.ready = true;
+            });
+        }
 
-                    // read MCU data
-                    read(block, image, stride, rows, cols);
+        BigEndianStream s(stream);
 
-                    // encode the data in MCU
-                    for (int i = 0; i < jp.channel_count; ++i)
-                    {
-                        s16 temp[BLOCK_SIZE];
-                        fdct(temp, block + i * BLOCK_SIZE, jp.channel[i].qtable);
+        // Start of image marker
+        s.write16(0xffd8);
 
-                        ptr = huffman.encode(ptr, jp.channel[i].component, temp);
-                    }
+        // copy the application and comment segments
+        const u8* p = memory.address + 2;
+        const u8* end = memory.address + memory.size;
 
-                    // flush encoding buffer
-                    if (ptr - huff_temp > flush_threshold)
-                    {
-                        buffer.append(huff_temp, ptr - huff_temp);
-                        ptr = huff_temp;
-                    }
+        for ( ; p + 4 <= end; )
+        {
+            u16 marker = uload16be(p);
+            if (marker == 0xffda || marker == 0xffd9 || (marker & 0xff00) != 0xff00)
+                break;
+
+            if (marker == 0xffff)
+            {
+                // fill byte
+                ++p;
+                continue;
+            }
+
+            size_t size = std::min(size_t(uload16be(p + 2)) + 2, size_t(end - p));
 
-                    image += jp.mcu_width_size;
+            if ((marker >= 0xffe0 && marker <= 0xffef) || marker == 0xfffe)
+            {
+                if (marker == 0xffe1)
+                {
+                    Buffer segment(p, size);
+                    updateOrientation(segment.data() + 4, size - 4, options.transform);
+                    s.write(segment.data(), size);
                 }
+                else
+                {
+                    s.write(p, size);
+                }
+            }
 
-                // flush encoding buffer
-                ptr = huffman.flush(ptr);
-                buffer.append(huff_temp, ptr - huff_temp);
+            p += size;
+        }
 
-                // mark buffer ready for writing
-                buffer.ready = true;
-            });
+        // Quantization tables; transposed blocks need transposed tables
+        u32 written = 0;
+        bool extended = false;
+
+        for (int i = 0; i < components; ++i)
+        {
+            const int Tq = source.frames[i].Tq & 3;
+            if (written & (1 << Tq))
+                continue;
+
+            written |= (1 << Tq);
+
+            s16 qt[64];
+            const s16* table = source.qt[Tq];
+
+            for (int j = 0; j < 64; ++j)
+            {
+                qt[j] = table[transform.transpose ? (j % 8) * 8 + j / 8 : j];
+            }
+
+            bool wide = false;
+            for (int j = 0; j < 64; ++j)
+            {
+                wide |= u16(qt[j]) > 255;
+            }
 
-            input += surface.stride * jp.mcu_height;
+            extended |= wide;
+
+            s.write16(0xffdb);
+            s.write16(wide ? 0x83 : 0x43);
+            s.write8(u8((wide ? 0x10 : 0x00) | Tq));
+
+            for (int j = 0; j < 64; ++j)
+            {
+                u16 value = u16(qt[zigzag_table_inverse[j]]);
+                if (wide)
+                    s.write16(value);
+                else
+                    s.write8(u8(value));
+            }
         }
 
-        BigEndianStream s(stream);
+        // Start of frame marker; 16 bit quantization tables are not allowed in baseline
+        s.write16(extended ? 0xffc1 : 0xffc0);
+        s.write16(u16(8 + 3 * components));
+        s.write8(8); // precision
+        s.write16(u16(height));
+        s.write16(u16(width));
+        s.write8(u8(components));
 
-        // writing marker data
-        jp.write_markers(s, sample, surface.width, surface.height);
+        for (int i = 0; i < components; ++i)
+        {
+            s.write8(u8(source.frames[i].compid));
+            s.write8(u8((component[i].h << 4) | component[i].v));
+            s.write8(u8(source.frames[i].Tq));
+        }
 
-        for (int y = 0; y < jp.vertical_mcus; ++y)
+        // huffman tables (DHT)
+        dc_table[0].write(s, 0x00);
+        ac_table[0].write(s, 0x10);
+
+        if (components > 1)
+        {
+            dc_table[1].write(s, 0x01);
+            ac_table[1].write(s, 0x11);
+        }
+
+        // Define Restart Interval marker
+        s.write16(0xffdd);
+        s.write16(4);
+        s.write16(u16(xmcu));
+
+        // Start of scan marker
+        s.write16(0xffda);
+        s.write16(u16(6 + components * 2));
+        s.write8(u8(components));
+
+        for (int i = 0; i < components; ++i)
+        {
+            s.write8(u8(source.frames[i].compid));
+            s.write8(i ? 0x11 : 0x00);
+        }
+
+        s.write8(0x00);
+        s.write8(0x3f);
+        s.write8(0x00);
+
+        for (int y = 0; y < ymcu; ++y)
         {
             EncodeBuffer& buffer = buffers[y];
 
@@ -1980,18 +3671,19 @@ namespace
                 queue.steal();
             }
 
-            // write huffman bitstream
-            s.write(buffer, size_t(buffer.size()));
+            stream.write(buffer.data(), buffer.size());
 
-            // write restart marker
-            int index = y & 7;
-            s.write16(0xffd0 + index);
+            // restart marker between MCU rows
+            if (y < ymcu - 1)
+            {
+                s.write16(0xffd0 + (y & 7));
+            }
         }
 
         // EOI marker
         s.write16(0xffd9);
-
-        status.info = jp.info;
+        status.info = "JPEG Transform: ";
+        status.info += decode_status.info;
     }
 
 } // namespace
@@ -2017,12 +3709,12 @@ namespace jpeg {
         return result;
     }
 
-    ImageEncodeStatus encodeImage(Stream& stream, const Surface& surface, float quality)
+    ImageEncodeStatus encodeImage(Stream& stream, const Surface& surface, const ImageEncodeOptions& options)
     {
         ImageEncodeStatus status;
 
         // configure quality
-        quality = clamp(1.0f - quality, 0.0f, 1.0f);
+        float quality = clamp(1.0f - options.quality, 0.0f, 1.0f);
         u32 iq = u32(std::pow(1.0f + quality, 11.0f) * 8.0f);
 
         SampleFormat sf = getSampleFormat(surface.format);
@@ -2030,7 +3722,7 @@ namespace jpeg {
         // encode
         if (surface.format == sf.format)
         {
-            encodeJPEG(status, surface, stream, iq, sf.sample);
+            encodeJPEG(status, surface, stream, iq, sf.sample, options.subsampling, options.optimize, options.progressive);
             status.direct = true;
         }
         else
@@ -2038,11 +3730,19 @@ namespace jpeg {
             // convert source surface to format supported in the encoder
             Bitmap temp(surface.width, surface.height, sf.format);
             temp.blit(0, 0, surface);
-            encodeJPEG(status, temp, stream, iq, sf.sample);
+            encodeJPEG(status, temp, stream, iq, sf.sample, options.subsampling, options.optimize, options.progressive);
         }
 
         return status;
     }
 
+    ImageEncodeStatus transformImage(Stream& stream, ConstMemory memory, const ImageTransformOptions& options)
+    {
+        ImageEncodeStatus status;
+        status.direct = true;
+        transformCoefficients(status, stream, memory, options);
+        return status;
+    }
+
 } // namespace jpeg
 } // namespace mango
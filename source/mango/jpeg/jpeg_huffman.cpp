@@ -92,7 +92,7 @@ namespace jpeg {
                 size++; \
             }  \
             v = int(x >> (JPEG_REGISTER_BITS - size)); \
-            symbol = h->valueAddress[size][v]; \
+            symbol = size > 16 ? 0 : h->valueAddress[size][v]; \
         } \
         buffer.remain -= size; \
     }
@@ -179,6 +179,139 @@ namespace jpeg {
         }
     }
     
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+
+    void huff_decode_mcu_fast(s16* output, DecodeState* state)
+    {
+        const u8* zigzagTable = state->zigzagTable;
+        Huffman& huffman = state->huffman;
+
+        // local copy keeps the bit buffer in registers
+        jpegBuffer buffer = state->buffer;
+
+        std::memset(output, 0, state->blocks * 64 * sizeof(s16));
+
+        for (int j = 0; j < state->blocks; ++j)
+        {
+            const DecodeBlock* block = state->block + j;
+
+            const HuffTable* dc_table = block->table.dc;
+            const HuffTable* ac_table = block->table.ac;
+            const u32* dc_fast = block->fast.dc->entry;
+            const u32* ac_fast = block->fast.ac->entry;
+
+            // DC
+            if (buffer.remain < JPEG_HUFF_FAST_BITS)
+            {
+                buffer.fill();
+            }
+
+            int s;
+            u32 e = dc_fast[PEEK_BITS(buffer, JPEG_HUFF_FAST_BITS)];
+
+            if (e & 31)
+            {
+                buffer.remain -= e & 31;
+                if (e & HuffFastTable::RECEIVE)
+                {
+                    HUFF_RECEIVE(buffer, (e >> 12) & 15);
+                }
+                else
+                {
+                    s = s32(e) >> 16;
+                }
+            }
+            else
+            {
+                HUFF_DECODE(s, dc_table);
+                if (s)
+                {
+                    HUFF_RECEIVE(buffer, s);
+                }
+            }
+
+            s += huffman.last_dc_value[block->pred];
+            huffman.last_dc_value[block->pred] = s;
+
+            output[0] = s16(s);
+
+            // AC
+            for (int i = 1; i < 64; )
+            {
+                if (buffer.remain < JPEG_HUFF_FAST_BITS)
+                {
+                    buffer.fill();
+                }
+
+                e = ac_fast[PEEK_BITS(buffer, JPEG_HUFF_FAST_BITS)];
+
+                if (e & HuffFastTable::PAIR)
+                {
+                    buffer.remain -= e & 31;
+                    i += (e >> 8) & 15;
+                    output[zigzagTable[i++]] = s16(s32(e << 6) >> 26);
+
+                    if (i >= 64)
+                    {
+                        // the second symbol belongs to the next block
+                        buffer.remain += (e >> 16) & 15;
+                        break;
+                    }
+
+                    if (e & HuffFastTable::EOB)
+                        break;
+
+                    i += (e >> 12) & 15;
+                    output[zigzagTable[i++]] = s16(s32(e) >> 26);
+                }
+                else if (e & 31)
+                {
+                    buffer.remain -= e & 31;
+
+                    if (e & HuffFastTable::EOB)
+                        break;
+
+                    i += (e >> 8) & 15;
+                    if (e & HuffFastTable::RECEIVE)
+                    {
+                        HUFF_RECEIVE(buffer, (e >> 12) & 15);
+                    }
+                    else
+                    {
+                        s = s32(e) >> 16;
+                    }
+
+                    output[zigzagTable[i++]] = s16(s);
+                }
+                else
+                {
+                    HUFF_DECODE(s, ac_table);
+
+                    int r = s >> 4;
+                    s &= 15;
+
+                    if (s)
+                    {
+                        i += r;
+                        HUFF_RECEIVE(buffer, s);
+                        output[zigzagTable[i++]] = s16(s);
+                    }
+                    else
+                    {
+                        if (!r) break;
+                        i += 16;
+                    }
+                }
+            }
+
+            output += 64;
+        }
+
+        state->buffer = buffer;
+    }
+
+#endif // JPEG_ENABLE_FAST_HUFFMAN
+
     void huff_decode_dc_first(s16* output, DecodeState* state)
     {
         Huffman& huffman = state->huffman;
@@ -521,9 +654,11 @@ namespace jpeg {
             }
             else
             {
+                valueAddress[j] = value;
                 maxcode[j] = 0; // TODO: should be -1 if no codes of this length
             }
         }
+        valueAddress[17] = value + 0; // invalid code; the decoder returns zero
         valueAddress[18] = value + 0;
         maxcode[17] = ~DataType(0);//0xfffff; // ensures jpeg_huff_decode terminates
 
@@ -559,6 +694,115 @@ namespace jpeg {
     }
 
 #endif
-    
+
+#ifdef JPEG_ENABLE_FAST_HUFFMAN
+
+    // ----------------------------------------------------------------------------
+    // HuffFastTable
+    // ----------------------------------------------------------------------------
+
+    void HuffFastTable::configure(const HuffTable& table, bool ac)
+    {
+        constexpr int bits = JPEG_HUFF_FAST_BITS;
+
+        std::memset(entry, 0, sizeof(entry));
+
+        // single symbols; the canonical codes are generated as in Figure C.2
+        u32 code = 0;
+        int p = 0;
+
+        for (int length = 1; length <= bits; ++length)
+        {
+            for (int i = 0; i < int(table.size[length]); ++i)
+            {
+                if (code >> length)
+                {
+                    // invalid table; the codes do not fit in length bits
+                    return;
+                }
+
+                const int symbol = table.value[p++];
+                const int run = ac ? symbol >> 4 : 0;
+                const int size = ac ? symbol & 15 : symbol;
+                const int shift = bits - length;
+
+                for (int tail = 0; tail < (1 << shift); ++tail)
+                {
+                    u32 e;
+
+                    if (ac && !size)
+                    {
+                        // huff_decode_mcu skips 16 coefficients for every run except EOB
+                        e = run ? length | (15 << 8) : length | EOB;
+                    }
+                    else if (length + size <= bits)
+                    {
+                        int value = 0;
+                        if (size)
+                        {
+                            value = (tail >> (shift - size)) & ((1 << size) - 1);
+                            value = huff_extend(value, size);
+                        }
+                        e = (length + size) | (run << 8) | (u32(value) << 16);
+                    }
+                    else if (size < 16)
+                    {
+                        e = length | RECEIVE | (run << 8) | (size << 12);
+                    }
+                    else
+                    {
+                        e = 0;
+                    }
+
+                    entry[(code << shift) | tail] = e;
+                }
+
+                ++code;
+            }
+
+            code <<= 1;
+        }
+
+        if (!ac)
+        {
+            return;
+        }
+
+        // combine two short AC symbols when the second one fits in the remaining bits
+        std::vector<u32> single(entry, entry + JPEG_HUFF_FAST_SIZE);
+
+        for (int x = 0; x < JPEG_HUFF_FAST_SIZE; ++x)
+        {
+            const u32 e0 = single[x];
+            const int length0 = e0 & 31;
+            const int value0 = s32(e0) >> 16;
+
+            if (!length0 || (e0 & (EOB | RECEIVE)) || value0 < -32 || value0 > 31)
+                continue;
+
+            const u32 e1 = single[(x << length0) & (JPEG_HUFF_FAST_SIZE - 1)];
+            const int length1 = e1 & 31;
+            const int value1 = s32(e1) >> 16;
+
+            if (!length1 || length0 + length1 > bits || (e1 & RECEIVE) || value1 < -32 || value1 > 31)
+                continue;
+
+            u32 e = (length0 + length1) | PAIR | (e0 & 0xf00) | (length1 << 16) | ((value0 & 63) << 20);
+
+            if (e1 & EOB)
+            {
+                e |= EOB;
+            }
+            else
+            {
+                e |= ((e1 & 0xf00) << 4) | (u32(value1 & 63) << 26);
+            }
+
+            entry[x] = e;
+        }
+    }
+
+#endif // JPEG_ENABLE_FAST_HUFFMAN
+
 } // namespace jpeg
 } // namespace mango
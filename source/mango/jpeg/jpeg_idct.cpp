@@ -123,6 +123,111 @@ namespace
         }
     }
 
+    // ------------------------------------------------------------------------------------------------
+    // Reduced size iDCT
+    // ------------------------------------------------------------------------------------------------
+
+    /*
+        The N x N iDCT (N = 4, 2, 1) uses only the lowest N x N coefficients of the block and
+        evaluates the N point transform at the centers of the N output samples:
+
+            f(x) = 1/2 * sum(u < N) C(u) * F(u) * cos((2x + 1) * u * pi / 2N), C(0) = 1/sqrt(2)
+
+        The normalization is the same as in the 8 x 8 transform so the output is the 8 x 8 block
+        downsampled by 8 / N; the block average (DC) is exactly preserved.
+    */
+
+    struct IDCT4
+    {
+        int x0, x1;
+        int y0, y1;
+
+        void compute(int s0, int s1, int s2, int s3)
+        {
+            // 13 bit fixed point: 5793 = cos(pi/4), 7568 = cos(pi/8), 3135 = cos(3pi/8)
+            x0 = (s0 + s2) * 5793;
+            x1 = (s0 - s2) * 5793;
+            y0 = s1 * 7568 + s3 * 3135;
+            y1 = s1 * 3135 - s3 * 7568;
+        }
+    };
+
+    template <int PRECISION>
+    void idct4x4(u8* dest, const s16* data, const s16* qt)
+    {
+        int temp[16];
+
+        // columns; keep 2 bits of extra precision for the rows
+        for (int i = 0; i < 4; ++i)
+        {
+            const int s0 = data[i + 8 * 0] * qt[i + 8 * 0];
+            const int s1 = data[i + 8 * 1] * qt[i + 8 * 1];
+            const int s2 = data[i + 8 * 2] * qt[i + 8 * 2];
+            const int s3 = data[i + 8 * 3] * qt[i + 8 * 3];
+
+            IDCT4 idct;
+            idct.compute(s0, s1, s2, s3);
+            const int bias = 0x800;
+            idct.x0 += bias;
+            idct.x1 += bias;
+            temp[i + 4 * 0] = (idct.x0 + idct.y0) >> 12;
+            temp[i + 4 * 1] = (idct.x1 + idct.y1) >> 12;
+            temp[i + 4 * 2] = (idct.x1 - idct.y1) >> 12;
+            temp[i + 4 * 3] = (idct.x0 - idct.y0) >> 12;
+        }
+
+        // rows
+        const int shift = PRECISION + 8;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            const int* v = temp + i * 4;
+
+            IDCT4 idct;
+            idct.compute(v[0], v[1], v[2], v[3]);
+            const int bias = (1 << (shift - 1)) + (128 << shift);
+            idct.x0 += bias;
+            idct.x1 += bias;
+            dest[0] = byteclamp((idct.x0 + idct.y0) >> shift);
+            dest[1] = byteclamp((idct.x1 + idct.y1) >> shift);
+            dest[2] = byteclamp((idct.x1 - idct.y1) >> shift);
+            dest[3] = byteclamp((idct.x0 - idct.y0) >> shift);
+            dest += 8;
+        }
+    }
+
+    template <int PRECISION>
+    void idct2x2(u8* dest, const s16* data, const s16* qt)
+    {
+        // the 2 point transform is (s0 +/- s1) / (2 * sqrt(2)) so the block is simply / 8
+        const int s0 = data[0] * qt[0];
+        const int s1 = data[1] * qt[1];
+        const int s2 = data[8] * qt[8];
+        const int s3 = data[9] * qt[9];
+
+        const int shift = PRECISION - 5;
+        const int bias = (1 << (shift - 1)) + (128 << shift);
+
+        const int x0 = s0 + s2 + bias;
+        const int x1 = s0 - s2 + bias;
+        const int y0 = s1 + s3;
+        const int y1 = s1 - s3;
+
+        dest[0] = byteclamp((x0 + y0) >> shift);
+        dest[1] = byteclamp((x0 - y0) >> shift);
+        dest[8] = byteclamp((x1 + y1) >> shift);
+        dest[9] = byteclamp((x1 - y1) >> shift);
+    }
+
+    template <int PRECISION>
+    void idct1x1(u8* dest, const s16* data, const s16* qt)
+    {
+        // block average
+        const int shift = PRECISION - 5;
+        const int bias = (1 << (shift - 1)) + (128 << shift);
+        dest[0] = byteclamp((data[0] * qt[0] + bias) >> shift);
+    }
+
 } // namespace
 
 namespace mango {
@@ -142,6 +247,36 @@ namespace jpeg {
         idct<12>(dest, data, qt);
     }
 
+    void idct8_4x4(u8* dest, const s16* data, const s16* qt)
+    {
+        idct4x4<8>(dest, data, qt);
+    }
+
+    void idct8_2x2(u8* dest, const s16* data, const s16* qt)
+    {
+        idct2x2<8>(dest, data, qt);
+    }
+
+    void idct8_1x1(u8* dest, const s16* data, const s16* qt)
+    {
+        idct1x1<8>(dest, data, qt);
+    }
+
+    void idct12_4x4(u8* dest, const s16* data, const s16* qt)
+    {
+        idct4x4<12>(dest, data, qt);
+    }
+
+    void idct12_2x2(u8* dest, const s16* data, const s16* qt)
+    {
+        idct2x2<12>(dest, data, qt);
+    }
+
+    void idct12_1x1(u8* dest, const s16* data, const s16* qt)
+    {
+        idct1x1<12>(dest, data, qt);
+    }
+
 #if defined(JPEG_ENABLE_SSE2)
 
     // ------------------------------------------------------------------------------------------------
@@ -325,6 +460,469 @@ namespace jpeg {
         _mm_storeu_si128(d + 3, s3);
     }
 
+    // Same transform as the scalar idct4x4<8>, four columns (or rows) at a time
+
+    static inline
+    void idct4x4_pass_sse2(__m128i& c0, __m128i& c1, __m128i& c2, __m128i& c3, __m128i even, __m128i odd, __m128i bias, int shift)
+    {
+        const __m128i k0 = _mm_setr_epi16(5793,  5793, 5793,  5793, 5793,  5793, 5793,  5793);
+        const __m128i k1 = _mm_setr_epi16(5793, -5793, 5793, -5793, 5793, -5793, 5793, -5793);
+        const __m128i k2 = _mm_setr_epi16(7568,  3135, 7568,  3135, 7568,  3135, 7568,  3135);
+        const __m128i k3 = _mm_setr_epi16(3135, -7568, 3135, -7568, 3135, -7568, 3135, -7568);
+
+        __m128i x0 = _mm_add_epi32(_mm_madd_epi16(even, k0), bias);
+        __m128i x1 = _mm_add_epi32(_mm_madd_epi16(even, k1), bias);
+        __m128i y0 = _mm_madd_epi16(odd, k2);
+        __m128i y1 = _mm_madd_epi16(odd, k3);
+
+        c0 = _mm_srai_epi32(_mm_add_epi32(x0, y0), shift);
+        c1 = _mm_srai_epi32(_mm_add_epi32(x1, y1), shift);
+        c2 = _mm_srai_epi32(_mm_sub_epi32(x1, y1), shift);
+        c3 = _mm_srai_epi32(_mm_sub_epi32(x0, y0), shift);
+    }
+
+    void idct4x4_sse2(u8* dest, const s16* data, const s16* qt)
+    {
+        // Load and dequantize the top-left 4x4 coefficients
+        __m128i v0 = _mm_mullo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(data +  0)),
+                                     _mm_loadl_epi64(reinterpret_cast<const __m128i *>(qt +  0)));
+        __m128i v1 = _mm_mullo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(data +  8)),
+                                     _mm_loadl_epi64(reinterpret_cast<const __m128i *>(qt +  8)));
+        __m128i v2 = _mm_mullo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(data + 16)),
+                                     _mm_loadl_epi64(reinterpret_cast<const __m128i *>(qt + 16)));
+        __m128i v3 = _mm_mullo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(data + 24)),
+                                     _mm_loadl_epi64(reinterpret_cast<const __m128i *>(qt + 24)));
+
+        // IDCT columns; a lane is a column
+        __m128i r0, r1, r2, r3;
+        idct4x4_pass_sse2(r0, r1, r2, r3, _mm_unpacklo_epi16(v0, v2), _mm_unpacklo_epi16(v1, v3), _mm_set1_epi32(0x800), 12);
+
+        // Transpose
+        __m128i a = _mm_packs_epi32(r0, r1);
+        __m128i b = _mm_packs_epi32(r2, r3);
+        __m128i u0 = _mm_unpacklo_epi16(a, b);
+        __m128i u1 = _mm_unpackhi_epi16(a, b);
+        __m128i c01 = _mm_unpacklo_epi16(u0, u1);
+        __m128i c23 = _mm_unpackhi_epi16(u0, u1);
+
+        // IDCT rows; a lane is a row
+        __m128i c0, c1, c2, c3;
+        idct4x4_pass_sse2(c0, c1, c2, c3, _mm_unpacklo_epi16(c01, c23), _mm_unpackhi_epi16(c01, c23),
+            _mm_set1_epi32((1 << 15) + (128 << 16)), 16);
+
+        // Pack to 8-bit integers and transpose back to rows
+        __m128i s = _mm_packus_epi16(_mm_packs_epi32(c0, c2), _mm_packs_epi32(c1, c3));
+        s = _mm_unpacklo_epi8(s, _mm_srli_si128(s, 8));
+        s = _mm_unpacklo_epi16(s, _mm_srli_si128(s, 8));
+
+        // Store with 8 byte stride
+        ustore32(dest +  0, _mm_cvtsi128_si32(s));
+        ustore32(dest +  8, _mm_cvtsi128_si32(_mm_srli_si128(s, 4)));
+        ustore32(dest + 16, _mm_cvtsi128_si32(_mm_srli_si128(s, 8)));
+        ustore32(dest + 24, _mm_cvtsi128_si32(_mm_srli_si128(s, 12)));
+    }
+
+#if defined(JPEG_ENABLE_AVX2)
+
+    // ------------------------------------------------------------------------------------------------
+    // AVX2 implementation
+    // ------------------------------------------------------------------------------------------------
+
+    // The SSE2 transform only uses lane-local instructions, so the same sequence on 256-bit
+    // registers transforms two blocks at once with one block in each 128-bit lane.
+
+#define JPEG_IDCT_ROTATE_YMM(dst0, dst1, x, y, c0, c1) \
+    __m256i c0##_l = _mm256_unpacklo_epi16(x, y); \
+    __m256i c0##_h = _mm256_unpackhi_epi16(x, y); \
+    __m256i dst0##_l = _mm256_madd_epi16(c0##_l, c0); \
+    __m256i dst0##_h = _mm256_madd_epi16(c0##_h, c0); \
+    __m256i dst1##_l = _mm256_madd_epi16(c0##_l, c1); \
+    __m256i dst1##_h = _mm256_madd_epi16(c0##_h, c1);
+
+#define JPEG_IDCT_WIDEN_YMM(dst, in) \
+    __m256i dst##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+    __m256i dst##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4);
+
+#define JPEG_IDCT_WADD_YMM(dst, a, b) \
+    __m256i dst##_l = _mm256_add_epi32(a##_l, b##_l); \
+    __m256i dst##_h = _mm256_add_epi32(a##_h, b##_h);
+
+#define JPEG_IDCT_WSUB_YMM(dst, a, b) \
+    __m256i dst##_l = _mm256_sub_epi32(a##_l, b##_l); \
+    __m256i dst##_h = _mm256_sub_epi32(a##_h, b##_h);
+
+#define JPEG_IDCT_BFLY_YMM(dst0, dst1, a, b, bias, norm) { \
+    __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+    __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+    JPEG_IDCT_WADD_YMM(sum, abiased, b) \
+    JPEG_IDCT_WSUB_YMM(diff, abiased, b) \
+    dst0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, norm), _mm256_srai_epi32(sum_h, norm)); \
+    dst1 = _mm256_packs_epi32(_mm256_srai_epi32(diff_l, norm), _mm256_srai_epi32(diff_h, norm)); \
+    }
+
+#define JPEG_IDCT_IDCT_PASS_YMM(bias, norm) { \
+    JPEG_IDCT_ROTATE_YMM(t2e, t3e, v2, v6, ymm_rot0_0, ymm_rot0_1) \
+    __m256i sum04 = _mm256_add_epi16(v0, v4); \
+    __m256i dif04 = _mm256_sub_epi16(v0, v4); \
+    JPEG_IDCT_WIDEN_YMM(t0e, sum04) \
+    JPEG_IDCT_WIDEN_YMM(t1e, dif04) \
+    JPEG_IDCT_WADD_YMM(x0, t0e, t3e) \
+    JPEG_IDCT_WSUB_YMM(x3, t0e, t3e) \
+    JPEG_IDCT_WADD_YMM(x1, t1e, t2e) \
+    JPEG_IDCT_WSUB_YMM(x2, t1e, t2e) \
+    JPEG_IDCT_ROTATE_YMM(y0o, y2o, v7, v3, ymm_rot2_0, ymm_rot2_1) \
+    JPEG_IDCT_ROTATE_YMM(y1o, y3o, v5, v1, ymm_rot3_0, ymm_rot3_1) \
+    __m256i sum17 = _mm256_add_epi16(v1, v7); \
+    __m256i sum35 = _mm256_add_epi16(v3, v5); \
+    JPEG_IDCT_ROTATE_YMM(y4o,y5o, sum17, sum35, ymm_rot1_0, ymm_rot1_1) \
+    JPEG_IDCT_WADD_YMM(x4, y0o, y4o) \
+    JPEG_IDCT_WADD_YMM(x5, y1o, y5o) \
+    JPEG_IDCT_WADD_YMM(x6, y2o, y5o) \
+    JPEG_IDCT_WADD_YMM(x7, y3o, y4o) \
+    JPEG_IDCT_BFLY_YMM(v0, v7, x0, x7, bias, norm) \
+    JPEG_IDCT_BFLY_YMM(v1, v6, x1, x6, bias, norm) \
+    JPEG_IDCT_BFLY_YMM(v2, v5, x2, x5, bias, norm) \
+    JPEG_IDCT_BFLY_YMM(v3, v4, x3, x4, bias, norm) \
+    }
+
+    static inline MANGO_TARGET_AVX2
+    void interleave8(__m256i &a, __m256i &b)
+    {
+        __m256i c = a;
+        a = _mm256_unpacklo_epi8(a, b);
+        b = _mm256_unpackhi_epi8(c, b);
+    }
+
+    static inline MANGO_TARGET_AVX2
+    void interleave16(__m256i &a, __m256i &b)
+    {
+        __m256i c = a;
+        a = _mm256_unpacklo_epi16(a, b);
+        b = _mm256_unpackhi_epi16(c, b);
+    }
+
+    static inline MANGO_TARGET_AVX2
+    void idct2_avx2(u8* dest, const s16* src, const s16* qt0, const s16* qt1)
+    {
+        const __m256i ymm_rot0_0 = _mm256_broadcastsi128_si256(rot0_0);
+        const __m256i ymm_rot0_1 = _mm256_broadcastsi128_si256(rot0_1);
+        const __m256i ymm_rot1_0 = _mm256_broadcastsi128_si256(rot1_0);
+        const __m256i ymm_rot1_1 = _mm256_broadcastsi128_si256(rot1_1);
+        const __m256i ymm_rot2_0 = _mm256_broadcastsi128_si256(rot2_0);
+        const __m256i ymm_rot2_1 = _mm256_broadcastsi128_si256(rot2_1);
+        const __m256i ymm_rot3_0 = _mm256_broadcastsi128_si256(rot3_0);
+        const __m256i ymm_rot3_1 = _mm256_broadcastsi128_si256(rot3_1);
+        const __m256i ymm_colBias = _mm256_set1_epi32(JPEG_IDCT_COL_BIAS);
+        const __m256i ymm_rowBias = _mm256_set1_epi32(JPEG_IDCT_ROW_BIAS);
+
+        const __m256i* data0 = reinterpret_cast<const __m256i *>(src);
+        const __m256i* data1 = reinterpret_cast<const __m256i *>(src + 64);
+        const __m256i* qtable0 = reinterpret_cast<const __m256i *>(qt0);
+        const __m256i* qtable1 = reinterpret_cast<const __m256i *>(qt1);
+
+        // Load and dequantize, two rows per register
+        __m256i a01 = _mm256_mullo_epi16(_mm256_loadu_si256(data0 + 0), _mm256_loadu_si256(qtable0 + 0));
+        __m256i a23 = _mm256_mullo_epi16(_mm256_loadu_si256(data0 + 1), _mm256_loadu_si256(qtable0 + 1));
+        __m256i a45 = _mm256_mullo_epi16(_mm256_loadu_si256(data0 + 2), _mm256_loadu_si256(qtable0 + 2));
+        __m256i a67 = _mm256_mullo_epi16(_mm256_loadu_si256(data0 + 3), _mm256_loadu_si256(qtable0 + 3));
+        __m256i b01 = _mm256_mullo_epi16(_mm256_loadu_si256(data1 + 0), _mm256_loadu_si256(qtable1 + 0));
+        __m256i b23 = _mm256_mullo_epi16(_mm256_loadu_si256(data1 + 1), _mm256_loadu_si256(qtable1 + 1));
+        __m256i b45 = _mm256_mullo_epi16(_mm256_loadu_si256(data1 + 2), _mm256_loadu_si256(qtable1 + 2));
+        __m256i b67 = _mm256_mullo_epi16(_mm256_loadu_si256(data1 + 3), _mm256_loadu_si256(qtable1 + 3));
+
+        // Same row of both blocks in one register
+        __m256i v0 = _mm256_permute2x128_si256(a01, b01, 0x20);
+        __m256i v1 = _mm256_permute2x128_si256(a01, b01, 0x31);
+        __m256i v2 = _mm256_permute2x128_si256(a23, b23, 0x20);
+        __m256i v3 = _mm256_permute2x128_si256(a23, b23, 0x31);
+        __m256i v4 = _mm256_permute2x128_si256(a45, b45, 0x20);
+        __m256i v5 = _mm256_permute2x128_si256(a45, b45, 0x31);
+        __m256i v6 = _mm256_permute2x128_si256(a67, b67, 0x20);
+        __m256i v7 = _mm256_permute2x128_si256(a67, b67, 0x31);
+
+        // IDCT columns
+        JPEG_IDCT_IDCT_PASS_YMM(ymm_colBias, 10)
+
+        // Transpose
+        interleave16(v0, v4);
+        interleave16(v2, v6);
+        interleave16(v1, v5);
+        interleave16(v3, v7);
+
+        interleave16(v0, v2);
+        interleave16(v1, v3);
+        interleave16(v4, v6);
+        interleave16(v5, v7);
+
+        interleave16(v0, v1);
+        interleave16(v2, v3);
+        interleave16(v4, v5);
+        interleave16(v6, v7);
+
+        // IDCT rows
+        JPEG_IDCT_IDCT_PASS_YMM(ymm_rowBias, 17)
+
+        // Pack to 8-bit integers, also saturates the result to 0..255
+        __m256i s0 = _mm256_packus_epi16(v0, v1);
+        __m256i s1 = _mm256_packus_epi16(v2, v3);
+        __m256i s2 = _mm256_packus_epi16(v4, v5);
+        __m256i s3 = _mm256_packus_epi16(v6, v7);
+
+        // Transpose
+        interleave8(s0, s2);
+        interleave8(s1, s3);
+        interleave8(s0, s1);
+        interleave8(s2, s3);
+        interleave8(s0, s2);
+        interleave8(s1, s3);
+
+        // Store; the low lanes hold the first block and the high lanes the second
+        __m256i* d = reinterpret_cast<__m256i *>(dest);
+        _mm256_storeu_si256(d + 0, _mm256_permute2x128_si256(s0, s2, 0x20));
+        _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(s1, s3, 0x20));
+        _mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(s0, s2, 0x31));
+        _mm256_storeu_si256(d + 3, _mm256_permute2x128_si256(s1, s3, 0x31));
+    }
+
+    MANGO_TARGET_AVX2
+    void idct_avx2(u8* dest, const s16* data, const Block* block, int count)
+    {
+        for ( ; count >= 2; count -= 2)
+        {
+            idct2_avx2(dest, data, block[0].qt, block[1].qt);
+            dest += 128;
+            data += 128;
+            block += 2;
+        }
+
+        if (count)
+        {
+            idct_sse2(dest, data, block[0].qt);
+        }
+    }
+
+#undef JPEG_IDCT_ROTATE_YMM
+#undef JPEG_IDCT_WIDEN_YMM
+#undef JPEG_IDCT_WADD_YMM
+#undef JPEG_IDCT_WSUB_YMM
+#undef JPEG_IDCT_BFLY_YMM
+#undef JPEG_IDCT_IDCT_PASS_YMM
+
+#endif // JPEG_ENABLE_AVX2
+
+#if defined(JPEG_ENABLE_AVX512)
+
+    // ------------------------------------------------------------------------------------------------
+    // AVX-512 implementation
+    // ------------------------------------------------------------------------------------------------
+
+    // Four blocks per call, one in each 128-bit lane.
+
+#if defined(MANGO_COMPILER_GCC)
+    // GCC 12 reports the _mm512_undefined_epi32() used inside the intrinsics as uninitialized
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+
+#define JPEG_IDCT_ROTATE_ZMM(dst0, dst1, x, y, c0, c1) \
+    __m512i c0##_l = _mm512_unpacklo_epi16(x, y); \
+    __m512i c0##_h = _mm512_unpackhi_epi16(x, y); \
+    __m512i dst0##_l = _mm512_madd_epi16(c0##_l, c0); \
+    __m512i dst0##_h = _mm512_madd_epi16(c0##_h, c0); \
+    __m512i dst1##_l = _mm512_madd_epi16(c0##_l, c1); \
+    __m512i dst1##_h = _mm512_madd_epi16(c0##_h, c1);
+
+#define JPEG_IDCT_WIDEN_ZMM(dst, in) \
+    __m512i dst##_l = _mm512_srai_epi32(_mm512_unpacklo_epi16(_mm512_setzero_si512(), (in)), 4); \
+    __m512i dst##_h = _mm512_srai_epi32(_mm512_unpackhi_epi16(_mm512_setzero_si512(), (in)), 4);
+
+#define JPEG_IDCT_WADD_ZMM(dst, a, b) \
+    __m512i dst##_l = _mm512_add_epi32(a##_l, b##_l); \
+    __m512i dst##_h = _mm512_add_epi32(a##_h, b##_h);
+
+#define JPEG_IDCT_WSUB_ZMM(dst, a, b) \
+    __m512i dst##_l = _mm512_sub_epi32(a##_l, b##_l); \
+    __m512i dst##_h = _mm512_sub_epi32(a##_h, b##_h);
+
+#define JPEG_IDCT_BFLY_ZMM(dst0, dst1, a, b, bias, norm) { \
+    __m512i abiased_l = _mm512_add_epi32(a##_l, bias); \
+    __m512i abiased_h = _mm512_add_epi32(a##_h, bias); \
+    JPEG_IDCT_WADD_ZMM(sum, abiased, b) \
+    JPEG_IDCT_WSUB_ZMM(diff, abiased, b) \
+    dst0 = _mm512_packs_epi32(_mm512_srai_epi32(sum_l, norm), _mm512_srai_epi32(sum_h, norm)); \
+    dst1 = _mm512_packs_epi32(_mm512_srai_epi32(diff_l, norm), _mm512_srai_epi32(diff_h, norm)); \
+    }
+
+#define JPEG_IDCT_IDCT_PASS_ZMM(bias, norm) { \
+    JPEG_IDCT_ROTATE_ZMM(t2e, t3e, v2, v6, zmm_rot0_0, zmm_rot0_1) \
+    __m512i sum04 = _mm512_add_epi16(v0, v4); \
+    __m512i dif04 = _mm512_sub_epi16(v0, v4); \
+    JPEG_IDCT_WIDEN_ZMM(t0e, sum04) \
+    JPEG_IDCT_WIDEN_ZMM(t1e, dif04) \
+    JPEG_IDCT_WADD_ZMM(x0, t0e, t3e) \
+    JPEG_IDCT_WSUB_ZMM(x3, t0e, t3e) \
+    JPEG_IDCT_WADD_ZMM(x1, t1e, t2e) \
+    JPEG_IDCT_WSUB_ZMM(x2, t1e, t2e) \
+    JPEG_IDCT_ROTATE_ZMM(y0o, y2o, v7, v3, zmm_rot2_0, zmm_rot2_1) \
+    JPEG_IDCT_ROTATE_ZMM(y1o, y3o, v5, v1, zmm_rot3_0, zmm_rot3_1) \
+    __m512i sum17 = _mm512_add_epi16(v1, v7); \
+    __m512i sum35 = _mm512_add_epi16(v3, v5); \
+    JPEG_IDCT_ROTATE_ZMM(y4o,y5o, sum17, sum35, zmm_rot1_0, zmm_rot1_1) \
+    JPEG_IDCT_WADD_ZMM(x4, y0o, y4o) \
+    JPEG_IDCT_WADD_ZMM(x5, y1o, y5o) \
+    JPEG_IDCT_WADD_ZMM(x6, y2o, y5o) \
+    JPEG_IDCT_WADD_ZMM(x7, y3o, y4o) \
+    JPEG_IDCT_BFLY_ZMM(v0, v7, x0, x7, bias, norm) \
+    JPEG_IDCT_BFLY_ZMM(v1, v6, x1, x6, bias, norm) \
+    JPEG_IDCT_BFLY_ZMM(v2, v5, x2, x5, bias, norm) \
+    JPEG_IDCT_BFLY_ZMM(v3, v4, x3, x4, bias, norm) \
+    }
+
+    static inline MANGO_TARGET_AVX512BW
+    void interleave8(__m512i &a, __m512i &b)
+    {
+        __m512i c = a;
+        a = _mm512_unpacklo_epi8(a, b);
+        b = _mm512_unpackhi_epi8(c, b);
+    }
+
+    static inline MANGO_TARGET_AVX512BW
+    void interleave16(__m512i &a, __m512i &b)
+    {
+        __m512i c = a;
+        a = _mm512_unpacklo_epi16(a, b);
+        b = _mm512_unpackhi_epi16(c, b);
+    }
+
+    // 4x4 transpose of the 128-bit lanes
+    static inline MANGO_TARGET_AVX512BW
+    void transpose_lanes(__m512i &a, __m512i &b, __m512i &c, __m512i &d)
+    {
+        __m512i t0 = _mm512_shuffle_i64x2(a, b, 0x44);
+        __m512i t1 = _mm512_shuffle_i64x2(c, d, 0x44);
+        __m512i t2 = _mm512_shuffle_i64x2(a, b, 0xee);
+        __m512i t3 = _mm512_shuffle_i64x2(c, d, 0xee);
+        a = _mm512_shuffle_i64x2(t0, t1, 0x88);
+        b = _mm512_shuffle_i64x2(t0, t1, 0xdd);
+        c = _mm512_shuffle_i64x2(t2, t3, 0x88);
+        d = _mm512_shuffle_i64x2(t2, t3, 0xdd);
+    }
+
+    static inline MANGO_TARGET_AVX512BW
+    void idct4_avx512(u8* dest, const s16* src, const Block* block)
+    {
+        const __m512i zmm_rot0_0 = _mm512_broadcast_i32x4(rot0_0);
+        const __m512i zmm_rot0_1 = _mm512_broadcast_i32x4(rot0_1);
+        const __m512i zmm_rot1_0 = _mm512_broadcast_i32x4(rot1_0);
+        const __m512i zmm_rot1_1 = _mm512_broadcast_i32x4(rot1_1);
+        const __m512i zmm_rot2_0 = _mm512_broadcast_i32x4(rot2_0);
+        const __m512i zmm_rot2_1 = _mm512_broadcast_i32x4(rot2_1);
+        const __m512i zmm_rot3_0 = _mm512_broadcast_i32x4(rot3_0);
+        const __m512i zmm_rot3_1 = _mm512_broadcast_i32x4(rot3_1);
+        const __m512i zmm_colBias = _mm512_set1_epi32(JPEG_IDCT_COL_BIAS);
+        const __m512i zmm_rowBias = _mm512_set1_epi32(JPEG_IDCT_ROW_BIAS);
+
+        // Load and dequantize, four rows per register
+        __m512i lo[4];
+        __m512i hi[4];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            const s16* data = src + i * 64;
+            const s16* qt = block[i].qt;
+            lo[i] = _mm512_mullo_epi16(_mm512_loadu_si512(data +  0), _mm512_loadu_si512(qt +  0));
+            hi[i] = _mm512_mullo_epi16(_mm512_loadu_si512(data + 32), _mm512_loadu_si512(qt + 32));
+        }
+
+        // Same row of all four blocks in one register
+        transpose_lanes(lo[0], lo[1], lo[2], lo[3]);
+        transpose_lanes(hi[0], hi[1], hi[2], hi[3]);
+
+        __m512i v0 = lo[0];
+        __m512i v1 = lo[1];
+        __m512i v2 = lo[2];
+        __m512i v3 = lo[3];
+        __m512i v4 = hi[0];
+        __m512i v5 = hi[1];
+        __m512i v6 = hi[2];
+        __m512i v7 = hi[3];
+
+        // IDCT columns
+        JPEG_IDCT_IDCT_PASS_ZMM(zmm_colBias, 10)
+
+        // Transpose
+        interleave16(v0, v4);
+        interleave16(v2, v6);
+        interleave16(v1, v5);
+        interleave16(v3, v7);
+
+        interleave16(v0, v2);
+        interleave16(v1, v3);
+        interleave16(v4, v6);
+        interleave16(v5, v7);
+
+        interleave16(v0, v1);
+        interleave16(v2, v3);
+        interleave16(v4, v5);
+        interleave16(v6, v7);
+
+        // IDCT rows
+        JPEG_IDCT_IDCT_PASS_ZMM(zmm_rowBias, 17)
+
+        // Pack to 8-bit integers, also saturates the result to 0..255
+        __m512i s0 = _mm512_packus_epi16(v0, v1);
+        __m512i s1 = _mm512_packus_epi16(v2, v3);
+        __m512i s2 = _mm512_packus_epi16(v4, v5);
+        __m512i s3 = _mm512_packus_epi16(v6, v7);
+
+        // Transpose
+        interleave8(s0, s2);
+        interleave8(s1, s3);
+        interleave8(s0, s1);
+        interleave8(s2, s3);
+        interleave8(s0, s2);
+        interleave8(s1, s3);
+
+        // Gather the lanes of each block and store
+        transpose_lanes(s0, s2, s1, s3);
+
+        __m512i* d = reinterpret_cast<__m512i *>(dest);
+        _mm512_storeu_si512(d + 0, s0);
+        _mm512_storeu_si512(d + 1, s2);
+        _mm512_storeu_si512(d + 2, s1);
+        _mm512_storeu_si512(d + 3, s3);
+    }
+
+    MANGO_TARGET_AVX512BW
+    void idct_avx512(u8* dest, const s16* data, const Block* block, int count)
+    {
+        for ( ; count >= 4; count -= 4)
+        {
+            idct4_avx512(dest, data, block);
+            dest += 256;
+            data += 256;
+            block += 4;
+        }
+
+        if (count)
+        {
+            idct_avx2(dest, data, block, count);
+        }
+    }
+
+#undef JPEG_IDCT_ROTATE_ZMM
+#undef JPEG_IDCT_WIDEN_ZMM
+#undef JPEG_IDCT_WADD_ZMM
+#undef JPEG_IDCT_WSUB_ZMM
+#undef JPEG_IDCT_BFLY_ZMM
+#undef JPEG_IDCT_IDCT_PASS_ZMM
+
+#if defined(MANGO_COMPILER_GCC)
+    #pragma GCC diagnostic pop
+#endif
+
+#endif // JPEG_ENABLE_AVX512
+
 #endif // JPEG_ENABLE_SSE2
 
 #if defined(JPEG_ENABLE_NEON)
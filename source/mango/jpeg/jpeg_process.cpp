@@ -100,9 +100,10 @@ void process_cmyk_bgra(u8* dest, int stride, const s16* data, ProcessState* stat
         data += 64;
     }
 
-    // MCU size in blocks
-    int xsize = (width + 7) / 8;
-    int ysize = (height + 7) / 8;
+    // MCU size in blocks; the blocks are N x N pixels when decoding at reduced size
+    const int N = state->idct_size;
+    int xsize = (width + N - 1) / N;
+    int ysize = (height + N - 1) / N;
 
     int cb_offset = state->frame[1].offset * 64;
     int cb_xshift = state->frame[1].Hsf;
@@ -126,34 +127,31 @@ void process_cmyk_bgra(u8* dest, int stride, const s16* data, ProcessState* stat
     for (int yb = 0; yb < ysize; ++yb)
     {
         // vertical clipping limit for current block
-        const int ymax = std::min(8, height - yb * 8);
+        const int ymax = std::min(N, height - yb * N);
 
         for (int xb = 0; xb < xsize; ++xb)
         {
-            u8* dest_block = dest + yb * 8 * stride + xb * 8 * sizeof(u32);
-            u8* y_block = result + (yb * xsize + xb) * 64;
-            u8* cb_block = cb_data + yb * (8 >> cb_yshift) * 8 + xb * (8 >> cb_xshift);
-            u8* cr_block = cr_data + yb * (8 >> cr_yshift) * 8 + xb * (8 >> cr_xshift);
-            u8* ck_block = ck_data + yb * (8 >> ck_yshift) * 8 + xb * (8 >> ck_xshift);
+            u8* dest_block = dest + yb * N * stride + xb * N * sizeof(u32);
+            u8* y_block = result + (yb * state->xblocks + xb) * 64;
 
             // horizontal clipping limit for current block
-            const int xmax = std::min(8, width - xb * 8);
+            const int xmax = std::min(N, width - xb * N);
 
-            // process 8x8 block
+            // process N x N block
             for (int y = 0; y < ymax; ++y)
             {
                 u32* d = reinterpret_cast<u32*>(dest_block);
 
-                u8* cb_scan = cb_block + (y >> cb_yshift) * 8;
-                u8* cr_scan = cr_block + (y >> cr_yshift) * 8;
-                u8* ck_scan = ck_block + (y >> ck_yshift) * 8;
+                u8* cb_scan = cb_data + ((yb * N + y) >> cb_yshift) * 8;
+                u8* cr_scan = cr_data + ((yb * N + y) >> cr_yshift) * 8;
+                u8* ck_scan = ck_data + ((yb * N + y) >> ck_yshift) * 8;
 
                 for (int x = 0; x < xmax; ++x)
                 {
                     u8 y0 = y_block[x];
-                    u8 cb = cb_scan[x >> cb_xshift];
-                    u8 cr = cr_scan[x >> cr_xshift];
-                    u8 ck = ck_scan[x >> ck_xshift];
+                    u8 cb = cb_scan[(xb * N + x) >> cb_xshift];
+                    u8 cr = cr_scan[(xb * N + x) >> cr_xshift];
+                    u8 ck = ck_scan[(xb * N + x) >> ck_xshift];
 
                     int C;
                     int M;
@@ -222,25 +220,26 @@ void process_ycbcr_8bit(u8* dest, int stride, const s16* data, ProcessState* sta
         data += 64;
     }
 
-    // MCU size in blocks
-    int xsize = (width + 7) / 8;
-    int ysize = (height + 7) / 8;
+    // MCU size in blocks; the blocks are N x N pixels when decoding at reduced size
+    const int N = state->idct_size;
+    int xsize = (width + N - 1) / N;
+    int ysize = (height + N - 1) / N;
 
     // process MCU
     for (int yb = 0; yb < ysize; ++yb)
     {
         // vertical clipping limit for current block
-        const int ymax = std::min(8, height - yb * 8);
+        const int ymax = std::min(N, height - yb * N);
 
         for (int xb = 0; xb < xsize; ++xb)
         {
-            u8* dest_block = dest + yb * 8 * stride + xb * 8 * sizeof(u8);
-            u8* y_block = result + (yb * xsize + xb) * 64;
+            u8* dest_block = dest + yb * N * stride + xb * N * sizeof(u8);
+            u8* y_block = result + (yb * state->xblocks + xb) * 64;
 
             // horizontal clipping limit for current block
-            const int xmax = std::min(8, width - xb * 8);
+            const int xmax = std::min(N, width - xb * N);
 
-            // process 8x8 block
+            // process N x N block
             for (int y = 0; y < ymax; ++y)
             {
                 std::memcpy(dest_block, y_block, xmax);
@@ -624,38 +623,71 @@ void convert_ycbcr_rgba_8x1_sse2(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 // Generate YCBCR to BGRA functions
 #define INNERLOOP_YCBCR      convert_ycbcr_bgra_8x1_sse2
 #define XSTEP                32
+#define TARGET_YCBCR
 #define FUNCTION_YCBCR_8x8   process_ycbcr_bgra_8x8_sse2
 #define FUNCTION_YCBCR_8x16  process_ycbcr_bgra_8x16_sse2
 #define FUNCTION_YCBCR_16x8  process_ycbcr_bgra_16x8_sse2
 #define FUNCTION_YCBCR_16x16 process_ycbcr_bgra_16x16_sse2
+#define FUNCTION_YCBCR_SCALED process_ycbcr_bgra_scaled_sse2
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
+#undef TARGET_YCBCR
 #undef FUNCTION_YCBCR_8x8
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_SCALED
 
 // Generate YCBCR to RGBA functions
 #define INNERLOOP_YCBCR      convert_ycbcr_rgba_8x1_sse2
 #define XSTEP                32
+#define TARGET_YCBCR
 #define FUNCTION_YCBCR_8x8   process_ycbcr_rgba_8x8_sse2
 #define FUNCTION_YCBCR_8x16  process_ycbcr_rgba_8x16_sse2
 #define FUNCTION_YCBCR_16x8  process_ycbcr_rgba_16x8_sse2
 #define FUNCTION_YCBCR_16x16 process_ycbcr_rgba_16x16_sse2
+#define FUNCTION_YCBCR_SCALED process_ycbcr_rgba_scaled_sse2
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
+#undef TARGET_YCBCR
 #undef FUNCTION_YCBCR_8x8
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_SCALED
+
+void process_y_32bit_sse2(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
+{
+    if (width < 8 || height < 8)
+    {
+        // clipped block at the right or bottom edge
+        process_y_32bit(dest, stride, data, state, width, height);
+        return;
+    }
+
+    u8 result[64];
+    state->idct(result, data, state->block[0].qt); // Y
+
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    for (int y = 0; y < 8; ++y)
+    {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8));
+        __m128i vv = _mm_unpacklo_epi8(v, v);
+        __m128i va = _mm_unpacklo_epi8(v, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest +  0), _mm_unpacklo_epi16(vv, va));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 16), _mm_unpackhi_epi16(vv, va));
+        dest += stride;
+    }
+}
 
 #endif // JPEG_ENABLE_SSE2
 
-#if defined(JPEG_ENABLE_SSE4)
+#if defined(JPEG_ENABLE_SSSE3)
 
-static inline
+static inline MANGO_TARGET_SSSE3
 void convert_ycbcr_bgr_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __m128i s0, __m128i s1, __m128i s2, __m128i rounding)
 {
     __m128i zero = _mm_setzero_si128();
@@ -713,7 +745,7 @@ void convert_ycbcr_bgr_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __
     _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + 16), bgr1);
 }
 
-static inline
+static inline MANGO_TARGET_SSSE3
 void convert_ycbcr_rgb_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __m128i s0, __m128i s1, __m128i s2, __m128i rounding)
 {
     __m128i zero = _mm_setzero_si128();
@@ -774,34 +806,247 @@ void convert_ycbcr_rgb_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 // Generate YCBCR to BGR functions
 #define INNERLOOP_YCBCR      convert_ycbcr_bgr_8x1_ssse3
 #define XSTEP                24
+#define TARGET_YCBCR         MANGO_TARGET_SSSE3
 #define FUNCTION_YCBCR_8x8   process_ycbcr_bgr_8x8_ssse3
 #define FUNCTION_YCBCR_8x16  process_ycbcr_bgr_8x16_ssse3
 #define FUNCTION_YCBCR_16x8  process_ycbcr_bgr_16x8_ssse3
 #define FUNCTION_YCBCR_16x16 process_ycbcr_bgr_16x16_ssse3
+#define FUNCTION_YCBCR_SCALED process_ycbcr_bgr_scaled_ssse3
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
+#undef TARGET_YCBCR
 #undef FUNCTION_YCBCR_8x8
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_SCALED
 
 // Generate YCBCR to RGB functions
 #define INNERLOOP_YCBCR      convert_ycbcr_rgb_8x1_ssse3
 #define XSTEP                24
+#define TARGET_YCBCR         MANGO_TARGET_SSSE3
 #define FUNCTION_YCBCR_8x8   process_ycbcr_rgb_8x8_ssse3
 #define FUNCTION_YCBCR_8x16  process_ycbcr_rgb_8x16_ssse3
 #define FUNCTION_YCBCR_16x8  process_ycbcr_rgb_16x8_ssse3
 #define FUNCTION_YCBCR_16x16 process_ycbcr_rgb_16x16_ssse3
+#define FUNCTION_YCBCR_SCALED process_ycbcr_rgb_scaled_ssse3
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
+#undef TARGET_YCBCR
 #undef FUNCTION_YCBCR_8x8
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_SCALED
+
+MANGO_TARGET_SSSE3
+void process_y_24bit_ssse3(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
+{
+    if (width < 8 || height < 8)
+    {
+        // clipped block at the right or bottom edge
+        process_y_24bit(dest, stride, data, state, width, height);
+        return;
+    }
+
+    u8 result[64];
+    state->idct(result, data, state->block[0].qt); // Y
+
+    constexpr u8 n = 0x80;
+
+    const __m128i mask0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    const __m128i mask1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, n, n, n, n, n, n, n, n);
+
+    for (int y = 0; y < 8; ++y)
+    {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest +  0), _mm_shuffle_epi8(v, mask0));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + 16), _mm_shuffle_epi8(v, mask1));
+        dest += stride;
+    }
+}
+
+#endif // JPEG_ENABLE_SSSE3
+
+#if defined(JPEG_ENABLE_AVX2)
+
+// ------------------------------------------------------------------------------------------------
+// AVX2 implementation
+// ------------------------------------------------------------------------------------------------
+
+// Same arithmetic as the SSE2 code but 16 pixels at a time; the iDCT is done for all blocks
+// of the MCU with one idct_blocks() call.
+
+#define JPEG_CONST_AVX2(x, y)  _mm256_set1_epi32(int(u32(u16(x)) | (u32(u16(y)) << 16)))
+
+static inline MANGO_TARGET_AVX2
+void convert_ycbcr_avx2(__m256i& r, __m256i& g, __m256i& b, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i zero = _mm256_setzero_si256();
+
+    __m256i r_l = _mm256_madd_epi16(_mm256_unpacklo_epi16(y, cr), s0);
+    __m256i r_h = _mm256_madd_epi16(_mm256_unpackhi_epi16(y, cr), s0);
+
+    __m256i b_l = _mm256_madd_epi16(_mm256_unpacklo_epi16(y, cb), s1);
+    __m256i b_h = _mm256_madd_epi16(_mm256_unpackhi_epi16(y, cb), s1);
+
+    __m256i g_l = _mm256_madd_epi16(_mm256_unpacklo_epi16(cb, cr), s2);
+    __m256i g_h = _mm256_madd_epi16(_mm256_unpackhi_epi16(cb, cr), s2);
+
+    g_l = _mm256_add_epi32(g_l, _mm256_slli_epi32(_mm256_unpacklo_epi16(y, zero), JPEG_PREC));
+    g_h = _mm256_add_epi32(g_h, _mm256_slli_epi32(_mm256_unpackhi_epi16(y, zero), JPEG_PREC));
+
+    r_l = _mm256_srai_epi32(_mm256_add_epi32(r_l, rounding), JPEG_PREC);
+    r_h = _mm256_srai_epi32(_mm256_add_epi32(r_h, rounding), JPEG_PREC);
+
+    b_l = _mm256_srai_epi32(_mm256_add_epi32(b_l, rounding), JPEG_PREC);
+    b_h = _mm256_srai_epi32(_mm256_add_epi32(b_h, rounding), JPEG_PREC);
+
+    g_l = _mm256_srai_epi32(_mm256_add_epi32(g_l, rounding), JPEG_PREC);
+    g_h = _mm256_srai_epi32(_mm256_add_epi32(g_h, rounding), JPEG_PREC);
+
+    // The unpack and pack instructions work inside the 128-bit lanes, so each lane
+    // holds 8 pixels twice: pixels 0..7 in the low lane and 8..15 in the high lane.
+    r = _mm256_packs_epi32(r_l, r_h);
+    g = _mm256_packs_epi32(g_l, g_h);
+    b = _mm256_packs_epi32(b_l, b_h);
+
+    r = _mm256_packus_epi16(r, r);
+    g = _mm256_packus_epi16(g, g);
+    b = _mm256_packus_epi16(b, b);
+}
+
+static inline MANGO_TARGET_AVX2
+void store_32bit_8x2_avx2(u8* dest0, u8* dest1, __m256i c0, __m256i c1, __m256i c2, __m256i c3)
+{
+    __m256i c01 = _mm256_unpacklo_epi8(c0, c1);
+    __m256i c23 = _mm256_unpacklo_epi8(c2, c3);
+
+    __m256i color0 = _mm256_unpacklo_epi16(c01, c23);
+    __m256i color1 = _mm256_unpackhi_epi16(c01, c23);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest0), _mm256_permute2x128_si256(color0, color1, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest1), _mm256_permute2x128_si256(color0, color1, 0x31));
+}
+
+static inline MANGO_TARGET_AVX2
+void store_24bit_8x2_avx2(u8* dest0, u8* dest1, __m256i c0, __m256i c1, __m256i c2)
+{
+    constexpr u8 n = 0x80;
+
+    const __m256i mask0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 8, n, 1, 9, n, 2, 10, n, 3, 11, n, 4, 12, n, 5));
+    const __m256i mask1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(13, n, 6, 14, n, 7, 15, n, n, n, n, n, n, n, n, n));
+    const __m256i mask2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, 0, n, n, 1, n, n, 2, n, n, 3, n, n, 4, n));
+    const __m256i mask3 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, 5, n, n, 6, n, n, 7, n, n, n, n, n, n, n, n));
+
+    __m256i c01 = _mm256_unpacklo_epi64(c0, c1);
+
+    __m256i color0 = _mm256_or_si256(_mm256_shuffle_epi8(c01, mask0), _mm256_shuffle_epi8(c2, mask2));
+    __m256i color1 = _mm256_or_si256(_mm256_shuffle_epi8(c01, mask1), _mm256_shuffle_epi8(c2, mask3));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest0 +  0), _mm256_castsi256_si128(color0));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dest0 + 16), _mm256_castsi256_si128(color1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest1 +  0), _mm256_extracti128_si256(color0, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dest1 + 16), _mm256_extracti128_si256(color1, 1));
+}
+
+static inline MANGO_TARGET_AVX2
+void convert_ycbcr_bgra_8x2_avx2(u8* dest0, u8* dest1, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i r, g, b;
+    convert_ycbcr_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
+    store_32bit_8x2_avx2(dest0, dest1, b, g, r, _mm256_cmpeq_epi8(r, r));
+}
+
+static inline MANGO_TARGET_AVX2
+void convert_ycbcr_rgba_8x2_avx2(u8* dest0, u8* dest1, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i r, g, b;
+    convert_ycbcr_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
+    store_32bit_8x2_avx2(dest0, dest1, r, g, b, _mm256_cmpeq_epi8(r, r));
+}
+
+static inline MANGO_TARGET_AVX2
+void convert_ycbcr_bgr_8x2_avx2(u8* dest0, u8* dest1, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i r, g, b;
+    convert_ycbcr_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
+    store_24bit_8x2_avx2(dest0, dest1, b, g, r);
+}
+
+static inline MANGO_TARGET_AVX2
+void convert_ycbcr_rgb_8x2_avx2(u8* dest0, u8* dest1, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i r, g, b;
+    convert_ycbcr_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
+    store_24bit_8x2_avx2(dest0, dest1, r, g, b);
+}
+
+// Generate YCBCR to BGRA functions
+#define INNERLOOP_YCBCR      convert_ycbcr_bgra_8x2_avx2
+#define XSTEP                32
+#define FUNCTION_YCBCR_8x8   process_ycbcr_bgra_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_bgra_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_bgra_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_bgra_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
+// Generate YCBCR to RGBA functions
+#define INNERLOOP_YCBCR      convert_ycbcr_rgba_8x2_avx2
+#define XSTEP                32
+#define FUNCTION_YCBCR_8x8   process_ycbcr_rgba_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_rgba_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_rgba_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_rgba_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
+// Generate YCBCR to BGR functions
+#define INNERLOOP_YCBCR      convert_ycbcr_bgr_8x2_avx2
+#define XSTEP                24
+#define FUNCTION_YCBCR_8x8   process_ycbcr_bgr_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_bgr_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_bgr_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_bgr_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
+// Generate YCBCR to RGB functions
+#define INNERLOOP_YCBCR      convert_ycbcr_rgb_8x2_avx2
+#define XSTEP                24
+#define FUNCTION_YCBCR_8x8   process_ycbcr_rgb_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_rgb_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_rgb_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_rgb_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
+#undef JPEG_CONST_AVX2
 
-#endif // JPEG_ENABLE_SSE4
+#endif // JPEG_ENABLE_AVX2
 
 } // namespace jpeg
 } // namespace mango
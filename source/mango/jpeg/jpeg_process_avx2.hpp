@@ -0,0 +1,152 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+
+// The innerloop converts 16 pixels; the first 8 are written to dest0 and the last 8 to dest1.
+// The full 8x8 rows are two rows per call and the horizontally upsampled rows one row per call.
+
+#ifdef FUNCTION_YCBCR_8x8
+MANGO_TARGET_AVX2
+void FUNCTION_YCBCR_8x8(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 3];
+
+    state->idct_blocks(result, data, state->block, 3); // Y, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(-128);
+
+    for (int y = 0; y < 4; ++y)
+    {
+        __m128i yy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 0));
+        __m128i cb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 64));
+        __m128i cr = _mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 128));
+
+        __m256i y0 = _mm256_cvtepu8_epi16(yy);
+        __m256i cb0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(cb), tosigned);
+        __m256i cr0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(cr), tosigned);
+
+        INNERLOOP_YCBCR(dest, dest + stride, y0, cb0, cr0, s0, s1, s2, rounding);
+        dest += stride * 2;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+#endif
+
+#ifdef FUNCTION_YCBCR_8x16
+MANGO_TARGET_AVX2
+void FUNCTION_YCBCR_8x16(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 4];
+
+    state->idct_blocks(result, data, state->block, 4); // Y0, Y1, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(-128);
+
+    for (int y = 0; y < 8; ++y)
+    {
+        __m128i yy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 0));
+        __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8 + 128));
+        __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8 + 192));
+
+        // both rows use the same chroma row
+        cb = _mm_unpacklo_epi64(cb, cb);
+        cr = _mm_unpacklo_epi64(cr, cr);
+
+        __m256i y0 = _mm256_cvtepu8_epi16(yy);
+        __m256i cb0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(cb), tosigned);
+        __m256i cr0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(cr), tosigned);
+
+        INNERLOOP_YCBCR(dest, dest + stride, y0, cb0, cr0, s0, s1, s2, rounding);
+        dest += stride * 2;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+#endif
+
+#ifdef FUNCTION_YCBCR_16x8
+MANGO_TARGET_AVX2
+void FUNCTION_YCBCR_16x8(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 4];
+
+    state->idct_blocks(result, data, state->block, 4); // Y0, Y1, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(-128);
+
+    for (int y = 0; y < 8; ++y)
+    {
+        __m128i y0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8 + 0));
+        __m128i y1 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8 + 64));
+        __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8 + 128));
+        __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(result + y * 8 + 192));
+
+        __m256i yy = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(y0, y1));
+        __m256i cb0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cb, cb)), tosigned);
+        __m256i cr0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cr, cr)), tosigned);
+
+        INNERLOOP_YCBCR(dest, dest + XSTEP, yy, cb0, cr0, s0, s1, s2, rounding);
+        dest += stride;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+#endif
+
+#ifdef FUNCTION_YCBCR_16x16
+MANGO_TARGET_AVX2
+void FUNCTION_YCBCR_16x16(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 6];
+
+    state->idct_blocks(result, data, state->block, 6); // Y0, Y1, Y2, Y3, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(-128);
+
+    for (int y = 0; y < 16; ++y)
+    {
+        const u8* luma = result + (y >> 3) * 128 + (y & 7) * 8;
+        const u8* chroma = result + 256 + (y >> 1) * 8;
+
+        __m128i y0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(luma + 0));
+        __m128i y1 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(luma + 64));
+        __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(chroma + 0));
+        __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(chroma + 64));
+
+        __m256i yy = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(y0, y1));
+        __m256i cb0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cb, cb)), tosigned);
+        __m256i cr0 = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cr, cr)), tosigned);
+
+        INNERLOOP_YCBCR(dest, dest + XSTEP, yy, cb0, cr0, s0, s1, s2, rounding);
+        dest += stride;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+#endif
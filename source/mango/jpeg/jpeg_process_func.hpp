@@ -15,9 +15,10 @@ void FUNCTION_GENERIC(u8* dest, int stride, const s16* data, ProcessState* state
         data += 64;
     }
 
-    // MCU size in blocks
-    int xsize = (width + 7) / 8;
-    int ysize = (height + 7) / 8;
+    // MCU size in blocks; the blocks are N x N pixels when decoding at reduced size
+    const int N = state->idct_size;
+    int xsize = (width + N - 1) / N;
+    int ysize = (height + N - 1) / N;
 
     int cb_offset = state->frame[1].offset * 64;
     int cb_xshift = state->frame[1].Hsf;
@@ -34,30 +35,28 @@ void FUNCTION_GENERIC(u8* dest, int stride, const s16* data, ProcessState* state
     for (int yb = 0; yb < ysize; ++yb)
     {
         // vertical clipping limit for current block
-        const int ymax = std::min(8, height - yb * 8);
+        const int ymax = std::min(N, height - yb * N);
 
         for (int xb = 0; xb < xsize; ++xb)
         {
-            u8* dest_block = dest + yb * 8 * stride + xb * 8 * XSTEP;
-            u8* y_block = result + (yb * xsize + xb) * 64;
-            u8* cb_block = cb_data + yb * (8 >> cb_yshift) * 8 + xb * (8 >> cb_xshift);
-            u8* cr_block = cr_data + yb * (8 >> cr_yshift) * 8 + xb * (8 >> cr_xshift);
+            u8* dest_block = dest + yb * N * stride + xb * N * XSTEP;
+            u8* y_block = result + (yb * state->xblocks + xb) * 64;
 
             // horizontal clipping limit for current block
-            const int xmax = std::min(8, width - xb * 8);
+            const int xmax = std::min(N, width - xb * N);
 
-            // process 8x8 block
+            // process N x N block
             for (int y = 0; y < ymax; ++y)
             {
                 u8* d = dest_block;
-                u8* cb_scan = cb_block + (y >> cb_yshift) * 8;
-                u8* cr_scan = cr_block + (y >> cr_yshift) * 8;
+                u8* cb_scan = cb_data + ((yb * N + y) >> cb_yshift) * 8;
+                u8* cr_scan = cr_data + ((yb * N + y) >> cr_yshift) * 8;
 
                 for (int x = 0; x < xmax; ++x)
                 {
                     u8 y0 = y_block[x];
-                    u8 cb = cb_scan[x >> cb_xshift];
-                    u8 cr = cr_scan[x >> cr_xshift];
+                    u8 cb = cb_scan[(xb * N + x) >> cb_xshift];
+                    u8 cr = cr_scan[(xb * N + x) >> cr_xshift];
                     int r, g, b;
                     COMPUTE_CBCR(cb, cr);
                     WRITE_COLOR(d, y0, r, g, b);
@@ -4,6 +4,7 @@
 */
 
 #ifdef FUNCTION_YCBCR_8x8
+TARGET_YCBCR
 void FUNCTION_YCBCR_8x8(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
 {
     u8 result[64 * 3];
@@ -50,6 +51,7 @@ void FUNCTION_YCBCR_8x8(u8* dest, int stride, const s16* data, ProcessState* sta
 #endif
 
 #ifdef FUNCTION_YCBCR_8x16
+TARGET_YCBCR
 void FUNCTION_YCBCR_8x16(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
 {
     u8 result[64 * 4];
@@ -104,6 +106,7 @@ void FUNCTION_YCBCR_8x16(u8* dest, int stride, const s16* data, ProcessState* st
 #endif
 
 #ifdef FUNCTION_YCBCR_16x8
+TARGET_YCBCR
 void FUNCTION_YCBCR_16x8(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
 {
     u8 result[64 * 4];
@@ -174,6 +177,7 @@ void FUNCTION_YCBCR_16x8(u8* dest, int stride, const s16* data, ProcessState* st
 #endif
 
 #ifdef FUNCTION_YCBCR_16x16
+TARGET_YCBCR
 void FUNCTION_YCBCR_16x16(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
 {
     u8 result[64 * 6];
@@ -254,3 +258,103 @@ void FUNCTION_YCBCR_16x16(u8* dest, int stride, const s16* data, ProcessState* s
     MANGO_UNREFERENCED(height);
 }
 #endif
+
+#ifdef FUNCTION_YCBCR_SCALED
+TARGET_YCBCR
+void FUNCTION_YCBCR_SCALED(u8* dest, int stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * JPEG_MAX_BLOCKS_IN_MCU];
+
+    for (int i = 0; i < state->blocks; ++i)
+    {
+        state->idct(result + i * 64, data, state->block[i].qt);
+        data += 64;
+    }
+
+    // The reduced size blocks are gathered into scanlines for the color conversion
+    const int N = state->idct_size;
+    const int nshift = u32_log2(N);
+    const int xblocks = state->xblocks;
+
+    const u8* cb_data = result + state->frame[1].offset * 64;
+    const int cb_xshift = state->frame[1].Hsf;
+    const int cb_yshift = state->frame[1].Vsf;
+
+    const u8* cr_data = result + state->frame[2].offset * 64;
+    const int cr_xshift = state->frame[2].Hsf;
+    const int cr_yshift = state->frame[2].Vsf;
+
+    // MCU is at most 32 pixels wide; the padding is for the 8 byte loads and stores
+    u8 scan[3][40] = { { 0 } };
+    u8 temp[XSTEP];
+
+    const __m128i s0 = JPEG_CONST_SSE2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m128i s1 = JPEG_CONST_SSE2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m128i s2 = JPEG_CONST_SSE2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m128i rounding = _mm_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m128i tosigned = _mm_set1_epi16(-128);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (int y = 0; y < height; ++y)
+    {
+        const u8* y_scan = result + (y >> nshift) * xblocks * 64 + (y & (N - 1)) * 8;
+        const u8* cb_scan = cb_data + (y >> cb_yshift) * 8;
+        const u8* cr_scan = cr_data + (y >> cr_yshift) * 8;
+
+        for (int x = 0; x < width; x += N)
+        {
+            // the next block overwrites the excess pixels
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(y_scan + (x >> nshift) * 64));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(scan[0] + x), v);
+        }
+
+        if (cb_xshift == 0 && cr_xshift == 0)
+        {
+            __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cb_scan));
+            __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cr_scan));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(scan[1]), cb);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(scan[2]), cr);
+        }
+        else if (cb_xshift == 1 && cr_xshift == 1)
+        {
+            // horizontally subsampled chroma
+            __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cb_scan));
+            __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cr_scan));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(scan[1]), _mm_unpacklo_epi8(cb, cb));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(scan[2]), _mm_unpacklo_epi8(cr, cr));
+        }
+        else
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                scan[1][x] = cb_scan[x >> cb_xshift];
+                scan[2][x] = cr_scan[x >> cr_xshift];
+            }
+        }
+
+        for (int x = 0; x < width; x += 8)
+        {
+            __m128i yy = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(scan[0] + x));
+            __m128i cb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(scan[1] + x));
+            __m128i cr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(scan[2] + x));
+
+            yy = _mm_unpacklo_epi8(yy, zero);
+            cb = _mm_add_epi16(_mm_unpacklo_epi8(cb, zero), tosigned);
+            cr = _mm_add_epi16(_mm_unpacklo_epi8(cr, zero), tosigned);
+
+            const int count = std::min(8, width - x);
+            if (count == 8)
+            {
+                INNERLOOP_YCBCR(dest + x * (XSTEP / 8), yy, cb, cr, s0, s1, s2, rounding);
+            }
+            else
+            {
+                INNERLOOP_YCBCR(temp, yy, cb, cr, s0, s1, s2, rounding);
+                std::memcpy(dest + x * (XSTEP / 8), temp, count * (XSTEP / 8));
+            }
+        }
+
+        dest += stride;
+    }
+}
+#endif
@@ -0,0 +1,336 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+// Converts every pair of the formats below with Surface::blit() and checks the
+// result against a double precision reference. Each pair is blitted twice so
+// that the second conversion runs the cached plan. With --benchmark the
+// throughput of every pair is printed as a matrix.
+
+namespace
+{
+
+    struct TestFormat
+    {
+        const char* name;
+        Format format;
+    };
+
+    const TestFormat g_formats[] =
+    {
+        { "BGRA8",    FORMAT_B8G8R8A8 },
+        { "RGBA8",    FORMAT_R8G8B8A8 },
+        { "BGRX8",    FORMAT_B8G8R8X8 },
+        { "BGR8",     FORMAT_B8G8R8 },
+        { "RGB8",     FORMAT_R8G8B8 },
+        { "B5G6R5",   FORMAT_B5G6R5 },
+        { "BGRA5551", FORMAT_B5G5R5A1 },
+        { "BGRA4",    FORMAT_B4G4R4A4 },
+        { "RGB10A2",  FORMAT_R10G10B10A2 },
+        { "R24A8",    Format(32, Format::UNORM, Format::RGBA, 24, 0, 0, 8) },
+        { "B2G3R3",   FORMAT_B2G3R3 },
+        { "L8",       FORMAT_L8 },
+        { "L8A8",     FORMAT_L8A8 },
+        { "L16",      FORMAT_L16 },
+        { "A8",       FORMAT_A8 },
+        { "R16",      FORMAT_R16 },
+        { "RG16",     FORMAT_RG16 },
+        { "RGB16",    FORMAT_RGB16 },
+        { "RGBA16",   FORMAT_RGBA16 },
+        { "RGBA16F",  FORMAT_RGBA16F },
+        { "RGBA32F",  FORMAT_RGBA32F },
+        { "L32F",     FORMAT_L32F },
+    };
+
+    const int g_format_count = int(sizeof(g_formats) / sizeof(g_formats[0]));
+
+    u32 random(u32& seed)
+    {
+        seed = seed * 1664525 + 1013904223;
+        return seed;
+    }
+
+    // missing color components decode as zero and missing alpha as one
+    void decode(double* color, const Format& format, const u8* pixel)
+    {
+        color[0] = 0.0;
+        color[1] = 0.0;
+        color[2] = 0.0;
+        color[3] = 1.0;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!format.size[i])
+                continue;
+
+            switch (format.type)
+            {
+                case Format::UNORM:
+                {
+                    u64 value = 0;
+                    std::memcpy(&value, pixel, format.bytes());
+                    const u64 mask = (u64(1) << format.size[i]) - 1;
+                    color[i] = double((value >> format.offset[i]) & mask) / mask;
+                    break;
+                }
+
+                case Format::FLOAT32:
+                {
+                    float value;
+                    std::memcpy(&value, pixel + format.offset[i] / 8, 4);
+                    color[i] = value;
+                    break;
+                }
+
+                default:
+                {
+                    float16 value;
+                    std::memcpy(&value.u, pixel + format.offset[i] / 8, 2);
+                    color[i] = float(value);
+                    break;
+                }
+            }
+        }
+    }
+
+    bool check(const Format& destFormat, const Format& srcFormat, const u8* dest, const u8* src)
+    {
+        double expected[4];
+        decode(expected, srcFormat, src);
+
+        if (destFormat.isLuminance() && !srcFormat.isLuminance())
+        {
+            expected[0] = expected[0] * 0.299 + expected[1] * 0.587 + expected[2] * 0.114;
+        }
+
+        double result[4];
+        decode(result, destFormat, dest);
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!destFormat.size[i])
+                continue;
+
+            // the luminance is stored in the red component
+            if (destFormat.isLuminance() && (i == 1 || i == 2))
+                continue;
+
+            double value = expected[i];
+
+            if (destFormat.type == Format::UNORM)
+            {
+                // within one step of the destination component; the blitter
+                // converts in single precision, so components of 24 bits or wider
+                // are within the float rounding instead
+                value = std::min(1.0, std::max(0.0, value));
+                const double scale = double((u64(1) << destFormat.size[i]) - 1);
+                const double tolerance = std::max(1.01, scale / double(1 << 23));
+                if (std::fabs(result[i] * scale - value * scale) > tolerance)
+                    return false;
+            }
+            else
+            {
+                const double tolerance = destFormat.type == Format::FLOAT16 ?
+                    1e-3 * std::fabs(value) + 1e-4 :
+                    1e-6 * std::fabs(value) + 1e-7;
+                if (std::fabs(result[i] - value) > tolerance)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    void fill(Surface& surface, u32 seed)
+    {
+        const Format& format = surface.format;
+
+        for (int y = 0; y < surface.height; ++y)
+        {
+            u8* scan = surface.address<u8>(0, y);
+
+            if (!format.isFloat())
+            {
+                for (int x = 0; x < surface.width * format.bytes(); ++x)
+                {
+                    scan[x] = u8(random(seed) >> 24);
+                }
+
+                // the first pixel is full scale and the second is zero
+                std::memset(scan, 0xff, format.bytes());
+                std::memset(scan + format.bytes(), 0, format.bytes());
+                continue;
+            }
+
+            // floats in [-0.1, 1.1] to exercise the clamping
+            for (int x = 0; x < surface.width; ++x)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (!format.size[i])
+                        continue;
+
+                    const float value = float(random(seed) >> 8) / float(1 << 24) * 1.2f - 0.1f;
+                    u8* p = scan + x * format.bytes() + format.offset[i] / 8;
+
+                    if (format.type == Format::FLOAT32)
+                    {
+                        std::memcpy(p, &value, 4);
+                    }
+                    else
+                    {
+                        const float16 half(value);
+                        std::memcpy(p, &half.u, 2);
+                    }
+                }
+            }
+        }
+    }
+
+    bool verify(const Surface& dest, const Surface& src, const char* destName, const char* srcName)
+    {
+        const int destBytes = dest.format.bytes();
+        const int srcBytes = src.format.bytes();
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            const u8* d = dest.address<u8>(0, y);
+            const u8* s = src.address<u8>(0, y);
+
+            for (int x = 0; x < src.width; ++x)
+            {
+                if (!check(dest.format, src.format, d + x * destBytes, s + x * srcBytes))
+                {
+                    double expected[4];
+                    double result[4];
+                    decode(expected, src.format, s + x * srcBytes);
+                    decode(result, dest.format, d + x * destBytes);
+
+                    std::printf("FAILED %s <- %s (%d, %d): source (%g %g %g %g) result (%g %g %g %g)\n",
+                        destName, srcName, x, y,
+                        expected[0], expected[1], expected[2], expected[3],
+                        result[0], result[1], result[2], result[3]);
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool identical(const Surface& a, const Surface& b)
+    {
+        for (int y = 0; y < a.height; ++y)
+        {
+            if (std::memcmp(a.address<u8>(0, y), b.address<u8>(0, y), a.width * a.format.bytes()))
+                return false;
+        }
+
+        return true;
+    }
+
+    double elapsed(std::chrono::steady_clock::time_point start)
+    {
+        auto time = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::milli>(time).count();
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const bool benchmark = argc > 1 && !std::strcmp(argv[1], "--benchmark");
+
+    // the odd width leaves a tail after the vectorized loops
+    const int width = benchmark ? 1024 : 253;
+    const int height = benchmark ? 256 : 64;
+    const int repeat = 5;
+
+    int failures = 0;
+
+    if (benchmark)
+    {
+        std::vector<u8> a(width * height * 4);
+        std::vector<u8> b(width * height * 4);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i)
+        {
+            std::memcpy(b.data(), a.data(), a.size());
+        }
+
+        const double time = elapsed(start) / repeat;
+        std::printf("memcpy (4 bytes per pixel): %.0f Mpix/s\n\n", width * height / time / 1000.0);
+
+        std::printf("%-9s", "dst\\src");
+        for (int j = 0; j < g_format_count; ++j)
+        {
+            std::printf("%9s", g_formats[j].name);
+        }
+        std::printf("\n");
+    }
+
+    for (int i = 0; i < g_format_count; ++i)
+    {
+        if (benchmark)
+        {
+            std::printf("%-9s", g_formats[i].name);
+        }
+
+        for (int j = 0; j < g_format_count; ++j)
+        {
+            const TestFormat& destFormat = g_formats[i];
+            const TestFormat& srcFormat = g_formats[j];
+
+            Bitmap src(width, height, srcFormat.format);
+            Bitmap dest(width, height, destFormat.format);
+            Bitmap cached(width, height, destFormat.format);
+
+            fill(src, 12345 + i * 77 + j);
+
+            dest.blit(0, 0, src);
+            cached.blit(0, 0, src);
+
+            bool ok = verify(dest, src, destFormat.name, srcFormat.name);
+
+            if (ok && !identical(dest, cached))
+            {
+                std::printf("FAILED %s <- %s: the cached plan gives a different result\n",
+                    destFormat.name, srcFormat.name);
+                ok = false;
+            }
+
+            failures += !ok;
+
+            if (benchmark)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for (int k = 0; k < repeat; ++k)
+                {
+                    dest.blit(0, 0, src);
+                }
+
+                const double time = elapsed(start) / repeat;
+                std::printf("%8.0f%c", width * height / time / 1000.0, ok ? ' ' : '!');
+            }
+        }
+
+        if (benchmark)
+        {
+            std::printf("\n");
+        }
+    }
+
+    std::printf("Blitter: %d pairs, %d failures\n", g_format_count * g_format_count, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+// Checks the bulk byteswap(dest, source, count) kernels against a byte reversal
+// for every count up to a few vector blocks, unaligned source and destination
+// pointers and in-place swapping, and the bulk reads and writes of the swapping
+// pointers. With --benchmark the kernels are timed against a scalar loop.
+
+namespace
+{
+
+    const u8 GUARD = 0xcd;
+
+    u32 random(u32& seed)
+    {
+        seed = seed * 1664525 + 1013904223;
+        return seed;
+    }
+
+    template <typename T>
+    void byteswap_scalar(T* dest, const T* source, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            T value;
+            std::memcpy(&value, source + i, sizeof(T));
+            value = byteswap(value);
+            std::memcpy(dest + i, &value, sizeof(T));
+        }
+    }
+
+    // every element reversed and the bytes around the destination untouched
+    bool verify(const u8* dest, const u8* source, size_t count, size_t size, size_t padding)
+    {
+        for (size_t i = 0; i < padding; ++i)
+        {
+            if (dest[i - padding] != GUARD || dest[count * size + i] != GUARD)
+                return false;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            for (size_t j = 0; j < size; ++j)
+            {
+                if (dest[i * size + j] != source[i * size + size - 1 - j])
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    int test_kernel(const char* name, size_t maxCount)
+    {
+        const size_t padding = 32;
+        const size_t bytes = maxCount * sizeof(T) + padding * 2 + 8;
+
+        std::vector<u8> source(bytes);
+        std::vector<u8> buffer(bytes);
+        std::vector<u8> inplace(bytes);
+
+        u32 seed = 1234;
+        for (auto& value : source)
+        {
+            value = u8(random(seed) >> 24);
+        }
+
+        int failures = 0;
+
+        for (size_t count = 0; count <= maxCount; count = count < 160 ? count + 1 : count * 2 + 13)
+        {
+            for (size_t srcOffset = 0; srcOffset < 8; ++srcOffset)
+            {
+                for (size_t destOffset = 0; destOffset < 8; destOffset += 3)
+                {
+                    const u8* s = source.data() + padding + srcOffset;
+                    u8* d = buffer.data() + padding + destOffset;
+
+                    std::memset(buffer.data(), GUARD, bytes);
+                    byteswap(reinterpret_cast<T*>(d), reinterpret_cast<const T*>(s), count);
+
+                    if (!verify(d, s, count, sizeof(T), padding))
+                    {
+                        std::printf("FAILED %s: count %d, source offset %d, dest offset %d\n",
+                            name, int(count), int(srcOffset), int(destOffset));
+                        ++failures;
+                    }
+                }
+
+                // in-place
+                u8* p = inplace.data() + padding + srcOffset;
+
+                std::memset(inplace.data(), GUARD, bytes);
+                std::memcpy(p, source.data(), count * sizeof(T));
+                byteswap(reinterpret_cast<T*>(p), reinterpret_cast<const T*>(p), count);
+
+                if (!verify(p, source.data(), count, sizeof(T), padding))
+                {
+                    std::printf("FAILED %s: in-place, count %d, offset %d\n",
+                        name, int(count), int(srcOffset));
+                    ++failures;
+                }
+            }
+        }
+
+        return failures;
+    }
+
+    int test_pointers()
+    {
+        const size_t count = 77;
+
+        std::vector<u8> source(count * 8 + 1);
+        u32 seed = 777;
+        for (auto& value : source)
+        {
+            value = u8(random(seed) >> 24);
+        }
+
+        int failures = 0;
+
+        // bulk reads match the element reads
+        std::vector<u16> a16(count);
+        std::vector<u32> a32(count);
+        std::vector<u64> a64(count);
+
+        SwapEndianConstPointer p = source.data() + 1;
+        p.read16(a16.data(), count);
+        SwapEndianConstPointer p16 = source.data() + 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            failures += a16[i] != p16.read16();
+        }
+
+        p = source.data() + 1;
+        p.read32(a32.data(), count);
+        SwapEndianConstPointer p32 = source.data() + 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            failures += a32[i] != p32.read32();
+        }
+
+        p = source.data() + 1;
+        p.read64(a64.data(), count);
+        SwapEndianConstPointer p64 = source.data() + 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            failures += a64[i] != p64.read64();
+        }
+
+        // bulk writes round-trip the bulk reads
+        std::vector<u8> dest(source.size(), 0);
+
+        SwapEndianPointer w = dest.data() + 1;
+        w.write64(a64.data(), count);
+        failures += std::memcmp(dest.data() + 1, source.data() + 1, count * 8) != 0;
+
+        w = dest.data() + 1;
+        w.write32(a32.data(), count);
+        w = dest.data() + 1;
+        w.write16(a16.data(), count);
+        failures += std::memcmp(dest.data() + 1, source.data() + 1, count * 8) != 0;
+
+        if (failures)
+        {
+            std::printf("FAILED: swapping pointer bulk reads and writes\n");
+        }
+
+        return failures ? 1 : 0;
+    }
+
+    double elapsed(std::chrono::steady_clock::time_point start)
+    {
+        auto time = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double>(time).count();
+    }
+
+    template <typename T>
+    void benchmark(const char* name, size_t bytes)
+    {
+        const size_t count = bytes / sizeof(T);
+        const int repeat = int(std::max(size_t(4), (size_t(256) << 20) / bytes));
+
+        std::vector<T> source(count, T(0x1234));
+        std::vector<T> dest(count);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i)
+        {
+            byteswap_scalar(dest.data(), source.data(), count);
+        }
+        const double scalar = elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i)
+        {
+            byteswap(dest.data(), source.data(), count);
+        }
+        const double kernel = elapsed(start);
+
+        const double total = double(bytes) * repeat / 1e9;
+        std::printf("%6d KB %s: scalar %5.1f GB/s, kernel %5.1f GB/s\n",
+            int(bytes / 1024), name, total / scalar, total / kernel);
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int failures = 0;
+
+    failures += test_kernel<u16>("u16", 5000);
+    failures += test_kernel<u32>("u32", 5000);
+    failures += test_kernel<u64>("u64", 5000);
+    failures += test_kernel<float>("float", 500);
+    failures += test_kernel<double>("double", 500);
+    failures += test_pointers();
+
+    if (argc > 1 && !std::strcmp(argv[1], "--benchmark"))
+    {
+        for (size_t bytes : { 16 << 10, 256 << 10, 8 << 20 })
+        {
+            benchmark<u16>("u16", bytes);
+            benchmark<u32>("u32", bytes);
+            benchmark<u64>("u64", bytes);
+        }
+    }
+
+    std::printf("Byteswap: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+// Checks md5, sha1 and sha2 against known digests at the padding boundaries and
+// the batched overloads against the single message functions, with odd message
+// counts and unaligned messages. The batched sha1 and sha2 run the multi-buffer
+// lanes only when the CPU has no SHA instructions; --generic selects the generic
+// SHA transforms to check the lanes on such CPUs. With --benchmark the single
+// and the batched functions are timed on 64 MB split into equal messages.
+
+namespace
+{
+
+    // message bytes: (i * 7 + (i >> 8)) & 255
+    struct Digest
+    {
+        size_t size;
+        const char* md5;
+        const char* sha1;
+        const char* sha2;
+    };
+
+    const Digest g_digests[] =
+    {
+        {      0, "d41d8cd98f00b204e9800998ecf8427e", "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+                  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        {      1, "93b885adfe0da089cdf634904fd59f71", "5ba93c9db0cff93f52b521d7420e43f6eda2784f",
+                  "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d" },
+        {     55, "8d24280288a696559fd8d5aa1b6d8c6e", "aecd1643c9903b9bae8cb94f53c50f8a4e18605b",
+                  "576a1bf8d4478657e6dc4af9398544765c2a92cde28478b019235cfed315fc09" },
+        {     56, "ef2c72b7254c92459e498eddd4ace573", "f5d65c621c02cc8e785159feff8088e3072da1bc",
+                  "9b20501dfd1d99161c257950f3444f3e49230c351c5c8e0943ef369f85f5205d" },
+        {     57, "5e319059f1ba9373988437b589fb9f21", "a69640f450b01dd44b096a2a697b52e3f2aeb117",
+                  "a5534a9d0694341dfde5b1bb3d8addcb38bd46f44a629dc97b3f8fb2721b0720" },
+        {     63, "c4c8c6d513f4e1604eb18508a1769364", "4952f0fe097e4d6410ae9eab4855aa836caf3bff",
+                  "30b345906b493f06f69444b6521113511c242f30e29840462950035043682f1e" },
+        {     64, "a2fcb39a253b9b785b1f97518fa37683", "1e17ae1fc093e5daca033553c97a5192ca164486",
+                  "d8bc63b4fc1156e5e7d95a418b9bf54cd3174bedbc2db40f74895349b229b3c0" },
+        {     65, "e49fe82d0bb12967a196c85de313e446", "ac44f5dbe3e9b5d2733fc9537fcad715c3c20bc3",
+                  "1ee23b0fbcaecc1aff4a9e8f1645f35ab2c8e13609cd73b68df8b5e3f63ce073" },
+        {    119, "1640deea49ebb258ec6ede18d4b2d2d7", "b4a4e69060d0b1e7e8ebbf7041a4211c63438b57",
+                  "7a6589821178918ca8d9edaba5abfc1e9b2669564f4469b66885379c1530b2c8" },
+        {    120, "05f879f7b542a7ebf0605adff67d4423", "b651390c2996406336a3f6647e4b590c18cdd6f8",
+                  "655250427d56b1b0eeb8497d21428704273458a01772d6881b65c0abac0f8a98" },
+        {    127, "c774d99f2281f28edc4257944c8871d1", "374f47c1c8d4700fc2588e71f6d1e861b431b5c3",
+                  "67d79933e3c9aa8e89f481e071cfca1e9a16c09d7263b5efa3bb01f1a9f8d065" },
+        {    128, "fe942895e9aae953f3e246e5fd00739d", "516846cd40bd1fe431119c3b0a0f362957992ee8",
+                  "54c9eb041badfd7064645067b107661fed6113197ce2dd066ba69618abd3732f" },
+        {   1000, "bd8c10439abeb42fb5c19745991e360e", "36b3862969aef72235b9f6aadcf795eefeacd183",
+                  "c85a431e0fe575b2609289d3a4042414715f400612575a125d2ce5573d608732" },
+        { 100000, "2dc29e5babf440db9204914bcbe05fbf", "557878b8118e7a9bdc75bcfc419f9b082ce073e6",
+                  "55af394c980c7a7fb68aa904c4afdd93d76e5f826487105fc06f92a25bab8cbe" },
+    };
+
+    u32 random(u32& seed)
+    {
+        seed = seed * 1664525 + 1013904223;
+        return seed;
+    }
+
+    // the hashes store the digest bytes in order
+    template <typename T, int S>
+    std::string hex(const Hash<T, S>& hash)
+    {
+        std::string s;
+        const u8* p = reinterpret_cast<const u8*>(hash.data);
+
+        for (size_t i = 0; i < sizeof(hash.data); ++i)
+        {
+            char temp[3];
+            std::snprintf(temp, sizeof(temp), "%02x", p[i]);
+            s += temp;
+        }
+
+        return s;
+    }
+
+    int test_digests(const u8* data)
+    {
+        int failures = 0;
+
+        for (const Digest& digest : g_digests)
+        {
+            // unaligned message
+            ConstMemory memory(data + 1, digest.size);
+
+            if (hex(md5(memory)) != digest.md5)
+            {
+                std::printf("FAILED md5: %d bytes\n", int(digest.size));
+                ++failures;
+            }
+
+            if (hex(sha1(memory)) != digest.sha1)
+            {
+                std::printf("FAILED sha1: %d bytes\n", int(digest.size));
+                ++failures;
+            }
+
+            if (hex(sha2(memory)) != digest.sha2)
+            {
+                std::printf("FAILED sha2: %d bytes\n", int(digest.size));
+                ++failures;
+            }
+        }
+
+        return failures;
+    }
+
+    template <typename H>
+    int test_batched(const char* name, const std::vector<ConstMemory>& messages,
+                     H (*single)(ConstMemory), void (*batched)(H*, const ConstMemory*, size_t))
+    {
+        // odd counts leave lanes without messages
+        const size_t counts[] = { 0, 1, 3, 7, 8, 9, messages.size() };
+
+        int failures = 0;
+
+        for (size_t count : counts)
+        {
+            std::vector<H> hashes(count);
+            batched(hashes.data(), messages.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (hashes[i] != single(messages[i]))
+                {
+                    std::printf("FAILED batched %s: %d messages, message %d (%d bytes)\n",
+                        name, int(count), int(i), int(messages[i].size));
+                    ++failures;
+                    break;
+                }
+            }
+        }
+
+        return failures;
+    }
+
+    double elapsed(std::chrono::steady_clock::time_point start)
+    {
+        auto time = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double>(time).count();
+    }
+
+    template <typename H>
+    void benchmark(const char* name, const u8* data, size_t bytes, size_t size,
+                   H (*single)(ConstMemory), void (*batched)(H*, const ConstMemory*, size_t))
+    {
+        const size_t count = bytes / size;
+
+        std::vector<ConstMemory> messages;
+        for (size_t i = 0; i < count; ++i)
+        {
+            messages.emplace_back(data + i * size, size);
+        }
+
+        std::vector<H> hashes(count);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            hashes[i] = single(messages[i]);
+        }
+        const double time0 = elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        batched(hashes.data(), messages.data(), count);
+        const double time1 = elapsed(start);
+
+        const double mb = double(bytes) / (1024.0 * 1024.0);
+        std::printf("%-5s %6d bytes: single %6.0f MB/s, batched %6.0f MB/s\n",
+            name, int(size), mb / time0, mb / time1);
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool benchmarks = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--generic"))
+        {
+            // before the first sha1() and sha2() call, which select the transform
+            setDispatchOverride("sha1", "generic");
+            setDispatchOverride("sha2", "generic");
+        }
+        else if (!std::strcmp(argv[i], "--benchmark"))
+        {
+            benchmarks = true;
+        }
+    }
+
+    std::vector<u8> data(200000);
+    for (size_t i = 0; i < data.size() - 1; ++i)
+    {
+        data[i + 1] = u8(i * 7 + (i >> 8));
+    }
+
+    int failures = test_digests(data.data());
+
+    // every length across a few blocks, then longer ones, at every alignment
+    std::vector<ConstMemory> messages;
+    u32 seed = 4321;
+
+    for (size_t size = 0; size < 300; ++size)
+    {
+        messages.emplace_back(data.data() + (size & 7), size);
+    }
+
+    for (int i = 0; i < 41; ++i)
+    {
+        const size_t size = random(seed) % 100000;
+        messages.emplace_back(data.data() + (random(seed) & 15), size);
+    }
+
+    failures += test_batched<MD5>("md5", messages, md5, md5);
+    failures += test_batched<SHA1>("sha1", messages, sha1, sha1);
+    failures += test_batched<SHA2>("sha2", messages, sha2, sha2);
+
+    if (benchmarks)
+    {
+        const size_t bytes = 64 * 1024 * 1024;
+        std::vector<u8> buffer(bytes, 0x5a);
+
+        for (size_t size : { 64, 1024, 16384 })
+        {
+            benchmark<MD5>("md5", buffer.data(), bytes, size, md5, md5);
+            benchmark<SHA1>("sha1", buffer.data(), bytes, size, sha1, sha1);
+            benchmark<SHA2>("sha2", buffer.data(), bytes, size, sha2, sha2);
+        }
+    }
+
+    std::printf("Hash: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,385 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mango/mango.hpp>
+#include "../source/external/miniz/miniz.h"
+
+using namespace mango;
+
+// Differential check of mango::Inflater against the miniz inflater (tinfl) it
+// replaced. A generated corpus is compressed with miniz at several levels and
+// strategies, as raw DEFLATE and as zlib streams, and decoded with the one-shot
+// Inflater::decompress(), with the streaming interface from random segments into
+// random read sizes, and with tinfl. Corrupted and truncated streams must not
+// decode to a different result than tinfl or, when truncated, at all. With
+// --benchmark the decoders are timed on the corpus and on any files given after
+// the option.
+
+namespace
+{
+
+    struct Input
+    {
+        std::string name;
+        std::vector<u8> data;
+    };
+
+    struct Config
+    {
+        const char* name;
+        int level;
+        int strategy;
+    };
+
+    const Config g_configs[] =
+    {
+        { "L0",      0, MZ_DEFAULT_STRATEGY },
+        { "L1",      1, MZ_DEFAULT_STRATEGY },
+        { "L6",      6, MZ_DEFAULT_STRATEGY },
+        { "L9",      9, MZ_DEFAULT_STRATEGY },
+        { "huffman", 6, MZ_HUFFMAN_ONLY },
+        { "rle",     6, MZ_RLE },
+        { "fixed",   6, MZ_FIXED },
+    };
+
+    u32 random(u32& seed)
+    {
+        seed = seed * 1664525 + 1013904223;
+        return seed;
+    }
+
+    std::vector<Input> createCorpus()
+    {
+        std::vector<Input> corpus;
+        u32 seed = 2019;
+
+        // words with a skewed distribution, like source code or text
+        const char* words[] =
+        {
+            "the", "mango", "inflate", "window", "literal", "length", "distance", "table",
+            "for", "(int i = 0; i < count; ++i)", "return", "{", "}", "const", "u8*", "size_t",
+            "\n", "\n    ", "// ", "static", "if", "else", "while", "0x1f", "decode", "stream",
+        };
+
+        std::string text;
+        while (text.size() < 256 * 1024)
+        {
+            const u32 x = random(seed) >> 16;
+            text += words[(x * x >> 16) % 26];
+            text += ' ';
+        }
+        corpus.push_back({ "text", std::vector<u8>(text.begin(), text.end()) });
+
+        // RGBA gradients with noise: short distances and literals
+        std::vector<u8> image(256 * 1024);
+        for (size_t i = 0; i < image.size(); ++i)
+        {
+            const size_t x = (i / 4) % 512;
+            const size_t y = i / 2048;
+            image[i] = u8((i & 3) == 3 ? 255 : x + y * (i & 3) + (random(seed) >> 30));
+        }
+        corpus.push_back({ "image", image });
+
+        // periods 1 to 40 and long repeats up to the 32 KB window
+        std::vector<u8> periodic;
+        for (int period = 1; period <= 40; ++period)
+        {
+            std::vector<u8> pattern(period);
+            for (auto& value : pattern)
+            {
+                value = u8(random(seed) >> 24);
+            }
+            for (int i = 0; i < 1000 + period * 17; ++i)
+            {
+                periodic.push_back(pattern[i % period]);
+            }
+        }
+        const size_t head = periodic.size();
+        for (size_t distance : { 258, 4096, 32767, 32768 })
+        {
+            periodic.insert(periodic.end(), periodic.end() - std::min(distance, head), periodic.end() - std::min(distance, head) + 3000);
+        }
+        corpus.push_back({ "periodic", periodic });
+
+        std::vector<u8> noise(64 * 1024);
+        for (auto& value : noise)
+        {
+            value = u8(random(seed) >> 24);
+        }
+        corpus.push_back({ "random", noise });
+
+        corpus.push_back({ "zeros", std::vector<u8>(100000, 0) });
+
+        // stored block and buffer boundaries
+        for (size_t size : { 0, 1, 2, 3, 7, 100, 1000, 65535, 65536, 65537 })
+        {
+            corpus.push_back({ "text" + std::to_string(size), std::vector<u8>(text.begin(), text.begin() + size) });
+        }
+
+        return corpus;
+    }
+
+    std::vector<u8> compress(const std::vector<u8>& data, const Config& config, Inflater::Format format)
+    {
+        const int window_bits = format == Inflater::ZLIB ? 15 : -15;
+        const mz_uint flags = tdefl_create_comp_flags_from_zip_params(config.level, window_bits, config.strategy);
+
+        size_t size = 0;
+        void* p = tdefl_compress_mem_to_heap(data.data(), data.size(), &size, flags);
+
+        std::vector<u8> result(reinterpret_cast<u8*>(p), reinterpret_cast<u8*>(p) + size);
+        mz_free(p);
+
+        return result;
+    }
+
+    // the decoders return false when the stream is rejected
+
+    bool decodeTinfl(std::vector<u8>& output, const std::vector<u8>& stream, Inflater::Format format)
+    {
+        const int flags = format == Inflater::ZLIB ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0;
+        const size_t size = tinfl_decompress_mem_to_mem(output.data(), output.size(), stream.data(), stream.size(), flags);
+        if (size == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED)
+            return false;
+
+        output.resize(size);
+        return true;
+    }
+
+    bool decodeOneShot(std::vector<u8>& output, const std::vector<u8>& stream, Inflater::Format format)
+    {
+        try
+        {
+            const size_t size = Inflater::decompress(Memory(output.data(), output.size()),
+                ConstMemory(stream.data(), stream.size()), format);
+            output.resize(size);
+            return true;
+        }
+        catch (const Exception&)
+        {
+            return false;
+        }
+    }
+
+    bool decodeStreaming(std::vector<u8>& output, const std::vector<u8>& stream, Inflater::Format format, u32 seed)
+    {
+        Inflater inflater(format);
+
+        for (size_t offset = 0; offset < stream.size(); )
+        {
+            const size_t size = std::min(stream.size() - offset, size_t(random(seed) % 5000 + 1));
+            inflater.append(ConstMemory(stream.data() + offset, size));
+            offset += size;
+        }
+
+        size_t total = 0;
+        while (total < output.size())
+        {
+            const size_t size = std::min(output.size() - total, size_t(random(seed) % 70000 + 1));
+            const size_t bytes = inflater.read(Memory(output.data() + total, size));
+            total += bytes;
+            if (bytes < size)
+                break;
+        }
+
+        // the end of the stream is decoded after the last byte of output
+        u8 extra;
+        const bool overflow = total == output.size() && inflater.read(Memory(&extra, 1)) != 0;
+
+        output.resize(total);
+        return !overflow && inflater.isEnd() && !inflater.getError();
+    }
+
+    int test_corpus(const std::vector<Input>& corpus)
+    {
+        int failures = 0;
+        int streams = 0;
+
+        for (const Input& input : corpus)
+        {
+            for (const Config& config : g_configs)
+            {
+                for (Inflater::Format format : { Inflater::DEFLATE, Inflater::ZLIB })
+                {
+                    const std::vector<u8> stream = compress(input.data, config, format);
+                    const char* formatName = format == Inflater::ZLIB ? "zlib" : "deflate";
+                    ++streams;
+
+                    // the exact size is enough room for every decoder
+                    std::vector<u8> a(input.data.size());
+                    std::vector<u8> b(input.data.size());
+                    std::vector<u8> c(input.data.size());
+
+                    const bool ok0 = decodeTinfl(a, stream, format) && a == input.data;
+                    const bool ok1 = decodeOneShot(b, stream, format) && b == input.data;
+                    const bool ok2 = decodeStreaming(c, stream, format, u32(streams)) && c == input.data;
+
+                    if (!ok0 || !ok1 || !ok2)
+                    {
+                        std::printf("FAILED %s %s %s: tinfl %s, decompress %s, streaming %s\n",
+                            input.name.c_str(), config.name, formatName,
+                            ok0 ? "ok" : "failed", ok1 ? "ok" : "failed", ok2 ? "ok" : "failed");
+                        ++failures;
+                    }
+                }
+            }
+        }
+
+        std::printf("Inflater: %d streams decoded\n", streams);
+        return failures;
+    }
+
+    int test_corrupted(const std::vector<u8>& data)
+    {
+        int failures = 0;
+        int rejected = 0;
+        int trials = 0;
+        u32 seed = 99;
+
+        for (Inflater::Format format : { Inflater::DEFLATE, Inflater::ZLIB })
+        {
+            const std::vector<u8> stream = compress(data, g_configs[2], format);
+
+            for (int trial = 0; trial < 300; ++trial)
+            {
+                std::vector<u8> corrupted = stream;
+
+                const bool truncate = trial % 3 == 0;
+                if (truncate)
+                {
+                    corrupted.resize(random(seed) % stream.size());
+                }
+                else
+                {
+                    for (int i = 0; i <= trial % 4; ++i)
+                    {
+                        const u32 bit = random(seed) % u32(stream.size() * 8);
+                        corrupted[bit / 8] ^= u8(1 << (bit % 8));
+                    }
+                }
+
+                // room for streams which decode to more than the original
+                std::vector<u8> a(data.size() + 65536);
+                std::vector<u8> b(data.size() + 65536);
+                std::vector<u8> c(data.size() + 65536);
+
+                const bool ok0 = decodeTinfl(a, corrupted, format);
+                const bool ok1 = decodeOneShot(b, corrupted, format);
+                const bool ok2 = decodeStreaming(c, corrupted, format, seed);
+
+                rejected += !ok1;
+                ++trials;
+
+                bool ok = true;
+
+                if (truncate)
+                {
+                    ok = !ok1 && !ok2;
+                }
+                else
+                {
+                    ok = (!ok0 || !ok1 || a == b) && (!ok0 || !ok2 || a == c);
+                }
+
+                if (!ok)
+                {
+                    std::printf("FAILED corrupted %s stream (trial %d): tinfl %s, decompress %s, streaming %s\n",
+                        format == Inflater::ZLIB ? "zlib" : "deflate", trial,
+                        ok0 ? "ok" : "failed", ok1 ? "ok" : "failed", ok2 ? "ok" : "failed");
+                    ++failures;
+                }
+            }
+        }
+
+        std::printf("Inflater: %d corrupted streams, %d rejected\n", trials, rejected);
+        return failures;
+    }
+
+    double elapsed(std::chrono::steady_clock::time_point start)
+    {
+        auto time = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double>(time).count();
+    }
+
+    // best of 3, MB/s of decompressed data
+    template <typename Decode>
+    double measure(const std::vector<u8>& data, Decode decode)
+    {
+        double best = 1e9;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            decode();
+            best = std::min(best, elapsed(start));
+        }
+
+        return data.size() / best / (1024.0 * 1024.0);
+    }
+
+    void benchmark(const std::string& name, const std::vector<u8>& data, const Config& config)
+    {
+        const std::vector<u8> stream = compress(data, config, Inflater::ZLIB);
+        std::vector<u8> output(data.size());
+
+        const double tinfl = measure(data, [&] {
+            std::vector<u8> temp(data.size());
+            decodeTinfl(temp, stream, Inflater::ZLIB);
+        });
+
+        const double oneshot = measure(data, [&] {
+            Inflater::decompress(Memory(output.data(), output.size()),
+                ConstMemory(stream.data(), stream.size()), Inflater::ZLIB);
+        });
+
+        const double streaming = measure(data, [&] {
+            Inflater inflater(Inflater::ZLIB);
+            inflater.append(ConstMemory(stream.data(), stream.size()));
+            for (size_t offset = 0; offset < output.size(); offset += 65536)
+            {
+                inflater.read(Memory(output.data() + offset, std::min(size_t(65536), output.size() - offset)));
+            }
+        });
+
+        std::printf("%-24s %-3s %9.0f %10.0f %10.0f\n", name.c_str(), config.name, oneshot, streaming, tinfl);
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::vector<Input> corpus = createCorpus();
+
+    int failures = test_corpus(corpus);
+    failures += test_corrupted(corpus[0].data);
+
+    if (argc > 1 && !std::strcmp(argv[1], "--benchmark"))
+    {
+        std::printf("\n%-28s %9s %10s %10s (MB/s)\n", "", "inflater", "streaming", "tinfl");
+
+        for (int i = 0; i < 3; ++i)
+        {
+            benchmark(corpus[i].name, corpus[i].data, g_configs[2]);
+        }
+        benchmark(corpus[3].name, corpus[3].data, g_configs[1]);
+
+        for (int i = 2; i < argc; ++i)
+        {
+            filesystem::File file(argv[i]);
+            const u8* p = file.data();
+            const std::vector<u8> data(p, p + file.size());
+            benchmark(argv[i], data, g_configs[2]);
+        }
+    }
+
+    std::printf("Inflater: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
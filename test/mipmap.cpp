@@ -0,0 +1,146 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+// Checks that MipmapGenerator stores the largest level unchanged when the source
+// has the same size, with every filter and with premultiplied alpha, for pixel
+// and compressed chains.
+
+namespace
+{
+
+    u32 random(u32& seed)
+    {
+        seed = seed * 1664525 + 1013904223;
+        return seed;
+    }
+
+    // random colors; every fourth texel is fully transparent
+    void fill(Surface& surface, u32 seed)
+    {
+        for (int y = 0; y < surface.height; ++y)
+        {
+            u8* scan = surface.address<u8>(0, y);
+
+            for (int x = 0; x < surface.width; ++x)
+            {
+                scan[x * 4 + 0] = u8(random(seed) >> 24);
+                scan[x * 4 + 1] = u8(random(seed) >> 24);
+                scan[x * 4 + 2] = u8(random(seed) >> 24);
+                scan[x * 4 + 3] = random(seed) & 0x30000000 ? u8(random(seed) >> 24) : 0;
+            }
+        }
+    }
+
+    bool identical(const Surface& a, const Surface& b)
+    {
+        for (int y = 0; y < a.height; ++y)
+        {
+            if (std::memcmp(a.address<u8>(0, y), b.address<u8>(0, y), a.width * a.format.bytes()))
+                return false;
+        }
+
+        return true;
+    }
+
+    const char* getFilterName(ResampleFilter filter)
+    {
+        switch (filter)
+        {
+            case ResampleFilter::BOX: return "BOX";
+            case ResampleFilter::BILINEAR: return "BILINEAR";
+            case ResampleFilter::MITCHELL: return "MITCHELL";
+            case ResampleFilter::LANCZOS: return "LANCZOS";
+        }
+        return "";
+    }
+
+} // namespace
+
+int main()
+{
+    const int width = 37;
+    const int height = 23;
+
+    int failures = 0;
+
+    const ResampleFilter filters[] =
+    {
+        ResampleFilter::BOX,
+        ResampleFilter::BILINEAR,
+        ResampleFilter::MITCHELL,
+        ResampleFilter::LANCZOS,
+    };
+
+    Bitmap source(width, height, FORMAT_R8G8B8A8);
+    fill(source, 4096);
+
+    for (ResampleFilter filter : filters)
+    {
+        for (int premultiply = 0; premultiply < 2; ++premultiply)
+        {
+            MipmapOptions options;
+            options.filter = filter;
+            options.premultiply = premultiply != 0;
+            options.alphaCoverage = premultiply ? 0.5f : 0.0f;
+
+            Mipmap mipmap(width, height, FORMAT_R8G8B8A8);
+            MipmapGenerator(options).generate(mipmap, source);
+
+            if (!identical(mipmap.surface(0), source))
+            {
+                std::printf("FAILED %s%s: the largest level differs from the source\n",
+                    getFilterName(filter), premultiply ? " premultiplied" : "");
+                ++failures;
+            }
+        }
+    }
+
+    // the compressed largest level is the encoded source
+    {
+        MipmapOptions options;
+        options.filter = ResampleFilter::MITCHELL;
+
+        Mipmap mipmap(width, height, TextureCompression::BC1_UNORM);
+
+        Bitmap temp(width, height, mipmap.format);
+        temp.blit(0, 0, source);
+
+        MipmapGenerator(options).generate(mipmap, temp);
+
+        Memory level = mipmap.memory(0);
+        std::vector<u8> expected(level.size);
+        mipmap.info.compress(Memory(expected.data(), expected.size()), temp);
+
+        if (std::memcmp(level.address, expected.data(), level.size))
+        {
+            std::printf("FAILED BC1: the largest level is not the encoded source\n");
+            ++failures;
+        }
+    }
+
+    // a source of a different size is still resampled
+    {
+        Bitmap large(width * 2, height * 2, FORMAT_R8G8B8A8);
+        fill(large, 8192);
+
+        Mipmap mipmap(width, height, FORMAT_R8G8B8A8);
+        MipmapGenerator().generate(mipmap, large);
+
+        if (mipmap.getWidth(0) != width || mipmap.getHeight(0) != height || identical(mipmap.surface(0), large))
+        {
+            std::printf("FAILED: the largest level was not resampled from a larger source\n");
+            ++failures;
+        }
+    }
+
+    std::printf("Mipmap: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <vector>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+namespace
+{
+
+    int g_failures = 0;
+
+    void check(bool condition, const char* text, size_t capacity)
+    {
+        if (!condition)
+        {
+            std::printf("FAILED (capacity %d): %s\n", int(capacity), text);
+            ++g_failures;
+        }
+    }
+
+    u8 pattern(size_t offset)
+    {
+        return u8(offset * 7 + (offset >> 8));
+    }
+
+    void test_large_read_seek(MemoryStream& stream, size_t capacity)
+    {
+        stream.seek(0, Stream::BEGIN);
+        LittleEndianStreamReader reader(stream, capacity);
+
+        // fill the buffer, then read past it with a read that bypasses the buffer
+        check(reader.read8() == pattern(0), "first byte", capacity);
+
+        std::vector<u8> block(capacity * 3);
+        reader.read(block.data(), block.size());
+
+        bool match = true;
+        for (size_t i = 0; i < block.size(); ++i)
+        {
+            match &= block[i] == pattern(i + 1);
+        }
+        check(match, "large read", capacity);
+
+        const u64 position = 1 + block.size();
+        check(reader.offset() == position, "offset after the large read", capacity);
+
+        // short seek backwards from the position after the large read
+        reader.seek(u64(-16), Stream::CURRENT);
+        check(reader.offset() == position - 16, "offset after seeking back", capacity);
+        check(reader.read8() == pattern(size_t(position - 16)), "read after seeking back", capacity);
+
+        reader.seek(position - 3, Stream::BEGIN);
+        check(reader.read8() == pattern(size_t(position - 3)), "read after seeking from the beginning", capacity);
+
+        // forward seek and reads through the buffer
+        reader.seek(5, Stream::CURRENT);
+        check(reader.read8() == pattern(size_t(position + 3)), "read after seeking forward", capacity);
+
+        const u32 value = reader.read32();
+        const u32 expected = u32(pattern(size_t(position + 4))) | (u32(pattern(size_t(position + 5))) << 8) |
+                             (u32(pattern(size_t(position + 6))) << 16) | (u32(pattern(size_t(position + 7))) << 24);
+        check(value == expected, "read32 through the buffer", capacity);
+    }
+
+} // namespace
+
+int main()
+{
+    const size_t size = 1024 * 1024;
+
+    std::vector<u8> data(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        data[i] = pattern(i);
+    }
+
+    MemoryStream stream(data.data(), data.size());
+
+    test_large_read_seek(stream, 64);
+    test_large_read_seek(stream, 4096);
+    test_large_read_seek(stream, 64 * 1024);
+
+    std::printf("StreamReader: %d failures\n", g_failures);
+    return g_failures ? 1 : 0;
+}